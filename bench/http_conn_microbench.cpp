@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: HttpConn microbenchmarks: a full request cycle (read,
+// parse, build, send) for each capture in bench/corpus over a socketpair,
+// and the response builders on their own.
+
+#include <benchmark/benchmark.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http/http_conn.hpp"
+#include "http/http_response_templates.hpp"
+
+namespace my_web_server {
+
+struct HttpConnBenchPeer {
+  static void Attach(HttpConn* conn) {
+    conn->req_ = RequestStatePtr(new RequestState);
+  }
+  static void ClearWrite(HttpConn* conn) { conn->req_->write_idx = 0; }
+  static auto AddResponse(HttpConn* conn, std::string_view text) -> bool {
+    return conn->AddResponse(text);
+  }
+  static auto ProcessWrite(HttpConn* conn, HttpConn::HTTP_CODE code) -> bool {
+    conn->req_->Reset();
+    conn->req_->linger = true;
+    return conn->ProcessWrite(code);
+  }
+};
+
+}  // namespace my_web_server
+
+namespace {
+
+using my_web_server::HttpConn;
+using my_web_server::HttpConnBenchPeer;
+
+struct Capture {
+  std::string name;
+  std::string bytes;
+};
+
+auto LoadCorpus() -> std::vector<Capture> {
+  std::vector<Capture> corpus;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(MWS_BENCH_CORPUS_DIR)) {
+    if (entry.path().extension() != ".http") {
+      continue;
+    }
+    std::ifstream file(entry.path(), std::ios::binary);
+    corpus.push_back({entry.path().stem().string(),
+                      std::string(std::istreambuf_iterator<char>(file), {})});
+  }
+  std::sort(corpus.begin(), corpus.end(),
+            [](const auto& a, const auto& b) { return a.name < b.name; });
+  return corpus;
+}
+
+// One connection on a socketpair, registered with its own epoll instance
+// like the server's, so ModFd() does the same syscalls as in production
+class PairedConn {
+ public:
+  PairedConn() {
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds_);
+    epoll_fd_ = epoll_create1(0);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    event.data.fd = fds_[0];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fds_[0], &event);
+    sockaddr_in addr{};
+    conn_->Init(fds_[0], addr, epoll_fd_);
+  }
+  ~PairedConn() {
+    conn_.reset();
+    close(fds_[0]);
+    close(fds_[1]);
+    close(epoll_fd_);
+  }
+  PairedConn(const PairedConn&) = delete;
+  auto operator=(const PairedConn&) -> PairedConn& = delete;
+
+  // Returns the number of response bytes, 0 on failure
+  auto RoundTrip(const std::string& request) -> size_t {
+    if (write(fds_[1], request.data(), request.size()) !=
+        static_cast<ssize_t>(request.size())) {
+      return 0;
+    }
+    if (!conn_->Read()) {
+      return 0;
+    }
+    conn_->Process();
+    conn_->Write();  // false for Connection: close, which is fine here
+    conn_->Init();
+    size_t total = 0;
+    ssize_t n = 0;
+    while ((n = read(fds_[1], buf_, sizeof(buf_))) > 0) {
+      total += static_cast<size_t>(n);
+    }
+    return total;
+  }
+
+  auto conn() -> HttpConn* { return conn_.get(); }
+
+ private:
+  int fds_[2]{-1, -1};
+  int epoll_fd_{-1};
+  std::shared_ptr<HttpConn> conn_ = std::make_shared<HttpConn>();
+  char buf_[16384];
+};
+
+void BM_HttpConnRequest(benchmark::State& state, const Capture& capture) {
+  PairedConn paired;
+  size_t response_bytes = 0;
+  for (auto _ : state) {
+    response_bytes = paired.RoundTrip(capture.bytes);
+    if (response_bytes == 0) {
+      state.SkipWithError("request failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(capture.bytes.size()));
+  state.counters["response_bytes"] = static_cast<double>(response_bytes);
+}
+
+void BM_HttpConnRequestMix(benchmark::State& state) {
+  static const auto corpus = LoadCorpus();
+  PairedConn paired;
+  size_t i = 0;
+  for (auto _ : state) {
+    if (paired.RoundTrip(corpus[i].bytes) == 0) {
+      state.SkipWithError("request failed");
+      break;
+    }
+    i = i + 1 == corpus.size() ? 0 : i + 1;
+  }
+}
+BENCHMARK(BM_HttpConnRequestMix);
+
+void BM_FormatFileHeader(benchmark::State& state) {
+  off_t size = 1;
+  for (auto _ : state) {
+    auto header = std::format(my_web_server::kHeader200File, size,
+                              "keep-alive");
+    benchmark::DoNotOptimize(header);
+    size = size * 7 % 1000003;
+  }
+}
+BENCHMARK(BM_FormatFileHeader);
+
+void BM_AddResponse(benchmark::State& state) {
+  auto conn = std::make_shared<HttpConn>();
+  HttpConnBenchPeer::Attach(conn.get());
+  std::string header =
+      std::format(my_web_server::kHeader200File, 12345, "keep-alive");
+  for (auto _ : state) {
+    HttpConnBenchPeer::ClearWrite(conn.get());
+    benchmark::DoNotOptimize(
+        HttpConnBenchPeer::AddResponse(conn.get(), header));
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(header.size()));
+}
+BENCHMARK(BM_AddResponse);
+
+// Header and body for each status, as ProcessWrite() builds them
+void BM_ProcessWrite(benchmark::State& state) {
+  auto code = static_cast<HttpConn::HTTP_CODE>(state.range(0));
+  auto conn = std::make_shared<HttpConn>();
+  HttpConnBenchPeer::Attach(conn.get());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(HttpConnBenchPeer::ProcessWrite(conn.get(), code));
+  }
+}
+BENCHMARK(BM_ProcessWrite)
+    ->ArgName("code")
+    ->Arg(HttpConn::GET_REQUEST)
+    ->Arg(HttpConn::BAD_REQUEST)
+    ->Arg(HttpConn::NO_RESOURCE);
+
+// One benchmark per capture, named after its file
+[[maybe_unused]] const bool kCorpusRegistered = []() {
+  static const auto corpus = LoadCorpus();
+  for (const auto& capture : corpus) {
+    benchmark::RegisterBenchmark(
+        ("BM_HttpConnRequest/" + capture.name).c_str(),
+        [&capture](benchmark::State& state) {
+          BM_HttpConnRequest(state, capture);
+        });
+  }
+  return true;
+}();
+
+}  // namespace
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Logger microbenchmarks: producer-side cost of text and
+// deferred-format records with 1, 8 and 32 threads logging at once.
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+
+#include "logger/logger.hpp"
+
+namespace {
+
+using my_web_server::Logger;
+using my_web_server::LogLevel;
+
+// Records dropped at a full ring are part of the cost being measured; the
+// count is reported so a change in drop rate is visible next to the time.
+void ReportDropped(benchmark::State& state, uint64_t dropped_before) {
+  if (state.thread_index() == 0) {
+    state.counters["dropped"] = benchmark::Counter(
+        static_cast<double>(Logger::Instance().dropped() - dropped_before));
+  }
+}
+
+void BM_LoggerLogText(benchmark::State& state) {
+  auto& logger = Logger::Instance();
+  uint64_t dropped = logger.dropped();
+  const std::string message = "127.0.0.1:52344 /index.html -> 1";
+  for (auto _ : state) {
+    logger.Log(LogLevel::kInfo, __FILE__, __LINE__, message);
+  }
+  state.SetItemsProcessed(state.iterations());
+  ReportDropped(state, dropped);
+}
+BENCHMARK(BM_LoggerLogText)->Threads(1)->Threads(8)->Threads(32)->UseRealTime();
+
+void BM_LoggerLogDeferred(benchmark::State& state) {
+  uint64_t dropped = Logger::Instance().dropped();
+  std::string url = "/index.html";
+  int fd = 42;
+  for (auto _ : state) {
+    LOG_INFO_FMT("{}:{} {} -> {}", 2130706433U, 52344, url, fd);
+  }
+  state.SetItemsProcessed(state.iterations());
+  ReportDropped(state, dropped);
+}
+BENCHMARK(BM_LoggerLogDeferred)
+    ->Threads(1)
+    ->Threads(8)
+    ->Threads(32)
+    ->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Microbenchmark entry point. Sets up the shared state the
+// benchmarked code expects (config, response cache, a quiet async logger)
+// and runs Google Benchmark. Pass --benchmark_format=json or
+// --benchmark_out=FILE --benchmark_out_format=json to track results.
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+
+#include "config/global_config.hpp"
+#include "http/response_cache.hpp"
+#include "logger/logger.hpp"
+#include "metrics/trace_clock.hpp"
+
+auto main(int argc, char* argv[]) -> int {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  // Same setup as main.cpp, with responses served from --text so no
+  // resource files are needed
+  std::array<char*, 3> server_args = {const_cast<char*>("microbench"),
+                                      const_cast<char*>("--text"),
+                                      const_cast<char*>("hello")};
+  auto& config = my_web_server::GlobalConfig::Instance();
+  if (!config.InitFromArgs(static_cast<int>(server_args.size()),
+                           server_args.data())) {
+    return 1;
+  }
+  my_web_server::TraceClock::Calibrate();
+  my_web_server::ResponseCache::Rebuild();
+  auto& logger = my_web_server::Logger::Instance();
+  logger.StartAsync({.file = {.path = "/dev/null"}});
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  logger.StopAsync();
+  return 0;
+}
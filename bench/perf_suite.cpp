@@ -0,0 +1,726 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: End-to-end performance regression suite. For each scenario
+// in a scenario file it starts server.o with the scenario's flags on a free
+// localhost port, drives it with bench_client --json, and records requests
+// per second, latency percentiles, server CPU time and peak RSS. Results are
+// written as JSON and compared with a stored baseline; a metric that got
+// worse by more than the threshold fails the run.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr size_t kListingFiles = 10000;
+constexpr off_t kSmallFileSize = off_t{1} << 20;
+constexpr off_t kLargeFileSize = off_t{1} << 30;
+constexpr auto kStartupTimeout = std::chrono::seconds(10);
+constexpr auto kShutdownTimeout = std::chrono::seconds(10);
+
+struct Options {
+  std::string server{};
+  std::string client{};
+  std::string scenarios{};
+  std::string baseline{};
+  std::string out{"perf_results.json"};
+  std::string work_dir{"perf_work"};
+  std::vector<std::string> only{};  // scenario names; empty runs all
+  double duration_s{5};
+  double warmup_s{1};
+  double threshold_pct{10};          // rps, CPU per request, peak RSS
+  double latency_threshold_pct{25};  // p99, which is noisier
+  bool update_baseline{false};
+};
+
+struct Scenario {
+  std::string name{};
+  std::vector<std::string> server_args{};
+  std::vector<std::string> client_args{};
+};
+
+struct Result {
+  std::string name{};
+  double requests{0};
+  double rps{0};
+  double p50_us{0};
+  double p90_us{0};
+  double p99_us{0};
+  double p999_us{0};
+  double max_us{0};
+  double errors{0};  // connect, I/O and parse errors, dropped idle conns
+  double non_2xx{0};
+  double cpu_s{0};   // server user + system time during the run
+  double cpu_us_per_req{0};
+  double peak_rss_kb{0};
+};
+
+// Compared against the baseline, in report order
+struct Metric {
+  const char* key;
+  double Result::*field;
+  bool higher_is_better;
+  bool latency;
+};
+
+constexpr Metric kMetrics[] = {
+    {"rps", &Result::rps, true, false},
+    {"p99_us", &Result::p99_us, false, true},
+    {"cpu_us_per_req", &Result::cpu_us_per_req, false, false},
+    {"peak_rss_kb", &Result::peak_rss_kb, false, false},
+};
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(
+      stderr,
+      "Usage: %s --server PATH --client PATH --scenarios FILE [options]\n"
+      "  --baseline FILE        compare with FILE; written if missing\n"
+      "  --update-baseline      overwrite the baseline with this run\n"
+      "  --out FILE             results (default perf_results.json)\n"
+      "  --work-dir DIR         fixtures and server logs (default "
+      "perf_work)\n"
+      "  --scenario NAME        run only NAME; may be repeated\n"
+      "  --duration S           seconds per scenario (default 5)\n"
+      "  --warmup S             seconds excluded from latency (default 1)\n"
+      "  --threshold PCT        allowed rps/CPU/RSS regression (default 10)\n"
+      "  --latency-threshold PCT  allowed p99 regression (default 25)\n",
+      argv0);
+}
+
+auto ParseNumber(std::string_view text, double* out) -> bool {
+  auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(),
+                                   *out);
+  return ec == std::errc() && ptr == text.data() + text.size() && *out >= 0;
+}
+
+auto ParseArgs(int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--update-baseline") {
+      opts->update_baseline = true;
+    } else if (arg == "--server" && has_value) {
+      opts->server = argv[++i];
+    } else if (arg == "--client" && has_value) {
+      opts->client = argv[++i];
+    } else if (arg == "--scenarios" && has_value) {
+      opts->scenarios = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      opts->baseline = argv[++i];
+    } else if (arg == "--out" && has_value) {
+      opts->out = argv[++i];
+    } else if (arg == "--work-dir" && has_value) {
+      opts->work_dir = argv[++i];
+    } else if (arg == "--scenario" && has_value) {
+      opts->only.emplace_back(argv[++i]);
+    } else if ((arg == "--duration" || arg == "--warmup" ||
+                arg == "--threshold" || arg == "--latency-threshold") &&
+               has_value) {
+      double number = 0;
+      if (!ParseNumber(argv[++i], &number)) {
+        std::fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1],
+                     argv[i]);
+        return false;
+      }
+      if (arg == "--duration") {
+        opts->duration_s = number;
+      } else if (arg == "--warmup") {
+        opts->warmup_s = number;
+      } else if (arg == "--threshold") {
+        opts->threshold_pct = number;
+      } else {
+        opts->latency_threshold_pct = number;
+      }
+    } else {
+      std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      return false;
+    }
+  }
+  if (opts->server.empty() || opts->client.empty() ||
+      opts->scenarios.empty()) {
+    std::fprintf(stderr, "--server, --client and --scenarios are required\n");
+    return false;
+  }
+  if (opts->warmup_s >= opts->duration_s) {
+    std::fprintf(stderr, "--warmup must be shorter than --duration\n");
+    return false;
+  }
+  return true;
+}
+
+auto Trim(std::string_view text) -> std::string_view {
+  auto begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  auto end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+auto SplitWords(std::string_view text, const std::string& fixtures)
+    -> std::vector<std::string> {
+  std::vector<std::string> words;
+  std::istringstream stream{std::string(text)};
+  std::string word;
+  while (stream >> word) {
+    for (auto pos = word.find("{fixtures}"); pos != std::string::npos;
+         pos = word.find("{fixtures}")) {
+      word.replace(pos, std::strlen("{fixtures}"), fixtures);
+    }
+    words.push_back(word);
+  }
+  return words;
+}
+
+auto ReadScenarios(const Options& opts, const std::string& fixtures,
+                   std::vector<Scenario>* scenarios) -> bool {
+  std::ifstream file(opts.scenarios);
+  if (!file) {
+    std::fprintf(stderr, "%s: %s\n", opts.scenarios.c_str(),
+                 std::strerror(errno));
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    auto text = Trim(line);
+    if (text.empty() || text[0] == '#') {
+      continue;
+    }
+    auto first = text.find('|');
+    auto second = first == std::string_view::npos
+                      ? std::string_view::npos
+                      : text.find('|', first + 1);
+    if (second == std::string_view::npos) {
+      std::fprintf(stderr, "%s: expected NAME | SERVER | CLIENT: \"%s\"\n",
+                   opts.scenarios.c_str(), line.c_str());
+      return false;
+    }
+    Scenario scenario;
+    scenario.name = Trim(text.substr(0, first));
+    if (!opts.only.empty() &&
+        std::find(opts.only.begin(), opts.only.end(), scenario.name) ==
+            opts.only.end()) {
+      continue;
+    }
+    scenario.server_args =
+        SplitWords(text.substr(first + 1, second - first - 1), fixtures);
+    scenario.client_args = SplitWords(text.substr(second + 1), fixtures);
+    scenarios->push_back(std::move(scenario));
+  }
+  if (scenarios->empty()) {
+    std::fprintf(stderr, "%s: no scenarios to run\n", opts.scenarios.c_str());
+    return false;
+  }
+  return true;
+}
+
+// A 10k-entry directory for the listing and the download files. The 1 GiB
+// file is sparse, so it costs no disk space; kept between runs.
+auto MakeFixtures(const fs::path& root) -> bool {
+  std::error_code ec;
+  fs::create_directories(root / "listing", ec);
+  fs::create_directories(root / "files", ec);
+  if (ec) {
+    std::fprintf(stderr, "%s: %s\n", root.c_str(), ec.message().c_str());
+    return false;
+  }
+  for (size_t i = 0; i < kListingFiles; ++i) {
+    auto path = root / "listing" / std::format("file{:05}.txt", i);
+    if (!fs::exists(path)) {
+      std::ofstream(path) << i << '\n';
+    }
+  }
+  auto sized = [](const fs::path& path, off_t size, bool sparse) {
+    std::error_code ec;
+    if (fs::exists(path, ec) &&
+        fs::file_size(path, ec) == static_cast<uintmax_t>(size)) {
+      return true;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd == -1) {
+      std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+      return false;
+    }
+    bool ok = true;
+    if (sparse) {
+      ok = ftruncate(fd, size) == 0;
+    } else {
+      std::string block(64 * 1024, '\0');
+      for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<char>('a' + i % 26);
+      }
+      for (off_t left = size; ok && left > 0;
+           left -= static_cast<off_t>(block.size())) {
+        ok = write(fd, block.data(), block.size()) ==
+             static_cast<ssize_t>(block.size());
+      }
+    }
+    close(fd);
+    return ok;
+  };
+  return sized(root / "files" / "1m.bin", kSmallFileSize, false) &&
+         sized(root / "files" / "1g.bin", kLargeFileSize, true);
+}
+
+// A port the kernel just handed out; free again by the time the server
+// binds it, barring a race with another process
+auto PickPort() -> int {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  int port = -1;
+  if (fd != -1 &&
+      bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  return port;
+}
+
+auto CanConnect(int port) -> bool {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  bool ok =
+      connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  close(fd);
+  return ok;
+}
+
+// fork + exec with stdout and stderr redirected. The child's descriptor
+// limit is raised to the hard limit, since the idle scenario holds
+// thousands of connections.
+auto Spawn(const std::vector<std::string>& args, int out_fd, int err_fd)
+    -> pid_t {
+  std::vector<char*> argv;
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  return pid;
+}
+
+// utime + stime of every thread, in seconds
+auto ReadCpuSeconds(pid_t pid) -> double {
+  std::ifstream file(std::format("/proc/{}/stat", pid));
+  std::string stat((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  auto paren = stat.rfind(')');
+  if (paren == std::string::npos) {
+    return 0;
+  }
+  // Fields after the command name start at 3 (state); utime is 14
+  std::istringstream fields(stat.substr(paren + 2));
+  std::string field;
+  double utime = 0;
+  double stime = 0;
+  for (int i = 3; i <= 15 && fields >> field; ++i) {
+    if (i == 14) {
+      utime = std::stod(field);
+    } else if (i == 15) {
+      stime = std::stod(field);
+    }
+  }
+  return (utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+}
+
+auto ReadPeakRssKb(pid_t pid) -> double {
+  std::ifstream file(std::format("/proc/{}/status", pid));
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.starts_with("VmHWM:")) {
+      return std::stod(line.substr(6));
+    }
+  }
+  return 0;
+}
+
+void StopServer(pid_t pid) {
+  kill(pid, SIGTERM);
+  auto deadline = std::chrono::steady_clock::now() + kShutdownTimeout;
+  while (waitpid(pid, nullptr, WNOHANG) == 0) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      std::fprintf(stderr, "server %d ignored SIGTERM, killing it\n", pid);
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+// The value after "key": in a flat JSON text; keys are unique in the
+// documents read here
+auto JsonNumber(std::string_view json, std::string_view key) -> double {
+  auto needle = std::format("\"{}\":", key);
+  auto pos = json.find(needle);
+  if (pos == std::string_view::npos) {
+    return 0;
+  }
+  pos += needle.size();
+  auto end = json.find_first_of(",}", pos);
+  double value = 0;
+  ParseNumber(json.substr(pos, end - pos), &value);
+  return value;
+}
+
+auto JsonString(std::string_view json, std::string_view key) -> std::string {
+  auto needle = std::format("\"{}\":\"", key);
+  auto pos = json.find(needle);
+  if (pos == std::string_view::npos) {
+    return {};
+  }
+  pos += needle.size();
+  return std::string(json.substr(pos, json.find('"', pos) - pos));
+}
+
+// The last value given for flag, as bench_client would read it
+auto FlagValue(const std::vector<std::string>& args, std::string_view flag,
+               double fallback) -> double {
+  double value = fallback;
+  for (size_t i = 0; i + 1 < args.size(); ++i) {
+    double number = 0;
+    if (args[i] == flag && ParseNumber(args[i + 1], &number)) {
+      value = number;
+    }
+  }
+  return value;
+}
+
+auto RunScenario(const Options& opts, const Scenario& scenario,
+                 const fs::path& work_dir, Result* result) -> bool {
+  result->name = scenario.name;
+  int port = PickPort();
+  if (port == -1) {
+    std::perror("bind");
+    return false;
+  }
+
+  auto log_path = work_dir / (scenario.name + ".server.log");
+  int log_fd = open(log_path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (log_fd == -1) {
+    std::fprintf(stderr, "%s: %s\n", log_path.c_str(), std::strerror(errno));
+    return false;
+  }
+  std::vector<std::string> server_args{opts.server, "--port",
+                                       std::to_string(port)};
+  server_args.insert(server_args.end(), scenario.server_args.begin(),
+                     scenario.server_args.end());
+  pid_t server = Spawn(server_args, log_fd, log_fd);
+  close(log_fd);
+  if (server == -1) {
+    std::perror("fork");
+    return false;
+  }
+  auto deadline = std::chrono::steady_clock::now() + kStartupTimeout;
+  while (!CanConnect(port)) {
+    if (waitpid(server, nullptr, WNOHANG) != 0 ||
+        std::chrono::steady_clock::now() > deadline) {
+      std::fprintf(stderr, "%s: server did not start, see %s\n",
+                   scenario.name.c_str(), log_path.c_str());
+      StopServer(server);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  std::vector<std::string> client_args{
+      opts.client, "--port", std::to_string(port), "--duration",
+      std::format("{}", opts.duration_s), "--warmup",
+      std::format("{}", opts.warmup_s), "--json"};
+  client_args.insert(client_args.end(), scenario.client_args.begin(),
+                     scenario.client_args.end());
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+    std::perror("pipe2");
+    StopServer(server);
+    return false;
+  }
+  double cpu_before = ReadCpuSeconds(server);
+  pid_t client = Spawn(client_args, pipe_fds[1], STDERR_FILENO);
+  close(pipe_fds[1]);
+  std::string json;
+  char buf[4096];
+  ssize_t n = 0;
+  while ((n = read(pipe_fds[0], buf, sizeof(buf))) > 0) {
+    json.append(buf, static_cast<size_t>(n));
+  }
+  close(pipe_fds[0]);
+  int status = 0;
+  waitpid(client, &status, 0);
+  result->cpu_s = ReadCpuSeconds(server) - cpu_before;
+  result->peak_rss_kb = ReadPeakRssKb(server);
+  StopServer(server);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || json.empty()) {
+    std::fprintf(stderr, "%s: bench_client failed (status %d)\n",
+                 scenario.name.c_str(), status);
+    return false;
+  }
+  result->requests = JsonNumber(json, "requests");
+  result->rps = JsonNumber(json, "rps");
+  result->p50_us = JsonNumber(json, "p50");
+  result->p90_us = JsonNumber(json, "p90");
+  result->p99_us = JsonNumber(json, "p99");
+  result->p999_us = JsonNumber(json, "p99.9");
+  result->max_us = JsonNumber(json, "max");
+  result->non_2xx = JsonNumber(json, "non_2xx");
+  result->errors = JsonNumber(json, "connect") + JsonNumber(json, "io") +
+                   JsonNumber(json, "parse") +
+                   JsonNumber(json, "idle_closed");
+  // CPU time covers the warmup too, so divide by every completed request
+  double duration_s = FlagValue(scenario.client_args, "--duration",
+                                opts.duration_s);
+  double warmup_s = FlagValue(scenario.client_args, "--warmup",
+                              opts.warmup_s);
+  double all_requests =
+      duration_s > warmup_s
+          ? result->requests * duration_s / (duration_s - warmup_s)
+          : result->requests;
+  result->cpu_us_per_req =
+      all_requests > 0 ? result->cpu_s * 1e6 / all_requests : 0;
+  return true;
+}
+
+auto FormatResult(const Result& r) -> std::string {
+  return std::format(
+      R"({{"name":"{}","requests":{:.0f},"rps":{:.1f},"p50_us":{:.1f},)"
+      R"("p90_us":{:.1f},"p99_us":{:.1f},"p999_us":{:.1f},"max_us":{:.1f},)"
+      R"("errors":{:.0f},"non_2xx":{:.0f},"cpu_s":{:.3f},)"
+      R"("cpu_us_per_req":{:.2f},"peak_rss_kb":{:.0f}}})",
+      r.name, r.requests, r.rps, r.p50_us, r.p90_us, r.p99_us, r.p999_us,
+      r.max_us, r.errors, r.non_2xx, r.cpu_s, r.cpu_us_per_req,
+      r.peak_rss_kb);
+}
+
+// One scenario per line, so the file reads back without a JSON parser
+auto WriteResults(const std::string& path, const Options& opts,
+                  const std::vector<Result>& results) -> bool {
+  char host[256] = {};
+  gethostname(host, sizeof(host) - 1);
+  std::string out = std::format(
+      "{{\"host\":\"{}\",\"cpus\":{},\"duration_s\":{},\"warmup_s\":{},"
+      "\"scenarios\":[\n",
+      host, std::thread::hardware_concurrency(), opts.duration_s,
+      opts.warmup_s);
+  for (size_t i = 0; i < results.size(); ++i) {
+    out += FormatResult(results[i]);
+    out += i + 1 < results.size() ? ",\n" : "\n";
+  }
+  out += "]}\n";
+  std::ofstream file(path, std::ios::trunc);
+  file << out;
+  if (!file) {
+    std::fprintf(stderr, "%s: cannot write results\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+auto ReadResults(const std::string& path, std::string* host,
+                 std::vector<Result>* results) -> bool {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (host->empty()) {
+      *host = JsonString(line, "host");
+    }
+    auto name = JsonString(line, "name");
+    if (name.empty()) {
+      continue;
+    }
+    Result r;
+    r.name = name;
+    r.requests = JsonNumber(line, "requests");
+    r.rps = JsonNumber(line, "rps");
+    r.p50_us = JsonNumber(line, "p50_us");
+    r.p90_us = JsonNumber(line, "p90_us");
+    r.p99_us = JsonNumber(line, "p99_us");
+    r.p999_us = JsonNumber(line, "p999_us");
+    r.max_us = JsonNumber(line, "max_us");
+    r.errors = JsonNumber(line, "errors");
+    r.non_2xx = JsonNumber(line, "non_2xx");
+    r.cpu_s = JsonNumber(line, "cpu_s");
+    r.cpu_us_per_req = JsonNumber(line, "cpu_us_per_req");
+    r.peak_rss_kb = JsonNumber(line, "peak_rss_kb");
+    results->push_back(std::move(r));
+  }
+  return true;
+}
+
+// Prints one line per scenario; returns the number of regressions
+auto Compare(const Options& opts, const std::vector<Result>& results,
+             const std::vector<Result>& baseline) -> int {
+  int regressions = 0;
+  for (const auto& r : results) {
+    auto base =
+        std::find_if(baseline.begin(), baseline.end(),
+                     [&r](const Result& b) { return b.name == r.name; });
+    std::string line = std::format("{:<18}", r.name);
+    if (base == baseline.end()) {
+      std::printf("%s not in baseline\n", line.c_str());
+      continue;
+    }
+    bool failed = false;
+    for (const auto& metric : kMetrics) {
+      double now = r.*metric.field;
+      double then = (*base).*metric.field;
+      double change = then > 0 ? (now - then) / then * 100 : 0;
+      double worse = metric.higher_is_better ? -change : change;
+      double limit = metric.latency ? opts.latency_threshold_pct
+                                    : opts.threshold_pct;
+      bool regressed = worse > limit;
+      failed |= regressed;
+      line += std::format("  {} {:.1f} ({:+.1f}%){}", metric.key, now, change,
+                          regressed ? " REGRESSED" : "");
+    }
+    if (r.errors > 0) {
+      failed = true;
+      line += std::format("  errors {:.0f}", r.errors);
+    }
+    regressions += failed ? 1 : 0;
+    std::printf("%s\n", line.c_str());
+  }
+  return regressions;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  Options opts;
+  if (argc > 1 && (std::string_view(argv[1]) == "-h" ||
+                   std::string_view(argv[1]) == "--help")) {
+    PrintUsage(argv[0]);
+    return 0;
+  }
+  if (!ParseArgs(argc, argv, &opts)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  std::error_code ec;
+  fs::path work_dir = fs::absolute(opts.work_dir, ec);
+  fs::create_directories(work_dir, ec);
+  fs::path fixtures = work_dir / "fixtures";
+  std::vector<Scenario> scenarios;
+  if (!MakeFixtures(fixtures) ||
+      !ReadScenarios(opts, fixtures.string(), &scenarios)) {
+    return 1;
+  }
+
+  std::vector<Result> results;
+  int failed_runs = 0;
+  for (const auto& scenario : scenarios) {
+    std::printf("running %s ...\n", scenario.name.c_str());
+    std::fflush(stdout);
+    Result result;
+    if (!RunScenario(opts, scenario, work_dir, &result)) {
+      ++failed_runs;
+      continue;
+    }
+    std::printf(
+        "  %.0f req/s, p50 %.1fus, p99 %.1fus, server CPU %.2fs "
+        "(%.1fus/req), peak RSS %.1f MiB\n",
+        result.rps, result.p50_us, result.p99_us, result.cpu_s,
+        result.cpu_us_per_req, result.peak_rss_kb / 1024);
+    results.push_back(std::move(result));
+  }
+  if (!WriteResults(opts.out, opts, results)) {
+    return 1;
+  }
+  std::printf("results written to %s\n", opts.out.c_str());
+  if (opts.baseline.empty()) {
+    return failed_runs == 0 ? 0 : 1;
+  }
+
+  std::string baseline_host;
+  std::vector<Result> baseline;
+  if (opts.update_baseline ||
+      !ReadResults(opts.baseline, &baseline_host, &baseline)) {
+    if (failed_runs > 0 || !WriteResults(opts.baseline, opts, results)) {
+      return 1;
+    }
+    std::printf("baseline written to %s\n", opts.baseline.c_str());
+    return 0;
+  }
+  char host[256] = {};
+  gethostname(host, sizeof(host) - 1);
+  if (baseline_host != host) {
+    std::printf("note: baseline was recorded on %s, this is %s\n",
+                baseline_host.c_str(), host);
+  }
+  std::printf("compared with %s (threshold %.0f%%, p99 %.0f%%):\n",
+              opts.baseline.c_str(), opts.threshold_pct,
+              opts.latency_threshold_pct);
+  int regressions = Compare(opts, results, baseline);
+  if (regressions > 0 || failed_runs > 0) {
+    std::printf("%d regressed, %d failed to run\n", regressions, failed_runs);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Throughput comparison of the work-stealing ThreadPool with
+// the previous single-queue pool, plus batched submission.
+//
+// Build (one command line) and run:
+//   g++ -std=c++20 -O2 -Iinclude bench/thread_pool_bench.cpp
+//       src/pool/thread_pool.cpp -lpthread -o thread_pool_bench
+//   ./thread_pool_bench [threads]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "pool/thread_pool.hpp"
+
+namespace {
+
+// The pool as it was before work stealing: one queue, one mutex, one condvar
+class LegacyThreadPool {
+ public:
+  explicit LegacyThreadPool(size_t thread_num) {
+    for (size_t i = 0; i < thread_num; ++i) {
+      workers_.emplace_back([this]() {
+        while (true) {
+          std::function<void()> task;
+          {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cond_.wait(lock,
+                       [this]() { return is_closed_ || !tasks_.empty(); });
+            if (is_closed_ && tasks_.empty()) {
+              return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+          }
+          task();
+        }
+      });
+    }
+  }
+  ~LegacyThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      is_closed_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  template <typename F>
+  void AddTask(F&& task) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      tasks_.emplace(std::forward<F>(task));
+    }
+    cond_.notify_one();
+  }
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  bool is_closed_ = false;
+  std::queue<std::function<void()>> tasks_;
+  std::vector<std::thread> workers_;
+};
+
+// A few hundred nanoseconds of work, roughly a small request parse
+void Work(int iterations) {
+  volatile uint64_t sink = 0;
+  for (int i = 0; i < iterations; ++i) {
+    sink = sink * 31 + static_cast<uint64_t>(i);
+  }
+}
+
+void WaitFor(const std::atomic<int64_t>& done, int64_t target) {
+  while (done.load(std::memory_order_acquire) < target) {
+    std::this_thread::yield();
+  }
+}
+
+// One producer (the reactor) submitting independent tasks
+template <typename Pool>
+auto SingleProducer(Pool& pool, int64_t tasks, int work) -> double {
+  std::atomic<int64_t> done{0};
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < tasks; ++i) {
+    pool.AddTask([&done, work]() {
+      Work(work);
+      done.fetch_add(1, std::memory_order_release);
+    });
+  }
+  WaitFor(done, tasks);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(tasks);
+}
+
+// Several producers submitting at once
+template <typename Pool>
+auto MultiProducer(Pool& pool, int producers, int64_t tasks, int work)
+    -> double {
+  std::atomic<int64_t> done{0};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&]() {
+      for (int64_t i = 0; i < tasks / producers; ++i) {
+        pool.AddTask([&done, work]() {
+          Work(work);
+          done.fetch_add(1, std::memory_order_release);
+        });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  WaitFor(done, tasks / producers * producers);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(tasks);
+}
+
+// The reactor path: tasks collected per event batch and submitted together
+auto Batched(my_web_server::ThreadPool& pool, int64_t tasks, int batch_size,
+             int work) -> double {
+  std::atomic<int64_t> done{0};
+  std::vector<my_web_server::Task> batch;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < tasks; ++i) {
+    batch.emplace_back([&done, work]() {
+      Work(work);
+      done.fetch_add(1, std::memory_order_release);
+    });
+    if (static_cast<int>(batch.size()) == batch_size) {
+      pool.AddTasks(batch);
+      batch.clear();
+    }
+  }
+  pool.AddTasks(batch);
+  WaitFor(done, tasks);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(tasks);
+}
+
+// Tasks that submit follow-up tasks, like parse -> respond continuations
+template <typename Pool>
+auto FanOut(Pool& pool, int64_t roots, int depth, int work) -> double {
+  std::atomic<int64_t> done{0};
+  int64_t per_root = (int64_t{1} << (depth + 1)) - 1;
+  std::function<void(int)> spawn = [&](int level) {
+    Work(work);
+    if (level < depth) {
+      pool.AddTask([&spawn, level]() { spawn(level + 1); });
+      pool.AddTask([&spawn, level]() { spawn(level + 1); });
+    }
+    done.fetch_add(1, std::memory_order_release);
+  };
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < roots; ++i) {
+    pool.AddTask([&spawn]() { spawn(0); });
+  }
+  WaitFor(done, roots * per_root);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(roots * per_root);
+}
+
+template <typename Pool>
+void RunAll(const char* name, size_t threads) {
+  constexpr int64_t kTasks = 400000;
+  Pool pool(threads);
+  std::cout << std::format("{:<14} single/0 {:>8.1f}  single/200 {:>8.1f}  "
+                           "multi4/200 {:>8.1f}  fanout/200 {:>8.1f}  "
+                           "ns/task\n",
+                           name, SingleProducer(pool, kTasks, 0),
+                           SingleProducer(pool, kTasks, 200),
+                           MultiProducer(pool, 4, kTasks, 200),
+                           FanOut(pool, kTasks / 1023, 9, 200));
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                            : std::max(2U, std::thread::hardware_concurrency());
+  std::cout << std::format("threads={}\n", threads);
+  RunAll<LegacyThreadPool>("legacy", threads);
+  RunAll<my_web_server::ThreadPool>("work-stealing", threads);
+  my_web_server::ThreadPool pool(threads);
+  std::cout << std::format("{:<14} batch64/0 {:>7.1f}  batch64/200 {:>7.1f}  "
+                           "ns/task\n",
+                           "work-stealing", Batched(pool, 400000, 64, 0),
+                           Batched(pool, 400000, 64, 200));
+  return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: ThreadPool microbenchmark: AddTask round-trip latency, from
+// submitting a task on an outside thread until it has run on a worker.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+
+#include "pool/thread_pool.hpp"
+
+namespace {
+
+using my_web_server::ThreadPool;
+
+// Idle workers park, so the round trip includes the wake-up. The submitter
+// polls with yield() rather than blocking, so its own wake-up is not timed
+// and it does not starve the worker on a single core.
+void BM_ThreadPoolRoundTrip(benchmark::State& state) {
+  ThreadPool pool(static_cast<size_t>(state.range(0)));
+  std::atomic<uint64_t> done{0};
+  uint64_t expected = 0;
+  for (auto _ : state) {
+    ++expected;
+    pool.AddTask([&done]() { done.fetch_add(1, std::memory_order_release); });
+    while (done.load(std::memory_order_acquire) != expected) {
+      std::this_thread::yield();
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ThreadPoolRoundTrip)
+    ->ArgName("workers")
+    ->Arg(1)
+    ->Arg(4)
+    ->UseRealTime();
+
+// Batches of 64 tasks, timed until the last one has run
+void BM_ThreadPoolBatch(benchmark::State& state) {
+  constexpr int kBatch = 64;
+  ThreadPool pool(static_cast<size_t>(state.range(0)));
+  std::atomic<uint64_t> done{0};
+  uint64_t expected = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < kBatch; ++i) {
+      pool.AddTask(
+          [&done]() { done.fetch_add(1, std::memory_order_release); });
+    }
+    expected += kBatch;
+    while (done.load(std::memory_order_acquire) != expected) {
+      std::this_thread::yield();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_ThreadPoolBatch)
+    ->ArgName("workers")
+    ->Arg(1)
+    ->Arg(4)
+    ->UseRealTime();
+
+}  // namespace
@@ -15,27 +15,68 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// File overview: Defines global, read-only server configuration.
+// File overview: Defines the global server configuration, published as
+// immutable snapshots that a reload replaces.
 
 #pragma once
 
 #include <filesystem>
 #include <optional>
 #include <string>
+#include <vector>
+
+#include "http/upstream_pool.hpp"
+#include "logger/access_log.hpp"
+#include "logger/logger.hpp"
+#include "logger/traffic_capture.hpp"
+#include "metrics/flight_recorder.hpp"
+#include "pool/executor.hpp"
+#include "utils/cpu_topology.hpp"
+#include "utils/rcu_cell.hpp"
 
 namespace my_web_server {
 
+constexpr size_t kDefaultMaxConns = 1000;
+
 struct ServerConfig {
   std::string ip{"0.0.0.0"};
   int port{8001};
   std::optional<std::string> custom_response_text{};
   std::filesystem::path server_working_dir{};
+  std::optional<int> tls_port{};     // TLS listener, disabled when unset
+  std::string tls_cert_file{};       // PEM certificate chain
+  std::string tls_key_file{};        // PEM private key
+  LogOverflowPolicy log_overflow{LogOverflowPolicy::kDrop};
+  std::string log_binary_path{};  // unformatted log for log_decoder
+  LogFileOptions log_file{};      // rotating text log, stderr when unset
+  AccessLogOptions access_log{};  // per-response log, off when path unset
+  TrafficCaptureOptions capture{};  // raw request capture, off when unset
+  ExecutorOptions executor{};     // cpu / io lane sizes and queue limits
+  size_t max_conn{kDefaultMaxConns};    // connections beyond this are refused
+  PinPolicy pin_policy{PinPolicy::kNone};  // reactor / worker CPU placement
+  bool coroutines{false};  // one handler coroutine per connection
+  bool h2c{false};  // HTTP/2 on the plain port (prior knowledge or upgrade)
+  uint64_t max_upload{0};  // PUT/POST body limit in bytes, 0 = no uploads
+  ProxyOptions proxy{};    // reverse-proxy routes, none by default
+  std::optional<int> metrics_port{};  // Prometheus endpoint, off when unset
+  size_t flight_recorder_events{FlightRecorder::kDefaultEvents};  // per thread
+  std::string flight_recorder_file{"flight_recorder.txt"};  // SIGUSR1 dump
 };
 
 class GlobalConfig {
  public:
   static auto Instance() -> GlobalConfig&;
+  // --config PATH loads a file first; the other flags override it
   auto InitFromArgs(int argc, char* argv[]) -> bool;
+  // Re-read the config file and flags into a new snapshot. Only text, dir,
+  // max-conn, the lane queue limits, access-log and capture sampling, h2c,
+  // max-upload and the flight recorder file change; other differences need
+  // a restart and are logged. The server has no timeouts, and its only
+  // cache (the prebuilt pages) has no size to tune; it is rebuilt when text
+  // or dir change. On any error the running snapshot stays in place.
+  auto Reload() -> bool;
+  // Lock-free; the returned snapshot stays valid until exit, so callers may
+  // hold the reference across a request
   auto Get() const -> const ServerConfig&;
 
   GlobalConfig(const GlobalConfig&) = delete;
@@ -45,8 +86,12 @@ class GlobalConfig {
  private:
   GlobalConfig() = default;
 
-  ServerConfig config_{};
-  bool initialized_ = false;
+  // Defaults, then the config file, then the command-line flags
+  auto Load(ServerConfig* out) const -> bool;
+
+  RcuCell<ServerConfig> snapshot_;
+  std::string config_path_{};       // empty without --config
+  std::vector<std::string> args_{};  // flags after argv[0], minus --config
 };
 
 }  // namespace my_web_server
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines ConnCoroutine, the return type of the coroutine
+// connection handler, and CoroArena, the per-connection frame storage.
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+namespace my_web_server {
+
+class HttpConn;
+
+// Frame storage for one connection's handler coroutine. Arenas are pooled,
+// so steady-state accepts allocate nothing; a frame that does not fit (a
+// compiler with a fatter frame layout) falls back to the heap and is
+// counted in CoroArena::HeapFallbacks().
+struct CoroArena {
+  static constexpr size_t kFrameBytes = 1024;
+
+  std::coroutine_handle<> handle{};  // suspended handler, null once destroyed
+  // Set by the handler right before co_return. Resume() reads it on the
+  // reactor while the frame may be running on a lane worker after a hop.
+  std::atomic<bool> finished{false};
+  bool frame_in_use{false};
+  alignas(std::max_align_t) unsigned char storage[kFrameBytes];
+
+  static auto Acquire() -> CoroArena*;
+  // Destroys a frame still parked in the arena before pooling it
+  static void Release(CoroArena* arena);
+
+  auto AllocateFrame(size_t size) -> void*;
+  static void DeallocateFrame(void* frame);
+  static auto HeapFallbacks() -> uint64_t;
+};
+
+// Handler coroutine. It starts suspended; the owner stores the handle in its
+// CoroArena and resumes it from the event loop.
+class ConnCoroutine {
+ public:
+  struct promise_type {
+    // Frames of member coroutines of HttpConn come from the connection's
+    // arena; the implicit object argument selects this overload.
+    static auto operator new(size_t size, HttpConn& conn) -> void*;
+    static void operator delete(void* frame) {
+      CoroArena::DeallocateFrame(frame);
+    }
+
+    auto get_return_object() -> ConnCoroutine {
+      return ConnCoroutine(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+    // Suspend at the end so the owner destroys the frame explicitly
+    auto final_suspend() noexcept -> std::suspend_always { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  ConnCoroutine(ConnCoroutine&& other) noexcept
+      : handle_(std::exchange(other.handle_, {})) {}
+  ~ConnCoroutine() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+  ConnCoroutine(const ConnCoroutine&) = delete;
+  auto operator=(const ConnCoroutine&) -> ConnCoroutine& = delete;
+  auto operator=(ConnCoroutine&&) -> ConnCoroutine& = delete;
+
+  // Hand the frame over to the caller, who must destroy it
+  auto Release() -> std::coroutine_handle<> {
+    return std::exchange(handle_, {});
+  }
+
+ private:
+  explicit ConnCoroutine(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines DirListing, the --dir index page produced a piece
+// at a time while it is sent, and ListingQuery, its query-string options.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace my_web_server {
+
+// ?offset=N&limit=N&sort=name|size|mtime&order=asc|desc
+struct ListingQuery {
+  enum class Sort : uint8_t { kNone, kName, kSize, kMtime };
+
+  static constexpr uint64_t kNoLimit = UINT64_MAX;
+  // A sorted page needs every entry up to offset + limit in memory
+  static constexpr uint64_t kDefaultSortedLimit = 1000;
+  static constexpr uint64_t kMaxSortedEntries = 100000;
+
+  Sort sort{Sort::kNone};
+  bool descending{false};
+  uint64_t offset{0};
+  uint64_t limit{kNoLimit};
+
+  // Unknown keys are ignored. False on a bad value, or a sorted page
+  // beyond kMaxSortedEntries.
+  static auto Parse(std::string_view query, ListingQuery* out) -> bool;
+};
+
+// Lists the regular files of a directory as HTML. Unsorted listings are
+// read from the directory as they are sent, so the first bytes go out at
+// once and memory stays the same for any directory size. A sorted page
+// keeps the best offset + limit entries in a bounded heap while the whole
+// directory is read in Open().
+class DirListing {
+ public:
+  // One chunk of HTTP/1.1 chunked coding, framing included
+  static constexpr size_t kChunkSize = 16384;
+
+  DirListing();  // leaves the buffers uninitialized, even for make_unique
+  ~DirListing();
+  DirListing(const DirListing&) = delete;
+  auto operator=(const DirListing&) -> DirListing& = delete;
+  DirListing(DirListing&&) = delete;
+  auto operator=(DirListing&&) -> DirListing& = delete;
+
+  // May block on the filesystem (io lane): opens the directory and reads
+  // the first batch of entries, or all of them for a sorted page. text is
+  // shown above the list.
+  // Errors reading the directory end up in the page, as before.
+  void Open(const std::filesystem::path& dir, const ListingQuery& query,
+            std::string_view text);
+
+  // Raw HTML: copies up to room bytes to out and returns how many. 0 once
+  // done().
+  auto Read(char* out, size_t room) -> size_t;
+  auto done() const -> bool { return stage_ == Stage::kDone && carry_.empty(); }
+
+  // Chunked transfer coding (HTTP/1.1): what is left of the current chunk,
+  // producing the next one when it was all sent. Empty after the last
+  // chunk.
+  auto Pending() -> std::string_view;
+  void Sent(size_t n) { chunk_sent_ += n; }
+  // Whether Pending() will return more after the current chunk
+  auto More() const -> bool { return !last_chunk_; }
+
+ private:
+  enum class Stage : uint8_t { kHead, kEntries, kNext, kTail, kDone };
+
+  struct Entry {
+    std::string name{};
+    int64_t key{0};  // size or mtime
+  };
+
+  // Next regular file in directory order; the view lives until the next
+  // call
+  auto NextFile(std::string_view* name, int64_t* key) -> bool;
+  // Next name of the page (after offset, within limit)
+  auto NextPageName(std::string_view* name) -> bool;
+#if defined(__linux__)
+  // Refill dents_; false at the end of the directory or on error
+  auto ReadDents() -> bool;
+#endif
+  // Read the whole directory into sorted_ (sorted pages only)
+  void CollectSorted();
+  void Fail(int err);
+
+  int fd_{-1};
+#if !defined(__linux__)
+  void* dir_{nullptr};  // DIR*
+#endif
+  ListingQuery query_{};
+  Stage stage_{Stage::kHead};
+  std::string head_{};
+  std::string carry_{};  // output that did not fit the caller's buffer
+  std::string error_{};  // directory read error, shown in the page
+  uint64_t skipped_{0};
+  uint64_t listed_{0};
+  bool more_{false};  // entries beyond this page
+  std::vector<Entry> sorted_{};
+  size_t sorted_next_{0};
+
+  // getdents64 buffer
+  size_t dents_pos_{0};
+  size_t dents_len_{0};
+  alignas(8) char dents_[8192];
+
+  // Chunk being sent: size line, data, CRLF (and the last chunk)
+  size_t chunk_begin_{0};
+  size_t chunk_end_{0};
+  size_t chunk_sent_{0};
+  bool last_chunk_{false};  // the current chunk ends the body
+  char chunk_[kChunkSize];
+};
+
+}  // namespace my_web_server
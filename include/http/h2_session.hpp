@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines H2Session, the HTTP/2 framing layer (RFC 9113)
+// that HttpConn switches to for h2c connections.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "http/dir_listing.hpp"
+#include "http/hpack.hpp"
+
+namespace my_web_server {
+
+// A cleartext connection that starts with this speaks HTTP/2 ("prior
+// knowledge"); after an h2c upgrade the client sends it right after the 101
+inline constexpr std::string_view kH2Preface =
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// Advertised in our SETTINGS. Streams beyond the limit are refused, which
+// also bounds the files one connection keeps open.
+inline constexpr uint32_t kH2MaxConcurrentStreams = 32;
+inline constexpr uint32_t kH2MaxHeaderListSize = 16384;
+
+enum class H2Error : uint32_t {
+  kNoError = 0x0,
+  kProtocol = 0x1,
+  kInternal = 0x2,
+  kFlowControl = 0x3,
+  kStreamClosed = 0x5,
+  kFrameSize = 0x6,
+  kRefusedStream = 0x7,
+  kCompression = 0x9,
+  kEnhanceYourCalm = 0xb,
+};
+
+// One response sent completely, for metrics and the access log
+struct H2StreamStats {
+  uint32_t stream_id{0};
+  uint16_t status{0};
+  uint64_t header_bytes{0};  // HEADERS and CONTINUATION frames
+  uint64_t body_bytes{0};    // DATA payload
+  int64_t start_ns{0};       // steady_clock, when the request was complete
+  int64_t ready_ns{0};       // steady_clock, when the response was queued
+  std::string path{};
+  std::string user_agent{};
+};
+
+// Frames in, frames out; no sockets. Feed() parses what the client sent
+// and collects complete requests, Respond() turns a response into HEADERS
+// and DATA, and Pending()/Sent()/Fill() drive the output. DATA frames of
+// all responding streams are interleaved round-robin within the
+// connection and per-stream flow-control windows, so one large file does
+// not hold up the others.
+//
+// Only GET requests are answered; request bodies are read and dropped.
+// Server push and priorities are not used. Not thread-safe: HttpConn
+// calls it from one thread at a time, like the rest of the connection.
+class H2Session {
+ public:
+  // A stream whose request headers (and body, if any) are complete
+  struct Request {
+    uint32_t stream_id{0};
+    std::string method{};
+    std::string path{};
+    std::string authority{};  // :authority, or Host
+    std::string user_agent{};
+    int64_t start_ns{0};
+  };
+
+  struct Response {
+    uint16_t status{200};
+    // Lowercase names, without connection-specific fields
+    std::vector<std::pair<std::string, std::string>> headers{};
+    std::string body{};
+    int file_fd{-1};      // body continues with file_size bytes of this file
+    off_t file_size{0};   // the session closes file_fd when done with it
+    std::unique_ptr<DirListing> listing{};  // or with this, read as sent
+    int64_t ready_ns{0};
+  };
+
+  H2Session() = default;
+  ~H2Session();
+  H2Session(const H2Session&) = delete;
+  auto operator=(const H2Session&) -> H2Session& = delete;
+  H2Session(H2Session&&) = delete;
+  auto operator=(H2Session&&) -> H2Session& = delete;
+
+  // Prior knowledge: queue our SETTINGS and expect the client preface
+  void Start();
+  // h2c upgrade: http2_settings is the request's HTTP2-Settings header and
+  // request becomes stream 1. Queues the 101 response, then our SETTINGS.
+  // False, with nothing queued, when the header does not decode.
+  auto Upgrade(std::string_view http2_settings, Request request) -> bool;
+
+  // Consume bytes read from the client. False once the connection failed;
+  // a GOAWAY is queued and the connection should close when it is sent.
+  auto Feed(const char* data, size_t len) -> bool;
+  // Requests waiting for Respond(); the caller clears the list
+  auto requests() -> std::vector<Request>& { return requests_; }
+  // Answer a request. Ignored (and the file closed) if the client reset
+  // the stream meanwhile.
+  void Respond(uint32_t stream_id, Response response);
+
+  // Bytes ready to be written, and how many of them were
+  auto Pending() const -> std::string_view {
+    return std::string_view(out_).substr(out_sent_);
+  }
+  void Sent(size_t n);
+  // Queue more DATA once Pending() is empty. False when nothing can be
+  // sent until the client opens a flow-control window or asks for more.
+  auto Fill() -> bool;
+  // Whether Pending() has bytes or Fill() would add some
+  auto HasOutput() const -> bool;
+  // The connection is finished (GOAWAY sent or received, nothing left to
+  // send) and can be closed
+  auto Done() const -> bool;
+
+  // Streams completed since the caller last cleared the list
+  auto finished() -> std::vector<H2StreamStats>& { return finished_; }
+
+ private:
+  struct Stream {
+    bool remote_closed{false};  // END_STREAM received
+    bool responding{false};     // HEADERS sent, DATA left
+    int64_t send_window{0};
+    int64_t recv_window{0};
+    Request request{};
+    std::string body{};
+    size_t body_sent{0};
+    int file_fd{-1};
+    off_t file_size{0};
+    off_t file_sent{0};
+    std::unique_ptr<DirListing> listing{};
+    H2StreamStats stats{};
+  };
+  using StreamMap = std::map<uint32_t, Stream>;
+
+  auto HandleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                   std::string_view payload) -> bool;
+  auto OnData(uint8_t flags, uint32_t stream_id, std::string_view payload)
+      -> bool;
+  auto OnHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload)
+      -> bool;
+  auto OnContinuation(uint8_t flags, uint32_t stream_id,
+                      std::string_view payload) -> bool;
+  auto OnRstStream(uint32_t stream_id, std::string_view payload) -> bool;
+  auto OnSettings(uint8_t flags, uint32_t stream_id, std::string_view payload)
+      -> bool;
+  auto OnPing(uint8_t flags, uint32_t stream_id, std::string_view payload)
+      -> bool;
+  auto OnGoaway(uint32_t stream_id, std::string_view payload) -> bool;
+  auto OnWindowUpdate(uint32_t stream_id, std::string_view payload) -> bool;
+  // A complete header block for header_stream_
+  auto FinishHeaders() -> bool;
+  auto ApplySettings(std::string_view payload) -> H2Error;
+  // The request on a stream is complete: hand it to the caller
+  void RequestReady(Stream* stream);
+  // Return the consumed receive window once half of it is used
+  void Replenish(uint32_t stream_id, int64_t* window);
+
+  // Connection error: queue GOAWAY and stop reading
+  auto Fail(H2Error error) -> bool;
+  // Stream error: queue RST_STREAM and forget the stream
+  void Reset(uint32_t stream_id, H2Error error);
+  // Drop a stream, closing its file; returns the next one
+  auto Erase(StreamMap::iterator it) -> StreamMap::iterator;
+  // Append one DATA frame for a responding stream
+  void SendData(StreamMap::iterator it);
+
+  void QueueSettings();
+  void QueueFrameHeader(size_t length, uint8_t type, uint8_t flags,
+                        uint32_t stream_id);
+
+  std::string in_{};   // unparsed input, at most one frame
+  std::string out_{};  // frames not yet written
+  size_t out_sent_{0};
+  bool preface_seen_{false};
+  bool settings_seen_{false};  // the client's first frame must be SETTINGS
+  bool failed_{false};         // we sent GOAWAY
+  bool peer_goaway_{false};    // the client sent GOAWAY
+
+  HpackDecoder decoder_{};
+  std::string header_block_{};   // HEADERS + CONTINUATION fragments
+  uint32_t header_stream_{0};    // stream of header_block_, 0 if none
+  bool header_end_stream_{false};
+
+  StreamMap streams_{};
+  uint32_t last_stream_id_{0};  // highest stream the client opened
+  uint32_t last_sent_stream_{0};  // round-robin position for DATA
+  std::vector<Request> requests_{};
+  std::vector<H2StreamStats> finished_{};
+
+  // Flow control (RFC 9113, 6.9); our receive windows stay at the default
+  int64_t conn_send_window_{65535};
+  int64_t conn_recv_window_{65535};
+  int64_t peer_initial_window_{65535};
+  uint32_t peer_max_frame_{16384};
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: HPACK header compression (RFC 7541) for the HTTP/2
+// session: a decoder with the full dynamic table and Huffman support, and
+// a stateless encoder for responses.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace my_web_server {
+
+inline constexpr size_t kHpackDefaultTableSize = 4096;
+
+struct HpackHeader {
+  std::string name{};
+  std::string value{};
+};
+
+// Decodes the header blocks of one direction of a connection. The dynamic
+// table carries over from block to block, so every block must be decoded,
+// even for streams that are refused.
+class HpackDecoder {
+ public:
+  // max_table_size is the SETTINGS_HEADER_TABLE_SIZE we advertised
+  explicit HpackDecoder(size_t max_table_size = kHpackDefaultTableSize)
+      : max_table_size_(max_table_size), table_limit_(max_table_size) {}
+
+  // Appends the fields of block to *out in order. False on a compression
+  // error, which is fatal for the connection.
+  auto Decode(std::string_view block, std::vector<HpackHeader>* out) -> bool;
+
+  auto table_size() const -> size_t { return table_size_; }
+  auto table_entries() const -> size_t { return table_.size(); }
+
+ private:
+  auto Lookup(uint64_t index, HpackHeader* out) const -> bool;
+  void Insert(HpackHeader header);
+  void Evict(size_t limit);
+
+  size_t max_table_size_;
+  size_t table_limit_;  // current size, lowered by table size updates
+  size_t table_size_{0};
+  std::deque<HpackHeader> table_;  // newest first
+};
+
+// Response fields that match the static table are sent as a single index
+// (":status: 200") or by name reference ("content-length"); everything is
+// sent as a literal without indexing. Nothing is added to the peer's
+// dynamic table, so the encoder keeps no state.
+class HpackEncoder {
+ public:
+  static void EncodeStatus(uint16_t status, std::string* out);
+  // name must be lowercase
+  static void Encode(std::string_view name, std::string_view value,
+                     std::string* out);
+};
+
+// Exposed for tests
+void HpackEncodeInteger(uint64_t value, int prefix_bits, uint8_t first_byte,
+                        std::string* out);
+auto HuffmanDecode(std::string_view in, std::string* out) -> bool;
+
+}  // namespace my_web_server
@@ -20,18 +20,45 @@
 #pragma once
 
 #include <netinet/in.h>
+#include <openssl/types.h>
 
-#include <filesystem>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 
+#include "http/conn_coroutine.hpp"
+#include "metrics/request_trace.hpp"
+
 namespace my_web_server {
 
+class DirListing;
+class Executor;
+class H2Session;
+class ProxyExchange;
+class Upload;
+class UpstreamPool;
+enum class Lane : uint8_t;
+struct H2StreamStats;
+
 constexpr size_t kReadBufferSize = 2048;
 constexpr size_t kWriteBufferSize = 1024;
+// Inline arena for request-scoped strings; larger requests spill to the heap
+constexpr size_t kRequestArenaSize = 512;
+
+struct RequestState;
+
+// Returns request state to the calling thread's free list instead of the heap
+struct RequestStateDeleter {
+  void operator()(RequestState* state) const;
+};
+using RequestStatePtr = std::unique_ptr<RequestState, RequestStateDeleter>;
 
 // Class to handle HTTP connections
-class HttpConn {
+class HttpConn : public std::enable_shared_from_this<HttpConn> {
  public:
   // HTTP request methods
   enum METHOD {
@@ -61,10 +88,25 @@ class HttpConn {
     NO_RESOURCE,        // resource not found (404)
     FORBIDDEN_REQUEST,  // access forbidden (403)
     INTERNAL_ERROR,     // internal server error (500)
-    CLOSED_CONNECTION   // connection closed by client
+    CLOSED_CONNECTION,  // connection closed by client
+    H2_REQUEST,         // HTTP/2 preface or h2c upgrade
+    UPLOAD_REQUEST,     // PUT/POST headers parsed; once the body is in, stored
+    LENGTH_REQUIRED,    // body without Content-Length or chunked (411)
+    PAYLOAD_TOO_LARGE,  // body over --max-upload (413)
+    PROXY_REQUEST,      // headers parsed for a --proxy route; relay it
+    BAD_GATEWAY         // no usable answer from an upstream (502)
   };
 
-  enum class NetEvent { READ_EVENT, WRITE_EVENT };
+  enum class NetEvent { READ_EVENT, WRITE_EVENT, READ_WRITE_EVENT };
+  // Outcome of one non-blocking handshake or send attempt
+  enum class IoStatus : uint8_t { kDone, kWantRead, kWantWrite, kError };
+  // TLS session progress; plain connections stay in TLS_NONE
+  enum class TlsState : uint8_t {
+    TLS_NONE,
+    TLS_HANDSHAKE,
+    TLS_READY,
+    TLS_FAILED
+  };
 
   HttpConn();
   ~HttpConn();
@@ -73,23 +115,114 @@ class HttpConn {
   HttpConn(HttpConn&&) = delete;
   auto operator=(HttpConn&&) -> HttpConn& = delete;
 
+  // Reset for the next request on a keep-alive connection
   void Init();
-  void Init(int sockfd, const sockaddr_in& addr, int fd);
-  // Handle the HTTP connection
+  // ssl is an accepted-state session owned by this connection afterwards
+  void Init(int sockfd, const sockaddr_in& addr, int fd, SSL* ssl = nullptr);
+  // Parse the request (cpu lane). Responses that touch the filesystem are
+  // continued on the io lane when an executor is set.
   void Process();
   // Non-block read all available data from the socket(for ET mode)
   auto Read() -> bool;
   // Non-block write all data to the socket(for ET mode)
   auto Write() -> bool;
+  // Drive the TLS handshake (run on the thread pool, re-arms the socket)
+  void Handshake();
+  auto GetFd() const -> int { return sockfd_; }
+  auto IsHandshaking() const -> bool {
+    return tls_state_ == TlsState::TLS_HANDSHAKE;
+  }
+
+  // Coroutine mode (--coroutines): the whole connection is one straight-line
+  // handler resumed by the reactor on readiness. Call StartCoroutine() once
+  // after Init(); Resume() on every event, closing the connection when it
+  // returns false.
+  void StartCoroutine();
+  auto Resume() -> bool;
+
+  // Stamp a trace point on the request in flight, if any
+  void Trace(TracePoint point);
+
+  // Reverse proxy (--proxy). A request on a proxy route is relayed on the
+  // reactor thread, woken by the client socket or by its upstream
+  // connection, whichever the exchange waits for; readiness of the other
+  // is stale and must be ignored.
+  auto IsProxying() const -> bool;
+  auto ProxyWants(int fd) const -> bool;
+  // Continue the relay (callback mode); false when the connection should
+  // close
+  auto Proxy() -> bool;
+  // Give the upstream connection back before this connection is closed
+  void AbortProxy();
+
+  // Lanes used by Process(); null runs every step inline (tests, and while
+  // the server drains its lanes on shutdown)
+  static void SetExecutor(Executor* executor) {
+    executor_.store(executor, std::memory_order_release);
+  }
+  // Connections to the --proxy upstreams, owned by the reactor
+  static void SetUpstreams(UpstreamPool* pool) {
+    upstreams_.store(pool, std::memory_order_release);
+  }
+
+  // Human-readable estimate of memory held by idle connections
+  static auto MemoryReport(size_t conn_count) -> std::string;
 
  private:
   // Process the read operation
   auto ProcessRead() -> HTTP_CODE;
   auto ParseRequest(char*) -> HTTP_CODE;  // For request line
   auto ParseHeader(char*) -> HTTP_CODE;   // For headers
-  auto ParseContent() -> HTTP_CODE;       // For message body
   auto ParseLine() -> LINE_STATUS;        // Find a complete line
 
+  // PUT/POST bodies (io lane). The body is not read by Read(): it stays in
+  // the socket until ReceiveBody() splices it into the upload file.
+  // Hop to the io lane and continue the body, or answer it once complete
+  void ProcessUpload();
+  // Check the target and open the file on the first call, then store what
+  // has arrived. NO_REQUEST while more is expected, UPLOAD_REQUEST once
+  // stored, or the error to answer.
+  auto ReceiveBody() -> HTTP_CODE;
+  auto StartUpload() -> HTTP_CODE;
+
+  // Set up the exchange after ProcessRead() returned PROXY_REQUEST,
+  // answering 100-continue first; false if no upstream can be asked
+  auto StartProxy() -> bool;
+  // Pump the exchange and arm what it waits for. kDone once the response
+  // was relayed, or with req_->proxy reset when a 502 is to be sent.
+  auto ProxyStep() -> IoStatus;
+  // Put what the exchange read past its request back into read_buf, where
+  // FinishResponse() finds it; false if it does not fit
+  auto KeepPipelined() -> bool;
+
+  // Mark a complete request as parsed (trace stamp and probe)
+  void Parsed(HTTP_CODE read_ret);
+  // Build the response for a parsed request and arm EPOLLOUT
+  void Respond(HTTP_CODE read_ret);
+  // Fill write_buf / file_fd for read_ret; write_idx is -1 on failure
+  void BuildResponse(HTTP_CODE read_ret);
+  // Whether building the response for read_ret may block on the filesystem
+  static auto NeedsFilesystem(HTTP_CODE read_ret) -> bool;
+
+  // HTTP/2 (h2c). The session lives in req_, which stays attached for the
+  // rest of the connection. Each stream's response is built by the HTTP/1.1
+  // builders on a borrowed RequestState and converted to HEADERS and DATA.
+  // Switch the connection over after ProcessRead() returned H2_REQUEST;
+  // false if the upgrade's HTTP2-Settings header is invalid
+  auto StartH2() -> bool;
+  // Feed read_buf to the session, answer complete requests, re-arm
+  void ProcessH2();
+  // Pass read_buf to the session; whether answering the requests that
+  // completed may block on the filesystem
+  auto FeedH2() -> bool;
+  void RespondH2();
+  // Write session output until the socket is full or nothing is left
+  auto SendH2() -> IoStatus;
+  // Readiness the session is waiting for
+  auto H2Interest() const -> NetEvent;
+  // Metrics and access log for one completed stream
+  void RecordH2Stream(const H2StreamStats& stats);
+
   // Process the write operation
   auto ProcessWrite(HTTP_CODE ret) -> bool;
   auto WriteInternalError() -> bool;
@@ -98,41 +231,142 @@ class HttpConn {
   auto WriteNoResource() -> bool;
   auto WriteGetRequest() -> bool;
   auto WriteServerError() -> bool;
+  auto WriteUploadResponse() -> bool;
+  auto WriteLengthRequired() -> bool;
+  auto WritePayloadTooLarge() -> bool;
+  auto WriteBadGateway() -> bool;
   auto AddResponse(std::string_view text)
       -> bool;  // Add response to write buffer
 
+  // One SSL_do_handshake attempt; updates tls_state_
+  auto HandshakeStep() -> IoStatus;
+  // Send as much of the response as the socket takes, without re-arming
+  auto SendResponse() -> IoStatus;
+  // Log the completed response and reset for the next request. Returns
+  // false when the connection should close instead.
+  auto FinishResponse() -> bool;
+  // After FinishResponse(): parse a pipelined request already in read_buf,
+  // or wait for the next one
+  void NextRequest();
+
+  // Coroutine mode handler and its awaitables
+  class ReadyAwaiter;
+  class LaneAwaiter;
+  friend struct ConnCoroutine::promise_type;
+  // Microbenchmarks call the response builders directly
+  friend struct HttpConnBenchPeer;
+  auto Serve() -> ConnCoroutine;
+  // Suspend until the socket is readable / writable; always resumed on the
+  // reactor thread
+  auto Ready(NetEvent ev) -> ReadyAwaiter;
+  // Continue on a worker of lane; yields true if the handler moved there,
+  // false if the lane was full and it kept running on the current thread
+  auto OnLane(Lane lane) -> LaneAwaiter;
+
+  // Socket I/O through the TLS session when present. Mirrors recv/send:
+  // returns -1 with errno EAGAIN when the session wants more I/O. more
+  // holds a partial packet back for the data that follows (MSG_MORE).
+  auto RecvSome(char* buf, size_t len) -> ssize_t;
+  auto SendSome(const char* buf, size_t len, bool more = false) -> ssize_t;
+
+  // Count the response just completed in the metrics
+  void RecordMetrics();
+  // Queue one access log record for the response just completed
+  void RecordAccess();
+
   // Utility functions for epoll
   auto SetNonblocking(int interest_fd) -> int;
   void ModFd(int interest_fd, NetEvent ev);
 
-  int sockfd_{-1};       // socket file descriptor
-  int mux_fd_{-1};       // epoll/kqueue file descriptor
-  sockaddr_in address_;  // client address
+  // Only the fields below live for the whole connection. Buffers and parsed
+  // request data sit in req_, which is attached while a request is in flight
+  // and released once the response is written, so idle keep-alive
+  // connections stay small.
+  int sockfd_{-1};                  // socket file descriptor
+  int mux_fd_{-1};                  // epoll/kqueue file descriptor
+  uint32_t peer_ip_{0};             // client address, network byte order
+  uint16_t peer_port_{0};           // client port, network byte order
+  TlsState tls_state_{TlsState::TLS_NONE};  // TLS handshake progress
+  bool ktls_send_{false};  // kernel encrypts writes, sendfile stays zero-copy
+  SSL* ssl_{nullptr};      // TLS session, null for plain
+  RequestStatePtr req_;    // active request, null while idle
+  CoroArena* coro_{nullptr};  // handler frame in coroutine mode
+  uint64_t accept_ticks_{0};  // TraceClock at accept, until the first read
+
+  // Read by workers while the reactor may clear them: load once per use
+  static inline std::atomic<Executor*> executor_{nullptr};
+  static inline std::atomic<UpstreamPool*> upstreams_{nullptr};
+};
+
+// Per-request state, pooled and attached to an HttpConn on demand
+struct RequestState {
+  char read_buf[kReadBufferSize];  // read buffer
+  int read_idx{0};                 // index of the next byte to read
+  int checked_idx{0};              // index of the byte being analyzed
+  int start_line{0};  // start index of the current line to be parsed
+
+  char write_buf[kWriteBufferSize];  // write buffer
+  int write_idx{0};                  // index of the next byte to write
+
+  // Request-scoped strings (URL, paths, page bodies) are carved from arena
+  // and dropped together in Reset(), so a steady-state request never calls
+  // the global allocator. Declared before the strings that use it.
+  alignas(std::max_align_t) std::byte arena_buf[kRequestArenaSize];
+  std::pmr::monotonic_buffer_resource arena{arena_buf, sizeof(arena_buf),
+                                            std::pmr::new_delete_resource()};
+
+  int version{0};                 // HTTP version
+  std::pmr::string url{&arena};   // request URL
+  std::pmr::string host{&arena};  // Host header value
+  bool linger{false};  // whether to keep the connection alive
+
+  HttpConn::METHOD method{HttpConn::GET};  // request method
+  HttpConn::CHECK_STATE check_state{
+      HttpConn::CHECK_STATE_REQUESTLINE};  // main state machine current state
+  HttpConn::LINE_STATUS line_status{
+      HttpConn::LINE_OK};  // line parsing status
+
+  off_t file_size{0};        // size of file being served
+  int file_fd{-1};           // fd of file being sent via sendfile
+  int write_buf_sent{0};     // bytes sent from write_buf
+  off_t file_bytes_sent{0};  // body bytes sent after write_buf (file or
+                             // listing chunks)
+
+  // Access log fields. Timestamps are steady_clock nanoseconds, 0 = unset.
+  int64_t start_ns{0};           // first request byte read
+  int64_t first_byte_ns{0};      // first response byte sent
+  uint16_t status{0};            // response status code
+  std::string_view user_agent{};  // points into read_buf
+  RequestTrace trace{};           // phase timestamps, see request_trace.hpp
 
-  char read_buf_[kReadBufferSize];  // read buffer
-  int read_idx_{0};                 // index of the next byte to read
-  int checked_idx_{0};              // index of the byte being analyzed
-  int start_line_{0};  // start index of the current line to be parsed
+  // h2c: the upgrade request's HTTP2-Settings header (into read_buf), and
+  // the session once the connection has switched
+  bool upgrade_h2c{false};
+  std::string_view h2_settings{};
+  std::unique_ptr<H2Session> h2{};
 
-  char write_buf_[kWriteBufferSize];  // write buffer
-  int write_idx_{0};                  // index of the next byte to write
+  // --dir index page, sent after write_buf in chunks as it is read
+  std::unique_ptr<DirListing> listing{};
 
-  int version_{0};      // HTTP version
-  std::string url_{};   // request URL
-  std::string host_{};  // Host header value
-  bool linger_{false};  // whether to keep the connection alive
+  // PUT/POST body framing from the headers, and the file it goes to
+  int64_t content_length{-1};  // -1 when absent
+  bool chunked{false};
+  bool expect_continue{false};
+  std::unique_ptr<Upload> upload{};
 
-  METHOD method_;  // request method
-  CHECK_STATE check_state_{
-      CHECK_STATE_REQUESTLINE};       // main state machine current state
-  LINE_STATUS line_status_{LINE_OK};  // line parsing status
+  // --proxy: the matching route (-1 for none), then the exchange relaying
+  // the request to one of its upstreams
+  int proxy_route{-1};
+  std::unique_ptr<ProxyExchange> proxy{};
 
-  off_t file_size_{0};        // size of file being served
-  int file_fd_{-1};           // fd of file being sent via sendfile
-  int write_buf_sent_{0};     // bytes sent from write_buf_
-  off_t file_bytes_sent_{0};  // bytes sent from file via sendfile
+  // Out of line, where H2Session, DirListing, Upload and ProxyExchange are
+  // complete
+  RequestState();
+  ~RequestState();
 
-  std::filesystem::path server_working_dir_{};  // cached working dir
+  // Clear indices and strings and rewind the arena; buffers are
+  // overwritten, never zeroed
+  void Reset();
 };
 
 }  // namespace my_web_server
@@ -65,11 +65,65 @@ inline constexpr std::string_view kHeader200File =
     "Content-Type: application/octet-stream\r\n"
     "Connection: {}\r\n"
     "\r\n";
+inline constexpr std::string_view kHeader404Empty =
+    "HTTP/1.1 404 Not Found\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+// Uploads: stored as a new file, or over an existing one
+inline constexpr std::string_view kHeader201 =
+    "HTTP/1.1 201 Created\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: {}\r\n"
+    "\r\n";
+inline constexpr std::string_view kHeader204 =
+    "HTTP/1.1 204 No Content\r\n"
+    "Connection: {}\r\n"
+    "\r\n";
+inline constexpr std::string_view kHeader100Continue =
+    "HTTP/1.1 100 Continue\r\n\r\n";
+inline constexpr std::string_view kHeader411Empty =
+    "HTTP/1.1 411 Length Required\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+inline constexpr std::string_view kHeader413Empty =
+    "HTTP/1.1 413 Content Too Large\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+// Reverse proxy: no upstream answered
+inline constexpr std::string_view kHeader502 =
+    "HTTP/1.1 502 Bad Gateway\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: {}\r\n"
+    "\r\n";
+// Directory listings are sent while the directory is read
+inline constexpr std::string_view kHeader200Chunked =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Connection: {}\r\n"
+    "\r\n";
+inline constexpr std::string_view kHeaderMetrics =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: {}\r\n"
+    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+// Accepts an "Upgrade: h2c" request; HTTP/2 frames follow
+inline constexpr std::string_view kHeader101H2c =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n"
+    "\r\n";
 inline constexpr std::string_view kHtmlWrapFmt =
     "<html><body>\n{}</body></html>\n";
 inline constexpr std::string_view kPreFmt = "<pre>\n{}</pre>\n";
 inline constexpr std::string_view kDirErrorFmt =
     "[Failed to read directory: {}]\n";
 inline constexpr std::string_view kFileLinkFmt = "<a href=\"/{}\">{}</a>\n";
+inline constexpr std::string_view kListingNextFmt =
+    "<a href=\"/?{}\">next page</a>\n";
 
 }  // namespace my_web_server
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines ProxyExchange, which relays one request to an
+// upstream and its response back to the client.
+
+#pragma once
+
+#include <openssl/types.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "http/upstream_pool.hpp"
+
+namespace my_web_server {
+
+// One request/response exchange between a client connection and an
+// upstream connection from the pool. Bodies go both ways without being
+// buffered whole: spliced through the connection's pipe where both sockets
+// allow it (plain TCP, or kTLS for writes to the client), copied through a
+// 16 KiB buffer otherwise. Chunked bodies are passed on as they are; only
+// the framing is followed, to find where they end. Pump() runs on the
+// reactor thread and stops whenever a socket would block, having armed the
+// upstream connection if that is what it waits for.
+class ProxyExchange {
+ public:
+  enum class Status : uint8_t {
+    kWait,        // see wait(); call Pump() again once that is ready
+    kDone,        // the whole response was relayed
+    kBadGateway,  // no usable response, and nothing sent to the client yet
+    kClosed,      // a peer went away or broke framing mid-exchange
+  };
+  enum class Wait : uint8_t {
+    kNone,
+    kClientRead,
+    kClientWrite,
+    kUpstreamRead,
+    kUpstreamWrite
+  };
+
+  struct Client {
+    int fd{-1};
+    SSL* ssl{nullptr};       // null for plain connections
+    bool splice_in{false};   // body bytes may be spliced from fd
+    bool splice_out{false};  // and into it (plain, or kTLS sends)
+    bool keep_alive{false};  // the client asked to keep the connection
+  };
+
+  // head is the request as the upstream gets it, ending in the blank line.
+  // body_start holds whatever of the body arrived with the headers; the
+  // rest follows on the client socket, framed by content_length (-1 when
+  // absent) or chunked. head_only is set for HEAD requests.
+  ProxyExchange(UpstreamPool* pool, size_t route, const Client& client,
+                std::string head, std::string_view body_start,
+                int64_t content_length, bool chunked, bool head_only);
+  // Gives the upstream connection back, closed unless the exchange
+  // completed
+  ~ProxyExchange();
+  ProxyExchange(const ProxyExchange&) = delete;
+  auto operator=(const ProxyExchange&) -> ProxyExchange& = delete;
+  ProxyExchange(ProxyExchange&&) = delete;
+  auto operator=(ProxyExchange&&) -> ProxyExchange& = delete;
+
+  auto Pump() -> Status;
+  auto wait() const -> Wait { return wait_; }
+  // Whether the exchange waits for fd; readiness of anything else is stale
+  auto Wants(int fd) const -> bool;
+
+  // Upstream status code, once the response head arrived
+  auto status() const -> uint16_t { return status_; }
+  // Response bytes sent to the client: head, then body
+  auto head_bytes() const -> uint64_t { return head_bytes_; }
+  auto body_bytes() const -> uint64_t { return body_bytes_; }
+  // Whether the client connection can take another request afterwards
+  auto keep_alive() const -> bool { return keep_alive_; }
+  // Client bytes read past the request: the start of the next ones
+  auto pipelined() const -> std::string_view { return pipelined_; }
+  // The upstream in use, for logs
+  auto upstream() const -> std::string_view;
+
+ private:
+  enum class Stage : uint8_t {
+    kConnect,
+    kConnecting,
+    kRequestHead,
+    kRequestBody,
+    kResponseHead,
+    kResponseHeadOut,
+    kResponseBody,
+    kDone
+  };
+  // Outcome of moving one body as far as the sockets allow
+  enum class Flow : uint8_t { kDone, kWaitIn, kWaitOut, kInClosed, kOutError };
+
+  // Where a body ends. Bytes are counted, never changed.
+  class Framing {
+   public:
+    enum class Kind : uint8_t { kNone, kLength, kChunked, kUntilClose };
+
+    void Reset(Kind kind, uint64_t length = 0);
+    auto done() const -> bool { return state_ == State::kDone; }
+    auto bad() const -> bool { return state_ == State::kBad; }
+    auto until_close() const -> bool { return kind_ == Kind::kUntilClose; }
+    // Payload that can be moved without looking at it (spliced)
+    auto blind() const -> uint64_t;
+    void Skip(uint64_t n);
+    // Follow data; returns how much of it belongs to the body
+    auto Scan(const char* data, size_t len) -> size_t;
+    // The sender closed: the end of an until-close body
+    void Closed();
+
+   private:
+    enum class State : uint8_t {
+      kData,
+      kSize,
+      kDataCr,
+      kDataLf,
+      kTrailer,
+      kDone,
+      kBad
+    };
+
+    Kind kind_{Kind::kNone};
+    State state_{State::kDone};
+    uint64_t left_{0};  // of the body, or of the current chunk
+    uint64_t size_{0};  // chunk size being read
+    size_t line_{0};    // length of the framing line being read
+    bool digits_{false};
+    bool ext_{false};
+  };
+
+  // Move one body from the client to the upstream or back
+  auto Relay(bool to_client, Framing* framing) -> Flow;
+  auto Recv(bool from_client, char* buf, size_t len) -> ssize_t;
+  auto Send(bool to_client, const char* buf, size_t len, bool more)
+      -> ssize_t;
+  // Fill head_out_ and resp_body_ from the upstream's head in buf_
+  auto ParseResponseHead(std::string_view head) -> bool;
+  auto WaitFor(Wait wait) -> Status;
+  // The upstream failed before responding. True when the request goes out
+  // again (stage_ is back at kConnect); otherwise the caller answers 502.
+  auto UpstreamBroke() -> bool;
+  auto BadGateway() -> Status;
+  auto Close() -> Status;
+
+  UpstreamPool* pool_;
+  size_t route_;
+  Client client_;
+  UpstreamLease lease_{};
+  const UpstreamAddress* address_{nullptr};  // last one picked
+  Stage stage_{Stage::kConnect};
+  // A new exchange is picked up on the client socket's write readiness
+  Wait wait_{Wait::kClientWrite};
+  size_t attempts_{0};  // fresh upstreams tried
+
+  std::string request_;  // head and the body that came with it
+  size_t request_sent_{0};
+  bool replayable_;  // the whole request is in request_
+  bool head_only_;
+  Framing req_body_{};
+  Framing resp_body_{};
+
+  std::string head_out_{};  // response head as the client gets it
+  size_t head_out_sent_{0};
+  uint16_t status_{0};
+  bool upstream_reusable_{false};
+  bool keep_alive_;
+  std::string pipelined_{};
+  uint64_t head_bytes_{0};
+  uint64_t body_bytes_{0};
+
+  size_t pipe_bytes_{0};  // spliced in, not yet out
+  size_t buf_begin_{0};   // unsent bytes of buf_
+  size_t buf_end_{0};
+  char buf_[16384];
+};
+
+}  // namespace my_web_server
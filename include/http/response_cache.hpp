@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines ResponseCache, prebuilt bodies for the responses
+// that do not depend on the request.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace my_web_server {
+
+struct ServerConfig;
+
+// Built from one config snapshot and published like it, so the hot path
+// neither reads error pages from disk nor formats the --text page per
+// request. A reload rebuilds it in the background on the io lane; until
+// then the previous cache keeps serving.
+struct ResponseCache {
+  enum Page : size_t {
+    kOk = 0,         // GET without --dir: the --text page or 200.html
+    kBadRequest,     // 400.html
+    kForbidden,      // 403.html
+    kNotFound,       // 404.html
+    kInternalError,  // 500.html
+    kPageCount
+  };
+
+  // nullopt when the page could not be read; callers answer with an
+  // empty 500 as they did when reading it directly
+  std::array<std::optional<std::string>, kPageCount> pages{};
+  std::optional<std::string> text{};  // --text the kOk page was built from
+
+  static auto Build(const ServerConfig& cfg) -> std::unique_ptr<ResponseCache>;
+  // Null until the first Rebuild()
+  static auto Current() -> const ResponseCache*;
+  // Build from the current config snapshot and publish
+  static void Rebuild();
+};
+
+}  // namespace my_web_server
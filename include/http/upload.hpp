@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines Upload, the body of a PUT or POST request stored
+// in a temporary file under --dir and renamed over its target when
+// complete.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace my_web_server {
+
+// Receives one request body into a file. The connection hands it the
+// bytes it already read (with the headers, and chunk framing), and lets
+// it splice the payload straight from the socket otherwise. Runs on the
+// io lane.
+class Upload {
+ public:
+  enum class Status : uint8_t {
+    kMore,      // needs more input
+    kWantRead,  // the socket has no more data for now
+    kDone,      // the whole body is in the file, or was discarded
+    kTooLarge,  // too far over the size limit to read to the end
+    kBadBody,   // malformed chunked coding
+    kClosed,    // the peer closed before the end of the body
+    kIoError,   // the file could not be written
+  };
+
+  // A body over the limit is read on and discarded, so the 413 response
+  // is not lost to a reset, unless it exceeds the limit by more than this
+  static constexpr uint64_t kMaxDiscard = 16 * 1024 * 1024;
+
+  // length is the Content-Length, unused when chunked. A length over limit
+  // starts discarding at once; Open() is then not needed.
+  Upload(uint64_t length, bool chunked, uint64_t limit);
+  // Removes the temporary file unless Commit() succeeded
+  ~Upload();
+  Upload(const Upload&) = delete;
+  auto operator=(const Upload&) -> Upload& = delete;
+  Upload(Upload&&) = delete;
+  auto operator=(Upload&&) -> Upload& = delete;
+
+  // Create the temporary file in dir for dir/name. False with errno set.
+  auto Open(const std::filesystem::path& dir, std::string_view name) -> bool;
+
+  // Store what it can of data, which holds body bytes read into memory,
+  // and set *used. An incomplete framing line is left unused.
+  auto Consume(std::string_view data, size_t* used) -> Status;
+  // Whether payload to keep comes next, so the socket can be spliced from
+  auto can_splice() const -> bool {
+    return stage_ == Stage::kData && !discard_;
+  }
+#if defined(__linux__)
+  // Move payload from sockfd to the file through a pipe, never copying it
+  // to user space. Stops at the next framing line (kMore).
+  auto Splice(int sockfd) -> Status;
+#endif
+
+  // Rename the file over the target. False with errno set.
+  auto Commit() -> bool;
+  // Whether Commit() created the target rather than replacing it
+  auto created() const -> bool { return created_; }
+  // Whether the body went over the limit and was thrown away
+  auto too_large() const -> bool { return discard_; }
+  // Payload bytes received so far
+  auto received() const -> uint64_t { return received_; }
+
+ private:
+  enum class Stage : uint8_t { kData, kSize, kDataEnd, kTrailer, kDone };
+
+  // Handle one chunked framing line (CRLF removed)
+  auto Frame(std::string_view line) -> Status;
+  // Account for n payload bytes written to the file
+  void Advance(uint64_t n);
+  auto Write(const char* data, size_t len) -> bool;
+
+  bool chunked_;
+  bool discard_;
+  uint64_t limit_;
+  uint64_t left_;  // payload left in the body, or in the current chunk
+  uint64_t received_{0};
+  Stage stage_;
+  int fd_{-1};
+  int pipe_[2]{-1, -1};
+  std::string temp_path_{};
+  std::string target_path_{};
+  bool committed_{false};
+  bool created_{false};
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines the reverse-proxy routes (--proxy) and
+// UpstreamPool, the reactor's keep-alive connections to the upstreams.
+
+#pragma once
+
+#include <netinet/in.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace my_web_server {
+
+// One backend, an IPv4 address and port
+struct UpstreamAddress {
+  std::string text{};  // as configured, for logs
+  in_addr_t ip{0};     // network byte order
+  uint16_t port{0};    // network byte order
+
+  auto operator==(const UpstreamAddress&) const -> bool = default;
+};
+
+// Requests whose path starts with prefix go to one of upstreams
+struct ProxyRoute {
+  std::string prefix{};
+  std::vector<UpstreamAddress> upstreams{};
+
+  auto operator==(const ProxyRoute&) const -> bool = default;
+};
+
+struct ProxyOptions {
+  std::vector<ProxyRoute> routes{};  // no proxying when empty
+  size_t keepalive{16};  // idle connections kept per upstream, 0 = none
+
+  auto operator==(const ProxyOptions&) const -> bool = default;
+};
+
+// "PREFIX=HOST:PORT[,HOST:PORT...]" with IPv4 hosts; false if malformed
+auto ParseProxyRoute(std::string_view spec, ProxyRoute* out) -> bool;
+// Index of the route with the longest prefix matching target's path, or -1.
+// A prefix matches whole path segments: "/api" takes "/api" and "/api/x",
+// not "/apix".
+auto MatchProxyRoute(const ProxyOptions& options, std::string_view target)
+    -> int;
+
+// A connection lent to one request. The pipe carries spliced bodies and
+// stays with the connection, so a reused one needs no new pipe either.
+struct UpstreamLease {
+  int fd{-1};
+  int pipe[2]{-1, -1};
+  uint32_t upstream{0};  // index in the pool
+  bool reused{false};      // taken from the idle list
+  bool connecting{false};  // connect() still in progress
+};
+
+// Connections to every upstream of every route, owned by the reactor and
+// registered with its epoll instance; only the reactor thread may call in.
+// An idle connection is watched for the upstream closing it. A leased one
+// reports readiness for the client connection that holds it.
+class UpstreamPool {
+ public:
+  UpstreamPool(const ProxyOptions& options, int mux_fd);
+  ~UpstreamPool();
+  UpstreamPool(const UpstreamPool&) = delete;
+  auto operator=(const UpstreamPool&) -> UpstreamPool& = delete;
+  UpstreamPool(UpstreamPool&&) = delete;
+  auto operator=(UpstreamPool&&) -> UpstreamPool& = delete;
+
+  // Lend a connection to an upstream of route for the client on owner_fd:
+  // the least busy one that has not failed lately, round-robin among
+  // equals. Reuses an idle connection or starts connecting a new one.
+  // False when no upstream could be tried.
+  auto Acquire(size_t route, int owner_fd, UpstreamLease* lease) -> bool;
+  // Take a connection back, keeping it for reuse if reusable (a complete
+  // exchange, empty pipe) and there is room
+  void Release(UpstreamLease* lease, bool reusable);
+  // Close a connection whose upstream refused or broke it; that upstream
+  // is skipped for a while
+  void Fail(UpstreamLease* lease);
+  // Wait for the leased connection to become writable or readable
+  void Arm(const UpstreamLease& lease, bool write);
+  // Create the lease's pipe if it has none. False with errno set.
+  auto EnsurePipe(UpstreamLease* lease) -> bool;
+
+  // Whether fd is one of the pool's connections
+  auto Contains(int fd) const -> bool {
+    return fd >= 0 && static_cast<size_t>(fd) < owners_.size() &&
+           owners_[static_cast<size_t>(fd)] != kNotOurs;
+  }
+  // An event on one of the pool's connections: the client fd holding it,
+  // or -1 once an idle connection's event has been handled here
+  auto OnEvent(int fd) -> int;
+
+  auto upstream(uint32_t index) const -> const UpstreamAddress& {
+    return backends_[index].address;
+  }
+  auto route_size(size_t route) const -> size_t {
+    return routes_[route].size();
+  }
+  // Connections lent out and kept idle, over all upstreams
+  auto active() const -> size_t;
+  auto idle() const -> size_t;
+
+ private:
+  static constexpr int kNotOurs = -2;
+  static constexpr int kIdle = -1;
+
+  struct IdleConn {
+    int fd;
+    int pipe[2];
+  };
+  struct Backend {
+    UpstreamAddress address;
+    uint32_t active{0};    // leased connections
+    uint32_t failures{0};  // in a row
+    int64_t retry_ns{0};   // skipped until then after a failure
+    std::vector<IdleConn> idle{};  // most recently used last
+  };
+
+  // Pick an upstream of route, see Acquire()
+  auto Pick(size_t route) -> uint32_t;
+  auto Connect(uint32_t backend, UpstreamLease* lease) -> bool;
+  void SetOwner(int fd, int owner);
+  void Watch(int fd, uint32_t events);
+  void CloseConn(int fd, const int* pipe);
+
+  int mux_fd_;
+  size_t keepalive_;
+  std::vector<Backend> backends_;  // one per distinct address
+  std::vector<std::vector<uint32_t>> routes_;  // backend indices per route
+  std::vector<size_t> cursors_;                // round-robin start per route
+  std::vector<int> owners_;  // by fd: kNotOurs, kIdle or the client fd
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Buffered, sampled access log with one compact record per
+// completed response, separate from the diagnostic Logger.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "logger/log_file_sink.hpp"
+
+namespace my_web_server {
+
+// kCombined is the Combined Log Format followed by TTFB and duration in
+// microseconds; kJsonLines writes one JSON object per line.
+enum class AccessLogFormat { kCombined, kJsonLines };
+
+struct AccessLogOptions {
+  LogFileOptions file{};  // empty path: access log disabled
+  AccessLogFormat format{AccessLogFormat::kCombined};
+  uint32_t sample_every{1};  // keep 1 in N successful responses
+  size_t ring_capacity{4096};  // records per producing thread
+  std::chrono::milliseconds drain_interval{50};
+};
+
+constexpr size_t kAccessUrlSize = 96;
+constexpr size_t kAccessAgentSize = 64;
+
+// Filled on the hot path; copied by value into a ring slot (~256 bytes)
+struct AccessRecord {
+  int64_t timestamp_ns{0};  // request start, system_clock since epoch
+  uint32_t peer_ip{0};      // network byte order
+  uint16_t peer_port{0};    // network byte order
+  uint16_t status{0};
+  uint64_t header_bytes{0};  // sent from the write buffer
+  uint64_t body_bytes{0};    // sent with sendfile / userspace TLS
+  uint32_t ttfb_us{0};       // first byte read -> first byte sent
+  uint32_t duration_us{0};   // first byte read -> response complete
+  uint8_t method{0};         // HttpConn::METHOD
+  bool tls{false};
+  uint8_t url_len{0};
+  uint8_t agent_len{0};
+  char url[kAccessUrlSize];
+  char agent[kAccessAgentSize];
+
+  void SetUrl(std::string_view value);
+  void SetAgent(std::string_view value);
+};
+
+struct AccessLogBuffer;
+
+class AccessLog {
+ public:
+  static auto Instance() -> AccessLog&;
+
+  // Start the writer thread. Does nothing when options.file.path is empty.
+  void Start(const AccessLogOptions& options);
+  // Write out pending records and join the writer thread
+  void Stop();
+  void ReopenFiles();
+
+  auto enabled() const -> bool {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Decide whether a response with this status is recorded. Errors are
+  // always kept; successes are sampled 1 in sample_every.
+  auto ShouldRecord(uint16_t status) -> bool;
+  // Change the sampling rate of a running log (config reload)
+  void SetSampleEvery(uint32_t sample_every);
+  // Queue one record; never blocks. Dropped when the ring is full.
+  void Record(const AccessRecord& record);
+
+  auto dropped() const -> uint64_t {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  AccessLog(const AccessLog&) = delete;
+  auto operator=(const AccessLog&) -> AccessLog& = delete;
+  AccessLog(AccessLog&&) = delete;
+  auto operator=(AccessLog&&) -> AccessLog& = delete;
+
+ private:
+  AccessLog() = default;
+  ~AccessLog();
+
+  auto LocalBuffer() -> AccessLogBuffer&;
+  void WriterLoop();
+  void DrainOnce(std::string* out, std::vector<size_t>* ends);
+
+  AccessLogOptions options_{};
+  std::atomic<uint32_t> sample_every_{1};  // live copy of options_ field
+  std::atomic<bool> enabled_{false};
+  std::atomic<uint64_t> dropped_{0};
+  std::unique_ptr<LogFileSink> sink_;
+
+  std::mutex buffers_mutex_;
+  std::vector<std::shared_ptr<AccessLogBuffer>> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_{false};
+  std::thread writer_;
+};
+
+// Render one record; exposed for tests
+void AppendAccessRecord(std::string* out, const AccessRecord& record,
+                        AccessLogFormat format);
+
+}  // namespace my_web_server
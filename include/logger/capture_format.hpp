@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: On-disk format of traffic captures written by
+// TrafficCapture and read by the capture_replay tool.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace my_web_server {
+
+// A capture is a magic header and the capture's start time (system_clock
+// nanoseconds, 8 bytes little-endian), followed by events:
+//   kind (1 byte), connection id (varint), time delta (zigzag varint, ns
+//   since the previous event in the file), then per kind:
+//   kOpen:    peer address and port as stored in sockaddr_in (4 and 2
+//             bytes, little-endian), flags (1 byte, bit 0 = TLS)
+//   kData:    length (varint) and that many request bytes, as read
+//   kClose:   nothing
+//   kDropped: nothing; the connection lost bytes to a full ring and must
+//             not be replayed
+// Events are in write order, which is close to but not exactly time order
+// across threads; readers sort by timestamp (stably) before use.
+inline constexpr std::string_view kCaptureMagic = "MWSCAP1\n";
+enum class CaptureKind : uint8_t {
+  kOpen = 1,
+  kData = 2,
+  kClose = 3,
+  kDropped = 4
+};
+
+struct CaptureEvent {
+  CaptureKind kind{CaptureKind::kData};
+  uint32_t conn_id{0};
+  int64_t time_ns{0};      // since the capture started
+  uint32_t peer_ip{0};     // kOpen, network byte order
+  uint16_t peer_port{0};   // kOpen, network byte order
+  bool tls{false};         // kOpen; replays are always plain text
+  std::string data{};      // kData
+};
+
+void AppendCaptureHeader(std::string* out, int64_t start_wall_ns);
+
+// Appends events, delta-encoding each time against the previous one
+class CaptureEncoder {
+ public:
+  void Append(std::string* out, CaptureKind kind, uint32_t conn_id,
+              int64_t time_ns, std::string_view payload);
+  void AppendOpen(std::string* out, uint32_t conn_id, int64_t time_ns,
+                  uint32_t peer_ip, uint16_t peer_port, bool tls);
+
+ private:
+  int64_t last_ns_{0};
+};
+
+// Sequential reader; returns false from Next at end of file or on a
+// truncated or corrupt event (error() tells which)
+class CaptureDecoder {
+ public:
+  explicit CaptureDecoder(std::FILE* in) : in_(in) {}
+
+  auto ReadHeader() -> bool;
+  auto Next(CaptureEvent* event) -> bool;
+
+  auto start_wall_ns() const -> int64_t { return start_wall_ns_; }
+  auto error() const -> bool { return error_; }
+
+ private:
+  auto ReadVarint(uint64_t* value) -> bool;
+
+  std::FILE* in_;
+  int64_t start_wall_ns_{0};
+  int64_t last_ns_{0};
+  bool error_{false};
+};
+
+}  // namespace my_web_server
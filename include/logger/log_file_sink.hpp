@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Append-only log file with batched writev, size/time based
+// rotation and reopen-on-signal support.
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace my_web_server {
+
+struct LogFileOptions {
+  std::string path{};
+  uint64_t rotate_bytes{0};  // rotate when the file would exceed this, 0=off
+  std::chrono::seconds rotate_interval{0};  // rotate after this long, 0=off
+};
+
+// Used only by the logger backend thread, except RequestReopen().
+class LogFileSink {
+ public:
+  LogFileSink() = default;
+  ~LogFileSink();
+  LogFileSink(const LogFileSink&) = delete;
+  auto operator=(const LogFileSink&) -> LogFileSink& = delete;
+  LogFileSink(LogFileSink&&) = delete;
+  auto operator=(LogFileSink&&) -> LogFileSink& = delete;
+
+  auto Open(const LogFileOptions& options) -> bool;
+  // Write whole records (one iovec each), many per writev call. Rotation
+  // happens between records, never inside one.
+  void Write(const std::vector<iovec>& records);
+  // Ask the backend to reopen the path before its next write, e.g. after an
+  // external logrotate moved the file. Safe to call from any thread.
+  void RequestReopen() { reopen_.store(true, std::memory_order_relaxed); }
+
+ private:
+  auto OpenFile() -> bool;
+  // False if the file could not be moved or reopened; writes then go on to
+  // the current file and the next attempt waits for rotate_retry_at_
+  auto Rotate() -> bool;
+  void WriteAll(const iovec* iov, size_t count);
+
+  LogFileOptions options_{};
+  int fd_{-1};
+  uint64_t size_{0};
+  std::chrono::steady_clock::time_point opened_at_{};
+  std::chrono::steady_clock::time_point rotate_retry_at_{};
+  std::chrono::seconds rotate_backoff_{0};
+  std::atomic<bool> reopen_{false};
+};
+
+}  // namespace my_web_server
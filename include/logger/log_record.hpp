@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Compact binary log records with deferred formatting, and the
+// on-disk frame format read by the log_decoder tool.
+
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace my_web_server {
+
+constexpr size_t kBinaryPayloadSize = 112;
+
+// A log call captured as a format-string id plus raw argument bytes. Fixed
+// size (128 bytes) so it can live in a ring slot without allocation.
+struct BinaryLogRecord {
+  int64_t timestamp_ns{0};  // system_clock since epoch
+  uint32_t fmt_id{0};       // index into the format registry
+  uint16_t payload_size{0};
+  uint16_t truncated{0};  // string arguments were cut to fit
+  std::array<char, kBinaryPayloadSize> payload{};
+};
+static_assert(sizeof(BinaryLogRecord) == 128);
+
+// Static description of one deferred log call site
+struct LogFormat {
+  int level{0};
+  const char* file{""};
+  int line{0};
+  std::string_view fmt{};
+};
+
+enum class LogArgTag : uint8_t { kI64 = 1, kU64, kF64, kBool, kChar, kStr };
+
+using LogArg =
+    std::variant<int64_t, uint64_t, double, bool, char, std::string_view>;
+
+namespace detail {
+
+inline auto PutBytes(BinaryLogRecord* rec, const void* data, size_t len)
+    -> bool {
+  if (rec->payload_size + len > kBinaryPayloadSize) {
+    return false;
+  }
+  std::memcpy(rec->payload.data() + rec->payload_size, data, len);
+  rec->payload_size += static_cast<uint16_t>(len);
+  return true;
+}
+
+template <typename T>
+void PutScalar(BinaryLogRecord* rec, LogArgTag tag, T value) {
+  if (rec->payload_size + 1 + sizeof(T) > kBinaryPayloadSize) {
+    rec->truncated = 1;
+    return;
+  }
+  PutBytes(rec, &tag, 1);
+  PutBytes(rec, &value, sizeof(T));
+}
+
+inline void PutString(BinaryLogRecord* rec, std::string_view str) {
+  constexpr size_t kHeader = 1 + sizeof(uint16_t);
+  if (rec->payload_size + kHeader > kBinaryPayloadSize) {
+    rec->truncated = 1;
+    return;
+  }
+  size_t room = kBinaryPayloadSize - rec->payload_size - kHeader;
+  if (str.size() > room) {
+    str = str.substr(0, room);
+    rec->truncated = 1;
+  }
+  auto tag = LogArgTag::kStr;
+  auto len = static_cast<uint16_t>(str.size());
+  PutBytes(rec, &tag, 1);
+  PutBytes(rec, &len, sizeof(len));
+  PutBytes(rec, str.data(), str.size());
+}
+
+template <typename T>
+void PutArg(BinaryLogRecord* rec, const T& value) {
+  using U = std::remove_cvref_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    PutScalar(rec, LogArgTag::kBool, value);
+  } else if constexpr (std::is_same_v<U, char>) {
+    PutScalar(rec, LogArgTag::kChar, value);
+  } else if constexpr (std::is_enum_v<U>) {
+    using Raw = std::underlying_type_t<U>;
+    PutScalar(rec, LogArgTag::kI64,
+              static_cast<int64_t>(static_cast<Raw>(value)));
+  } else if constexpr (std::signed_integral<U>) {
+    PutScalar(rec, LogArgTag::kI64, static_cast<int64_t>(value));
+  } else if constexpr (std::unsigned_integral<U>) {
+    PutScalar(rec, LogArgTag::kU64, static_cast<uint64_t>(value));
+  } else if constexpr (std::floating_point<U>) {
+    PutScalar(rec, LogArgTag::kF64, static_cast<double>(value));
+  } else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+    PutString(rec, std::string_view(value));
+  } else {
+    static_assert(sizeof(U) == 0,
+                  "Deferred log arguments must be integers, floats, bool, "
+                  "char or strings; format others eagerly with LOG_INFO");
+  }
+}
+
+}  // namespace detail
+
+// Capture args into rec without formatting
+template <typename... Args>
+void EncodeLogArgs(BinaryLogRecord* rec, const Args&... args) {
+  rec->payload_size = 0;
+  rec->truncated = 0;
+  (detail::PutArg(rec, args), ...);
+}
+
+// Decode the payload; string views point into rec
+auto DecodeLogArgs(const BinaryLogRecord& rec) -> std::vector<LogArg>;
+
+// Substitute args into a std::format string at runtime. Supports automatic
+// field numbering and per-field format specs such as {:>8} or {:.2f}.
+auto FormatLogRecord(std::string_view fmt, const std::vector<LogArg>& args)
+    -> std::string;
+
+// On-disk binary log: a magic header followed by frames. A format frame
+// describes a call site the first time it appears; a record frame carries
+// one BinaryLogRecord and the producing thread id; a text frame carries an
+// already formatted message from the plain LOG_* macros.
+inline constexpr std::string_view kBinaryLogMagic = "MWSLOG1\n";
+enum class LogFrameKind : uint8_t { kFormat = 1, kRecord = 2, kText = 3 };
+
+void WriteFormatFrame(std::string* out, uint32_t fmt_id,
+                      const LogFormat& format);
+void WriteRecordFrame(std::string* out, size_t thread_id,
+                      const BinaryLogRecord& rec);
+void WriteTextFrame(std::string* out, size_t thread_id, int64_t timestamp_ns,
+                    int level, std::string_view message);
+
+struct DecodedFrame {
+  LogFrameKind kind{};
+  uint32_t fmt_id{0};
+  int level{0};
+  int line{0};
+  std::string file{};
+  std::string fmt{};
+  size_t thread_id{0};
+  BinaryLogRecord record{};  // kRecord; kText uses timestamp_ns only
+  std::string text{};        // kText
+};
+
+// Read the next frame; returns false at end of file or on corruption
+auto ReadFrame(std::FILE* in, DecodedFrame* frame) -> bool;
+
+}  // namespace my_web_server
@@ -15,16 +15,35 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// File overview: Thread-safe in-memory logger with INFO/WARN/ERROR levels.
+// File overview: Thread-safe in-memory logger with INFO/WARN/ERROR levels
+// and an optional asynchronous backend fed by per-thread lock-free rings.
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdio>
+#include <format>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "logger/log_file_sink.hpp"
+#include "logger/log_record.hpp"
+
+// Compile-time minimum level: 0 = INFO, 1 = WARN, 2 = ERROR. LOG_* macros
+// below it expand to nothing, so their arguments are never evaluated. Set
+// with -DLOG_MIN_LEVEL=WARN at configure time.
+#ifndef MWS_LOG_MIN_LEVEL
+#define MWS_LOG_MIN_LEVEL 0
+#endif
+
 namespace my_web_server {
 
 enum class LogLevel { kInfo, kWarn, kError };
@@ -32,20 +51,60 @@ enum class LogLevel { kInfo, kWarn, kError };
 struct LogEntry {
   std::chrono::system_clock::time_point timestamp;
   LogLevel level;
-  std::string file;
+  const char* file;  // __FILE__, static storage
   int line;
   size_t thread_id;
   std::string message;
 };
 
+// What a logging thread does when its ring is full in async mode
+enum class LogOverflowPolicy { kDrop, kBlock };
+
+struct AsyncLogOptions {
+  LogOverflowPolicy overflow{LogOverflowPolicy::kDrop};
+  size_t ring_capacity{1024};  // records per producing thread
+  std::chrono::milliseconds drain_interval{10};
+  // When set, records are appended unformatted to this file and decoded
+  // offline by the log_decoder tool instead of being written to stderr
+  std::string binary_path{};
+  // When file.path is set, text records go to a rotating file, not stderr
+  LogFileOptions file{};
+};
+
+struct ThreadLogBuffer;
+
 class Logger {
  public:
   static auto Instance() -> Logger&;
 
   void Log(LogLevel level, const char* file, int line, std::string message);
+  // Write out everything logged so far. In async mode this waits until the
+  // backend has drained the calling thread's records.
   void Flush();
 
+  // Switch to the asynchronous backend: Log() only pushes to a per-thread
+  // ring and a dedicated thread formats and writes records in batches.
+  void StartAsync(const AsyncLogOptions& options = {});
+  // Drain every ring and join the backend; Log() becomes synchronous again.
+  void StopAsync();
+  // Reopen the log file before the next batch (after external rotation)
+  void ReopenFiles();
+
+  // Deferred formatting: a call site registers its format string once and
+  // each call records only the format id and raw argument values. Use the
+  // LOG_*_FMT macros rather than calling these directly.
+  auto RegisterFormat(LogLevel level, const char* file, int line,
+                      std::string_view fmt) -> uint32_t;
+  template <typename... Args>
+  void LogDeferred(uint32_t fmt_id, std::format_string<const Args&...> fmt,
+                   const Args&... args);
+  auto Format(uint32_t fmt_id) const -> const LogFormat*;
+
   auto entries() const -> const std::vector<LogEntry>&;
+  // Records discarded because a ring was full (kDrop policy)
+  auto dropped() const -> uint64_t {
+    return dropped_.load(std::memory_order_relaxed);
+  }
 
   Logger(const Logger&) = delete;
   auto operator=(const Logger&) -> Logger& = delete;
@@ -53,25 +112,113 @@ class Logger {
   auto operator=(Logger&&) -> Logger&  = delete;
  private:
   Logger() = default;
+  ~Logger();
+
+  struct BinaryBatchEntry {
+    size_t thread_id;
+    BinaryLogRecord record;
+  };
 
   void FlushLocked();
+  auto LocalBuffer() -> ThreadLogBuffer&;
+  void PushBinary(BinaryLogRecord&& record);
+  // Format a deferred record into a text entry
+  auto ToEntry(size_t thread_id, const BinaryLogRecord& record) const
+      -> LogEntry;
+  void BackendLoop();
+  // Pop every ring into the batches; returns false when nothing was pending
+  auto DrainRings(std::vector<LogEntry>* batch,
+                  std::vector<BinaryBatchEntry>* binary_batch) -> bool;
+  void WriteBatch(std::vector<LogEntry>* batch,
+                  std::vector<BinaryBatchEntry>* binary_batch);
+  void WriteBinaryBatch(std::vector<LogEntry>* batch,
+                        std::vector<BinaryBatchEntry>* binary_batch);
 
   static constexpr size_t kFlushThreshold = 8;
+  static constexpr size_t kMaxLogFormats = 1024;
+
+  // Call-site registry: slots are written once, then published by
+  // format_count_, so readers never lock
+  std::mutex formats_mutex_;
+  std::unique_ptr<LogFormat[]> formats_{new LogFormat[kMaxLogFormats]};
+  std::atomic<uint32_t> format_count_{0};
 
   std::mutex mutex_;
   std::vector<LogEntry> entries_;
-};
 
-}  // namespace my_web_server
+  // Async backend state
+  std::atomic<bool> async_{false};
+  AsyncLogOptions options_{};
+  std::mutex buffers_mutex_;  // guards buffers_ registration only
+  std::vector<std::shared_ptr<ThreadLogBuffer>> buffers_;
+  std::mutex backend_mutex_;
+  std::condition_variable backend_cond_;
+  bool stop_backend_{false};
+  // From StartAsync() until StopAsync() has joined backend_; the thread
+  // object itself is only touched by those two
+  bool backend_running_{false};
+  uint64_t flush_requested_{0};
+  uint64_t flush_done_{0};
+  std::condition_variable flush_cond_;
+  std::thread backend_;
+  std::atomic<uint64_t> dropped_{0};
+  uint64_t dropped_reported_{0};
+  std::FILE* binary_file_{nullptr};
+  std::unique_ptr<LogFileSink> file_sink_;
+  uint32_t formats_written_{0};  // format frames already in binary_file_
+};
 
-#define LOG_INFO(msg)                                                   \
-  my_web_server::Logger::Instance().Log(my_web_server::LogLevel::kInfo, \
-                                        __FILE__, __LINE__, msg)
+template <typename... Args>
+void Logger::LogDeferred(uint32_t fmt_id,
+                         std::format_string<const Args&...> /*fmt*/,
+                         const Args&... args) {
+  // fmt is only checked at compile time; formatting happens later
+  BinaryLogRecord record;
+  record.timestamp_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  record.fmt_id = fmt_id;
+  EncodeLogArgs(&record, args...);
+  PushBinary(std::move(record));
+}
 
-#define LOG_WARN(msg)                                                   \
-  my_web_server::Logger::Instance().Log(my_web_server::LogLevel::kWarn, \
-                                        __FILE__, __LINE__, msg)
+}  // namespace my_web_server
 
-#define LOG_ERROR(msg)                                                   \
-  my_web_server::Logger::Instance().Log(my_web_server::LogLevel::kError, \
-                                        __FILE__, __LINE__, msg)
+#define MWS_LOG_TEXT(level, msg) \
+  my_web_server::Logger::Instance().Log(level, __FILE__, __LINE__, msg)
+
+// Deferred-formatting variants for hot paths: LOG_INFO_FMT("fd={}", fd).
+// The format string is validated at compile time and registered once per
+// call site; arguments must be integers, floats, bool, char or strings.
+#define MWS_LOG_DEFERRED(level, fmt, ...)                                 \
+  do {                                                                    \
+    static const uint32_t mws_log_fmt_id =                                \
+        my_web_server::Logger::Instance().RegisterFormat(level, __FILE__, \
+                                                         __LINE__, fmt);  \
+    my_web_server::Logger::Instance().LogDeferred(                        \
+        mws_log_fmt_id, fmt __VA_OPT__(, ) __VA_ARGS__);                  \
+  } while (0)
+
+#if MWS_LOG_MIN_LEVEL <= 0
+#define LOG_INFO(msg) MWS_LOG_TEXT(my_web_server::LogLevel::kInfo, msg)
+#define LOG_INFO_FMT(fmt, ...) \
+  MWS_LOG_DEFERRED(my_web_server::LogLevel::kInfo, fmt, __VA_ARGS__)
+#else
+#define LOG_INFO(msg) ((void)0)
+#define LOG_INFO_FMT(fmt, ...) ((void)0)
+#endif
+
+#if MWS_LOG_MIN_LEVEL <= 1
+#define LOG_WARN(msg) MWS_LOG_TEXT(my_web_server::LogLevel::kWarn, msg)
+#define LOG_WARN_FMT(fmt, ...) \
+  MWS_LOG_DEFERRED(my_web_server::LogLevel::kWarn, fmt, __VA_ARGS__)
+#else
+#define LOG_WARN(msg) ((void)0)
+#define LOG_WARN_FMT(fmt, ...) ((void)0)
+#endif
+
+// ERROR is the highest level and always compiled in
+#define LOG_ERROR(msg) MWS_LOG_TEXT(my_web_server::LogLevel::kError, msg)
+#define LOG_ERROR_FMT(fmt, ...) \
+  MWS_LOG_DEFERRED(my_web_server::LogLevel::kError, fmt, __VA_ARGS__)
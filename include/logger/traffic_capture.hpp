@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Optional traffic capture. Sampled connections have their
+// raw request bytes, arrival times and open/close events queued on the hot
+// path and written to a binary capture file by a background thread, for
+// replay with the capture_replay tool.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger/capture_format.hpp"
+
+namespace my_web_server {
+
+struct TrafficCaptureOptions {
+  std::string path{};          // empty: capture disabled
+  uint32_t sample_every{1};    // capture 1 in N connections
+  size_t ring_capacity{2048};  // chunks per producing thread
+  std::chrono::milliseconds drain_interval{50};
+};
+
+constexpr size_t kCaptureChunkBytes = 1008;
+
+// One queued event; reads longer than a chunk are split (~1 KiB per slot)
+struct CaptureChunk {
+  int64_t time_ns{0};  // steady_clock
+  uint32_t conn_id{0};
+  uint16_t len{0};
+  CaptureKind kind{CaptureKind::kData};
+  char data[kCaptureChunkBytes];
+};
+
+struct CaptureBuffer;
+
+class TrafficCapture {
+ public:
+  static auto Instance() -> TrafficCapture&;
+
+  // Open the file and start the writer thread. Does nothing when
+  // options.path is empty; logs and stays off when the file cannot be
+  // opened.
+  void Start(const TrafficCaptureOptions& options);
+  // Write out pending events and join the writer thread
+  void Stop();
+
+  auto enabled() const -> bool {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Change the sampling rate for connections accepted from now on
+  void SetSampleEvery(uint32_t sample_every);
+
+  // Hot-path hooks, keyed by socket descriptor. OnOpen decides whether the
+  // connection is sampled; it must run before the descriptor is handed to
+  // the reactor, and OnClose before the descriptor is closed.
+  void OnOpen(int fd, uint32_t peer_ip, uint16_t peer_port, bool tls);
+  void OnData(int fd, const char* data, size_t len);
+  void OnClose(int fd);
+
+  auto dropped() const -> uint64_t {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  TrafficCapture(const TrafficCapture&) = delete;
+  auto operator=(const TrafficCapture&) -> TrafficCapture& = delete;
+  TrafficCapture(TrafficCapture&&) = delete;
+  auto operator=(TrafficCapture&&) -> TrafficCapture& = delete;
+
+ private:
+  TrafficCapture() = default;
+  ~TrafficCapture();
+
+  auto LocalBuffer() -> CaptureBuffer&;
+  auto Push(CaptureChunk* chunk) -> bool;
+  auto ConnId(int fd) const -> uint32_t;
+  void WriterLoop();
+  void DrainOnce(std::vector<CaptureChunk>* pending);
+
+  TrafficCaptureOptions options_{};
+  std::atomic<uint32_t> sample_every_{1};
+  std::atomic<bool> enabled_{false};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint32_t> next_conn_{0};
+  int fd_{-1};
+  int64_t start_ns_{0};  // steady_clock at Start
+  CaptureEncoder encoder_;
+
+  // Connection id per descriptor, 0 when not sampled; the top bit marks a
+  // connection that lost bytes to a full ring
+  std::unique_ptr<std::atomic<uint32_t>[]> conn_ids_;
+  size_t conn_ids_size_{0};
+
+  std::mutex buffers_mutex_;
+  std::vector<std::shared_ptr<CaptureBuffer>> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_{false};
+  std::thread writer_;
+};
+
+}  // namespace my_web_server
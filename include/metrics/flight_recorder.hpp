@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines FlightRecorder, an always-on per-thread ring of
+// the most recent connection events, written out on SIGUSR1.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrics/trace_clock.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace my_web_server {
+
+enum class FlightEvent : uint16_t {
+  kAccept = 0,   // arg: 1 for TLS
+  kClose,
+  kEpollBatch,   // fd -1, arg: events returned
+  kDispatch,     // Process() queued on the cpu lane
+  kTaskStart,    // Process() started
+  kParsed,       // arg: HttpConn::HTTP_CODE
+  kResponse,     // arg: status
+  kComplete,     // response sent, arg: status
+  kEagainRead,   // woken for a read that found no data
+  kEagainWrite,  // socket send buffer full
+  kSignal,       // fd -1, arg: signal number
+  kCount
+};
+
+auto FlightEventName(FlightEvent event) -> std::string_view;
+
+struct FlightRecord {
+  uint64_t ticks{0};  // TraceClock
+  int32_t tid{0};     // writing thread
+  int32_t fd{-1};
+  FlightEvent event{FlightEvent::kAccept};
+  uint16_t arg{0};
+};
+
+// Each thread writes its own fixed-size ring and never waits; the oldest
+// events are overwritten. Every slot carries a sequence number, so a dump
+// can copy the rings while they are being written and skip any slot that
+// changed under it. Traffic never stops for a dump.
+class FlightRecorder {
+ public:
+  static constexpr size_t kDefaultEvents = 4096;
+
+  static auto Instance() -> FlightRecorder&;
+
+  // Events kept per thread, rounded up to a power of two; 0 disables
+  // recording. Call before any thread records.
+  void SetCapacity(size_t events) { capacity_ = events; }
+
+  void Record(FlightEvent event, int fd, uint32_t arg = 0) {
+    if (capacity_ == 0) {
+      return;
+    }
+    Local().Push(TraceClock::Now(), Pack(event, fd, arg));
+  }
+
+  // All threads' events, oldest first
+  auto Snapshot() const -> std::vector<FlightRecord>;
+  // Append the snapshot as text to path. Returns the number of events
+  // written, or -1 if the file could not be written.
+  auto Dump(const std::string& path) const -> int64_t;
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  auto operator=(const FlightRecorder&) -> FlightRecorder& = delete;
+  FlightRecorder(FlightRecorder&&) = delete;
+  auto operator=(FlightRecorder&&) -> FlightRecorder& = delete;
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq{0};  // event index + 1, 0 while written
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> packed{0};  // fd | event << 32 | arg << 48
+  };
+
+  class alignas(kCacheLineSize) Ring {
+   public:
+    Ring(size_t capacity, int tid);
+
+    // Single writer
+    void Push(uint64_t ticks, uint64_t packed) {
+      uint64_t head = head_.load(std::memory_order_relaxed);
+      auto& slot = slots_[head & mask_];
+      slot.seq.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.ticks.store(ticks, std::memory_order_relaxed);
+      slot.packed.store(packed, std::memory_order_relaxed);
+      slot.seq.store(head + 1, std::memory_order_release);
+      head_.store(head + 1, std::memory_order_release);
+    }
+    // Any thread; appends the events that were stable during the copy
+    void CopyTo(std::vector<FlightRecord>* out) const;
+    auto tid() const -> int { return tid_; }
+
+   private:
+    size_t mask_;
+    int tid_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> head_{0};  // events written so far
+  };
+
+  static auto Pack(FlightEvent event, int fd, uint32_t arg) -> uint64_t {
+    return static_cast<uint32_t>(fd) |
+           static_cast<uint64_t>(event) << 32 |
+           static_cast<uint64_t>(arg > UINT16_MAX ? UINT16_MAX : arg) << 48;
+  }
+
+  FlightRecorder() = default;
+  auto Local() -> Ring&;
+
+  size_t capacity_{kDefaultEvents};  // set once before threads start
+  mutable std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;  // kept after threads exit
+};
+
+}  // namespace my_web_server
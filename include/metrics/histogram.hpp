@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines LogLinearHistogram, a fixed-size HdrHistogram-style
+// recorder for latencies and sizes.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace my_web_server {
+
+// Values below 16 get exact buckets; above that every power of two is split
+// into 8 linear sub-buckets, so a recorded value is reported at most 12.5%
+// too high. 496 buckets cover the whole uint64_t range with no
+// configuration and no allocation.
+//
+// One thread records (plain load + store on relaxed atomics, no locked
+// instructions); any thread may read a Snapshot concurrently.
+class LogLinearHistogram {
+ public:
+  static constexpr size_t kLinearBuckets = 16;
+  static constexpr size_t kSubBuckets = 8;
+  static constexpr size_t kBucketCount =
+      kLinearBuckets + (64 - 4) * kSubBuckets;
+
+  static constexpr auto BucketIndex(uint64_t value) -> size_t {
+    if (value < kLinearBuckets) {
+      return static_cast<size_t>(value);
+    }
+    auto msb = static_cast<size_t>(std::bit_width(value)) - 1;  // >= 4
+    size_t shift = msb - 3;
+    size_t sub = static_cast<size_t>(value >> shift) - kSubBuckets;
+    return kLinearBuckets + (msb - 4) * kSubBuckets + sub;
+  }
+  // Largest value that lands in bucket index
+  static constexpr auto BucketUpper(size_t index) -> uint64_t {
+    if (index < kLinearBuckets) {
+      return index;
+    }
+    size_t msb = (index - kLinearBuckets) / kSubBuckets + 4;
+    size_t sub = (index - kLinearBuckets) % kSubBuckets + kSubBuckets;
+    size_t shift = msb - 3;
+    return ((static_cast<uint64_t>(sub) + 1) << shift) - 1;
+  }
+
+  struct Snapshot {
+    std::array<uint64_t, kBucketCount> counts{};
+    uint64_t count{0};
+    uint64_t sum{0};
+
+    void Merge(const Snapshot& other) {
+      for (size_t i = 0; i < kBucketCount; ++i) {
+        counts[i] += other.counts[i];
+      }
+      count += other.count;
+      sum += other.sum;
+    }
+    // Recorded values <= value, counting whole buckets only
+    auto CountAtMost(uint64_t value) const -> uint64_t {
+      uint64_t total = 0;
+      for (size_t i = 0; i < kBucketCount && BucketUpper(i) <= value; ++i) {
+        total += counts[i];
+      }
+      return total;
+    }
+    // Upper edge of the bucket holding quantile q (0..1); 0 when empty
+    auto Quantile(double q) const -> uint64_t {
+      if (count == 0) {
+        return 0;
+      }
+      auto rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+      uint64_t seen = 0;
+      for (size_t i = 0; i < kBucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+          return BucketUpper(i);
+        }
+      }
+      return BucketUpper(kBucketCount - 1);
+    }
+  };
+
+  void Record(uint64_t value) {
+    Bump(&counts_[BucketIndex(value)], 1);
+    Bump(&count_, 1);
+    Bump(&sum_, value);
+  }
+
+  void AddTo(Snapshot* out) const {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      out->counts[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+    out->count += count_.load(std::memory_order_relaxed);
+    out->sum += sum_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static void Bump(std::atomic<uint64_t>* cell, uint64_t delta) {
+    cell->store(cell->load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+};
+
+static_assert(LogLinearHistogram::BucketIndex(~uint64_t{0}) ==
+              LogLinearHistogram::kBucketCount - 1);
+static_assert(LogLinearHistogram::BucketUpper(
+                  LogLinearHistogram::BucketIndex(1000)) >= 1000);
+
+}  // namespace my_web_server
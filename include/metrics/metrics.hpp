@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines Metrics, per-thread counters and histograms
+// aggregated on read and exported in the Prometheus text format.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrics/histogram.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace my_web_server {
+
+enum class Counter : uint8_t {
+  kConnectionsAccepted = 0,
+  kConnectionsRefused,  // over --max-conn
+  kTlsHandshakes,
+  kTlsHandshakeFailures,
+  kH2Connections,  // prior knowledge or upgrade
+  kH2Streams,      // HTTP/2 responses sent
+  kStatus200,
+  kStatus400,
+  kStatus403,
+  kStatus404,
+  kStatus500,
+  kStatusOther,
+  kResponseBytes,  // headers and body
+  kUploadBytes,    // PUT/POST body bytes received
+  kProxyRequests,     // requests sent to an upstream (--proxy)
+  kUpstreamConnects,  // new upstream connections attempted
+  kUpstreamFailures,  // upstream connections refused or broken
+  kCount
+};
+
+enum class Histogram : uint8_t {
+  kRequestDuration = 0,  // ns, first request byte to last response byte
+  kResponseSize,         // bytes
+  kPhaseAccept,          // ns per TracePhase, in the same order
+  kPhaseRead,
+  kPhaseQueue,
+  kPhaseParse,
+  kPhaseRespond,
+  kPhaseSendWait,
+  kPhaseSend,
+  kCount
+};
+
+// Every thread that records gets its own cache-line-aligned shard, so hot
+// paths never share a written line and never use a locked instruction.
+// Reads walk all shards and add them up; shards of exited threads are kept,
+// so totals never go backwards.
+class Metrics {
+ public:
+  static auto Instance() -> Metrics&;
+
+  void Add(Counter counter, uint64_t delta = 1) {
+    auto& cell = Local().counters[static_cast<size_t>(counter)];
+    cell.store(cell.load(std::memory_order_relaxed) + delta,
+               std::memory_order_relaxed);
+  }
+  void Observe(Histogram histogram, uint64_t value) {
+    Local().histograms[static_cast<size_t>(histogram)].Record(value);
+  }
+  // Counter for a response status code
+  static auto StatusCounter(uint16_t status) -> Counter;
+
+  auto Read(Counter counter) const -> uint64_t;
+  auto Read(Histogram histogram) const -> LogLinearHistogram::Snapshot;
+
+  // Append the counters and histograms above in Prometheus text format
+  void Render(std::string* out) const;
+
+  Metrics(const Metrics&) = delete;
+  auto operator=(const Metrics&) -> Metrics& = delete;
+  Metrics(Metrics&&) = delete;
+  auto operator=(Metrics&&) -> Metrics& = delete;
+
+ private:
+  struct alignas(kCacheLineSize) Shard {
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::kCount)>
+        counters{};
+    std::array<LogLinearHistogram, static_cast<size_t>(Histogram::kCount)>
+        histograms{};
+  };
+
+  Metrics() = default;
+  auto Local() -> Shard&;
+
+  mutable std::mutex shards_mutex_;
+  std::vector<std::shared_ptr<Shard>> shards_;
+};
+
+// Prometheus text format helpers, also used for values owned elsewhere
+// (connection count, lane queues). Names get the "mws_" prefix; labels are
+// given preformatted, e.g. R"(lane="cpu")".
+void AppendMetricHeader(std::string* out, std::string_view name,
+                        std::string_view type, std::string_view help);
+void AppendSample(std::string* out, std::string_view name,
+                  std::string_view labels, double value);
+// Cumulative _bucket series at the given upper bounds plus _sum and
+// _count. Values are multiplied by scale (e.g. 1e-9 for ns -> seconds);
+// bucket edges are the histogram's own, so counts are exact only at them.
+void AppendHistogram(std::string* out, std::string_view name,
+                     std::string_view labels,
+                     const LogLinearHistogram::Snapshot& snapshot,
+                     double scale, std::span<const double> bounds);
+// Upper bounds used for latencies (seconds) and sizes (bytes)
+auto LatencyBounds() -> std::span<const double>;
+auto SizeBounds() -> std::span<const double>;
+
+}  // namespace my_web_server
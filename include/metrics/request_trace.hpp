@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines RequestTrace, per-request phase timestamps, and
+// SlowTraceLog, which feeds phase histograms and keeps the slowest traces.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrics/trace_clock.hpp"
+
+namespace my_web_server {
+
+// In request order. Phase i runs from point i to point i + 1.
+enum class TracePoint : uint8_t {
+  kAccept = 0,     // connection accepted (first request only)
+  kFirstRead,      // first request bytes read
+  kEnqueue,        // Process() queued on the cpu lane
+  kTaskStart,      // Process() started
+  kParseDone,      // request parsed
+  kResponseReady,  // headers built, file opened
+  kFirstSend,      // first response bytes sent
+  kComplete,       // last response byte sent
+  kCount
+};
+
+enum class TracePhase : uint8_t {
+  kAccept = 0,  // waiting for the client (and the TLS handshake)
+  kRead,        // rest of the request, until it is queued
+  kQueue,       // waiting in the cpu lane
+  kParse,
+  kRespond,     // io lane hop, filesystem work, building headers
+  kSendWait,    // waiting for EPOLLOUT
+  kSend,        // first to last response byte
+  kCount
+};
+
+constexpr size_t kTracePointCount = static_cast<size_t>(TracePoint::kCount);
+constexpr size_t kTracePhaseCount = static_cast<size_t>(TracePhase::kCount);
+
+auto TracePhaseName(TracePhase phase) -> std::string_view;
+
+// TraceClock ticks per point, 0 when the request did not pass it (keep-alive
+// requests have no accept). Coroutine mode parses inline, so its enqueue and
+// task start coincide.
+struct RequestTrace {
+  std::array<uint64_t, kTracePointCount> ticks{};
+
+  void Stamp(TracePoint point) {
+    ticks[static_cast<size_t>(point)] = TraceClock::Now();
+  }
+  void Clear() { ticks.fill(0); }
+};
+
+struct SlowTrace {
+  static constexpr size_t kUrlSize = 64;
+
+  int64_t wall_ns{0};   // completion, system clock
+  uint64_t total_ns{0};  // first stamp to completion
+  // 0 for phases the request did not go through
+  std::array<uint64_t, kTracePhaseCount> phase_ns{};
+  uint16_t status{0};
+  uint8_t url_len{0};
+  char url[kUrlSize]{};
+};
+
+// Each completed request reports its phases into the Metrics histograms
+// and offers itself to a fixed set of slots holding the slowest requests
+// seen so far. Requests faster than the fastest slot (the common case once
+// the slots are full) are rejected with one relaxed load, without locking.
+class SlowTraceLog {
+ public:
+  static constexpr size_t kSlots = 32;
+
+  static auto Instance() -> SlowTraceLog&;
+
+  void Finish(const RequestTrace& trace, uint16_t status,
+              std::string_view url);
+  // Slowest first
+  auto Slowest() const -> std::vector<SlowTrace>;
+  // One line per kept trace with its phases in microseconds
+  void Render(std::string* out) const;
+
+  SlowTraceLog(const SlowTraceLog&) = delete;
+  auto operator=(const SlowTraceLog&) -> SlowTraceLog& = delete;
+  SlowTraceLog(SlowTraceLog&&) = delete;
+  auto operator=(SlowTraceLog&&) -> SlowTraceLog& = delete;
+
+ private:
+  SlowTraceLog() = default;
+  void Offer(const SlowTrace& trace);
+
+  std::atomic<uint64_t> threshold_ns_{0};  // fastest kept once full
+  mutable std::mutex mutex_;
+  std::array<SlowTrace, kSlots> slots_{};
+  size_t used_{0};
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines TraceClock, a cheap monotonic tick source for
+// request tracing: calibrated TSC where it is invariant, otherwise
+// CLOCK_MONOTONIC_RAW.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace my_web_server {
+
+class TraceClock {
+ public:
+  // Measure the TSC rate against CLOCK_MONOTONIC_RAW (about 10 ms). Call
+  // once at startup before any request is traced; until then, and on
+  // machines without an invariant TSC, ticks are nanoseconds.
+  static void Calibrate();
+
+  static auto Now() -> uint64_t {
+#if defined(__x86_64__) || defined(__i386__)
+    if (use_tsc_) {
+      return __rdtsc();
+    }
+#endif
+    timespec ts;
+    clock_gettime(kRawClock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+           static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  // Convert a tick difference to nanoseconds
+  static auto ToNs(uint64_t ticks) -> uint64_t {
+    if (!use_tsc_) {
+      return ticks;
+    }
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(ticks) * ns_per_tick_q32_) >> 32);
+  }
+
+  // "tsc 2995.1 MHz" or "CLOCK_MONOTONIC_RAW"
+  static auto Describe() -> std::string;
+
+ private:
+#if defined(CLOCK_MONOTONIC_RAW)
+  static constexpr clockid_t kRawClock = CLOCK_MONOTONIC_RAW;
+#else
+  static constexpr clockid_t kRawClock = CLOCK_MONOTONIC;
+#endif
+  // Written once by Calibrate() before worker threads start
+  static inline bool use_tsc_{false};
+  static inline uint64_t ns_per_tick_q32_{1ULL << 32};  // 32.32 fixed point
+};
+
+}  // namespace my_web_server
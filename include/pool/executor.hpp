@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines Executor, named thread pool lanes for CPU-bound and
+// blocking filesystem work.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "pool/task.hpp"
+#include "pool/thread_pool.hpp"
+
+namespace my_web_server {
+
+// kCpu parses requests and runs handshakes; kIo runs steps that may block
+// on the filesystem (open, stat, directory walks, reading error pages), so a
+// slow disk cannot stall parsing of unrelated requests.
+enum class Lane : uint8_t { kCpu = 0, kIo, kCount };
+
+struct LaneOptions {
+  size_t threads{0};         // 0: sized from the CPU topology
+  // Waiting tasks before cpu callers run work inline; soft on io, see Post
+  size_t queue_limit{4096};
+  // Worker i may run on affinity[i % size()]; empty leaves threads unpinned
+  std::vector<std::vector<int>> affinity{};
+};
+
+struct ExecutorOptions {
+  LaneOptions cpu{};
+  LaneOptions io{};
+};
+
+class Executor {
+ public:
+  explicit Executor(const ExecutorOptions& options);
+  // Drains cpu before io, since cpu tasks continue on io
+  ~Executor();
+  Executor(const Executor&) = delete;
+  auto operator=(const Executor&) -> Executor& = delete;
+  Executor(Executor&&) = delete;
+  auto operator=(Executor&&) -> Executor& = delete;
+
+  // Queue task on lane. When the cpu lane is at its queue limit the task
+  // runs on the calling thread instead, which pushes back on the producer
+  // (the reactor) rather than dropping the request. io work may block on
+  // the disk, so it never runs on the caller: past its limit it still
+  // queues, and is counted as over the limit.
+  template <typename F>
+  void Post(Lane lane, F&& task);
+  // Like Post, but returns false instead of running a refused task
+  template <typename F>
+  auto TryPost(Lane lane, F&& task) -> bool;
+  // Batch form of Post for the reactor; tasks are moved from
+  void PostBatch(Lane lane, std::span<Task> tasks);
+
+  auto pool(Lane lane) -> ThreadPool& {
+    return *pools_[static_cast<size_t>(lane)];
+  }
+  auto Stats(Lane lane) const -> PoolStats {
+    return pools_[static_cast<size_t>(lane)]->Stats();
+  }
+  // Per lane: threads, depth, max depth, waits and tasks over the limit
+  auto Report() const -> std::string;
+  // Per-lane gauges, task counters and queue wait histograms in Prometheus
+  // text format
+  void AppendMetrics(std::string* out) const;
+
+  static auto LaneName(Lane lane) -> std::string_view;
+
+ private:
+  std::array<std::unique_ptr<ThreadPool>, static_cast<size_t>(Lane::kCount)>
+      pools_;
+};
+
+template <typename F>
+void Executor::Post(Lane lane, F&& task) {
+  // A refused task is left untouched, so it can still run here
+  if (!TryPost(lane, std::forward<F>(task))) {
+    task();
+  }
+}
+
+template <typename F>
+auto Executor::TryPost(Lane lane, F&& task) -> bool {
+  if (pool(lane).TryAddTask(std::forward<F>(task))) {
+    return true;
+  }
+  if (lane == Lane::kIo) {
+    pool(lane).AddTask(std::forward<F>(task));
+    return true;
+  }
+  return false;
+}
+
+}  // namespace my_web_server
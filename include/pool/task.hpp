@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Move-only type-erased task with inline capture storage.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace my_web_server {
+
+// Replacement for std::function<void()> on the submit path. Callables up to
+// kInlineSize bytes (a shared_ptr capture is 16) are stored in place, so
+// submitting one never allocates; larger ones fall back to the heap. Being
+// move-only it also accepts lambdas capturing unique_ptr.
+class Task {
+ public:
+  // Sized so a queued task (Task plus a link pointer) fits one cache line
+  static constexpr size_t kInlineSize = 40;
+
+  Task() = default;
+
+  template <typename F>
+    requires(!std::is_same_v<std::decay_t<F>, Task> &&
+             std::is_invocable_r_v<void, std::decay_t<F>&>)
+  Task(F&& fn) {  // NOLINT(google-explicit-constructor): like std::function
+    using Fn = std::decay_t<F>;
+    if constexpr (kStoredInline<Fn>) {
+      new (storage_) Fn(std::forward<F>(fn));
+      ops_ = &kInlineOps<Fn>;
+    } else {
+      *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(fn));
+      ops_ = &kHeapOps<Fn>;
+    }
+  }
+
+  Task(Task&& other) noexcept { MoveFrom(other); }
+  auto operator=(Task&& other) noexcept -> Task& {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  auto operator=(const Task&) -> Task& = delete;
+  ~Task() { Reset(); }
+
+  void operator()() { ops_->invoke(storage_); }
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  void Reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* storage);
+    // Move-construct into dst and destroy src
+    void (*relocate)(void* dst, void* src);
+    void (*destroy)(void* storage);
+  };
+
+  template <typename Fn>
+  static constexpr bool kStoredInline =
+      sizeof(Fn) <= kInlineSize &&
+      alignof(Fn) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<Fn>;
+
+  template <typename Fn>
+  static constexpr Ops kInlineOps = {
+      [](void* storage) { (*std::launder(static_cast<Fn*>(storage)))(); },
+      [](void* dst, void* src) {
+        auto* from = std::launder(static_cast<Fn*>(src));
+        new (dst) Fn(std::move(*from));
+        from->~Fn();
+      },
+      [](void* storage) { std::launder(static_cast<Fn*>(storage))->~Fn(); }};
+
+  template <typename Fn>
+  static constexpr Ops kHeapOps = {
+      [](void* storage) { (**static_cast<Fn**>(storage))(); },
+      [](void* dst, void* src) {
+        *static_cast<Fn**>(dst) = *static_cast<Fn**>(src);
+      },
+      [](void* storage) { delete *static_cast<Fn**>(storage); }};
+
+  void MoveFrom(Task& other) {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_{nullptr};
+};
+
+}  // namespace my_web_server
@@ -15,24 +15,53 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// File overview: Defines ThreadPool for running tasks on worker threads.
+// File overview: Defines ThreadPool, a work-stealing pool of worker threads.
 
 #pragma once
 
-#include <condition_variable>
+#include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
-#include <queue>
+#include <span>
 #include <stdexcept>
 #include <thread>
 #include <vector>
 
+#include "metrics/histogram.hpp"
+#include "pool/task.hpp"
+#include "utils/chase_lev_deque.hpp"
+#include "utils/event_count.hpp"
+#include "utils/spsc_ring.hpp"
+
 namespace my_web_server {
 
+// Each worker owns a Chase-Lev deque. Tasks submitted from outside the pool
+// (the reactor) go round-robin to a worker's lock-free inbox; tasks
+// submitted by a task go to the running worker's own deque. Idle workers
+// first drain their inbox, then steal from other workers' deques and
+// inboxes, and finally park on an eventcount that wakes one worker per
+// submitted task. Queue nodes come from per-thread free lists, so a steady
+// stream of submissions does not touch the heap.
+// Counters are cumulative since construction, except the queue depths.
+struct PoolStats {
+  uint64_t submitted{0};  // accepted by AddTask / TryAddTask / AddTasks
+  uint64_t rejected{0};   // refused by TryAddTask(s) at the queue limit
+  uint64_t started{0};
+  int64_t queued{0};      // submitted but not started yet
+  int64_t max_queued{0};
+  uint64_t wait_ns_total{0};  // submit -> start, summed over started tasks
+  uint64_t max_wait_ns{0};
+};
+
 class ThreadPool {
  public:
-  explicit ThreadPool(size_t thread_num = 8);
+  // Runs on each worker thread before it takes tasks, e.g. to pin it
+  using ThreadInit = std::function<void(size_t worker_index)>;
+
+  // queue_limit bounds TryAddTask(s); 0 means unbounded
+  explicit ThreadPool(size_t thread_num = 8, size_t queue_limit = 0,
+                      ThreadInit thread_init = {});
+  // Runs every task already submitted, then joins the workers
   ~ThreadPool();
   ThreadPool(const ThreadPool&) = delete;
   auto operator=(const ThreadPool&) -> ThreadPool& = delete;
@@ -41,29 +70,87 @@ class ThreadPool {
 
   template <typename F>
   void AddTask(F&& task);
+  // Submit many tasks with one inbox CAS and at most one wakeup; woken
+  // workers spread the rest by stealing. The tasks are moved from.
+  void AddTasks(std::span<Task> tasks);
+  // Like AddTask / AddTasks but refuse work once queue_limit tasks are
+  // waiting. TryAddTasks accepts a prefix and returns its length; the
+  // remaining tasks are left untouched for the caller.
+  template <typename F>
+  auto TryAddTask(F&& task) -> bool;
+  auto TryAddTasks(std::span<Task> tasks) -> size_t;
+
+  auto thread_num() const -> size_t { return workers_.size(); }
+  auto queue_limit() const -> size_t {
+    return queue_limit_.load(std::memory_order_relaxed);
+  }
+  // Takes effect for the next submission; tasks already queued stay
+  void SetQueueLimit(size_t queue_limit) {
+    queue_limit_.store(queue_limit, std::memory_order_relaxed);
+  }
+  auto Stats() const -> PoolStats;
+  // Distribution of submit -> start waits, in ns
+  auto WaitHistogram() const -> LogLinearHistogram::Snapshot;
 
  private:
-  struct Pool {
-    std::mutex mtx;
-    std::condition_variable cond;
-    bool is_closed = false;
-    size_t thread_num = 0;
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+  struct TaskNode;
+
+  struct alignas(kCacheLineSize) Worker {
+    ChaseLevDeque<TaskNode*> deque;
+    // Treiber stack of external submissions. Push is a CAS; consumers take
+    // the whole list with one exchange, so there is no ABA problem.
+    alignas(kCacheLineSize) std::atomic<TaskNode*> inbox{nullptr};
+    std::thread thread;
+    // Written only by the owning worker, read by Stats()
+    alignas(kCacheLineSize) std::atomic<uint64_t> started{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> max_wait_ns{0};
+    LogLinearHistogram wait_histogram;
   };
 
-  std::shared_ptr<Pool> pool_;
+  // Callers check CheckOpen() before Admit(), so a refused task is never
+  // counted as queued
+  void Submit(Task&& task);
+  // Account for count new tasks and return how many may be queued. Bounded
+  // admission stops at queue_limit_; the limit is approximate under races.
+  auto Admit(size_t count, bool bounded) -> size_t;
+  void RunNode(TaskNode* node, Worker& worker);
+  void Enqueue(std::span<Task> tasks);
+  // Push a linked chain of nodes onto one worker's inbox
+  void PushInbox(TaskNode* first, TaskNode* last);
+  // Throws once the pool is closed, except for tasks adding follow-up work
+  void CheckOpen() const;
+  void WorkerLoop(size_t index);
+  auto FindTask(size_t index) -> TaskNode*;
+  // Move a whole inbox into worker index's deque; returns one task to run
+  auto TakeInbox(Worker& from, size_t index) -> TaskNode*;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  EventCount idle_;
+  std::atomic<size_t> queue_limit_;
+  alignas(kCacheLineSize) std::atomic<size_t> next_worker_{0};
+  std::atomic<bool> closed_{false};
+  // Depth bookkeeping: incremented on submit, decremented on start
+  alignas(kCacheLineSize) std::atomic<int64_t> queued_{0};
+  std::atomic<int64_t> max_queued_{0};
+  std::atomic<uint64_t> rejected_{0};
 };
 
 template <typename F>
 void ThreadPool::AddTask(F&& task) {
-  std::unique_lock<std::mutex> lock(pool_->mtx);
-  if (pool_->is_closed) {
-    throw std::runtime_error("ThreadPool is closed. Cannot add new task.");
+  CheckOpen();
+  Admit(1, false);
+  Submit(Task(std::forward<F>(task)));
+}
+
+template <typename F>
+auto ThreadPool::TryAddTask(F&& task) -> bool {
+  CheckOpen();
+  if (Admit(1, true) == 0) {
+    return false;
   }
-  pool_->tasks.emplace(std::forward<F>(task));
-  lock.unlock();
-  pool_->cond.notify_one();
+  Submit(Task(std::forward<F>(task)));
+  return true;
 }
 
 }  // namespace my_web_server
@@ -21,21 +21,29 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "config/global_config.hpp"
 #include "http/http_conn.hpp"
+#include "pool/task.hpp"
 
 namespace my_web_server {
 
 constexpr int kMaxEvents = 10000;
-constexpr int kDefaultMaxConns = 1000;
+constexpr size_t kMaxAdminConns = 16;      // concurrent metrics scrapes
+constexpr size_t kMaxAdminRequest = 8192;  // bytes of request headers
 
-class ThreadPool;
+class Executor;
+class TlsContext;
+class UpstreamPool;
 
 class WebServer {
  public:
-  WebServer(const char* ip, int port, std::size_t max_conn = kDefaultMaxConns,
-            std::size_t thread_num = 8);
+  // Lane sizes and thread placement come from GlobalConfig
+  WebServer(const char* ip, int port, std::size_t max_conn = kDefaultMaxConns);
   ~WebServer();
   WebServer(const WebServer&) = delete;
   auto operator=(const WebServer&) -> WebServer& = delete;
@@ -50,9 +58,46 @@ class WebServer {
   auto SetNonblocking(int interest_fd) -> int;
   void AddFd(int interest_fd, bool one_shot);
   void RemoveFd(int interest_fd);
+  // Drop a client connection and close its socket
+  void CloseConn(int sockfd);
+  // The live connection on sockfd, or null when there is none (closed
+  // earlier in the same event batch)
+  auto FindConn(int sockfd) const -> std::shared_ptr<HttpConn>;
 
   void StartListening();
+  void BindAndListen(int interest_fd, int port);
+  // Accept every pending connection on a listener (ET mode)
+  void AcceptConnections(int interest_fd, const TlsContext* tls);
   void SetupSignalHandling();
+  // Pin the calling (reactor) thread according to the placement plan
+  void PinReactor();
+  // Drain the self-pipe and act on each signal received
+  void HandleSignals();
+  // SIGHUP: publish a new config snapshot and apply its live settings
+  void ReloadConfig();
+  // SIGUSR1: append the flight recorder rings to the configured file
+  void DumpFlightRecorder();
+
+  // Hand the tasks collected during one event batch to the cpu lane at once
+  void FlushTasks();
+
+  // Readiness of a --proxy upstream connection: continue the client
+  // connection holding it, if that is what its exchange waits for
+  void HandleUpstream(int upstream_fd);
+
+  // Metrics endpoint (--metrics-port). Scrapes are answered on the reactor
+  // thread, so they never queue behind client work in the lanes.
+  struct AdminConn {
+    std::string request{};
+    std::string response{};  // empty until the request is complete
+    size_t sent{0};
+  };
+  void AcceptAdmin();
+  void HandleAdmin(int interest_fd, bool hangup);
+  void CloseAdmin(int interest_fd);
+  auto BuildAdminResponse(std::string_view request) const -> std::string;
+  // Wait for writability instead of readability on a registered socket
+  void ArmWrite(int interest_fd);
 
   void CleanUp();
 
@@ -60,12 +105,20 @@ class WebServer {
   char* ip_;              // Server IP address
   int port_;              // Server port
   std::size_t max_conn_;  // Maximum number of connections
+  bool coroutines_{false};  // readiness resumes each connection's handler
 
   int listen_fd_;         // Listening socket file descriptor
+  int tls_listen_fd_{-1};  // TLS listening socket, -1 when TLS is disabled
+  int metrics_listen_fd_{-1};  // admin socket, -1 without --metrics-port
   int mux_fd_;            // epoll/kqueue file descriptor
   std::unordered_map<int, std::shared_ptr<HttpConn>>
       users_;  // Map of active HTTP connections
-  std::unique_ptr<ThreadPool> thread_pool_;
+  std::unordered_map<int, AdminConn> admin_conns_;  // metrics scrapes
+  std::unique_ptr<Executor> executor_;
+  std::vector<Task> pending_tasks_;  // reactor thread only
+  std::vector<int> reactor_cpus_;    // empty: reactor is not pinned
+  std::unique_ptr<TlsContext> tls_ctx_;
+  std::unique_ptr<UpstreamPool> upstreams_;  // null without --proxy
 };
 
 }  // namespace my_web_server
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines TlsContext, a server-side OpenSSL context that
+// prefers kernel TLS (kTLS) for the record layer.
+
+#pragma once
+
+#include <openssl/ssl.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+
+namespace my_web_server {
+
+class TlsContext {
+ public:
+  TlsContext() = default;
+  ~TlsContext();
+  TlsContext(const TlsContext&) = delete;
+  auto operator=(const TlsContext&) -> TlsContext& = delete;
+  TlsContext(TlsContext&&) = delete;
+  auto operator=(TlsContext&&) -> TlsContext& = delete;
+
+  // Load a PEM certificate chain and private key. Returns false on failure.
+  auto Init(const std::string& cert_file, const std::string& key_file) -> bool;
+  // Create a server session bound to sockfd, or nullptr on failure.
+  auto NewSession(int sockfd) const -> SSL*;
+
+ private:
+  SSL_CTX* ctx_{nullptr};
+};
+
+// Drain the OpenSSL error queue into a single printable string.
+auto TlsErrorString() -> std::string;
+
+// recv()/send() over a session on a non-blocking socket: -1 with errno
+// EAGAIN when the session waits for the socket, EIO on other errors
+auto TlsRecv(SSL* ssl, char* buf, size_t len) -> ssize_t;
+auto TlsSend(SSL* ssl, const char* buf, size_t len) -> ssize_t;
+
+}  // namespace my_web_server
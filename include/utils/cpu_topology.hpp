@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Detects the CPUs this process may run on (cores, SMT
+// siblings, NUMA nodes) and plans thread placement on them.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace my_web_server {
+
+// none:   threads float, the scheduler decides (previous behaviour)
+// numa:   reactor on one core, cpu-lane workers one per remaining core of
+//         the same NUMA node (physical cores before SMT siblings), io-lane
+//         workers free within that node
+// spread: reactor on one core, cpu-lane workers one per physical core
+//         across all allowed CPUs, io-lane workers free on all of them
+enum class PinPolicy { kNone, kNuma, kSpread };
+
+auto ParsePinPolicy(std::string_view text, PinPolicy* out) -> bool;
+auto PinPolicyName(PinPolicy policy) -> std::string_view;
+
+struct CpuInfo {
+  int cpu{0};
+  int core_id{0};     // physical core within the package
+  int package_id{0};  // socket
+  int numa_node{0};
+};
+
+// Where each thread may run; an empty CPU list means "do not pin".
+struct ThreadPlacement {
+  std::vector<int> reactor{};
+  std::vector<std::vector<int>> cpu_workers{};  // one entry per worker
+  std::vector<int> io_workers{};                // shared by all io workers
+  size_t cpu_threads{0};
+  size_t io_threads{0};
+};
+
+class CpuTopology {
+ public:
+  CpuTopology() = default;
+  // For tests and callers that already know the layout
+  explicit CpuTopology(std::vector<CpuInfo> cpus) : cpus_(std::move(cpus)) {}
+
+  // Online CPUs from /sys/devices/system/cpu filtered by sched_getaffinity.
+  // Falls back to hardware_concurrency() CPUs without topology data.
+  static auto Detect() -> CpuTopology;
+
+  auto cpus() const -> const std::vector<CpuInfo>& { return cpus_; }
+  auto NumaNodeCount() const -> size_t;
+  // Human-readable summary for the startup log
+  auto Describe() const -> std::string;
+
+  // Resolve thread counts (0 = auto) and CPU sets for a policy. Auto sizing
+  // gives the cpu lane one worker per CPU in scope minus the reactor's, and
+  // the io lane half as many (at least two).
+  auto Plan(PinPolicy policy, size_t cpu_threads, size_t io_threads) const
+      -> ThreadPlacement;
+
+ private:
+  std::vector<CpuInfo> cpus_;  // sorted by cpu number
+};
+
+// Restrict the calling thread to cpus. Returns false when unsupported
+// (macOS) or refused; an empty list is a no-op that returns true.
+auto PinCurrentThread(const std::vector<int>& cpus) -> bool;
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+auto ParseCpuList(std::string_view text) -> std::vector<int>;
+
+}  // namespace my_web_server
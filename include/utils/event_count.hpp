@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Eventcount for parking idle threads without lost wakeups.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace my_web_server {
+
+// Lets a consumer sleep until "something may have changed" without holding a
+// lock around the condition it checks. Usage on the waiting side:
+//
+//   auto key = ec.PrepareWait();
+//   if (condition()) { ec.CancelWait(); ...; }
+//   else { ec.Wait(key); }
+//
+// A producer makes the condition true and then calls NotifyOne(), which is a
+// single load when nobody is parked. Sleeping uses std::atomic::wait, a
+// futex on Linux, and wakes one waiter per notification.
+class EventCount {
+ public:
+  auto PrepareWait() -> uint32_t {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+  void CancelWait() { waiters_.fetch_sub(1, std::memory_order_seq_cst); }
+  void Wait(uint32_t key) {
+    epoch_.wait(key, std::memory_order_seq_cst);
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  void NotifyOne() {
+    // Orders the caller's publish before the waiter count check; pairs with
+    // the increment in PrepareWait()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    epoch_.notify_one();
+  }
+  void NotifyAll() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    epoch_.notify_all();
+  }
+
+ private:
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+};
+
+}  // namespace my_web_server
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Defines RcuCell, a pointer to an immutable snapshot that
+// readers load without locks and writers replace by publishing a new one.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace my_web_server {
+
+// Readers may keep a reference to a snapshot for as long as they like:
+// replaced snapshots are retired, not freed, until the cell is destroyed.
+// That is the grace period, and it is acceptable because snapshots are
+// small and only replaced on an operator's reload.
+template <typename T>
+class RcuCell {
+ public:
+  RcuCell() = default;
+  RcuCell(const RcuCell&) = delete;
+  auto operator=(const RcuCell&) -> RcuCell& = delete;
+  RcuCell(RcuCell&&) = delete;
+  auto operator=(RcuCell&&) -> RcuCell& = delete;
+
+  // Null until the first Publish()
+  auto Load() const -> const T* {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  void Publish(std::unique_ptr<const T> snapshot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_.store(snapshot.get(), std::memory_order_release);
+    snapshots_.push_back(std::move(snapshot));
+  }
+
+  auto generation() const -> size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return snapshots_.size();
+  }
+
+ private:
+  std::atomic<const T*> current_{nullptr};
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<const T>> snapshots_;  // current is last
+};
+
+}  // namespace my_web_server
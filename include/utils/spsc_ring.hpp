@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Bounded single-producer single-consumer lock-free ring.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace my_web_server {
+
+constexpr size_t kCacheLineSize = 64;
+
+// Fixed-capacity ring for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two. Head and tail live on
+// separate cache lines, and each side caches the other's index so the common
+// case touches only its own line.
+template <typename T>
+class SpscRing {
+ public:
+  explicit SpscRing(size_t capacity)
+      : mask_(RoundUpPow2(capacity) - 1),
+        slots_(std::make_unique<T[]>(mask_ + 1)) {}
+  SpscRing(const SpscRing&) = delete;
+  auto operator=(const SpscRing&) -> SpscRing& = delete;
+  SpscRing(SpscRing&&) = delete;
+  auto operator=(SpscRing&&) -> SpscRing& = delete;
+
+  // Producer side. Returns false when the ring is full.
+  auto TryPush(T&& value) -> bool {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the ring is empty.
+  auto TryPop(T* out) -> bool {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    *out = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate; exact only when called from the consumer with no producer.
+  auto Empty() const -> bool {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+  auto Capacity() const -> size_t { return mask_ + 1; }
+
+ private:
+  static constexpr auto RoundUpPow2(size_t n) -> size_t {
+    size_t pow2 = 1;
+    while (pow2 < n) {
+      pow2 <<= 1;
+    }
+    return pow2;
+  }
+
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+
+  alignas(kCacheLineSize) std::atomic<size_t> head_{0};  // consumer index
+  size_t tail_cache_{0};  // consumer's view of tail_
+  alignas(kCacheLineSize) std::atomic<size_t> tail_{0};  // producer index
+  size_t head_cache_{0};  // producer's view of head_
+};
+
+}  // namespace my_web_server
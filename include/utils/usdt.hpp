@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: USDT (systemtap SDT) probe macros. Each probe is a single
+// nop plus an ELF note describing where its arguments live, the same layout
+// <sys/sdt.h> emits, so perf, bpftrace and bcc can attach to
+// usdt:server.o:mws:<name>. Nothing runs unless a tracer patches the nop.
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Probes are compiled out (arguments unevaluated) with -DENABLE_USDT=OFF at
+// configure time, and on targets without the ELF note support below.
+#ifndef MWS_USDT_ENABLED
+#define MWS_USDT_ENABLED 1
+#endif
+
+namespace my_web_server {
+
+// Every probe argument is passed as a signed 64-bit value ("-8@")
+template <typename T>
+inline auto UsdtArg(T value) -> int64_t {
+  if constexpr (std::is_pointer_v<T>) {
+    return static_cast<int64_t>(reinterpret_cast<intptr_t>(value));
+  } else {
+    return static_cast<int64_t>(value);
+  }
+}
+
+}  // namespace my_web_server
+
+#if MWS_USDT_ENABLED && defined(__linux__) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+// The .stapsdt.base section lets tools adjust probe addresses for prelink;
+// the note records the nop address, provider, name and argument specs.
+#define MWS_USDT_ASM(name, args)                                       \
+  "990: nop\n"                                                         \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                        \
+  ".balign 4\n"                                                        \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                   \
+  "991: .asciz \"stapsdt\"\n"                                          \
+  "992: .balign 4\n"                                                   \
+  "993: .8byte 990b\n"                                                 \
+  ".8byte _.stapsdt.base\n"                                            \
+  ".8byte 0\n"                                                         \
+  ".asciz \"mws\"\n"                                                   \
+  ".asciz \"" #name "\"\n"                                             \
+  ".asciz \"" args "\"\n"                                              \
+  "994: .balign 4\n"                                                   \
+  ".popsection\n"                                                      \
+  ".ifndef _.stapsdt.base\n"                                           \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+  ".weak _.stapsdt.base\n"                                             \
+  ".hidden _.stapsdt.base\n"                                           \
+  "_.stapsdt.base: .space 1\n"                                         \
+  ".size _.stapsdt.base, 1\n"                                          \
+  ".popsection\n"                                                      \
+  ".endif\n"
+
+#define MWS_USDT_OP(x) "nor"(my_web_server::UsdtArg(x))
+
+#define MWS_USDT(name) __asm__ volatile(MWS_USDT_ASM(name, "") : :)
+#define MWS_USDT1(name, a) \
+  __asm__ volatile(MWS_USDT_ASM(name, "-8@%0") : : MWS_USDT_OP(a))
+#define MWS_USDT2(name, a, b)                                   \
+  __asm__ volatile(MWS_USDT_ASM(name, "-8@%0 -8@%1")            \
+                   :                                            \
+                   : MWS_USDT_OP(a), MWS_USDT_OP(b))
+#define MWS_USDT3(name, a, b, c)                                 \
+  __asm__ volatile(MWS_USDT_ASM(name, "-8@%0 -8@%1 -8@%2")       \
+                   :                                             \
+                   : MWS_USDT_OP(a), MWS_USDT_OP(b), MWS_USDT_OP(c))
+
+#else
+
+#define MWS_USDT(name) ((void)0)
+#define MWS_USDT1(name, a) ((void)0)
+#define MWS_USDT2(name, a, b) ((void)0)
+#define MWS_USDT3(name, a, b, c) ((void)0)
+
+#endif
@@ -19,26 +19,275 @@
 
 #include "config/global_config.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <format>
+#include <fstream>
+#include <memory>
 #include <string_view>
+#include <vector>
 
 #include "logger/logger.hpp"
 
 namespace my_web_server {
 
+namespace {
+
+auto ParsePort(std::string_view port, int* out) -> bool {
+  if (port.size() < 4 || port.size() > 5) {
+    LOG_ERROR("Port number must be between 1025 and 65535");
+    return false;
+  }
+
+  int port_number = 0;
+  for (char ch : port) {
+    if (ch < '0' || ch > '9') {
+      LOG_ERROR("Port number must be between 1025 and 65535");
+      return false;
+    }
+    port_number = port_number * 10 + (ch - '0');
+  }
+
+  if (port_number <= 1024 || port_number >= 65536) {
+    LOG_ERROR("Port number must be between 1025 and 65535");
+    return false;
+  }
+  *out = port_number;
+  return true;
+}
+
+// Non-negative integer with an optional K/M/G (binary) suffix
+auto ParseSize(std::string_view text, uint64_t* out) -> bool {
+  if (text.empty()) {
+    return false;
+  }
+  uint64_t multiplier = 1;
+  switch (text.back()) {
+    case 'K':
+    case 'k':
+      multiplier = 1ULL << 10;
+      break;
+    case 'M':
+    case 'm':
+      multiplier = 1ULL << 20;
+      break;
+    case 'G':
+    case 'g':
+      multiplier = 1ULL << 30;
+      break;
+    default:
+      break;
+  }
+  if (multiplier != 1) {
+    text.remove_suffix(1);
+  }
+  if (text.empty() || text.size() > 15) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (char ch : text) {
+    if (ch < '0' || ch > '9') {
+      return false;
+    }
+    value = value * 10 + static_cast<uint64_t>(ch - '0');
+  }
+  if (value > UINT64_MAX / multiplier) {
+    return false;  // would wrap to a small number
+  }
+  *out = value * multiplier;
+  return true;
+}
+
+auto Trim(std::string_view text) -> std::string_view {
+  constexpr std::string_view kSpace = " \t\r";
+  auto begin = text.find_first_not_of(kSpace);
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  auto end = text.find_last_not_of(kSpace);
+  return text.substr(begin, end - begin + 1);
+}
+
+// "key = value" lines, '#' starts a comment line. Keys are the command-line
+// flags without the leading dashes; the value may be double-quoted.
+// Switches take true or false. Lines become the equivalent flags so both
+// sources share one parser.
+auto ReadConfigFile(const std::string& path, std::vector<std::string>* args)
+    -> bool {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    LOG_ERROR(std::format("Cannot open config file \"{}\".", path));
+    return false;
+  }
+  std::string line;
+  for (int line_no = 1; std::getline(file, line); ++line_no) {
+    std::string_view text = Trim(line);
+    if (text.empty() || text.front() == '#') {
+      continue;
+    }
+    auto eq = text.find('=');
+    if (eq == std::string_view::npos) {
+      LOG_ERROR(std::format("{}:{}: expected \"key = value\".", path,
+                            line_no));
+      return false;
+    }
+    std::string_view key = Trim(text.substr(0, eq));
+    std::string_view value = Trim(text.substr(eq + 1));
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+      value = value.substr(1, value.size() - 2);
+    }
+    if (key.empty() || key == "config") {
+      LOG_ERROR(std::format("{}:{}: invalid key \"{}\".", path, line_no, key));
+      return false;
+    }
+    if (key == "coroutines" || key == "h2c") {
+      if (value != "true" && value != "false") {
+        LOG_ERROR(std::format("{}:{}: {} must be true or false.", path,
+                              line_no, key));
+        return false;
+      }
+      args->push_back(std::format("--{}{}", value == "true" ? "" : "no-", key));
+      continue;
+    }
+    args->push_back(std::format("--{}", key));
+    args->emplace_back(value);
+  }
+  return true;
+}
+
+// Comma-separated names of settings that differ but are only read at
+// startup (sockets, threads, log files)
+auto RestartOnlyChanges(const ServerConfig& running,
+                        const ServerConfig& loaded) -> std::string {
+  std::string names;
+  auto check = [&names](bool same, std::string_view name) {
+    if (!same) {
+      names += names.empty() ? "" : ", ";
+      names += name;
+    }
+  };
+  check(running.ip == loaded.ip, "ip");
+  check(running.port == loaded.port, "port");
+  check(running.tls_port == loaded.tls_port, "tls-port");
+  check(running.tls_cert_file == loaded.tls_cert_file, "tls-cert");
+  check(running.tls_key_file == loaded.tls_key_file, "tls-key");
+  check(running.log_overflow == loaded.log_overflow, "log-overflow");
+  check(running.log_binary_path == loaded.log_binary_path, "log-binary");
+  check(running.log_file.path == loaded.log_file.path, "log-file");
+  check(running.log_file.rotate_bytes == loaded.log_file.rotate_bytes,
+        "log-rotate-size");
+  check(running.log_file.rotate_interval == loaded.log_file.rotate_interval,
+        "log-rotate-interval");
+  check(running.access_log.file.path == loaded.access_log.file.path,
+        "access-log");
+  check(running.access_log.format == loaded.access_log.format,
+        "access-log-format");
+  check(running.capture.path == loaded.capture.path, "capture");
+  check(running.executor.cpu.threads == loaded.executor.cpu.threads,
+        "cpu-threads");
+  check(running.executor.io.threads == loaded.executor.io.threads,
+        "io-threads");
+  check(running.pin_policy == loaded.pin_policy, "pin");
+  check(running.coroutines == loaded.coroutines, "coroutines");
+  check(running.proxy == loaded.proxy, "proxy");
+  check(running.metrics_port == loaded.metrics_port, "metrics-port");
+  check(running.flight_recorder_events == loaded.flight_recorder_events,
+        "flight-recorder");
+  return names;
+}
+
+// Copy the settings a running server picks up from a reload
+void ApplyLiveSettings(const ServerConfig& loaded, ServerConfig* next) {
+  next->custom_response_text = loaded.custom_response_text;
+  next->server_working_dir = loaded.server_working_dir;
+  next->max_conn = loaded.max_conn;
+  next->executor.cpu.queue_limit = loaded.executor.cpu.queue_limit;
+  next->executor.io.queue_limit = loaded.executor.io.queue_limit;
+  next->access_log.sample_every = loaded.access_log.sample_every;
+  next->capture.sample_every = loaded.capture.sample_every;
+  next->flight_recorder_file = loaded.flight_recorder_file;
+  next->h2c = loaded.h2c;
+  next->max_upload = loaded.max_upload;
+}
+
+}  // namespace
+
 auto GlobalConfig::Instance() -> GlobalConfig& {
   static GlobalConfig instance;
   return instance;
 }
 
 auto GlobalConfig::InitFromArgs(int argc, char* argv[]) -> bool {
-  if (initialized_) {
+  if (snapshot_.Load() != nullptr) {
     return true;
   }
 
-  ServerConfig cfg;
-  for (int i = 1; i < argc; ++i) {
+  args_.assign(argv + std::min(argc, 1), argv + argc);
+  for (size_t i = 0; i < args_.size(); ++i) {
+    if (args_[i] == "--config") {
+      if (i + 1 >= args_.size()) {
+        LOG_ERROR("No config file specified.");
+        return false;
+      }
+      config_path_ = args_[i + 1];
+      args_.erase(args_.begin() + static_cast<std::ptrdiff_t>(i),
+                  args_.begin() + static_cast<std::ptrdiff_t>(i) + 2);
+      break;
+    }
+  }
+
+  auto cfg = std::make_unique<ServerConfig>();
+  if (!Load(cfg.get())) {
+    return false;
+  }
+  snapshot_.Publish(std::move(cfg));
+  return true;
+}
+
+auto GlobalConfig::Reload() -> bool {
+  if (config_path_.empty()) {
+    LOG_WARN("Reload requested, but the server was started without --config.");
+    return false;
+  }
+  ServerConfig loaded;
+  if (!Load(&loaded)) {
+    LOG_ERROR(std::format("Reload of \"{}\" failed, keeping the running "
+                          "configuration.",
+                          config_path_));
+    return false;
+  }
+  const ServerConfig& running = Get();
+  std::string restart_only = RestartOnlyChanges(running, loaded);
+  if (!restart_only.empty()) {
+    LOG_WARN(std::format("Reload ignores settings that need a restart: {}",
+                         restart_only));
+  }
+  auto next = std::make_unique<ServerConfig>(running);
+  ApplyLiveSettings(loaded, next.get());
+  snapshot_.Publish(std::move(next));
+  LOG_INFO(std::format("Configuration reloaded from \"{}\" (generation {}).",
+                       config_path_, snapshot_.generation()));
+  return true;
+}
+
+auto GlobalConfig::Load(ServerConfig* out) const -> bool {
+  // The file sets the base values, flags on the command line override it
+  std::vector<std::string> args;
+  if (!config_path_.empty() && !ReadConfigFile(config_path_, &args)) {
+    return false;
+  }
+  args.insert(args.end(), args_.begin(), args_.end());
+
+  ServerConfig& cfg = *out;
+  int argc = static_cast<int>(args.size());
+  std::vector<const char*> argv_storage;
+  argv_storage.reserve(args.size());
+  for (const auto& arg : args) {
+    argv_storage.push_back(arg.c_str());
+  }
+  const char* const* argv = argv_storage.data();
+  for (int i = 0; i < argc; ++i) {
     std::string_view para = argv[i];
     if (para == "--ip") {
       if (i + 1 >= argc) {
@@ -51,27 +300,9 @@ auto GlobalConfig::InitFromArgs(int argc, char* argv[]) -> bool {
         LOG_ERROR("No port specified.");
         return false;
       }
-
-      std::string_view port = argv[++i];
-      if (port.size() < 4 || port.size() > 5) {
-        LOG_ERROR("Port number must be between 1025 and 65535");
-        return false;
-      }
-
-      int port_number = 0;
-      for (char ch : port) {
-        if (ch < '0' || ch > '9') {
-          LOG_ERROR("Port number must be between 1025 and 65535");
-          return false;
-        }
-        port_number = port_number * 10 + (ch - '0');
-      }
-
-      if (port_number <= 1024 || port_number >= 65536) {
-        LOG_ERROR("Port number must be between 1025 and 65535");
+      if (!ParsePort(argv[++i], &cfg.port)) {
         return false;
       }
-      cfg.port = port_number;
     } else if (para == "--text") {
       if (i + 1 >= argc) {
         LOG_ERROR("No text specified.");
@@ -99,23 +330,253 @@ auto GlobalConfig::InitFromArgs(int argc, char* argv[]) -> bool {
             std::format("Invalid directory \"{}\" : {}", dir, ec.message()));
         return false;
       }
+    } else if (para == "--tls-port") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No TLS port specified.");
+        return false;
+      }
+      int tls_port = 0;
+      if (!ParsePort(argv[++i], &tls_port)) {
+        return false;
+      }
+      cfg.tls_port = tls_port;
+    } else if (para == "--tls-cert") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No TLS certificate specified.");
+        return false;
+      }
+      cfg.tls_cert_file = argv[++i];
+    } else if (para == "--tls-key") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No TLS private key specified.");
+        return false;
+      }
+      cfg.tls_key_file = argv[++i];
+    } else if (para == "--log-overflow") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No log overflow policy specified.");
+        return false;
+      }
+      std::string_view policy = argv[++i];
+      if (policy == "drop") {
+        cfg.log_overflow = LogOverflowPolicy::kDrop;
+      } else if (policy == "block") {
+        cfg.log_overflow = LogOverflowPolicy::kBlock;
+      } else {
+        LOG_ERROR("Log overflow policy must be \"drop\" or \"block\".");
+        return false;
+      }
+    } else if (para == "--log-binary") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No binary log file specified.");
+        return false;
+      }
+      cfg.log_binary_path = argv[++i];
+    } else if (para == "--log-file") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No log file specified.");
+        return false;
+      }
+      cfg.log_file.path = argv[++i];
+    } else if (para == "--log-rotate-size") {
+      if (i + 1 >= argc ||
+          !ParseSize(argv[i + 1], &cfg.log_file.rotate_bytes)) {
+        LOG_ERROR("Log rotate size must be a byte count like 64M.");
+        return false;
+      }
+      ++i;
+    } else if (para == "--log-rotate-interval") {
+      uint64_t seconds = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &seconds)) {
+        LOG_ERROR("Log rotate interval must be a number of seconds.");
+        return false;
+      }
+      cfg.log_file.rotate_interval =
+          std::chrono::seconds(static_cast<int64_t>(seconds));
+      ++i;
+    } else if (para == "--access-log") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No access log file specified.");
+        return false;
+      }
+      cfg.access_log.file.path = argv[++i];
+    } else if (para == "--access-log-format") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No access log format specified.");
+        return false;
+      }
+      std::string_view format = argv[++i];
+      if (format == "combined") {
+        cfg.access_log.format = AccessLogFormat::kCombined;
+      } else if (format == "json") {
+        cfg.access_log.format = AccessLogFormat::kJsonLines;
+      } else {
+        LOG_ERROR("Access log format must be \"combined\" or \"json\".");
+        return false;
+      }
+    } else if (para == "--access-log-sample") {
+      uint64_t every = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &every) || every == 0 ||
+          every > UINT32_MAX) {
+        LOG_ERROR("Access log sample rate must be a positive integer N "
+                  "(keep 1 in N).");
+        return false;
+      }
+      cfg.access_log.sample_every = static_cast<uint32_t>(every);
+      ++i;
+    } else if (para == "--capture") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No capture file specified.");
+        return false;
+      }
+      cfg.capture.path = argv[++i];
+    } else if (para == "--capture-sample") {
+      uint64_t every = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &every) || every == 0 ||
+          every > UINT32_MAX) {
+        LOG_ERROR("Capture sample rate must be a positive integer N "
+                  "(capture 1 in N connections).");
+        return false;
+      }
+      cfg.capture.sample_every = static_cast<uint32_t>(every);
+      ++i;
+    } else if (para == "--cpu-threads" || para == "--io-threads") {
+      uint64_t threads = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &threads) || threads == 0 ||
+          threads > 1024) {
+        LOG_ERROR(std::format("{} must be between 1 and 1024.", para));
+        return false;
+      }
+      auto& lane = para == "--cpu-threads" ? cfg.executor.cpu : cfg.executor.io;
+      lane.threads = static_cast<size_t>(threads);
+      ++i;
+    } else if (para == "--cpu-queue" || para == "--io-queue") {
+      uint64_t limit = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &limit)) {
+        LOG_ERROR(std::format("{} must be a task count, 0 for unbounded.",
+                              para));
+        return false;
+      }
+      auto& lane = para == "--cpu-queue" ? cfg.executor.cpu : cfg.executor.io;
+      lane.queue_limit = static_cast<size_t>(limit);
+      ++i;
+    } else if (para == "--max-conn") {
+      uint64_t max_conn = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &max_conn) ||
+          max_conn == 0) {
+        LOG_ERROR("--max-conn must be a positive connection count.");
+        return false;
+      }
+      cfg.max_conn = static_cast<size_t>(max_conn);
+      ++i;
+    } else if (para == "--max-upload") {
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &cfg.max_upload)) {
+        LOG_ERROR("--max-upload must be a byte count like 512M, 0 for none.");
+        return false;
+      }
+      ++i;
+    } else if (para == "--proxy") {
+      ProxyRoute route;
+      if (i + 1 >= argc || !ParseProxyRoute(argv[i + 1], &route)) {
+        LOG_ERROR("--proxy must look like /PREFIX=HOST:PORT[,HOST:PORT...] "
+                  "with IPv4 hosts.");
+        return false;
+      }
+      // A prefix given again (e.g. a flag over the config file) replaces it
+      auto& routes = cfg.proxy.routes;
+      auto it = std::find_if(routes.begin(), routes.end(),
+                             [&route](const ProxyRoute& r) {
+                               return r.prefix == route.prefix;
+                             });
+      if (it != routes.end()) {
+        *it = std::move(route);
+      } else {
+        routes.push_back(std::move(route));
+      }
+      ++i;
+    } else if (para == "--proxy-keepalive") {
+      uint64_t keepalive = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &keepalive) ||
+          keepalive > 4096) {
+        LOG_ERROR("--proxy-keepalive must be a connection count up to 4096.");
+        return false;
+      }
+      cfg.proxy.keepalive = static_cast<size_t>(keepalive);
+      ++i;
+    } else if (para == "--pin") {
+      if (i + 1 >= argc || !ParsePinPolicy(argv[i + 1], &cfg.pin_policy)) {
+        LOG_ERROR("Pin policy must be \"none\", \"numa\" or \"spread\".");
+        return false;
+      }
+      ++i;
+    } else if (para == "--metrics-port") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No metrics port specified.");
+        return false;
+      }
+      int metrics_port = 0;
+      if (!ParsePort(argv[++i], &metrics_port)) {
+        return false;
+      }
+      cfg.metrics_port = metrics_port;
+    } else if (para == "--flight-recorder") {
+      uint64_t events = 0;
+      if (i + 1 >= argc || !ParseSize(argv[i + 1], &events) ||
+          events > (1U << 20)) {
+        LOG_ERROR("--flight-recorder must be an event count up to 1048576, "
+                  "0 to disable.");
+        return false;
+      }
+      cfg.flight_recorder_events = static_cast<size_t>(events);
+      ++i;
+    } else if (para == "--flight-recorder-file") {
+      if (i + 1 >= argc) {
+        LOG_ERROR("No flight recorder file specified.");
+        return false;
+      }
+      cfg.flight_recorder_file = argv[++i];
+    } else if (para == "--coroutines") {
+      cfg.coroutines = true;
+    } else if (para == "--no-coroutines") {
+      cfg.coroutines = false;
+    } else if (para == "--h2c") {
+      cfg.h2c = true;
+    } else if (para == "--no-h2c") {
+      cfg.h2c = false;
     } else {
       LOG_ERROR(std::format("Invalid parameter: {}", argv[i]));
       return false;
     }
   }
 
-  config_ = std::move(cfg);
-  initialized_ = true;
+  if (cfg.tls_port.has_value() &&
+      (cfg.tls_cert_file.empty() || cfg.tls_key_file.empty())) {
+    LOG_ERROR("--tls-port requires both --tls-cert and --tls-key.");
+    return false;
+  }
+  if (cfg.tls_port.has_value() && cfg.tls_port.value() == cfg.port) {
+    LOG_ERROR("TLS port must differ from the plain HTTP port.");
+    return false;
+  }
+  if (cfg.metrics_port.has_value() &&
+      (cfg.metrics_port == cfg.port || cfg.metrics_port == cfg.tls_port)) {
+    LOG_ERROR("Metrics port must differ from the HTTP and TLS ports.");
+    return false;
+  }
+
+  // Both files follow the same rotation policy
+  cfg.access_log.file.rotate_bytes = cfg.log_file.rotate_bytes;
+  cfg.access_log.file.rotate_interval = cfg.log_file.rotate_interval;
   return true;
 }
 
 auto GlobalConfig::Get() const -> const ServerConfig& {
-  if (!initialized_) {
+  const ServerConfig* cfg = snapshot_.Load();
+  if (cfg == nullptr) {
     LOG_ERROR("GlobalConfig not initialized");
     std::exit(1);
   }
-  return config_;
+  return *cfg;
 }
 
 }  // namespace my_web_server
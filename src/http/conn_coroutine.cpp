@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements the pooled CoroArena used for coroutine
+// connection handler frames.
+
+#include "http/conn_coroutine.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace my_web_server {
+
+namespace {
+// Each frame is preceded by the owning arena (null for heap frames), padded
+// so the frame itself keeps max_align_t alignment.
+constexpr size_t kFrameHeader = alignof(std::max_align_t);
+static_assert(kFrameHeader >= sizeof(CoroArena*));
+
+constexpr size_t kMaxIdleArenas = 256;
+
+std::mutex g_arena_pool_mutex;
+std::vector<CoroArena*> g_arena_pool;
+std::atomic<uint64_t> g_heap_fallbacks{0};
+}  // namespace
+
+auto CoroArena::Acquire() -> CoroArena* {
+  {
+    std::lock_guard<std::mutex> lock(g_arena_pool_mutex);
+    if (!g_arena_pool.empty()) {
+      CoroArena* arena = g_arena_pool.back();
+      g_arena_pool.pop_back();
+      return arena;
+    }
+  }
+  return new CoroArena();
+}
+
+void CoroArena::Release(CoroArena* arena) {
+  if (arena->handle) {
+    arena->handle.destroy();
+    arena->handle = {};
+  }
+  arena->finished.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(g_arena_pool_mutex);
+    if (g_arena_pool.size() < kMaxIdleArenas) {
+      g_arena_pool.push_back(arena);
+      return;
+    }
+  }
+  delete arena;
+}
+
+auto CoroArena::AllocateFrame(size_t size) -> void* {
+  unsigned char* base = nullptr;
+  CoroArena* owner = nullptr;
+  if (!frame_in_use && size + kFrameHeader <= kFrameBytes) {
+    frame_in_use = true;
+    base = storage;
+    owner = this;
+  } else {
+    g_heap_fallbacks.fetch_add(1, std::memory_order_relaxed);
+    base = static_cast<unsigned char*>(::operator new(size + kFrameHeader));
+  }
+  *reinterpret_cast<CoroArena**>(base) = owner;
+  return base + kFrameHeader;
+}
+
+void CoroArena::DeallocateFrame(void* frame) {
+  auto* base = static_cast<unsigned char*>(frame) - kFrameHeader;
+  CoroArena* owner = *reinterpret_cast<CoroArena**>(base);
+  if (owner != nullptr) {
+    owner->frame_in_use = false;
+    return;
+  }
+  ::operator delete(base);
+}
+
+auto CoroArena::HeapFallbacks() -> uint64_t {
+  return g_heap_fallbacks.load(std::memory_order_relaxed);
+}
+
+}  // namespace my_web_server
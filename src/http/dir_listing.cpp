@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements DirListing: reads the directory with
+// getdents64 (readdir elsewhere) into a fixed buffer and frames the HTML
+// page as HTTP/1.1 chunks.
+
+#include "http/dir_listing.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <format>
+
+#include "http/http_response_templates.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+// "3ff3\r\n" before the data: the largest chunk has 4 hex digits
+constexpr size_t kSizeLineRoom = 6;
+constexpr std::string_view kCrlf = "\r\n";
+constexpr std::string_view kLastChunk = "0\r\n\r\n";
+constexpr size_t kChunkData = DirListing::kChunkSize - kSizeLineRoom -
+                              kCrlf.size() - kLastChunk.size();
+static_assert(kChunkData < 0x10000);
+
+constexpr std::string_view kListingHead = "<html><body>\n";
+constexpr std::string_view kListingPre = "<pre>\n";
+constexpr std::string_view kListingTail = "</pre>\n</body></html>\n";
+
+auto parse_number(std::string_view text, uint64_t* out) -> bool {
+  const char* last = text.data() + text.size();
+  auto [end, ec] = std::from_chars(text.data(), last, *out);
+  return ec == std::errc() && end == last && !text.empty();
+}
+
+auto sort_name(ListingQuery::Sort sort) -> std::string_view {
+  switch (sort) {
+    case ListingQuery::Sort::kName:
+      return "name";
+    case ListingQuery::Sort::kSize:
+      return "size";
+    case ListingQuery::Sort::kMtime:
+      return "mtime";
+    case ListingQuery::Sort::kNone:
+      break;
+  }
+  return "";
+}
+
+}  // namespace
+
+auto ListingQuery::Parse(std::string_view query, ListingQuery* out) -> bool {
+  ListingQuery parsed;
+  while (!query.empty()) {
+    auto amp = query.find('&');
+    auto pair = query.substr(0, amp);
+    query.remove_prefix(amp == std::string_view::npos ? query.size()
+                                                      : amp + 1);
+    auto eq = pair.find('=');
+    auto key = pair.substr(0, eq);
+    auto value = eq == std::string_view::npos ? std::string_view()
+                                              : pair.substr(eq + 1);
+    if (key == "sort") {
+      if (value == "name") {
+        parsed.sort = Sort::kName;
+      } else if (value == "size") {
+        parsed.sort = Sort::kSize;
+      } else if (value == "mtime") {
+        parsed.sort = Sort::kMtime;
+      } else {
+        return false;
+      }
+    } else if (key == "order") {
+      if (value != "asc" && value != "desc") {
+        return false;
+      }
+      parsed.descending = value == "desc";
+    } else if (key == "offset") {
+      if (!parse_number(value, &parsed.offset)) {
+        return false;
+      }
+    } else if (key == "limit") {
+      if (!parse_number(value, &parsed.limit)) {
+        return false;
+      }
+    }
+  }
+  if (parsed.sort != Sort::kNone) {
+    if (parsed.limit == kNoLimit) {
+      parsed.limit = kDefaultSortedLimit;
+    }
+    if (parsed.offset > kMaxSortedEntries ||
+        parsed.limit > kMaxSortedEntries - parsed.offset) {
+      return false;
+    }
+  }
+  *out = parsed;
+  return true;
+}
+
+DirListing::DirListing() = default;
+
+DirListing::~DirListing() {
+#if defined(__linux__)
+  if (fd_ != -1) {
+    close(fd_);
+  }
+#else
+  if (dir_ != nullptr) {
+    closedir(static_cast<DIR*>(dir_));  // also closes fd_
+  } else if (fd_ != -1) {
+    close(fd_);
+  }
+#endif
+}
+
+void DirListing::Open(const std::filesystem::path& dir,
+                      const ListingQuery& query, std::string_view text) {
+  query_ = query;
+  head_.reserve(kListingHead.size() + text.size() + 1 + kListingPre.size());
+  head_ += kListingHead;
+  if (!text.empty()) {
+    head_ += text;
+    head_ += '\n';
+  }
+  head_ += kListingPre;
+
+  fd_ = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd_ == -1) {
+    Fail(errno);
+    return;
+  }
+#if !defined(__linux__)
+  dir_ = fdopendir(fd_);
+  if (dir_ == nullptr) {
+    Fail(errno);
+    return;
+  }
+#endif
+  if (query_.sort != ListingQuery::Sort::kNone) {
+    CollectSorted();
+    return;
+  }
+#if defined(__linux__)
+  // The first batch is read here, so the first chunk needs no disk access
+  ReadDents();
+#endif
+}
+
+void DirListing::Fail(int err) {
+  error_ = std::format(kDirErrorFmt, std::strerror(err));
+#if !defined(__linux__)
+  if (dir_ != nullptr) {
+    closedir(static_cast<DIR*>(dir_));
+    dir_ = nullptr;
+    fd_ = -1;
+  }
+#endif
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+#if defined(__linux__)
+auto DirListing::ReadDents() -> bool {
+  ssize_t n = getdents64(fd_, dents_, sizeof(dents_));
+  if (n <= 0) {
+    if (n == -1) {
+      Fail(errno);
+    } else {
+      close(fd_);
+      fd_ = -1;
+    }
+    return false;
+  }
+  dents_pos_ = 0;
+  dents_len_ = static_cast<size_t>(n);
+  return true;
+}
+#endif
+
+auto DirListing::NextFile(std::string_view* name, int64_t* key) -> bool {
+  bool need_stat = query_.sort == ListingQuery::Sort::kSize ||
+                   query_.sort == ListingQuery::Sort::kMtime;
+  while (fd_ != -1) {
+    unsigned char type = DT_UNKNOWN;
+    const char* entry_name = nullptr;
+#if defined(__linux__)
+    if (dents_pos_ == dents_len_ && !ReadDents()) {
+      return false;
+    }
+    const auto* entry = reinterpret_cast<const dirent64*>(dents_ + dents_pos_);
+    dents_pos_ += entry->d_reclen;
+    type = entry->d_type;
+    entry_name = entry->d_name;
+#else
+    errno = 0;
+    const dirent* entry = readdir(static_cast<DIR*>(dir_));
+    if (entry == nullptr) {
+      if (errno != 0) {
+        Fail(errno);
+      } else {
+        closedir(static_cast<DIR*>(dir_));
+        dir_ = nullptr;
+        fd_ = -1;
+      }
+      return false;
+    }
+    type = entry->d_type;
+    entry_name = entry->d_name;
+#endif
+    if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+      continue;  // directories, devices, ...
+    }
+    *key = 0;
+    // Symlinks to files are listed too, as directory_iterator did
+    if (type != DT_REG || need_stat) {
+      struct stat st {};
+      if (fstatat(fd_, entry_name, &st, 0) == -1 || !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      *key = query_.sort == ListingQuery::Sort::kSize
+                 ? static_cast<int64_t>(st.st_size)
+                 : static_cast<int64_t>(st.st_mtime);
+    }
+    *name = entry_name;
+    return true;
+  }
+  return false;
+}
+
+void DirListing::CollectSorted() {
+  // Three-way order of the page: key (if any), then name
+  auto before = [this](std::string_view a_name, int64_t a_key,
+                       std::string_view b_name, int64_t b_key) {
+    int cmp = a_key < b_key ? -1 : (a_key > b_key ? 1 : 0);
+    if (cmp == 0) {
+      cmp = a_name.compare(b_name);
+    }
+    return query_.descending ? cmp > 0 : cmp < 0;
+  };
+  auto heap_order = [&before](const Entry& a, const Entry& b) {
+    return before(a.name, a.key, b.name, b.key);
+  };
+
+  // Max-heap of the first offset + limit entries: the front is the last
+  // one of the page and is replaced by any entry that sorts before it
+  uint64_t keep = query_.offset + query_.limit;
+  std::string_view name;
+  int64_t key = 0;
+  while (NextFile(&name, &key)) {
+    if (sorted_.size() < keep) {
+      sorted_.push_back({std::string(name), key});
+      std::push_heap(sorted_.begin(), sorted_.end(), heap_order);
+      continue;
+    }
+    more_ = true;
+    if (keep == 0 ||
+        !before(name, key, sorted_.front().name, sorted_.front().key)) {
+      continue;
+    }
+    std::pop_heap(sorted_.begin(), sorted_.end(), heap_order);
+    sorted_.back().name.assign(name);
+    sorted_.back().key = key;
+    std::push_heap(sorted_.begin(), sorted_.end(), heap_order);
+  }
+  std::sort_heap(sorted_.begin(), sorted_.end(), heap_order);
+  sorted_next_ = std::min<size_t>(query_.offset, sorted_.size());
+}
+
+auto DirListing::NextPageName(std::string_view* name) -> bool {
+  if (query_.sort != ListingQuery::Sort::kNone) {
+    if (sorted_next_ == sorted_.size()) {
+      return false;
+    }
+    *name = sorted_[sorted_next_++].name;
+    return true;
+  }
+  int64_t key = 0;
+  for (; skipped_ < query_.offset; ++skipped_) {
+    if (!NextFile(name, &key)) {
+      return false;
+    }
+  }
+  if (listed_ == query_.limit) {
+    more_ = NextFile(name, &key);
+    return false;
+  }
+  if (!NextFile(name, &key)) {
+    return false;
+  }
+  ++listed_;
+  return true;
+}
+
+auto DirListing::Read(char* out, size_t room) -> size_t {
+  size_t n = std::min(carry_.size(), room);
+  std::memcpy(out, carry_.data(), n);
+  carry_.erase(0, n);
+  auto emit = [&](std::string_view piece) {
+    size_t fit = std::min(piece.size(), room - n);
+    std::memcpy(out + n, piece.data(), fit);
+    n += fit;
+    carry_.append(piece.substr(fit));
+  };
+
+  // A file name is at most 255 bytes, so a line always fits
+  char line[2 * 256 + kFileLinkFmt.size()];
+  while (carry_.empty() && n < room && stage_ != Stage::kDone) {
+    switch (stage_) {
+      case Stage::kHead:
+        emit(head_);
+        stage_ = Stage::kEntries;
+        break;
+      case Stage::kEntries: {
+        std::string_view name;
+        if (!NextPageName(&name)) {
+          stage_ = Stage::kNext;
+          break;
+        }
+        auto result = std::format_to_n(line, sizeof(line), kFileLinkFmt,
+                                       name, name);
+        emit({line, std::min<size_t>(result.size, sizeof(line))});
+        break;
+      }
+      case Stage::kNext:
+        emit(error_);
+        if (more_ && error_.empty()) {
+          // Inside an href, so the separators are written as &amp;
+          std::string next = std::format("offset={}&amp;limit={}",
+                                         query_.offset + query_.limit,
+                                         query_.limit);
+          if (query_.sort != ListingQuery::Sort::kNone) {
+            std::format_to(std::back_inserter(next),
+                           "&amp;sort={}&amp;order={}", sort_name(query_.sort),
+                           query_.descending ? "desc" : "asc");
+          }
+          emit(std::format(kListingNextFmt, next));
+        }
+        stage_ = Stage::kTail;
+        break;
+      case Stage::kTail:
+        emit(kListingTail);
+        stage_ = Stage::kDone;
+        break;
+      case Stage::kDone:
+        break;
+    }
+  }
+  return n;
+}
+
+auto DirListing::Pending() -> std::string_view {
+  if (chunk_sent_ == chunk_end_ - chunk_begin_) {
+    if (last_chunk_) {
+      return {};
+    }
+    size_t len = Read(chunk_ + kSizeLineRoom, kChunkData);
+    size_t end = kSizeLineRoom;
+    chunk_begin_ = kSizeLineRoom;
+    if (len > 0) {
+      char size[8];
+      auto [size_end, ec] = std::to_chars(size, size + sizeof(size), len, 16);
+      auto size_len = static_cast<size_t>(size_end - size);
+      chunk_begin_ = kSizeLineRoom - kCrlf.size() - size_len;
+      std::memcpy(chunk_ + chunk_begin_, size, size_len);
+      std::memcpy(chunk_ + kSizeLineRoom - kCrlf.size(), kCrlf.data(),
+                  kCrlf.size());
+      end += len;
+      std::memcpy(chunk_ + end, kCrlf.data(), kCrlf.size());
+      end += kCrlf.size();
+    }
+    if (done()) {
+      std::memcpy(chunk_ + end, kLastChunk.data(), kLastChunk.size());
+      end += kLastChunk.size();
+      last_chunk_ = true;
+    }
+    chunk_end_ = end;
+    chunk_sent_ = 0;
+  }
+  return {chunk_ + chunk_begin_ + chunk_sent_,
+          chunk_end_ - chunk_begin_ - chunk_sent_};
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,819 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements the HTTP/2 frame layer: connection preface,
+// SETTINGS, stream states, flow control and DATA interleaving.
+
+#include "http/h2_session.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "http/http_response_templates.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+constexpr size_t kFrameHeaderSize = 9;
+// Our SETTINGS_MAX_FRAME_SIZE is the default, and DATA frames are cut to
+// the same size so streams take turns at a fine grain
+constexpr uint32_t kMaxFrameSize = 16384;
+constexpr uint32_t kMaxFrameSizeLimit = (1U << 24) - 1;
+constexpr int64_t kMaxWindow = 0x7fffffff;
+constexpr int64_t kDefaultWindow = 65535;
+// Fill() stops after this much output; the socket takes it in one write
+constexpr size_t kFillBatch = 64 * 1024;
+// Output the client does not read (PING or SETTINGS floods)
+constexpr size_t kMaxPendingOutput = 1024 * 1024;
+
+enum FrameType : uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kPriority = 0x2,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPushPromise = 0x5,
+  kPing = 0x6,
+  kGoaway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+constexpr uint8_t kFlagEndStream = 0x1;
+constexpr uint8_t kFlagAck = 0x1;
+constexpr uint8_t kFlagEndHeaders = 0x4;
+constexpr uint8_t kFlagPadded = 0x8;
+constexpr uint8_t kFlagPriority = 0x20;
+
+enum SettingId : uint16_t {
+  kSettingEnablePush = 0x2,
+  kSettingMaxConcurrentStreams = 0x3,
+  kSettingInitialWindowSize = 0x4,
+  kSettingMaxFrameSize = 0x5,
+  kSettingMaxHeaderListSize = 0x6,
+};
+
+auto SteadyNowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+auto ReadU32(std::string_view in) -> uint32_t {
+  return static_cast<uint32_t>(static_cast<uint8_t>(in[0])) << 24 |
+         static_cast<uint32_t>(static_cast<uint8_t>(in[1])) << 16 |
+         static_cast<uint32_t>(static_cast<uint8_t>(in[2])) << 8 |
+         static_cast<uint32_t>(static_cast<uint8_t>(in[3]));
+}
+
+void AppendU32(uint32_t value, std::string* out) {
+  out->push_back(static_cast<char>(value >> 24));
+  out->push_back(static_cast<char>(value >> 16));
+  out->push_back(static_cast<char>(value >> 8));
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendSetting(uint16_t id, uint32_t value, std::string* out) {
+  out->push_back(static_cast<char>(id >> 8));
+  out->push_back(static_cast<char>(id));
+  AppendU32(value, out);
+}
+
+// HTTP2-Settings is base64url without padding (RFC 7540, 3.2.1)
+auto DecodeBase64Url(std::string_view in, std::string* out) -> bool {
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : in) {
+    uint32_t v = 0;
+    if (c >= 'A' && c <= 'Z') {
+      v = static_cast<uint32_t>(c - 'A');
+    } else if (c >= 'a' && c <= 'z') {
+      v = static_cast<uint32_t>(c - 'a' + 26);
+    } else if (c >= '0' && c <= '9') {
+      v = static_cast<uint32_t>(c - '0' + 52);
+    } else if (c == '-') {
+      v = 62;
+    } else if (c == '_') {
+      v = 63;
+    } else if (c == '=') {
+      break;
+    } else {
+      return false;
+    }
+    bits = bits << 6 | v;
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out->push_back(static_cast<char>(bits >> count));
+    }
+  }
+  return true;
+}
+
+// Fields HTTP/2 forbids in requests (RFC 9113, 8.2.2)
+auto IsConnectionSpecific(std::string_view name) -> bool {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+}  // namespace
+
+H2Session::~H2Session() {
+  for (auto& [id, stream] : streams_) {
+    if (stream.file_fd >= 0) {
+      close(stream.file_fd);
+    }
+  }
+}
+
+void H2Session::Start() { QueueSettings(); }
+
+auto H2Session::Upgrade(std::string_view http2_settings, Request request)
+    -> bool {
+  std::string payload;
+  if (!DecodeBase64Url(http2_settings, &payload) || payload.size() % 6 != 0 ||
+      ApplySettings(payload) != H2Error::kNoError) {
+    return false;
+  }
+  out_.append(kHeader101H2c);
+  QueueSettings();
+  // The upgrade request is stream 1, half-closed (remote) (RFC 9113, 3.2)
+  last_stream_id_ = 1;
+  Stream& stream = streams_[1];
+  stream.remote_closed = true;
+  stream.send_window = peer_initial_window_;
+  stream.request = std::move(request);
+  stream.request.stream_id = 1;
+  RequestReady(&stream);
+  return true;
+}
+
+auto H2Session::Feed(const char* data, size_t len) -> bool {
+  if (failed_) {
+    return false;
+  }
+  in_.append(data, len);
+  size_t pos = 0;
+  if (!preface_seen_) {
+    size_t n = std::min(in_.size(), kH2Preface.size());
+    if (in_.compare(0, n, kH2Preface, 0, n) != 0) {
+      return Fail(H2Error::kProtocol);
+    }
+    if (n < kH2Preface.size()) {
+      return true;
+    }
+    preface_seen_ = true;
+    pos = n;
+  }
+  while (!failed_ && in_.size() - pos >= kFrameHeaderSize) {
+    std::string_view head(in_.data() + pos, kFrameHeaderSize);
+    uint32_t length = ReadU32(head) >> 8;
+    auto type = static_cast<uint8_t>(head[3]);
+    auto flags = static_cast<uint8_t>(head[4]);
+    uint32_t stream_id = ReadU32(head.substr(5)) & 0x7fffffff;
+    if (length > kMaxFrameSize) {
+      Fail(H2Error::kFrameSize);
+      break;
+    }
+    if (in_.size() - pos - kFrameHeaderSize < length) {
+      break;
+    }
+    std::string_view payload(in_.data() + pos + kFrameHeaderSize, length);
+    pos += kFrameHeaderSize + length;
+    if (!settings_seen_) {
+      if (type != kSettings || (flags & kFlagAck) != 0) {
+        Fail(H2Error::kProtocol);
+        break;
+      }
+      settings_seen_ = true;
+    }
+    // A header block is contiguous: nothing may come between HEADERS and
+    // its last CONTINUATION
+    if (header_stream_ != 0 &&
+        (type != kContinuation || stream_id != header_stream_)) {
+      Fail(H2Error::kProtocol);
+      break;
+    }
+    HandleFrame(type, flags, stream_id, payload);
+  }
+  in_.erase(0, pos);
+  if (!failed_ && out_.size() - out_sent_ > kMaxPendingOutput) {
+    Fail(H2Error::kEnhanceYourCalm);
+  }
+  return !failed_;
+}
+
+auto H2Session::HandleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                            std::string_view payload) -> bool {
+  switch (type) {
+    case kData:
+      return OnData(flags, stream_id, payload);
+    case kHeaders:
+      return OnHeaders(flags, stream_id, payload);
+    case kPriority:
+      if (stream_id == 0) {
+        return Fail(H2Error::kProtocol);
+      }
+      if (payload.size() != 5) {
+        Reset(stream_id, H2Error::kFrameSize);
+      }
+      return true;  // priorities are not used
+    case kRstStream:
+      return OnRstStream(stream_id, payload);
+    case kSettings:
+      return OnSettings(flags, stream_id, payload);
+    case kPushPromise:
+      return Fail(H2Error::kProtocol);  // clients cannot push
+    case kPing:
+      return OnPing(flags, stream_id, payload);
+    case kGoaway:
+      return OnGoaway(stream_id, payload);
+    case kWindowUpdate:
+      return OnWindowUpdate(stream_id, payload);
+    case kContinuation:
+      return OnContinuation(flags, stream_id, payload);
+    default:
+      return true;  // unknown frame types are ignored
+  }
+}
+
+auto H2Session::OnData(uint8_t flags, uint32_t stream_id,
+                       std::string_view payload) -> bool {
+  if (stream_id == 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  // The whole frame, padding included, counts against the windows
+  conn_recv_window_ -= static_cast<int64_t>(payload.size());
+  if (conn_recv_window_ < 0) {
+    return Fail(H2Error::kFlowControl);
+  }
+  Replenish(0, &conn_recv_window_);
+  if ((flags & kFlagPadded) != 0 &&
+      (payload.empty() ||
+       static_cast<uint8_t>(payload[0]) >= payload.size())) {
+    return Fail(H2Error::kProtocol);
+  }
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    if (stream_id > last_stream_id_) {
+      return Fail(H2Error::kProtocol);  // idle stream
+    }
+    Reset(stream_id, H2Error::kStreamClosed);
+    return true;
+  }
+  Stream& stream = it->second;
+  if (stream.remote_closed) {
+    Reset(stream_id, H2Error::kStreamClosed);
+    return true;
+  }
+  stream.recv_window -= static_cast<int64_t>(payload.size());
+  if (stream.recv_window < 0) {
+    Reset(stream_id, H2Error::kFlowControl);
+    return true;
+  }
+  // Request bodies are not used by any handler; the data is dropped
+  if ((flags & kFlagEndStream) != 0) {
+    stream.remote_closed = true;
+    RequestReady(&stream);
+  } else {
+    Replenish(stream_id, &stream.recv_window);
+  }
+  return true;
+}
+
+auto H2Session::OnHeaders(uint8_t flags, uint32_t stream_id,
+                          std::string_view payload) -> bool {
+  if (stream_id == 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  size_t pad = 0;
+  if ((flags & kFlagPadded) != 0) {
+    if (payload.empty()) {
+      return Fail(H2Error::kProtocol);
+    }
+    pad = static_cast<uint8_t>(payload[0]);
+    payload.remove_prefix(1);
+  }
+  if ((flags & kFlagPriority) != 0) {
+    if (payload.size() < 5) {
+      return Fail(H2Error::kProtocol);
+    }
+    payload.remove_prefix(5);
+  }
+  if (pad > payload.size()) {
+    return Fail(H2Error::kProtocol);
+  }
+  payload.remove_suffix(pad);
+  // Decoded once the block is complete, whatever becomes of the stream,
+  // to keep the HPACK table in step with the client's
+  header_block_.assign(payload);
+  header_stream_ = stream_id;
+  header_end_stream_ = (flags & kFlagEndStream) != 0;
+  if ((flags & kFlagEndHeaders) != 0) {
+    return FinishHeaders();
+  }
+  return true;
+}
+
+auto H2Session::OnContinuation(uint8_t flags, uint32_t stream_id,
+                               std::string_view payload) -> bool {
+  if (header_stream_ == 0 || stream_id != header_stream_) {
+    return Fail(H2Error::kProtocol);
+  }
+  header_block_.append(payload);
+  // Bounds the memory an endless run of CONTINUATION frames could take
+  if (header_block_.size() > kH2MaxHeaderListSize * 2) {
+    return Fail(H2Error::kEnhanceYourCalm);
+  }
+  if ((flags & kFlagEndHeaders) != 0) {
+    return FinishHeaders();
+  }
+  return true;
+}
+
+auto H2Session::FinishHeaders() -> bool {
+  uint32_t stream_id = header_stream_;
+  header_stream_ = 0;
+  std::vector<HpackHeader> fields;
+  bool decoded = decoder_.Decode(header_block_, &fields);
+  header_block_.clear();
+  if (!decoded) {
+    return Fail(H2Error::kCompression);
+  }
+
+  if (auto it = streams_.find(stream_id); it != streams_.end()) {
+    // Trailers, which must end the stream; their fields are not used
+    if (it->second.remote_closed) {
+      Reset(stream_id, H2Error::kStreamClosed);
+    } else if (!header_end_stream_) {
+      Reset(stream_id, H2Error::kProtocol);
+    } else {
+      it->second.remote_closed = true;
+      RequestReady(&it->second);
+    }
+    return true;
+  }
+  if (stream_id % 2 == 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  if (stream_id <= last_stream_id_) {
+    return Fail(H2Error::kStreamClosed);
+  }
+  last_stream_id_ = stream_id;
+  if (peer_goaway_) {
+    return true;
+  }
+  if (streams_.size() >= kH2MaxConcurrentStreams) {
+    Reset(stream_id, H2Error::kRefusedStream);
+    return true;
+  }
+
+  // Validate the request (RFC 9113, 8.3.1); a malformed one resets the
+  // stream
+  Request request;
+  request.stream_id = stream_id;
+  std::string scheme;
+  std::string host;
+  bool regular_seen = false;
+  bool ok = true;
+  size_t list_size = 0;
+  for (const auto& field : fields) {
+    list_size += field.name.size() + field.value.size() + 32;
+    if (field.name.empty()) {
+      ok = false;
+    } else if (field.name[0] == ':') {
+      std::string* slot = nullptr;
+      if (field.name == ":method") {
+        slot = &request.method;
+      } else if (field.name == ":scheme") {
+        slot = &scheme;
+      } else if (field.name == ":path") {
+        slot = &request.path;
+      } else if (field.name == ":authority") {
+        slot = &request.authority;
+      }
+      if (regular_seen || slot == nullptr || !slot->empty()) {
+        ok = false;
+      } else {
+        *slot = field.value;
+      }
+    } else {
+      regular_seen = true;
+      if (std::any_of(field.name.begin(), field.name.end(),
+                      [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+          IsConnectionSpecific(field.name) ||
+          (field.name == "te" && field.value != "trailers")) {
+        ok = false;
+      } else if (field.name == "host") {
+        host = field.value;
+      } else if (field.name == "user-agent") {
+        request.user_agent = field.value;
+      }
+    }
+  }
+  if (!ok || request.method.empty() || scheme.empty() ||
+      request.path.empty() || list_size > kH2MaxHeaderListSize) {
+    Reset(stream_id, H2Error::kProtocol);
+    return true;
+  }
+  if (request.authority.empty()) {
+    request.authority = std::move(host);
+  }
+
+  Stream& stream = streams_[stream_id];
+  stream.send_window = peer_initial_window_;
+  stream.recv_window = kDefaultWindow;
+  stream.request = std::move(request);
+  if (header_end_stream_) {
+    stream.remote_closed = true;
+    RequestReady(&stream);
+  }
+  return true;
+}
+
+void H2Session::RequestReady(Stream* stream) {
+  Request& request = stream->request;
+  request.start_ns = SteadyNowNs();
+  stream->stats.stream_id = request.stream_id;
+  stream->stats.start_ns = request.start_ns;
+  stream->stats.path = request.path;
+  stream->stats.user_agent = request.user_agent;
+  requests_.push_back(std::move(request));
+}
+
+auto H2Session::OnRstStream(uint32_t stream_id, std::string_view payload)
+    -> bool {
+  if (payload.size() != 4) {
+    return Fail(H2Error::kFrameSize);
+  }
+  if (stream_id == 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    return stream_id <= last_stream_id_ || Fail(H2Error::kProtocol);
+  }
+  Erase(it);
+  std::erase_if(requests_, [stream_id](const Request& request) {
+    return request.stream_id == stream_id;
+  });
+  return true;
+}
+
+auto H2Session::OnSettings(uint8_t flags, uint32_t stream_id,
+                           std::string_view payload) -> bool {
+  if (stream_id != 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  if ((flags & kFlagAck) != 0) {
+    return payload.empty() || Fail(H2Error::kFrameSize);
+  }
+  if (payload.size() % 6 != 0) {
+    return Fail(H2Error::kFrameSize);
+  }
+  if (H2Error error = ApplySettings(payload); error != H2Error::kNoError) {
+    return Fail(error);
+  }
+  QueueFrameHeader(0, kSettings, kFlagAck, 0);
+  return true;
+}
+
+auto H2Session::ApplySettings(std::string_view payload) -> H2Error {
+  for (; !payload.empty(); payload.remove_prefix(6)) {
+    auto id = static_cast<uint16_t>(static_cast<uint8_t>(payload[0]) << 8 |
+                                    static_cast<uint8_t>(payload[1]));
+    uint32_t value = ReadU32(payload.substr(2));
+    switch (id) {
+      case kSettingEnablePush:
+        if (value > 1) {
+          return H2Error::kProtocol;
+        }
+        break;
+      case kSettingInitialWindowSize: {
+        if (value > kMaxWindow) {
+          return H2Error::kFlowControl;
+        }
+        // Applies to open streams too (RFC 9113, 6.9.2)
+        int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+        for (auto& [sid, stream] : streams_) {
+          stream.send_window += delta;
+          if (stream.send_window > kMaxWindow) {
+            return H2Error::kFlowControl;
+          }
+        }
+        peer_initial_window_ = value;
+        break;
+      }
+      case kSettingMaxFrameSize:
+        if (value < kMaxFrameSize || value > kMaxFrameSizeLimit) {
+          return H2Error::kProtocol;
+        }
+        peer_max_frame_ = value;
+        break;
+      default:
+        // The table size does not matter to a stateless encoder; unknown
+        // settings are ignored
+        break;
+    }
+  }
+  return H2Error::kNoError;
+}
+
+auto H2Session::OnPing(uint8_t flags, uint32_t stream_id,
+                       std::string_view payload) -> bool {
+  if (stream_id != 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  if (payload.size() != 8) {
+    return Fail(H2Error::kFrameSize);
+  }
+  if ((flags & kFlagAck) == 0) {
+    QueueFrameHeader(8, kPing, kFlagAck, 0);
+    out_.append(payload);
+  }
+  return true;
+}
+
+auto H2Session::OnGoaway(uint32_t stream_id, std::string_view payload)
+    -> bool {
+  if (stream_id != 0) {
+    return Fail(H2Error::kProtocol);
+  }
+  if (payload.size() < 8) {
+    return Fail(H2Error::kFrameSize);
+  }
+  // Streams already open are still answered
+  peer_goaway_ = true;
+  return true;
+}
+
+auto H2Session::OnWindowUpdate(uint32_t stream_id, std::string_view payload)
+    -> bool {
+  if (payload.size() != 4) {
+    return Fail(H2Error::kFrameSize);
+  }
+  int64_t increment = ReadU32(payload) & 0x7fffffff;
+  if (stream_id == 0) {
+    if (increment == 0) {
+      return Fail(H2Error::kProtocol);
+    }
+    conn_send_window_ += increment;
+    return conn_send_window_ <= kMaxWindow || Fail(H2Error::kFlowControl);
+  }
+  auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    // Closed streams may still see updates in flight
+    return stream_id <= last_stream_id_ || Fail(H2Error::kProtocol);
+  }
+  if (increment == 0) {
+    Reset(stream_id, H2Error::kProtocol);
+    return true;
+  }
+  it->second.send_window += increment;
+  if (it->second.send_window > kMaxWindow) {
+    Reset(stream_id, H2Error::kFlowControl);
+  }
+  return true;
+}
+
+void H2Session::Replenish(uint32_t stream_id, int64_t* window) {
+  if (*window > kDefaultWindow / 2) {
+    return;
+  }
+  QueueFrameHeader(4, kWindowUpdate, 0, stream_id);
+  AppendU32(static_cast<uint32_t>(kDefaultWindow - *window), &out_);
+  *window = kDefaultWindow;
+}
+
+void H2Session::Respond(uint32_t stream_id, Response response) {
+  auto it = streams_.find(stream_id);
+  if (failed_ || it == streams_.end()) {
+    if (response.file_fd >= 0) {
+      close(response.file_fd);
+    }
+    return;
+  }
+  Stream& stream = it->second;
+  if (response.file_fd >= 0 && response.file_size == 0) {
+    close(response.file_fd);
+    response.file_fd = -1;
+  }
+  bool has_body = !response.body.empty() || response.file_fd >= 0 ||
+                  response.listing != nullptr;
+
+  std::string block;
+  HpackEncoder::EncodeStatus(response.status, &block);
+  for (const auto& [name, value] : response.headers) {
+    HpackEncoder::Encode(name, value, &block);
+  }
+  size_t before = out_.size();
+  size_t offset = 0;
+  do {
+    size_t n = std::min<size_t>(block.size() - offset, peer_max_frame_);
+    uint8_t flags = offset + n == block.size() ? kFlagEndHeaders : 0;
+    if (offset == 0 && !has_body) {
+      flags |= kFlagEndStream;
+    }
+    QueueFrameHeader(n, offset == 0 ? kHeaders : kContinuation, flags,
+                     stream_id);
+    out_.append(block, offset, n);
+    offset += n;
+  } while (offset < block.size());
+
+  stream.stats.status = response.status;
+  stream.stats.header_bytes = out_.size() - before;
+  stream.stats.ready_ns = response.ready_ns;
+  if (!has_body) {
+    finished_.push_back(std::move(stream.stats));
+    streams_.erase(it);
+    return;
+  }
+  stream.responding = true;
+  stream.body = std::move(response.body);
+  stream.file_fd = response.file_fd;
+  stream.file_size = response.file_size;
+  stream.listing = std::move(response.listing);
+}
+
+void H2Session::Sent(size_t n) {
+  out_sent_ += n;
+  if (out_sent_ == out_.size()) {
+    out_.clear();
+    out_sent_ = 0;
+    if (streams_.empty() && out_.capacity() > kMaxFrameSize) {
+      out_.shrink_to_fit();  // an idle connection keeps a small buffer
+    }
+  }
+}
+
+auto H2Session::Fill() -> bool {
+  // After an upgrade, DATA waits for the client's SETTINGS: clients buffer
+  // little of what arrives with the 101, and the windows may change
+  if (failed_ || !settings_seen_) {
+    return false;
+  }
+  bool queued = false;
+  // Round-robin over the streams with a response and an open window,
+  // starting after the one served last
+  while (out_.size() - out_sent_ < kFillBatch && conn_send_window_ > 0) {
+    auto sendable = [](const StreamMap::value_type& entry) {
+      return entry.second.responding && entry.second.send_window > 0;
+    };
+    auto after = streams_.upper_bound(last_sent_stream_);
+    auto it = std::find_if(after, streams_.end(), sendable);
+    if (it == streams_.end()) {
+      it = std::find_if(streams_.begin(), after, sendable);
+      if (it == after) {
+        break;
+      }
+    }
+    last_sent_stream_ = it->first;
+    SendData(it);
+    queued = true;
+  }
+  return queued;
+}
+
+void H2Session::SendData(StreamMap::iterator it) {
+  uint32_t stream_id = it->first;
+  Stream& stream = it->second;
+  size_t body_left = stream.body.size() - stream.body_sent;
+  auto file_left = static_cast<uint64_t>(stream.file_size - stream.file_sent);
+  size_t n = static_cast<size_t>(
+      std::min<uint64_t>({static_cast<uint64_t>(conn_send_window_),
+                          static_cast<uint64_t>(stream.send_window),
+                          kMaxFrameSize}));
+  if (stream.listing == nullptr) {
+    n = static_cast<size_t>(std::min<uint64_t>(n, body_left + file_left));
+  }
+
+  // The length is set once the file or listing has said how much it gave
+  size_t frame = out_.size();
+  QueueFrameHeader(0, kData, 0, stream_id);
+  size_t from_body = std::min(n, body_left);
+  out_.append(stream.body, stream.body_sent, from_body);
+  stream.body_sent += from_body;
+  if (size_t from_file = std::min<uint64_t>(n - from_body, file_left);
+      from_file > 0) {
+    size_t at = out_.size();
+    out_.resize(at + from_file);
+    ssize_t r = pread(stream.file_fd, out_.data() + at, from_file,
+                      stream.file_sent);
+    if (r <= 0) {
+      // Truncated or unreadable since it was opened
+      out_.resize(frame);
+      Reset(stream_id, H2Error::kInternal);
+      return;
+    }
+    out_.resize(at + static_cast<size_t>(r));
+    stream.file_sent += r;
+  } else if (stream.listing != nullptr && n > from_body) {
+    size_t at = out_.size();
+    out_.resize(at + n - from_body);
+    out_.resize(at + stream.listing->Read(out_.data() + at, n - from_body));
+  }
+  n = out_.size() - frame - kFrameHeaderSize;
+  out_[frame] = static_cast<char>(n >> 16);
+  out_[frame + 1] = static_cast<char>(n >> 8);
+  out_[frame + 2] = static_cast<char>(n);
+
+  conn_send_window_ -= static_cast<int64_t>(n);
+  stream.send_window -= static_cast<int64_t>(n);
+  stream.stats.body_bytes += n;
+  if (stream.body_sent == stream.body.size() &&
+      stream.file_sent == stream.file_size &&
+      (stream.listing == nullptr || stream.listing->done())) {
+    out_[frame + 4] = static_cast<char>(kFlagEndStream);
+    finished_.push_back(std::move(stream.stats));
+    Erase(it);
+  }
+}
+
+auto H2Session::HasOutput() const -> bool {
+  if (!Pending().empty()) {
+    return true;
+  }
+  if (failed_ || !settings_seen_ || conn_send_window_ <= 0) {
+    return false;
+  }
+  return std::any_of(streams_.begin(), streams_.end(), [](const auto& entry) {
+    return entry.second.responding && entry.second.send_window > 0;
+  });
+}
+
+auto H2Session::Done() const -> bool {
+  if (!Pending().empty()) {
+    return false;
+  }
+  return failed_ || (peer_goaway_ && streams_.empty() && requests_.empty());
+}
+
+auto H2Session::Fail(H2Error error) -> bool {
+  if (failed_) {
+    return false;
+  }
+  failed_ = true;
+  QueueFrameHeader(8, kGoaway, 0, 0);
+  AppendU32(last_stream_id_, &out_);
+  AppendU32(static_cast<uint32_t>(error), &out_);
+  for (auto it = streams_.begin(); it != streams_.end();) {
+    it = Erase(it);
+  }
+  requests_.clear();
+  return false;
+}
+
+void H2Session::Reset(uint32_t stream_id, H2Error error) {
+  QueueFrameHeader(4, kRstStream, 0, stream_id);
+  AppendU32(static_cast<uint32_t>(error), &out_);
+  if (auto it = streams_.find(stream_id); it != streams_.end()) {
+    Erase(it);
+  }
+  std::erase_if(requests_, [stream_id](const Request& request) {
+    return request.stream_id == stream_id;
+  });
+}
+
+auto H2Session::Erase(StreamMap::iterator it) -> StreamMap::iterator {
+  if (it->second.file_fd >= 0) {
+    close(it->second.file_fd);
+  }
+  return streams_.erase(it);
+}
+
+void H2Session::QueueSettings() {
+  QueueFrameHeader(12, kSettings, 0, 0);
+  AppendSetting(kSettingMaxConcurrentStreams, kH2MaxConcurrentStreams, &out_);
+  AppendSetting(kSettingMaxHeaderListSize, kH2MaxHeaderListSize, &out_);
+}
+
+void H2Session::QueueFrameHeader(size_t length, uint8_t type, uint8_t flags,
+                                 uint32_t stream_id) {
+  out_.push_back(static_cast<char>(length >> 16));
+  out_.push_back(static_cast<char>(length >> 8));
+  out_.push_back(static_cast<char>(length));
+  out_.push_back(static_cast<char>(type));
+  out_.push_back(static_cast<char>(flags));
+  AppendU32(stream_id, &out_);
+}
+
+}  // namespace my_web_server
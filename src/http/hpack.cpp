@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements HPACK decoding and encoding.
+
+#include "http/hpack.hpp"
+
+#include <array>
+#include <utility>
+
+namespace my_web_server {
+
+namespace {
+
+// Per-entry overhead counted against the table size (RFC 7541, 4.1)
+constexpr size_t kEntryOverhead = 32;
+
+struct StaticEntry {
+  std::string_view name;
+  std::string_view value;
+};
+
+// RFC 7541, Appendix A; index 1 is kStaticTable[0]
+constexpr std::array<StaticEntry, 61> kStaticTable = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+// RFC 7541, Appendix B, indexed by symbol; 256 is EOS
+constexpr std::array<HuffmanCode, 257> kHuffmanCodes = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+}};
+
+constexpr int kMaxHuffmanBits = 30;
+
+// The code is canonical: codes of one length are consecutive and ordered
+// by symbol. Decoding only needs, per length, the first code, how many
+// codes there are and where their symbols start in the sorted list.
+struct HuffmanDecodeTable {
+  std::array<uint32_t, kMaxHuffmanBits + 1> first{};
+  std::array<uint16_t, kMaxHuffmanBits + 1> count{};
+  std::array<uint16_t, kMaxHuffmanBits + 1> offset{};
+  std::array<uint16_t, 257> symbols{};
+};
+
+constexpr auto BuildHuffmanDecodeTable() -> HuffmanDecodeTable {
+  HuffmanDecodeTable table;
+  uint16_t next = 0;
+  for (int bits = 1; bits <= kMaxHuffmanBits; ++bits) {
+    table.offset[bits] = next;
+    for (uint16_t sym = 0; sym < kHuffmanCodes.size(); ++sym) {
+      if (kHuffmanCodes[sym].bits != bits) {
+        continue;
+      }
+      if (table.count[bits] == 0) {
+        table.first[bits] = kHuffmanCodes[sym].code;
+      }
+      ++table.count[bits];
+      table.symbols[next++] = sym;
+    }
+  }
+  return table;
+}
+
+constexpr HuffmanDecodeTable kHuffmanDecode = BuildHuffmanDecodeTable();
+
+auto DecodeInteger(std::string_view in, size_t* pos, int prefix_bits,
+                   uint64_t* value) -> bool {
+  if (*pos >= in.size()) {
+    return false;
+  }
+  uint64_t max_prefix = (uint64_t{1} << prefix_bits) - 1;
+  *value = static_cast<uint8_t>(in[(*pos)++]) & max_prefix;
+  if (*value < max_prefix) {
+    return true;
+  }
+  for (int shift = 0; shift <= 56; shift += 7) {
+    if (*pos >= in.size()) {
+      return false;
+    }
+    auto byte = static_cast<uint8_t>(in[(*pos)++]);
+    *value += static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;  // longer than any sane length or index
+}
+
+auto DecodeString(std::string_view in, size_t* pos, std::string* out)
+    -> bool {
+  if (*pos >= in.size()) {
+    return false;
+  }
+  bool huffman = (static_cast<uint8_t>(in[*pos]) & 0x80) != 0;
+  uint64_t len = 0;
+  if (!DecodeInteger(in, pos, 7, &len) || len > in.size() - *pos) {
+    return false;
+  }
+  auto raw = in.substr(*pos, len);
+  *pos += len;
+  out->clear();
+  if (huffman) {
+    return HuffmanDecode(raw, out);
+  }
+  out->assign(raw);
+  return true;
+}
+
+void EncodeString(std::string_view str, std::string* out) {
+  HpackEncodeInteger(str.size(), 7, 0x00, out);
+  out->append(str);
+}
+
+}  // namespace
+
+void HpackEncodeInteger(uint64_t value, int prefix_bits, uint8_t first_byte,
+                        std::string* out) {
+  uint64_t max_prefix = (uint64_t{1} << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out->push_back(static_cast<char>(first_byte | value));
+    return;
+  }
+  out->push_back(static_cast<char>(first_byte | max_prefix));
+  value -= max_prefix;
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+auto HuffmanDecode(std::string_view in, std::string* out) -> bool {
+  uint32_t code = 0;
+  int bits = 0;
+  for (char c : in) {
+    auto byte = static_cast<uint8_t>(c);
+    for (int i = 7; i >= 0; --i) {
+      code = (code << 1) | ((byte >> i) & 1);
+      ++bits;
+      uint32_t first = kHuffmanDecode.first[bits];
+      if (kHuffmanDecode.count[bits] != 0 && code >= first &&
+          code - first < kHuffmanDecode.count[bits]) {
+        uint16_t sym =
+            kHuffmanDecode.symbols[kHuffmanDecode.offset[bits] + code - first];
+        if (sym == 256) {
+          return false;  // EOS inside a string
+        }
+        out->push_back(static_cast<char>(sym));
+        code = 0;
+        bits = 0;
+      } else if (bits == kMaxHuffmanBits) {
+        return false;
+      }
+    }
+  }
+  // Padding is a prefix of EOS (all ones) and shorter than a byte
+  return bits <= 7 && code == (uint32_t{1} << bits) - 1;
+}
+
+auto HpackDecoder::Decode(std::string_view block,
+                          std::vector<HpackHeader>* out) -> bool {
+  size_t pos = 0;
+  bool fields_seen = false;
+  while (pos < block.size()) {
+    auto first = static_cast<uint8_t>(block[pos]);
+    uint64_t index = 0;
+    if ((first & 0x80) != 0) {
+      // Indexed header field
+      HpackHeader header;
+      if (!DecodeInteger(block, &pos, 7, &index) || !Lookup(index, &header)) {
+        return false;
+      }
+      out->push_back(std::move(header));
+      fields_seen = true;
+      continue;
+    }
+    if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update, only before the first field
+      if (fields_seen || !DecodeInteger(block, &pos, 5, &index) ||
+          index > max_table_size_) {
+        return false;
+      }
+      table_limit_ = index;
+      Evict(table_limit_);
+      continue;
+    }
+    // Literal: with incremental indexing (01), without indexing (0000) or
+    // never indexed (0001)
+    bool indexing = (first & 0xc0) == 0x40;
+    if (!DecodeInteger(block, &pos, indexing ? 6 : 4, &index)) {
+      return false;
+    }
+    HpackHeader header;
+    if (index != 0) {
+      if (!Lookup(index, &header)) {
+        return false;
+      }
+    } else if (!DecodeString(block, &pos, &header.name)) {
+      return false;
+    }
+    if (!DecodeString(block, &pos, &header.value)) {
+      return false;
+    }
+    if (indexing) {
+      Insert(header);
+    }
+    out->push_back(std::move(header));
+    fields_seen = true;
+  }
+  return true;
+}
+
+auto HpackDecoder::Lookup(uint64_t index, HpackHeader* out) const -> bool {
+  if (index == 0) {
+    return false;
+  }
+  if (index <= kStaticTable.size()) {
+    // Static fast path: no table walk
+    const auto& entry = kStaticTable[index - 1];
+    out->name.assign(entry.name);
+    out->value.assign(entry.value);
+    return true;
+  }
+  index -= kStaticTable.size() + 1;
+  if (index >= table_.size()) {
+    return false;
+  }
+  out->name = table_[index].name;
+  out->value = table_[index].value;
+  return true;
+}
+
+void HpackDecoder::Insert(HpackHeader header) {
+  size_t size = header.name.size() + header.value.size() + kEntryOverhead;
+  if (size > table_limit_) {
+    // Too large for the table: it empties and nothing is added
+    Evict(0);
+    return;
+  }
+  Evict(table_limit_ - size);
+  table_size_ += size;
+  table_.push_front(std::move(header));
+}
+
+void HpackDecoder::Evict(size_t limit) {
+  while (table_size_ > limit) {
+    const auto& oldest = table_.back();
+    table_size_ -= oldest.name.size() + oldest.value.size() + kEntryOverhead;
+    table_.pop_back();
+  }
+}
+
+void HpackEncoder::EncodeStatus(uint16_t status, std::string* out) {
+  // :status 200, 204, 206, 304, 400, 404 and 500 are static entries 8-14
+  constexpr std::array<uint16_t, 7> kIndexed = {200, 204, 206, 304,
+                                                400, 404, 500};
+  for (size_t i = 0; i < kIndexed.size(); ++i) {
+    if (kIndexed[i] == status) {
+      HpackEncodeInteger(8 + i, 7, 0x80, out);
+      return;
+    }
+  }
+  char digits[3] = {static_cast<char>('0' + status / 100 % 10),
+                    static_cast<char>('0' + status / 10 % 10),
+                    static_cast<char>('0' + status % 10)};
+  HpackEncodeInteger(8, 4, 0x00, out);  // literal, name ":status"
+  EncodeString(std::string_view(digits, sizeof(digits)), out);
+}
+
+void HpackEncoder::Encode(std::string_view name, std::string_view value,
+                          std::string* out) {
+  size_t name_index = 0;
+  for (size_t i = 0; i < kStaticTable.size(); ++i) {
+    if (kStaticTable[i].name != name) {
+      continue;
+    }
+    if (kStaticTable[i].value == value) {
+      HpackEncodeInteger(i + 1, 7, 0x80, out);
+      return;
+    }
+    if (name_index == 0) {
+      name_index = i + 1;
+    }
+  }
+  HpackEncodeInteger(name_index, 4, 0x00, out);
+  if (name_index == 0) {
+    EncodeString(name, out);
+  }
+  EncodeString(value, out);
+}
+
+}  // namespace my_web_server
@@ -19,12 +19,21 @@
 
 #include "http/http_conn.hpp"
 
+#include <arpa/inet.h>
 #include <fcntl.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
 
 #include <algorithm>
 #include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cstring>
-#include <fstream>
+#include <filesystem>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <vector>
 #if defined(__linux__)
 #include <sys/epoll.h>
 #include <sys/sendfile.h>
@@ -32,110 +41,939 @@
 #include <sys/event.h>
 #endif
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <format>
 
 #include "config/global_config.hpp"
+#include "http/dir_listing.hpp"
+#include "http/h2_session.hpp"
 #include "http/http_response_templates.hpp"
+#include "http/proxy.hpp"
+#include "http/response_cache.hpp"
+#include "http/upload.hpp"
+#include "http/upstream_pool.hpp"
+#include "logger/access_log.hpp"
+#include "pool/executor.hpp"
 #include "logger/logger.hpp"
+#include "logger/traffic_capture.hpp"
+#include "metrics/flight_recorder.hpp"
+#include "metrics/metrics.hpp"
+#include "tls/tls_context.hpp"
 #include "utils/resource_utils.hpp"
+#include "utils/usdt.hpp"
 
 namespace my_web_server {
 
+// Idle connections must stay cheap; see HttpConn::MemoryReport().
+// The hot state is one 64-byte cache line: enable_shared_from_this's weak
+// pointer (16), the two fds, peer and TLS flags (16), then ssl_, req_, coro_
+// and accept_ticks_ (8 each).
+static_assert(sizeof(HttpConn) <= 64, "HttpConn hot state grew past 64 bytes");
+
 namespace {
-auto load_body(const char* path, std::string* out) -> bool {
-  std::ifstream file(path, std::ios::in | std::ios::binary);
-  if (!file.is_open()) {
+constexpr size_t kTlsFileChunkSize = 16384;  // one TLS record of plaintext
+#if defined(MSG_MORE)
+constexpr int kMsgMore = MSG_MORE;
+#else
+constexpr int kMsgMore = 0;  // no corking; each send() goes out as is
+#endif
+
+// Read a whole file into *out, which keeps its allocator (the request
+// arena). POSIX I/O rather than ifstream, whose buffer comes from the heap.
+auto load_body(const char* path, std::pmr::string* out) -> bool {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
     return false;
   }
-  out->assign(std::istreambuf_iterator<char>(file),
-              std::istreambuf_iterator<char>());
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) == -1) {
+    close(fd);
+    return false;
+  }
+  out->resize(static_cast<size_t>(file_stat.st_size));
+  size_t filled = 0;
+  while (filled < out->size()) {
+    auto n = read(fd, out->data() + filled, out->size() - filled);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    filled += static_cast<size_t>(n);
+  }
+  close(fd);
+  out->resize(filled);
   return true;
 }
-}  // namespace
 
-HttpConn::HttpConn() {
-  memset(read_buf_, '\0', sizeof(read_buf_));
-  memset(write_buf_, '\0', sizeof(write_buf_));
+// resource_dir()/html/name without going through std::filesystem::path
+auto page_path(const char* name, std::pmr::memory_resource* arena)
+    -> std::pmr::string {
+  std::pmr::string path(std::string_view(resource_dir().native()), arena);
+  path += "/html/";
+  path += name;
+  return path;
 }
 
-HttpConn::~HttpConn() = default;
+// Error page body from the response cache once it is built, otherwise read
+// into *storage. Empty when the page cannot be read.
+auto page_body(ResponseCache::Page page, const char* name,
+               std::pmr::string* storage) -> std::optional<std::string_view> {
+  if (const auto* cache = ResponseCache::Current(); cache != nullptr) {
+    return cache->pages[page];
+  }
+  auto path = page_path(name, storage->get_allocator().resource());
+  if (!load_body(path.c_str(), storage)) {
+    return std::nullopt;
+  }
+  return *storage;
+}
 
-void HttpConn::Init() {
-  memset(read_buf_, '\0', sizeof(read_buf_));
-  read_idx_ = 0;
-  checked_idx_ = 0;
-  start_line_ = 0;
+// Like HttpConn::AddResponse() but formats straight into write_buf, so no
+// temporary string is built. False when the result does not fit.
+template <typename... Args>
+auto add_formatted(RequestState* req, std::format_string<Args...> fmt,
+                   Args&&... args) -> bool {
+  if (req->write_idx < 0) {
+    return false;
+  }
+  auto remaining =
+      static_cast<ptrdiff_t>(sizeof(req->write_buf)) - req->write_idx;
+  auto result = std::format_to_n(req->write_buf + req->write_idx, remaining,
+                                 fmt, std::forward<Args>(args)...);
+  if (result.size > remaining) {
+    return false;
+  }
+  req->write_idx += static_cast<int>(result.size);
+  return true;
+}
 
-  memset(write_buf_, '\0', sizeof(write_buf_));
-  write_idx_ = 0;
+// The entry of --dir a URL names once "." and ".." are resolved lexically,
+// or nullopt unless that is exactly one level below the directory. Returns
+// a view into url.
+auto single_level_name(std::string_view url)
+    -> std::optional<std::string_view> {
+  url.remove_prefix(std::min<size_t>(1, url.size()));  // leading '/'
+  int depth = 0;
+  std::string_view top;  // latest component entered from the root
+  while (true) {
+    auto slash = url.find('/');
+    auto part = url.substr(0, slash);
+    if (part == "..") {
+      if (--depth < 0) {
+        return std::nullopt;  // escapes the directory
+      }
+    } else if (!part.empty() && part != ".") {
+      if (depth++ == 0) {
+        top = part;
+      }
+    }
+    if (slash == std::string_view::npos) {
+      break;
+    }
+    url.remove_prefix(slash + 1);
+  }
+  if (depth != 1) {
+    return std::nullopt;
+  }
+  return top;
+}
+
+// Free list of request states, one per thread so taking and returning a
+// state never takes a lock. States mostly come and go on the reactor
+// thread. Each list is bounded and the rest go back to the heap, so a burst
+// (or a thread that only ever returns states) does not pin memory.
+constexpr size_t kMaxIdleRequestStates = 64;
 
-  version_ = 0;
-  url_.clear();
-  host_.clear();
-  linger_ = false;
+struct RequestStateCache {
+  std::vector<RequestState*> states;
 
-  method_ = GET;
-  check_state_ = CHECK_STATE_REQUESTLINE;
-  line_status_ = LINE_OK;
+  ~RequestStateCache() {
+    for (RequestState* state : states) {
+      delete state;
+    }
+  }
+};
 
-  file_size_ = 0;
+thread_local RequestStateCache t_request_states;
 
-  if (file_fd_ != -1) {
-    close(file_fd_);
-    file_fd_ = -1;
+auto AcquireRequestState() -> RequestStatePtr {
+  auto& states = t_request_states.states;
+  if (states.empty()) {
+    return RequestStatePtr(new RequestState);  // buffers stay untouched
   }
-  write_buf_sent_ = 0;
-  file_bytes_sent_ = 0;
+  RequestState* state = states.back();
+  states.pop_back();
+  return RequestStatePtr(state);
+}
 
-  server_working_dir_.clear();
-  const auto& cfg = GlobalConfig::Instance().Get();
-  if (!cfg.server_working_dir.empty()) {
-    server_working_dir_ = cfg.server_working_dir;
+auto SteadyNowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Rewrite a response built for HTTP/1.1 (the write_buf, file_fd and listing
+// of state) as an HTTP/2 one. The header block is re-parsed rather than
+// built twice; it is small and this keeps a single set of response builders.
+auto to_h2_response(RequestState* state) -> H2Session::Response {
+  H2Session::Response response;
+  response.ready_ns = SteadyNowNs();
+  if (state->write_idx < 0) {
+    response.status = 500;
+    response.headers.emplace_back("content-length", "0");
+    return response;
   }
+  response.status = state->status;
+  std::string_view head(state->write_buf,
+                        static_cast<size_t>(state->write_idx));
+  auto end = head.find("\r\n\r\n");
+  if (end == std::string_view::npos) {
+    end = head.size();
+  } else {
+    response.body.assign(head.substr(end + 4));
+  }
+  head = head.substr(0, end);
+  head.remove_prefix(std::min(head.size(), head.find("\r\n")));  // status
+  while (!head.empty()) {
+    head.remove_prefix(std::min<size_t>(2, head.size()));  // "\r\n"
+    auto line = head.substr(0, head.find("\r\n"));
+    head.remove_prefix(line.size());
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    std::string name(line.substr(0, colon));
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    if (name == "connection" || name == "keep-alive" ||
+        name == "transfer-encoding" || name == "upgrade") {
+      continue;  // connection-specific, not allowed in HTTP/2
+    }
+    auto value = line.substr(colon + 1);
+    while (!value.empty() && value.front() == ' ') {
+      value.remove_prefix(1);
+    }
+    response.headers.emplace_back(std::move(name), std::string(value));
+  }
+  response.file_fd = std::exchange(state->file_fd, -1);
+  response.file_size = state->file_size;
+  response.listing = std::move(state->listing);
+  return response;
 }
 
-void HttpConn::Init(int sockfd, const sockaddr_in& addr, int fd) {
+// The request head as an upstream gets it, rebuilt from the lines that
+// ParseLine() ended with two NULs in read_buf. Hop-by-hop headers are
+// dropped (100-continue was answered here), the upstream connection is
+// kept alive, and the client address and scheme are passed on.
+auto proxy_request_head(const RequestState& req, uint32_t peer_ip, bool tls)
+    -> std::string {
+  auto is_equal_ncase = [](std::string_view s1, std::string_view s2) {
+    return s1.size() == s2.size() &&
+           std::equal(s1.begin(), s1.end(), s2.begin(), [](char a, char b) {
+             return std::tolower(static_cast<unsigned char>(a)) ==
+                    std::tolower(static_cast<unsigned char>(b));
+           });
+  };
+  constexpr std::string_view kDropped[] = {
+      "Connection", "Keep-Alive",        "Proxy-Connection", "TE",
+      "Upgrade",    "Expect",            "HTTP2-Settings",   "Trailer",
+      "X-Forwarded-For", "X-Forwarded-Proto"};
+  std::string head;
+  head.reserve(static_cast<size_t>(req.checked_idx) + 128);
+  std::string_view forwarded_for;
+  auto end = static_cast<size_t>(req.checked_idx);
+  for (size_t pos = 0; pos < end;) {
+    std::string_view line(req.read_buf + pos);
+    bool request_line = pos == 0;
+    pos += line.size() + 2;
+    if (line.empty()) {
+      break;
+    }
+    if (!request_line) {
+      auto name = line.substr(0, line.find(':'));
+      if (is_equal_ncase(name, "X-Forwarded-For")) {
+        forwarded_for = line.substr(name.size() + 1);
+        while (!forwarded_for.empty() && forwarded_for.front() == ' ') {
+          forwarded_for.remove_prefix(1);
+        }
+      }
+      if (std::any_of(std::begin(kDropped), std::end(kDropped),
+                      [&](std::string_view h) {
+                        return is_equal_ncase(name, h);
+                      })) {
+        continue;
+      }
+    }
+    head.append(line).append("\r\n");
+  }
+  char ip[INET_ADDRSTRLEN] = {};
+  in_addr addr{};
+  addr.s_addr = peer_ip;
+  inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+  head += "X-Forwarded-For: ";
+  if (!forwarded_for.empty()) {
+    head.append(forwarded_for).append(", ");
+  }
+  head += ip;
+  head += tls ? "\r\nX-Forwarded-Proto: https" : "\r\nX-Forwarded-Proto: http";
+  head += "\r\nConnection: keep-alive\r\n\r\n";
+  return head;
+}
+}  // namespace
+
+RequestState::RequestState() = default;
+RequestState::~RequestState() = default;
+
+void RequestState::Reset() {
+  read_idx = 0;
+  checked_idx = 0;
+  start_line = 0;
+  read_buf[0] = '\0';
+  write_idx = 0;
+
+  version = 0;
+  // Hand string storage back before the arena is rewound under it
+  std::pmr::string(&arena).swap(url);
+  std::pmr::string(&arena).swap(host);
+  arena.release();
+  linger = false;
+
+  method = HttpConn::GET;
+  check_state = HttpConn::CHECK_STATE_REQUESTLINE;
+  line_status = HttpConn::LINE_OK;
+
+  if (file_fd != -1) {
+    close(file_fd);
+    file_fd = -1;
+  }
+  file_size = 0;
+  write_buf_sent = 0;
+  file_bytes_sent = 0;
+
+  start_ns = 0;
+  first_byte_ns = 0;
+  status = 0;
+  user_agent = {};
+  trace.Clear();
+
+  upgrade_h2c = false;
+  h2_settings = {};
+  h2.reset();
+  listing.reset();
+
+  content_length = -1;
+  chunked = false;
+  expect_continue = false;
+  upload.reset();  // removes an unfinished upload's file
+
+  proxy_route = -1;
+  proxy.reset();
+}
+
+void RequestStateDeleter::operator()(RequestState* state) const {
+  state->Reset();
+  auto& states = t_request_states.states;
+  if (states.size() < kMaxIdleRequestStates) {
+    states.push_back(state);
+    return;
+  }
+  delete state;
+}
+
+auto HttpConn::MemoryReport(size_t conn_count) -> std::string {
+  // users_ holds each connection as an unordered_map node (key, shared_ptr,
+  // next pointer, cached hash) plus one bucket pointer; make_shared puts the
+  // control block (two counters, vtable) in front of the HttpConn.
+  constexpr size_t kMapNodeBytes =
+      sizeof(void*) + sizeof(std::pair<const int, std::shared_ptr<HttpConn>>) +
+      sizeof(size_t) + sizeof(void*);
+  constexpr size_t kControlBlockBytes = 2 * sizeof(int) + sizeof(void*);
+  constexpr size_t kIdleBytes =
+      sizeof(HttpConn) + kControlBlockBytes + kMapNodeBytes;
+  return std::format(
+      "Connection memory: HttpConn={}B, idle conn~{}B (conn+control "
+      "block+map node), active request +{}B; {} idle conns ~{:.1f} MiB "
+      "(TLS sessions extra)",
+      sizeof(HttpConn), kIdleBytes, sizeof(RequestState), conn_count,
+      static_cast<double>(kIdleBytes * conn_count) / (1024.0 * 1024.0));
+}
+
+HttpConn::HttpConn() = default;
+
+HttpConn::~HttpConn() {
+  if (coro_ != nullptr) {
+    CoroArena::Release(coro_);  // destroys a handler parked at an await
+    coro_ = nullptr;
+  }
+  if (ssl_ != nullptr) {
+    SSL_free(ssl_);
+    ssl_ = nullptr;
+  }
+}
+
+void HttpConn::Init() {
+  // Idle keep-alive connections hold no buffers; the next Read() attaches
+  // a fresh RequestState from the free list.
+  req_.reset();
+}
+
+void HttpConn::Init(int sockfd, const sockaddr_in& addr, int fd, SSL* ssl) {
   sockfd_ = sockfd;
-  address_ = addr;
+  peer_ip_ = addr.sin_addr.s_addr;
+  peer_port_ = addr.sin_port;
   mux_fd_ = fd;
+  if (ssl_ != nullptr) {
+    SSL_free(ssl_);
+  }
+  ssl_ = ssl;
+  tls_state_ = ssl != nullptr ? TlsState::TLS_HANDSHAKE : TlsState::TLS_NONE;
+  ktls_send_ = false;
+  accept_ticks_ = TraceClock::Now();
   Init();
 }
 
+void HttpConn::Trace(TracePoint point) {
+  if (req_) {
+    req_->trace.Stamp(point);
+  }
+}
+
+void HttpConn::Handshake() {
+  switch (HandshakeStep()) {
+    case IoStatus::kDone:
+    case IoStatus::kWantRead:
+      ModFd(sockfd_, NetEvent::READ_EVENT);
+      return;
+    case IoStatus::kWantWrite:
+      ModFd(sockfd_, NetEvent::WRITE_EVENT);
+      return;
+    case IoStatus::kError:
+      // Let the reactor observe the failure in Write() and close the socket
+      ModFd(sockfd_, NetEvent::WRITE_EVENT);
+      return;
+  }
+}
+
+auto HttpConn::HandshakeStep() -> IoStatus {
+  int ret = SSL_do_handshake(ssl_);
+  if (ret == 1) {
+    Metrics::Instance().Add(Counter::kTlsHandshakes);
+    tls_state_ = TlsState::TLS_READY;
+    ktls_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    LOG_INFO_FMT("TLS handshake done fd={} {} {} ktls_send={}", sockfd_,
+                 SSL_get_version(ssl_), SSL_get_cipher_name(ssl_),
+                 ktls_send_);
+    return IoStatus::kDone;
+  }
+
+  int err = SSL_get_error(ssl_, ret);
+  if (err == SSL_ERROR_WANT_READ) {
+    return IoStatus::kWantRead;
+  }
+  if (err == SSL_ERROR_WANT_WRITE) {
+    return IoStatus::kWantWrite;
+  }
+
+  LOG_WARN(std::format("TLS handshake failed fd={}: {}", sockfd_,
+                       TlsErrorString()));
+  Metrics::Instance().Add(Counter::kTlsHandshakeFailures);
+  tls_state_ = TlsState::TLS_FAILED;
+  return IoStatus::kError;
+}
+
 void HttpConn::Process() {
+  req_->trace.Stamp(TracePoint::kTaskStart);
+  FlightRecorder::Instance().Record(FlightEvent::kTaskStart, sockfd_);
+  if (req_->h2) {
+    ProcessH2();
+    return;
+  }
+  if (req_->upload) {
+    ProcessUpload();  // more of the body arrived
+    return;
+  }
   HTTP_CODE read_ret = ProcessRead();
   if (read_ret == NO_REQUEST) {
     // Need to read more data; re-arm EPOLLIN for this socket (one-shot)
     ModFd(sockfd_, NetEvent::READ_EVENT);
     return;
   }
+  if (read_ret == H2_REQUEST) {
+    if (StartH2()) {
+      ProcessH2();
+      return;
+    }
+    read_ret = BAD_REQUEST;
+  }
+  Parsed(read_ret);
+  if (read_ret == UPLOAD_REQUEST) {
+    ProcessUpload();
+    return;
+  }
+  if (read_ret == PROXY_REQUEST) {
+    // Relayed on the reactor thread from here on; the socket's first write
+    // readiness hands it over
+    if (StartProxy()) {
+      ModFd(sockfd_, NetEvent::WRITE_EVENT);
+      return;
+    }
+    read_ret = BAD_GATEWAY;
+  }
+  Executor* executor = executor_.load(std::memory_order_acquire);
+  if (executor != nullptr && NeedsFilesystem(read_ret)) {
+    executor->Post(Lane::kIo, [self = shared_from_this(), read_ret]() {
+      self->Respond(read_ret);
+    });
+    return;
+  }
+  Respond(read_ret);
+}
+
+void HttpConn::Parsed(HTTP_CODE read_ret) {
+  req_->trace.Stamp(TracePoint::kParseDone);
+  FlightRecorder::Instance().Record(FlightEvent::kParsed, sockfd_, read_ret);
+  MWS_USDT3(request_parsed, sockfd_, read_ret, req_->url.c_str());
+}
+
+auto HttpConn::NeedsFilesystem(HTTP_CODE read_ret) -> bool {
+  // Pages come from the response cache once it is built
+  const auto* cache = ResponseCache::Current();
+  if (read_ret != GET_REQUEST) {
+    return cache == nullptr;
+  }
+  const auto& cfg = GlobalConfig::Instance().Get();
+  if (!cfg.server_working_dir.empty()) {
+    return true;
+  }
+  bool cached = cache != nullptr && cache->text == cfg.custom_response_text;
+  return !cached && !cfg.custom_response_text.has_value();
+}
+
+void HttpConn::ProcessUpload() {
+  auto receive = [this]() {
+    HTTP_CODE ret = ReceiveBody();
+    if (ret == NO_REQUEST) {
+      ModFd(sockfd_, NetEvent::READ_EVENT);  // back here once data arrives
+      return;
+    }
+    Respond(ret);
+  };
+  if (Executor* executor = executor_.load(std::memory_order_acquire);
+      executor != nullptr) {
+    executor->Post(Lane::kIo,
+                   [self = shared_from_this(), receive]() { receive(); });
+    return;
+  }
+  receive();
+}
+
+void HttpConn::Respond(HTTP_CODE read_ret) {
+  BuildResponse(read_ret);
+  // Ready to send response in write_buf, switch to EPOLLOUT for sending
+  ModFd(sockfd_, NetEvent::WRITE_EVENT);
+}
+
+void HttpConn::BuildResponse(HTTP_CODE read_ret) {
   bool write_ret = ProcessWrite(read_ret);
   if (!write_ret) {
-    // Failed to process write, set write_idx_ to -1 to indicate no data to send
-    write_idx_ = -1;
+    // Failed to process write, set write_idx to -1 to indicate no data to send
+    req_->write_idx = -1;
   }
-  // Ready to send response in write_buf_, switch to EPOLLOUT for sending
-  ModFd(sockfd_, NetEvent::WRITE_EVENT);
 
-  LOG_INFO(std::format("{}:{} {} -> {}", ntohl(address_.sin_addr.s_addr),
-                       ntohs(address_.sin_port), url_,
-                       static_cast<int>(read_ret)));
+  // Log before re-arming: once EPOLLOUT fires the reactor may finish the
+  // response and release req_.
+  LOG_INFO_FMT("{}:{} {} -> {}", ntohl(peer_ip_), ntohs(peer_port_), req_->url,
+               static_cast<int>(read_ret));
+  req_->trace.Stamp(TracePoint::kResponseReady);
+  MWS_USDT3(response_chosen, sockfd_, req_->status, req_->file_size);
+  FlightRecorder::Instance().Record(FlightEvent::kResponse, sockfd_,
+                                    req_->status);
+}
+
+auto HttpConn::StartH2() -> bool {
+  auto& req = *req_;
+  req.h2 = std::make_unique<H2Session>();
+  if (!req.upgrade_h2c) {
+    req.h2->Start();  // prior knowledge: the preface is still in read_buf
+  } else {
+    H2Session::Request request;
+    request.method = "GET";
+    request.path = req.url;
+    request.authority = req.host;
+    request.user_agent = req.user_agent;
+    if (!req.h2->Upgrade(req.h2_settings, std::move(request))) {
+      req.h2.reset();
+      return false;
+    }
+    // Bytes after the upgrade request belong to the HTTP/2 connection
+    std::memmove(req.read_buf, req.read_buf + req.checked_idx,
+                 static_cast<size_t>(req.read_idx - req.checked_idx));
+    req.read_idx -= req.checked_idx;
+    req.checked_idx = 0;
+  }
+  req.h2_settings = {};
+  req.user_agent = {};
+  Metrics::Instance().Add(Counter::kH2Connections);
+  LOG_INFO_FMT("{}:{} switched to HTTP/2 ({})", ntohl(peer_ip_),
+               ntohs(peer_port_), req.upgrade_h2c ? "upgrade" : "preface");
+  return true;
+}
+
+void HttpConn::ProcessH2() {
+  Executor* executor = executor_.load(std::memory_order_acquire);
+  if (FeedH2() && executor != nullptr) {
+    executor->Post(Lane::kIo, [self = shared_from_this()]() {
+      self->RespondH2();
+      self->ModFd(self->sockfd_, self->H2Interest());
+    });
+    return;
+  }
+  RespondH2();
+  ModFd(sockfd_, H2Interest());
+}
+
+auto HttpConn::FeedH2() -> bool {
+  auto& req = *req_;
+  // A failed session keeps its GOAWAY queued; Write() closes after it
+  req.h2->Feed(req.read_buf, static_cast<size_t>(req.read_idx));
+  req.read_idx = 0;
+  return std::any_of(req.h2->requests().begin(), req.h2->requests().end(),
+                     [](const H2Session::Request& request) {
+                       return NeedsFilesystem(request.method == "GET"
+                                                  ? GET_REQUEST
+                                                  : BAD_REQUEST);
+                     });
+}
+
+void HttpConn::RespondH2() {
+  auto& h2 = *req_->h2;
+  auto requests = std::move(h2.requests());
+  h2.requests().clear();
+  for (const auto& request : requests) {
+    RequestStatePtr state = AcquireRequestState();
+    state->url.assign(request.path);
+    state->host.assign(request.authority);
+    state->user_agent = request.user_agent;
+    state->linger = true;
+    state->start_ns = request.start_ns;
+    // Only GET is served, as over HTTP/1.1; streams are not relayed to
+    // --proxy upstreams
+    HTTP_CODE code = request.method == "GET" ? GET_REQUEST : BAD_REQUEST;
+    if (MatchProxyRoute(GlobalConfig::Instance().Get().proxy, request.path) >=
+        0) {
+      code = BAD_GATEWAY;
+    }
+    req_.swap(state);
+    BuildResponse(code);
+    req_.swap(state);
+    h2.Respond(request.stream_id, to_h2_response(state.get()));
+  }
+}
+
+auto HttpConn::SendH2() -> IoStatus {
+  auto& h2 = *req_->h2;
+  IoStatus status = IoStatus::kDone;
+  while (true) {
+    auto pending = h2.Pending();
+    if (pending.empty()) {
+      if (!h2.Fill()) {
+        break;
+      }
+      continue;
+    }
+    auto ret = SendSome(pending.data(), pending.size());
+    if (ret == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return IoStatus::kError;
+      }
+      FlightRecorder::Instance().Record(FlightEvent::kEagainWrite, sockfd_);
+      status = IoStatus::kWantWrite;
+      break;
+    }
+    if (ret == 0) {
+      return IoStatus::kError;
+    }
+    h2.Sent(static_cast<size_t>(ret));
+  }
+  for (const auto& stats : h2.finished()) {
+    RecordH2Stream(stats);
+  }
+  h2.finished().clear();
+  return status;
+}
+
+auto HttpConn::H2Interest() const -> NetEvent {
+  const auto& h2 = *req_->h2;
+  if (h2.Done()) {
+    return NetEvent::WRITE_EVENT;  // Write() sees it and closes
+  }
+  return h2.HasOutput() ? NetEvent::READ_WRITE_EVENT : NetEvent::READ_EVENT;
+}
+
+void HttpConn::RecordH2Stream(const H2StreamStats& stats) {
+  auto& metrics = Metrics::Instance();
+  uint64_t bytes = stats.header_bytes + stats.body_bytes;
+  int64_t now_ns = SteadyNowNs();
+  metrics.Add(Counter::kH2Streams);
+  metrics.Add(Metrics::StatusCounter(stats.status));
+  metrics.Add(Counter::kResponseBytes, bytes);
+  metrics.Observe(Histogram::kResponseSize, bytes);
+  metrics.Observe(Histogram::kRequestDuration,
+                  static_cast<uint64_t>(now_ns - stats.start_ns));
+
+  auto& access_log = AccessLog::Instance();
+  if (!access_log.ShouldRecord(stats.status)) {
+    return;
+  }
+  auto duration = std::chrono::nanoseconds(now_ns - stats.start_ns);
+  AccessRecord record;
+  record.timestamp_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          (std::chrono::system_clock::now() - duration).time_since_epoch())
+          .count();
+  record.peer_ip = peer_ip_;
+  record.peer_port = peer_port_;
+  record.status = stats.status;
+  record.header_bytes = stats.header_bytes;
+  record.body_bytes = stats.body_bytes;
+  // Streams share the socket; the response being queued stands in for the
+  // first byte sent
+  record.ttfb_us =
+      static_cast<uint32_t>((stats.ready_ns - stats.start_ns) / 1000);
+  record.duration_us = static_cast<uint32_t>(duration.count() / 1000);
+  record.method = static_cast<uint8_t>(GET);
+  record.tls = false;
+  record.SetUrl(stats.path);
+  record.SetAgent(stats.user_agent);
+  access_log.Record(record);
+}
+
+// The handler only touches the frame from one thread at a time: EPOLLONESHOT
+// keeps the reactor quiet while a lane worker runs it, and both awaitables
+// hand the frame over as the last thing they do.
+class HttpConn::ReadyAwaiter {
+ public:
+  ReadyAwaiter(HttpConn* conn, NetEvent ev) : conn_(conn), ev_(ev) {}
+  auto await_ready() const noexcept -> bool { return false; }
+  // Once armed, the reactor may resume the handler before this returns
+  void await_suspend(std::coroutine_handle<> /*handle*/) const {
+    conn_->ModFd(conn_->sockfd_, ev_);
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  HttpConn* conn_;
+  NetEvent ev_;
+};
+
+class HttpConn::LaneAwaiter {
+ public:
+  LaneAwaiter(HttpConn* conn, Lane lane)
+      : conn_(conn),
+        lane_(lane),
+        lanes_(executor_.load(std::memory_order_acquire)) {}
+  auto await_ready() const noexcept -> bool { return lanes_ == nullptr; }
+  auto await_suspend(std::coroutine_handle<> handle) -> bool {
+    // Written before submitting: the worker reads it in await_resume()
+    moved_ = true;
+    if (lanes_->TryPost(lane_, [self = conn_->shared_from_this(), handle]() {
+          handle.resume();
+        })) {
+      return true;
+    }
+    moved_ = false;  // cpu lane full, keep running here
+    return false;
+  }
+  auto await_resume() const noexcept -> bool { return moved_; }
+
+ private:
+  HttpConn* conn_;
+  Lane lane_;
+  Executor* lanes_;
+  bool moved_{false};
+};
+
+auto ConnCoroutine::promise_type::operator new(size_t size, HttpConn& conn)
+    -> void* {
+  return conn.coro_->AllocateFrame(size);
+}
+
+auto HttpConn::Ready(NetEvent ev) -> ReadyAwaiter { return {this, ev}; }
+
+auto HttpConn::OnLane(Lane lane) -> LaneAwaiter { return {this, lane}; }
+
+void HttpConn::StartCoroutine() {
+  coro_ = CoroArena::Acquire();
+  coro_->handle = Serve().Release();
+}
+
+auto HttpConn::Resume() -> bool {
+  coro_->handle.resume();
+  // The handler may now be running on a lane worker; it only sets finished
+  // on its last step, and acquire makes everything before that visible
+  return !coro_->finished.load(std::memory_order_acquire);
+}
+
+// Runs from the first EPOLLIN after accept until the connection closes.
+// Socket waits resume it on the reactor thread; handshakes and filesystem
+// work hop to their lanes. It always finishes on the reactor, which then
+// closes the socket.
+auto HttpConn::Serve() -> ConnCoroutine {
+  if (tls_state_ == TlsState::TLS_HANDSHAKE) {
+    IoStatus status = IoStatus::kWantRead;
+    while (true) {
+      co_await OnLane(Lane::kCpu);
+      status = HandshakeStep();
+      if (status == IoStatus::kWantRead) {
+        co_await Ready(NetEvent::READ_EVENT);
+      } else if (status == IoStatus::kWantWrite) {
+        co_await Ready(NetEvent::WRITE_EVENT);
+      } else {
+        break;
+      }
+    }
+    if (status == IoStatus::kError) {
+      co_await Ready(NetEvent::WRITE_EVENT);  // back to the reactor to close
+      coro_->finished.store(true, std::memory_order_release);
+      co_return;
+    }
+    co_await Ready(NetEvent::READ_EVENT);
+  }
+
+  while (true) {
+    HTTP_CODE read_ret = NO_REQUEST;
+    while (true) {
+      if (!Read()) {
+        coro_->finished.store(true, std::memory_order_release);
+        co_return;
+      }
+      Trace(TracePoint::kEnqueue);
+      Trace(TracePoint::kTaskStart);
+      read_ret = ProcessRead();
+      if (read_ret != NO_REQUEST) {
+        Parsed(read_ret);
+        break;
+      }
+      co_await Ready(NetEvent::READ_EVENT);
+    }
+
+    if (read_ret == H2_REQUEST) {
+      if (StartH2()) {
+        // The rest of the connection is HTTP/2
+        while (true) {
+          if (FeedH2()) {
+            bool moved_h2 = co_await OnLane(Lane::kIo);
+            RespondH2();
+            if (moved_h2) {
+              co_await Ready(NetEvent::WRITE_EVENT);
+            }
+          } else {
+            RespondH2();
+          }
+          if (SendH2() == IoStatus::kError || req_->h2->Done()) {
+            coro_->finished.store(true, std::memory_order_release);
+            co_return;
+          }
+          co_await Ready(H2Interest());
+          if (!Read()) {
+            coro_->finished.store(true, std::memory_order_release);
+            co_return;
+          }
+        }
+      }
+      read_ret = BAD_REQUEST;
+    }
+
+    if (read_ret == PROXY_REQUEST) {
+      // Relayed right here on the reactor thread, which resumes the
+      // handler for the client socket and the upstream connection alike
+      IoStatus status = StartProxy() ? ProxyStep() : IoStatus::kDone;
+      while (status == IoStatus::kWantRead || status == IoStatus::kWantWrite) {
+        co_await std::suspend_always{};
+        status = ProxyStep();
+      }
+      if (status == IoStatus::kError) {
+        coro_->finished.store(true, std::memory_order_release);
+        co_return;
+      }
+      if (req_->proxy) {
+        if (!FinishResponse()) {
+          coro_->finished.store(true, std::memory_order_release);
+          co_return;
+        }
+        if (!req_) {
+          co_await Ready(NetEvent::READ_EVENT);
+        }
+        continue;
+      }
+      read_ret = BAD_GATEWAY;
+    }
+
+    bool moved = false;
+    if (read_ret == UPLOAD_REQUEST) {
+      // The body goes from the socket to the file on the io lane, waiting
+      // on the reactor whenever the socket runs dry
+      while (true) {
+        moved = co_await OnLane(Lane::kIo);
+        read_ret = ReceiveBody();
+        if (read_ret != NO_REQUEST) {
+          break;
+        }
+        co_await Ready(NetEvent::READ_EVENT);
+      }
+    } else if (NeedsFilesystem(read_ret)) {
+      moved = co_await OnLane(Lane::kIo);
+    }
+    BuildResponse(read_ret);
+    if (moved) {
+      // Send from the reactor; a lane worker must not finish the handler
+      co_await Ready(NetEvent::WRITE_EVENT);
+    }
+    IoStatus status = SendResponse();
+    while (status == IoStatus::kWantRead || status == IoStatus::kWantWrite) {
+      co_await Ready(NetEvent::WRITE_EVENT);
+      status = SendResponse();
+    }
+    if (status == IoStatus::kError || !FinishResponse()) {
+      coro_->finished.store(true, std::memory_order_release);
+      co_return;
+    }
+    if (!req_) {
+      co_await Ready(NetEvent::READ_EVENT);  // nothing pipelined
+    }
+  }
 }
 
 auto HttpConn::Read() -> bool {
-  if (read_idx_ >= static_cast<int>(sizeof(read_buf_) - 1)) {
+  if (!req_) {
+    req_ = AcquireRequestState();
+  }
+  auto& req = *req_;
+  if (req.upload) {
+    return true;  // the body is left in the socket for ReceiveBody()
+  }
+  if (req.read_idx >= static_cast<int>(sizeof(req.read_buf) - 1)) {
     return false;  // buffer full -> treat as error
   }
 
   ssize_t bytes_read = 0;
+  int start_idx = req.read_idx;
   // Non-blocking read loop
   while (true) {
-    bytes_read = recv(sockfd_, read_buf_ + read_idx_,
-                      static_cast<int>(sizeof(read_buf_) - read_idx_ - 1), 0);
+    bytes_read =
+        RecvSome(req.read_buf + req.read_idx,
+                 sizeof(req.read_buf) - static_cast<size_t>(req.read_idx) - 1);
     if (bytes_read == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
         // No more data for now
+        if (req.read_idx == start_idx) {
+          FlightRecorder::Instance().Record(FlightEvent::kEagainRead, sockfd_);
+        }
         return true;
       }
       return false;
@@ -146,88 +984,304 @@ auto HttpConn::Read() -> bool {
       return false;
     }
 
-    read_idx_ += static_cast<int>(bytes_read);
-    // Buffer overflow
-    if (read_idx_ >= static_cast<int>(sizeof(read_buf_) - 1)) {
-      return false;
+    TrafficCapture::Instance().OnData(sockfd_, req.read_buf + req.read_idx,
+                                      static_cast<size_t>(bytes_read));
+    if (req.read_idx == 0) {
+      req.start_ns = SteadyNowNs();
+      req.trace.Stamp(TracePoint::kFirstRead);
+      if (accept_ticks_ != 0) {
+        req.trace.ticks[static_cast<size_t>(TracePoint::kAccept)] =
+            accept_ticks_;
+        accept_ticks_ = 0;
+      }
+    }
+    req.read_idx += static_cast<int>(bytes_read);
+    // Keep the buffer NUL-terminated; it is no longer zeroed per request
+    req.read_buf[req.read_idx] = '\0';
+    // Buffer full: Process() drains it (HTTP/2 frames, an upload body
+    // after the headers) or refuses headers that do not fit
+    if (req.read_idx >= static_cast<int>(sizeof(req.read_buf) - 1)) {
+      return true;
     }
   }
 }
 
 // Write response to socket
 auto HttpConn::Write() -> bool {
-  if (write_idx_ == -1) {
+  if (req_ && req_->h2) {
+    if (SendH2() == IoStatus::kError || req_->h2->Done()) {
+      return false;
+    }
+    ModFd(sockfd_, H2Interest());
+    return true;
+  }
+  switch (SendResponse()) {
+    case IoStatus::kDone:
+      break;
+    case IoStatus::kWantRead:
+    case IoStatus::kWantWrite:
+      ModFd(sockfd_, NetEvent::WRITE_EVENT);
+      return true;
+    case IoStatus::kError:
+      return false;
+  }
+  if (!FinishResponse()) {
     return false;
   }
+  NextRequest();
+  return true;
+}
 
-  // Phase 1: send HTTP header from write_buf_
-  while (write_buf_sent_ < write_idx_) {
-    auto ret = send(sockfd_, write_buf_ + write_buf_sent_,
-                    write_idx_ - write_buf_sent_, 0);
+auto HttpConn::SendResponse() -> IoStatus {
+  if (tls_state_ == TlsState::TLS_FAILED || !req_ || req_->write_idx == -1) {
+    return IoStatus::kError;
+  }
+  auto& req = *req_;
+
+  // Phase 1: send HTTP header from write_buf. When a body follows, hold it
+  // back with MSG_MORE so it leaves in the body's first segment instead of
+  // as a small packet that Nagle and delayed ACK stall the body behind;
+  // the body's last send (sendfile's final chunk included) pushes it out
+  bool body_follows =
+      req.listing != nullptr || (req.file_fd != -1 && req.file_size > 0);
+  while (req.write_buf_sent < req.write_idx) {
+    auto ret =
+        SendSome(req.write_buf + req.write_buf_sent,
+                 static_cast<size_t>(req.write_idx - req.write_buf_sent),
+                 body_follows);
     if (ret == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        ModFd(sockfd_, NetEvent::WRITE_EVENT);
-        return true;
+        FlightRecorder::Instance().Record(FlightEvent::kEagainWrite, sockfd_);
+        return IoStatus::kWantWrite;
       }
-      return false;
+      return IoStatus::kError;
     }
     if (ret == 0) {
-      return false;
+      return IoStatus::kError;
+    }
+    if (req.first_byte_ns == 0) {
+      req.first_byte_ns = SteadyNowNs();
+      req.trace.Stamp(TracePoint::kFirstSend);
+    }
+    req.write_buf_sent += ret;
+  }
+
+  // Phase 2a: userspace TLS cannot use sendfile, encrypt file chunks instead
+  if (req.file_fd != -1 && ssl_ != nullptr && !ktls_send_) {
+    while (req.file_bytes_sent < req.file_size) {
+      // A retry after EAGAIN re-reads the same offset and length, which is
+      // what OpenSSL requires for a pending SSL_write.
+      char chunk[kTlsFileChunkSize];
+      auto len =
+          std::min<off_t>(sizeof(chunk), req.file_size - req.file_bytes_sent);
+      auto n = pread(req.file_fd, chunk, static_cast<size_t>(len),
+                     req.file_bytes_sent);
+      if (n <= 0) {
+        close(req.file_fd);
+        req.file_fd = -1;
+        return IoStatus::kError;
+      }
+      auto ret = SendSome(chunk, static_cast<size_t>(n));
+      if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          FlightRecorder::Instance().Record(FlightEvent::kEagainWrite, sockfd_);
+          return IoStatus::kWantWrite;
+        }
+        close(req.file_fd);
+        req.file_fd = -1;
+        return IoStatus::kError;
+      }
+      req.file_bytes_sent += ret;
     }
-    write_buf_sent_ += ret;
+    close(req.file_fd);
+    req.file_fd = -1;
   }
 
-  // Phase 2: send file body via sendfile
-  if (file_fd_ != -1) {
-    while (file_bytes_sent_ < file_size_) {
+  // Phase 2: send file body via sendfile (kTLS encrypts it in the kernel)
+  if (req.file_fd != -1) {
+    while (req.file_bytes_sent < req.file_size) {
+      MWS_USDT3(sendfile_start, sockfd_, req.file_bytes_sent, req.file_size);
 #if defined(__linux__)
-      off_t offset = file_bytes_sent_;
-      auto ret = sendfile(sockfd_, file_fd_, &offset,
-                          static_cast<size_t>(file_size_ - file_bytes_sent_));
+      off_t offset = req.file_bytes_sent;
+      auto ret = sendfile(sockfd_, req.file_fd, &offset,
+                          static_cast<size_t>(req.file_size -
+                                              req.file_bytes_sent));
       auto sent = ret;
 #elif defined(__APPLE__)
-      off_t len = file_size_ - file_bytes_sent_;
+      off_t len = req.file_size - req.file_bytes_sent;
       auto ret =
-          sendfile(file_fd_, sockfd_, file_bytes_sent_, &len, nullptr, 0);
+          sendfile(req.file_fd, sockfd_, req.file_bytes_sent, &len, nullptr, 0);
       auto sent = len;
 #endif
+      MWS_USDT2(sendfile_end, sockfd_, ret == -1 ? -errno : sent);
       if (ret == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
 #if defined(__APPLE__)
-          file_bytes_sent_ += sent;
+          req.file_bytes_sent += sent;
 #endif
-          ModFd(sockfd_, NetEvent::WRITE_EVENT);
-          return true;
+          FlightRecorder::Instance().Record(FlightEvent::kEagainWrite, sockfd_);
+          return IoStatus::kWantWrite;
         }
-        close(file_fd_);
-        file_fd_ = -1;
-        return false;
+        close(req.file_fd);
+        req.file_fd = -1;
+        return IoStatus::kError;
       }
-      file_bytes_sent_ += sent;
+      req.file_bytes_sent += sent;
     }
-    close(file_fd_);
-    file_fd_ = -1;
+    close(req.file_fd);
+    req.file_fd = -1;
   }
 
-  if (!linger_) {
-    return false;
+  // Phase 3: directory listing, read a chunk at a time as the socket drains
+  if (req.listing != nullptr) {
+    for (auto chunk = req.listing->Pending(); !chunk.empty();
+         chunk = req.listing->Pending()) {
+      auto ret = SendSome(chunk.data(), chunk.size(), req.listing->More());
+      if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          FlightRecorder::Instance().Record(FlightEvent::kEagainWrite, sockfd_);
+          return IoStatus::kWantWrite;
+        }
+        return IoStatus::kError;
+      }
+      if (ret == 0) {
+        return IoStatus::kError;
+      }
+      req.listing->Sent(static_cast<size_t>(ret));
+      req.file_bytes_sent += ret;
+    }
   }
 
-  Init();
-  ModFd(sockfd_, NetEvent::READ_EVENT);
+  return IoStatus::kDone;
+}
+
+auto HttpConn::FinishResponse() -> bool {
+  FlightRecorder::Instance().Record(FlightEvent::kComplete, sockfd_,
+                                    req_->status);
+  RecordMetrics();
+  RecordAccess();
+  if (!req_->linger) {
+    if (tls_state_ == TlsState::TLS_READY) {
+      SSL_shutdown(ssl_);  // best-effort close_notify before the reactor closes
+    }
+    return false;
+  }
+  // Requests pipelined behind this one were read along with it and no
+  // EPOLLIN will announce them; keep them at the front of read_buf
+  auto& req = *req_;
+  auto pending = static_cast<size_t>(req.read_idx - req.checked_idx);
+  if (pending == 0 || req.h2) {
+    Init();
+    return true;
+  }
+  if (req.status == 400) {
+    return false;  // where the next request starts is anyone's guess
+  }
+  int from = req.checked_idx;
+  req.Reset();
+  std::memmove(req.read_buf, req.read_buf + from, pending);
+  req.read_idx = static_cast<int>(pending);
+  req.read_buf[pending] = '\0';
+  req.start_ns = SteadyNowNs();
+  req.trace.Stamp(TracePoint::kFirstRead);
   return true;
 }
 
+void HttpConn::NextRequest() {
+  if (!req_) {
+    ModFd(sockfd_, NetEvent::READ_EVENT);
+    return;
+  }
+  if (Executor* executor = executor_.load(std::memory_order_acquire);
+      executor != nullptr) {
+    executor->Post(Lane::kCpu,
+                   [self = shared_from_this()]() { self->Process(); });
+    return;
+  }
+  Process();
+}
+
+void HttpConn::RecordMetrics() {
+  const auto& req = *req_;
+  auto& metrics = Metrics::Instance();
+  auto bytes = static_cast<uint64_t>(req.write_buf_sent) +
+               static_cast<uint64_t>(req.file_bytes_sent);
+  metrics.Add(Metrics::StatusCounter(req.status));
+  metrics.Add(Counter::kResponseBytes, bytes);
+  metrics.Observe(Histogram::kResponseSize, bytes);
+  if (req.start_ns != 0) {
+    metrics.Observe(Histogram::kRequestDuration,
+                    static_cast<uint64_t>(SteadyNowNs() - req.start_ns));
+  }
+  req_->trace.Stamp(TracePoint::kComplete);
+  SlowTraceLog::Instance().Finish(req.trace, req.status, req.url);
+}
+
+void HttpConn::RecordAccess() {
+  auto& access_log = AccessLog::Instance();
+  const auto& req = *req_;
+  if (!access_log.ShouldRecord(req.status)) {
+    return;
+  }
+  int64_t now_ns = SteadyNowNs();
+  int64_t start_ns = req.start_ns != 0 ? req.start_ns : now_ns;
+  int64_t first_byte_ns = req.first_byte_ns != 0 ? req.first_byte_ns : now_ns;
+  auto duration = std::chrono::nanoseconds(now_ns - start_ns);
+
+  AccessRecord record;
+  // Wall-clock start derived from the monotonic duration; one clock read
+  record.timestamp_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          (std::chrono::system_clock::now() - duration).time_since_epoch())
+          .count();
+  record.peer_ip = peer_ip_;
+  record.peer_port = peer_port_;
+  record.status = req.status;
+  record.header_bytes = static_cast<uint64_t>(req.write_buf_sent);
+  record.body_bytes = static_cast<uint64_t>(req.file_bytes_sent);
+  record.ttfb_us = static_cast<uint32_t>((first_byte_ns - start_ns) / 1000);
+  record.duration_us = static_cast<uint32_t>(duration.count() / 1000);
+  record.method = static_cast<uint8_t>(req.method);
+  record.tls = ssl_ != nullptr;
+  record.SetUrl(req.url);
+  record.SetAgent(req.user_agent);
+  access_log.Record(record);
+}
+
+auto HttpConn::RecvSome(char* buf, size_t len) -> ssize_t {
+  if (ssl_ == nullptr) {
+    return recv(sockfd_, buf, len, 0);
+  }
+  return TlsRecv(ssl_, buf, len);
+}
+
+auto HttpConn::SendSome(const char* buf, size_t len, bool more) -> ssize_t {
+  if (ssl_ == nullptr) {
+    return send(sockfd_, buf, len, more ? kMsgMore : 0);
+  }
+  return TlsSend(ssl_, buf, len);
+}
+
 // Handle the HTTP connection
 auto HttpConn::ProcessRead() -> HTTP_CODE {
-  line_status_ = ParseLine();
+  // HTTP/2 with prior knowledge starts with the connection preface
+  if (req_->checked_idx == 0 && ssl_ == nullptr &&
+      GlobalConfig::Instance().Get().h2c) {
+    std::string_view head(req_->read_buf,
+                          static_cast<size_t>(req_->read_idx));
+    size_t n = std::min(head.size(), kH2Preface.size());
+    if (head.substr(0, n) == kH2Preface.substr(0, n)) {
+      return n == kH2Preface.size() ? H2_REQUEST : NO_REQUEST;
+    }
+  }
+  req_->line_status = ParseLine();
   HTTP_CODE ret = NO_REQUEST;
   char* text = nullptr;
   // Main state machine loop
-  while (line_status_ == LINE_OK) {
-    text = read_buf_ + start_line_;
-    start_line_ = checked_idx_;
-    switch (check_state_) {
+  while (req_->line_status == LINE_OK) {
+    text = req_->read_buf + req_->start_line;
+    req_->start_line = req_->checked_idx;
+    switch (req_->check_state) {
       case CHECK_STATE_REQUESTLINE: {
         ret = ParseRequest(text);
         if (ret == BAD_REQUEST) {
@@ -241,16 +1295,9 @@ auto HttpConn::ProcessRead() -> HTTP_CODE {
         if (ret == BAD_REQUEST) {
           return BAD_REQUEST;
         }
-        if (ret == GET_REQUEST) {
-          return GET_REQUEST;
+        if (ret != NO_REQUEST) {
+          return ret;
         }
-        // We ignore other cases for now
-        break;
-      }
-
-      case CHECK_STATE_CONTENT: {
-        ret = ParseContent();
-        /* TODO */
         break;
       }
 
@@ -259,7 +1306,12 @@ auto HttpConn::ProcessRead() -> HTTP_CODE {
       }
     }
 
-    line_status_ = ParseLine();
+    req_->line_status = ParseLine();
+  }
+  // Headers that do not fit read_buf can never complete
+  if (req_->read_idx >= static_cast<int>(sizeof(req_->read_buf) - 1)) {
+    req_->linger = false;
+    return BAD_REQUEST;
   }
   return NO_REQUEST;
 }
@@ -277,160 +1329,206 @@ auto HttpConn::ProcessWrite(HTTP_CODE ret) -> bool {
       return WriteNoResource();
     case GET_REQUEST:
       return WriteGetRequest();
+    case UPLOAD_REQUEST:
+      return WriteUploadResponse();
+    case LENGTH_REQUIRED:
+      return WriteLengthRequired();
+    case PAYLOAD_TOO_LARGE:
+      return WritePayloadTooLarge();
+    case BAD_GATEWAY:
+      return WriteBadGateway();
     default:
       return false;
   }
 }
 
 auto HttpConn::WriteInternalError() -> bool {
-  std::string body;
-  auto path = (resource_dir() / "html" / "500.html").string();
-  if (!load_body(path.c_str(), &body)) {
+  req_->status = 500;
+  std::pmr::string storage(&req_->arena);
+  auto body = page_body(ResponseCache::kInternalError, "500.html", &storage);
+  if (!body.has_value()) {
     return WriteServerError();
   }
-  if (!AddResponse(std::format(kHeader500, body.size()))) {
+  if (!add_formatted(req_.get(), kHeader500, body->size())) {
     return false;
   }
-  return AddResponse(body);
+  return AddResponse(*body);
 }
 
 auto HttpConn::WriteBadRequest() -> bool {
-  std::string body;
-  auto path = (resource_dir() / "html" / "400.html").string();
-  if (!load_body(path.c_str(), &body)) {
+  req_->status = 400;
+  std::pmr::string storage(&req_->arena);
+  auto body = page_body(ResponseCache::kBadRequest, "400.html", &storage);
+  if (!body.has_value()) {
     return WriteServerError();
   }
-  if (!AddResponse(std::format(kHeader400, body.size()))) {
+  if (!add_formatted(req_.get(), kHeader400, body->size())) {
     return false;
   }
-  return AddResponse(body);
+  return AddResponse(*body);
 }
 
 auto HttpConn::WriteForbiddenRequest() -> bool {
-  std::string body;
-  auto path = (resource_dir() / "html" / "403.html").string();
-  if (!load_body(path.c_str(), &body)) {
+  req_->status = 403;
+  std::pmr::string storage(&req_->arena);
+  auto body = page_body(ResponseCache::kForbidden, "403.html", &storage);
+  if (!body.has_value()) {
     return WriteServerError();
   }
-  if (!AddResponse(std::format(kHeader403, body.size()))) {
+  if (!add_formatted(req_.get(), kHeader403, body->size())) {
     return false;
   }
-  return AddResponse(body);
+  return AddResponse(*body);
 }
 
 auto HttpConn::WriteNoResource() -> bool {
-  std::string body;
-  auto path = (resource_dir() / "html" / "404.html").string();
-  if (!load_body(path.c_str(), &body)) {
+  req_->status = 404;
+  std::pmr::string storage(&req_->arena);
+  auto body = page_body(ResponseCache::kNotFound, "404.html", &storage);
+  if (!body.has_value()) {
     return WriteServerError();
   }
-  if (!AddResponse(std::format(kHeader404, body.size()))) {
+  if (!add_formatted(req_.get(), kHeader404, body->size())) {
     return false;
   }
-  return AddResponse(body);
+  return AddResponse(*body);
 }
 
 auto HttpConn::WriteServerError() -> bool {
-  linger_ = false;
+  req_->status = 500;
+  req_->linger = false;
   return AddResponse(kHeader500Empty);
 }
 
+auto HttpConn::WriteUploadResponse() -> bool {
+  const char* connection = req_->linger ? "keep-alive" : "close";
+  if (req_->upload->created()) {
+    req_->status = 201;
+    return add_formatted(req_.get(), kHeader201, connection);
+  }
+  req_->status = 204;
+  return add_formatted(req_.get(), kHeader204, connection);
+}
+
+auto HttpConn::WriteLengthRequired() -> bool {
+  req_->status = 411;
+  req_->linger = false;
+  return AddResponse(kHeader411Empty);
+}
+
+auto HttpConn::WritePayloadTooLarge() -> bool {
+  req_->status = 413;
+  req_->linger = false;
+  return AddResponse(kHeader413Empty);
+}
+
+auto HttpConn::WriteBadGateway() -> bool {
+  req_->status = 502;
+  return add_formatted(req_.get(), kHeader502,
+                       req_->linger ? "keep-alive" : "close");
+}
+
 auto HttpConn::WriteGetRequest() -> bool {
+  // Shared, read-only configuration; nothing is copied per connection
   const auto& cfg = GlobalConfig::Instance().Get();
+  const auto& working_dir = cfg.server_working_dir;
+  auto* arena = &req_->arena;
+  const char* connection = req_->linger ? "keep-alive" : "close";
+  req_->status = 200;
 
   // Default response without server dir specified
-  if (server_working_dir_.empty()) {
-    std::string body;
-    if (cfg.custom_response_text.has_value()) {
-      body += cfg.custom_response_text.value();
-      body += '\n';
-    }
-
-    if (body.empty()) {
-      auto path = (resource_dir() / "html" / "200.html").string();
-      if (!load_body(path.c_str(), &body)) {
+  if (working_dir.empty()) {
+    std::pmr::string body(arena);
+    std::string_view page;
+    const auto* cache = ResponseCache::Current();
+    // A cache built before the last reload may still hold the old --text
+    if (cache != nullptr && cache->text == cfg.custom_response_text) {
+      if (!cache->pages[ResponseCache::kOk].has_value()) {
         return WriteServerError();
       }
+      page = *cache->pages[ResponseCache::kOk];
     } else {
-      body = std::format(kHtmlWrapFmt, body);
+      if (cfg.custom_response_text.has_value()) {
+        std::pmr::string text(arena);
+        text += cfg.custom_response_text.value();
+        text += '\n';
+        std::format_to(std::back_inserter(body), kHtmlWrapFmt, text);
+      } else {
+        auto path = page_path("200.html", arena);
+        if (!load_body(path.c_str(), &body)) {
+          return WriteServerError();
+        }
+      }
+      page = body;
     }
 
-    if (!AddResponse(std::format(kHeader200, body.size(),
-                                 (linger_ ? "keep-alive" : "close")))) {
+    if (!add_formatted(req_.get(), kHeader200, page.size(), connection)) {
       return false;
     }
-    return AddResponse(body);
+    return AddResponse(page);
   }
 
-  // Default request with server dir specified
-  if (url_ == "/") {
-    std::string dir_listing;
-    try {
-      for (const auto& entry :
-           std::filesystem::directory_iterator(server_working_dir_)) {
-        if (entry.is_regular_file()) {
-          auto name = entry.path().filename().string();
-          dir_listing += std::format(kFileLinkFmt, name, name);
-        }
-      }
-    } catch (const std::filesystem::filesystem_error& e) {
-      dir_listing += std::format(kDirErrorFmt, e.what());
-    }
+  // The query string only matters to the listing
+  std::string_view target = req_->url;
+  std::string_view query;
+  if (auto mark = target.find('?'); mark != std::string_view::npos) {
+    query = target.substr(mark + 1);
+    target = target.substr(0, mark);
+  }
 
-    std::string body;
-    if (cfg.custom_response_text.has_value()) {
-      body += cfg.custom_response_text.value();
-      body += '\n';
+  // Default request with server dir specified: the listing is read and
+  // sent a chunk at a time, see SendResponse()
+  if (target == "/") {
+    ListingQuery listing_query;
+    if (!ListingQuery::Parse(query, &listing_query)) {
+      return WriteBadRequest();
     }
-    body += std::format(kPreFmt, dir_listing);
-    body = std::format(kHtmlWrapFmt, body);
-
-    if (!AddResponse(std::format(kHeader200, body.size(),
-                                 (linger_ ? "keep-alive" : "close")))) {
-      return false;
+    std::string_view text;
+    if (cfg.custom_response_text.has_value()) {
+      text = *cfg.custom_response_text;
     }
-    return AddResponse(body);
+    req_->listing = std::make_unique<DirListing>();
+    req_->listing->Open(working_dir, listing_query, text);
+    return add_formatted(req_.get(), kHeader200Chunked, connection);
   }
 
   // Request for file, allow single-level plain file only
-  auto requested_path =
-      (server_working_dir_ / url_.substr(1)).lexically_normal();
-
-  // Guard against escape
-  auto [mismatch_start, _] =
-      std::mismatch(server_working_dir_.begin(), server_working_dir_.end(),
-                    requested_path.begin());
-  if (mismatch_start != server_working_dir_.end()) {
+  auto name = single_level_name(target);
+  if (!name.has_value()) {
     return WriteForbiddenRequest();
   }
-
-  // Check single-level
-  auto relative =
-      std::filesystem::relative(requested_path, server_working_dir_);
-  if (relative.empty() || relative.has_parent_path()) {
-    return WriteForbiddenRequest();
+  std::pmr::string path(arena);
+  // Sized once: growing by doubling would leave dead copies in the arena
+  path.reserve(working_dir.native().size() + name->size() + 2);
+  path += working_dir.native();
+  if (path.back() != '/') {
+    path += '/';
+  }
+  path += *name;
+  // A URL ending in "/", "/." or "/.." names a directory; keep the slash so
+  // lstat() fails for a plain file
+  if (!target.ends_with(*name)) {
+    path += '/';
   }
 
-  auto file_status = std::filesystem::symlink_status(requested_path);
-  if (!std::filesystem::exists(file_status)) {
-    return WriteNoResource();
+  struct stat file_stat {};
+  if (lstat(path.c_str(), &file_stat) == -1) {
+    return errno == EACCES ? WriteForbiddenRequest() : WriteNoResource();
   }
-  if (std::filesystem::is_directory(file_status) ||
-      std::filesystem::is_symlink(file_status)) {
-    return WriteForbiddenRequest();
+  if (!S_ISREG(file_stat.st_mode)) {
+    return WriteForbiddenRequest();  // directories, symlinks, devices
   }
 
-  file_fd_ = open(requested_path.c_str(), O_RDONLY);
-  if (file_fd_ == -1) {
+  req_->file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (req_->file_fd == -1) {
     return WriteServerError();
   }
-  file_size_ = std::filesystem::file_size(requested_path);
-  LOG_INFO(std::format("Serving file: {} ({} bytes)", requested_path.string(),
-                       file_size_));
-  if (!AddResponse(std::format(kHeader200File, file_size_,
-                               (linger_ ? "keep-alive" : "close")))) {
-    close(file_fd_);
-    file_fd_ = -1;
+  req_->file_size = file_stat.st_size;
+  LOG_INFO_FMT("Serving file: {} ({} bytes)", path, req_->file_size);
+  if (!add_formatted(req_.get(), kHeader200File, req_->file_size,
+                     connection)) {
+    close(req_->file_fd);
+    req_->file_fd = -1;
     return false;
   }
   return true;
@@ -438,26 +1536,27 @@ auto HttpConn::WriteGetRequest() -> bool {
 
 // Parse a line and determine its status (Search \r\n)
 auto HttpConn::ParseLine() -> LINE_STATUS {
+  auto& req = *req_;
   char tmp;
-  for (; checked_idx_ < read_idx_; ++checked_idx_) {
-    tmp = read_buf_[checked_idx_];
+  for (; req.checked_idx < req.read_idx; ++req.checked_idx) {
+    tmp = req.read_buf[req.checked_idx];
     if (tmp == '\r') {
-      if ((checked_idx_ + 1) == read_idx_) {
+      if ((req.checked_idx + 1) == req.read_idx) {
         return LINE_OPEN;
       }
 
-      if (read_buf_[checked_idx_ + 1] == '\n') {
-        read_buf_[checked_idx_++] = '\0';  // For convenience
-        read_buf_[checked_idx_++] = '\0';
+      if (req.read_buf[req.checked_idx + 1] == '\n') {
+        req.read_buf[req.checked_idx++] = '\0';  // For convenience
+        req.read_buf[req.checked_idx++] = '\0';
         return LINE_OK;
       }
       return LINE_BAD;
     }
 
     if (tmp == '\n') {
-      if (checked_idx_ > 0 && read_buf_[checked_idx_ - 1] == '\r') {
-        read_buf_[checked_idx_ - 1] = '\0';
-        read_buf_[checked_idx_++] = '\0';
+      if (req.checked_idx > 0 && req.read_buf[req.checked_idx - 1] == '\r') {
+        req.read_buf[req.checked_idx - 1] = '\0';
+        req.read_buf[req.checked_idx++] = '\0';
         return LINE_OK;
       }
       return LINE_BAD;
@@ -470,15 +1569,27 @@ auto HttpConn::ParseLine() -> LINE_STATUS {
 auto HttpConn::ParseRequest(char* text) -> HTTP_CODE {
   int start = 0;
   int end = 0;
-  version_ = 0;
+  req_->version = 0;
   // Parse method
   while (text[end] != '\0') {
     if (text[end] == ' ') {
-      std::string method(text + start, end - start);
+      std::string_view method(text + start, end - start);
       if (method == "GET") {
-        method_ = GET;
+        req_->method = GET;
+      } else if (method == "PUT") {
+        req_->method = PUT;
+      } else if (method == "POST") {
+        req_->method = POST;  // a raw body, stored like PUT
+      } else if (method == "HEAD") {
+        req_->method = HEAD;  // these only on --proxy routes, see below
+      } else if (method == "DELETE") {
+        req_->method = DELETE;
+      } else if (method == "OPTIONS") {
+        req_->method = OPTIONS;
+      } else if (method == "PATCH") {
+        req_->method = PATCH;
       } else {
-        return BAD_REQUEST;  // We only support GET for now
+        return BAD_REQUEST;
       }
       break;
     }
@@ -493,7 +1604,7 @@ auto HttpConn::ParseRequest(char* text) -> HTTP_CODE {
   // Parse URL
   while (text[end] != '\0') {
     if (text[end] == ' ') {
-      url_ = std::string(text + start, end - start);
+      req_->url.assign(text + start, end - start);
       break;
     }
     ++end;
@@ -504,12 +1615,22 @@ auto HttpConn::ParseRequest(char* text) -> HTTP_CODE {
   }
   start = ++end;
 
+  // Paths under a --proxy route go upstream whatever the method
+  const auto& proxy = GlobalConfig::Instance().Get().proxy;
+  if (!proxy.routes.empty()) {
+    req_->proxy_route = MatchProxyRoute(proxy, req_->url);
+  }
+  if (req_->proxy_route < 0 && req_->method != GET && req_->method != PUT &&
+      req_->method != POST) {
+    return BAD_REQUEST;
+  }
+
   // Parse HTTP version
   while (text[end] != '\0') {
     if (text[end + 1] == '\0') {
-      std::string version(text + start, end - start + 1);
+      std::string_view version(text + start, end - start + 1);
       if (version == "HTTP/1.1") {
-        version_ = 1;
+        req_->version = 1;
       } else {
         return BAD_REQUEST;  // We only support HTTP/1.1 for now
       }
@@ -518,11 +1639,11 @@ auto HttpConn::ParseRequest(char* text) -> HTTP_CODE {
     ++end;
   }
 
-  if (version_ == 0) {
+  if (req_->version == 0) {
     return BAD_REQUEST;
   }
 
-  check_state_ = CHECK_STATE_HEADER;
+  req_->check_state = CHECK_STATE_HEADER;
   return NO_REQUEST;
 }
 
@@ -531,7 +1652,35 @@ auto HttpConn::ParseHeader(char* text) -> HTTP_CODE {
   std::string_view line(text);
   // An empty line indicates the end of headers
   if (line.empty()) {
-    return GET_REQUEST;
+    if (req_->proxy_route >= 0) {
+      // Same smuggling rule as uploads; the framing is relayed as is
+      if (req_->chunked && req_->content_length >= 0) {
+        req_->linger = false;
+        return BAD_REQUEST;
+      }
+      req_->check_state = CHECK_STATE_CONTENT;
+      return PROXY_REQUEST;
+    }
+    // h2c upgrade (RFC 7540, 3.2); not offered over TLS, which would
+    // negotiate h2 with ALPN instead
+    if (req_->upgrade_h2c && !req_->h2_settings.empty() && ssl_ == nullptr &&
+        req_->method == GET && GlobalConfig::Instance().Get().h2c) {
+      return H2_REQUEST;
+    }
+    req_->upgrade_h2c = false;
+    if (req_->method == GET) {
+      return GET_REQUEST;
+    }
+    // Both framings at once is how requests get smuggled (RFC 9112, 6.3)
+    if (req_->chunked && req_->content_length >= 0) {
+      req_->linger = false;
+      return BAD_REQUEST;
+    }
+    if (!req_->chunked && req_->content_length < 0) {
+      return LENGTH_REQUIRED;
+    }
+    req_->check_state = CHECK_STATE_CONTENT;
+    return UPLOAD_REQUEST;
   }
 
   auto colon_idx = line.find(':');
@@ -554,35 +1703,320 @@ auto HttpConn::ParseHeader(char* text) -> HTTP_CODE {
   };
 
   if (is_equal_ncase(key, "Host")) {
-    host_ = std::string(value);
+    req_->host.assign(value);
+  } else if (is_equal_ncase(key, "User-Agent")) {
+    req_->user_agent = value;  // read_buf outlives the request
   } else if (is_equal_ncase(key, "Connection")) {
     if (is_equal_ncase(value, "keep-alive")) {
-      linger_ = true;
+      req_->linger = true;
     }
+  } else if (is_equal_ncase(key, "Upgrade")) {
+    req_->upgrade_h2c = value.find("h2c") != std::string_view::npos;
+  } else if (is_equal_ncase(key, "HTTP2-Settings")) {
+    req_->h2_settings = value;  // read_buf outlives the request
+  } else if (is_equal_ncase(key, "Content-Length")) {
+    uint64_t length = 0;
+    auto [end, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), length);
+    if (value.empty() || ec != std::errc() ||
+        end != value.data() + value.size() || length > INT64_MAX ||
+        (req_->content_length >= 0 &&
+         static_cast<uint64_t>(req_->content_length) != length)) {
+      req_->linger = false;
+      return BAD_REQUEST;
+    }
+    req_->content_length = static_cast<int64_t>(length);
+  } else if (is_equal_ncase(key, "Transfer-Encoding")) {
+    if (!is_equal_ncase(value, "chunked")) {
+      req_->linger = false;
+      return BAD_REQUEST;  // no other coding is decoded
+    }
+    req_->chunked = true;
+  } else if (is_equal_ncase(key, "Expect")) {
+    req_->expect_continue = is_equal_ncase(value, "100-continue");
   } else {
     // Other headers are ignored for now
   }
   return NO_REQUEST;  // Need to read more
 }
 
-// Parse the HTTP message body
-auto HttpConn::ParseContent() -> HTTP_CODE {
-  // For GET requests there is typically no message body.
-  // Accept this as a complete request.
-  return GET_REQUEST;
+auto HttpConn::StartUpload() -> HTTP_CODE {
+  auto& req = *req_;
+  const auto& cfg = GlobalConfig::Instance().Get();
+  if (cfg.server_working_dir.empty() || cfg.max_upload == 0) {
+    return FORBIDDEN_REQUEST;  // uploads are off
+  }
+  // A body over the limit is read and discarded rather than left in the
+  // socket, unless the client waits for 100-continue or it is far over
+  auto length = static_cast<uint64_t>(std::max<int64_t>(req.content_length, 0));
+  bool too_large = !req.chunked && length > cfg.max_upload;
+  if (too_large && (req.expect_continue ||
+                    length - cfg.max_upload > Upload::kMaxDiscard)) {
+    return PAYLOAD_TOO_LARGE;
+  }
+  // Same rule as downloads: a plain file directly under --dir
+  std::string_view target = req.url;
+  target = target.substr(0, target.find('?'));
+  auto name = single_level_name(target);
+  if (!name.has_value() || !target.ends_with(*name)) {
+    return FORBIDDEN_REQUEST;
+  }
+  std::pmr::string path(&req.arena);
+  path.reserve(cfg.server_working_dir.native().size() + name->size() + 2);
+  path += cfg.server_working_dir.native();
+  if (path.back() != '/') {
+    path += '/';
+  }
+  path += *name;
+  struct stat file_stat {};
+  if (lstat(path.c_str(), &file_stat) == 0 && !S_ISREG(file_stat.st_mode)) {
+    return FORBIDDEN_REQUEST;  // directories, symlinks, devices
+  }
+
+  auto upload = std::make_unique<Upload>(length, req.chunked, cfg.max_upload);
+  if (!too_large && !upload->Open(cfg.server_working_dir, *name)) {
+    int err = errno;
+    LOG_ERROR_FMT("Cannot create upload file in {}: {}",
+                  cfg.server_working_dir.native(), std::strerror(err));
+    return err == EACCES ? FORBIDDEN_REQUEST : INTERNAL_ERROR;
+  }
+  // Tell a waiting client to send the body, unless it already started
+  if (req.expect_continue && req.checked_idx == req.read_idx &&
+      SendSome(kHeader100Continue.data(), kHeader100Continue.size()) !=
+          static_cast<ssize_t>(kHeader100Continue.size())) {
+    return CLOSED_CONNECTION;
+  }
+  // read_buf is reused for the body; keep the User-Agent for the access log
+  if (!req.user_agent.empty()) {
+    auto* copy = static_cast<char*>(req.arena.allocate(req.user_agent.size()));
+    std::memcpy(copy, req.user_agent.data(), req.user_agent.size());
+    req.user_agent = {copy, req.user_agent.size()};
+  }
+  req.upload = std::move(upload);
+  return NO_REQUEST;
+}
+
+auto HttpConn::ReceiveBody() -> HTTP_CODE {
+  auto& req = *req_;
+  if (!req.upload) {
+    if (HTTP_CODE ret = StartUpload(); ret != NO_REQUEST) {
+      req.linger = false;  // the body is still unread
+      return ret;
+    }
+  }
+  auto& upload = *req.upload;
+  using Status = Upload::Status;
+  Status status = Status::kMore;
+  while (status == Status::kMore) {
+    // Bytes that came with the headers, then chunk framing
+    size_t used = 0;
+    status = upload.Consume(
+        std::string_view(req.read_buf + req.checked_idx,
+                         static_cast<size_t>(req.read_idx - req.checked_idx)),
+        &used);
+    req.checked_idx += static_cast<int>(used);
+    if (status != Status::kMore) {
+      break;
+    }
+    // Keep an incomplete framing line at the front of read_buf
+    std::memmove(req.read_buf, req.read_buf + req.checked_idx,
+                 static_cast<size_t>(req.read_idx - req.checked_idx));
+    req.read_idx -= req.checked_idx;
+    req.checked_idx = 0;
+#if defined(__linux__)
+    if (req.read_idx == 0 && ssl_ == nullptr && upload.can_splice()) {
+      status = upload.Splice(sockfd_);
+      continue;
+    }
+#endif
+    // Framing, and the payload too under TLS
+    ssize_t n =
+        RecvSome(req.read_buf + req.read_idx,
+                 sizeof(req.read_buf) - static_cast<size_t>(req.read_idx) - 1);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      status = Status::kWantRead;
+    } else if (n <= 0) {
+      status = Status::kClosed;
+    } else {
+      req.read_idx += static_cast<int>(n);
+    }
+  }
+
+  HTTP_CODE ret = UPLOAD_REQUEST;
+  switch (status) {
+    case Status::kWantRead:
+      return NO_REQUEST;
+    case Status::kDone:
+      if (upload.too_large()) {
+        ret = PAYLOAD_TOO_LARGE;
+      } else if (!upload.Commit()) {
+        int err = errno;
+        LOG_ERROR_FMT("Cannot store upload {}: {}", req.url,
+                      std::strerror(err));
+        ret = err == EISDIR || err == EACCES ? FORBIDDEN_REQUEST
+                                             : INTERNAL_ERROR;
+      }
+      break;
+    case Status::kTooLarge:
+      ret = PAYLOAD_TOO_LARGE;
+      break;
+    case Status::kBadBody:
+      ret = BAD_REQUEST;
+      break;
+    case Status::kClosed:
+      ret = CLOSED_CONNECTION;
+      break;
+    case Status::kMore:
+    case Status::kIoError:
+      LOG_ERROR_FMT("Cannot write upload {}: {}", req.url,
+                    std::strerror(errno));
+      ret = INTERNAL_ERROR;
+      break;
+  }
+  Metrics::Instance().Add(Counter::kUploadBytes, upload.received());
+  if (ret != UPLOAD_REQUEST) {
+    req.linger = status == Status::kDone && req.linger;
+    req.upload.reset();  // drop the partial file here, on the io lane
+  } else {
+    LOG_INFO_FMT("Stored upload: {} ({} bytes)", req.url, upload.received());
+  }
+  return ret;
+}
+
+auto HttpConn::StartProxy() -> bool {
+  auto& req = *req_;
+  UpstreamPool* upstreams = upstreams_.load(std::memory_order_acquire);
+  if (upstreams == nullptr) {
+    return false;
+  }
+  // Tell a waiting client to send the body, unless it already started
+  bool has_body = req.chunked || req.content_length > 0;
+  if (req.expect_continue && has_body && req.checked_idx == req.read_idx &&
+      SendSome(kHeader100Continue.data(), kHeader100Continue.size()) !=
+          static_cast<ssize_t>(kHeader100Continue.size())) {
+    req.linger = false;
+    return false;
+  }
+  // The exchange takes whatever followed the head, pipelined or not, and
+  // hands back what it did not relay once done (KeepPipelined())
+  std::string_view body_start(req.read_buf + req.checked_idx,
+                              static_cast<size_t>(req.read_idx -
+                                                  req.checked_idx));
+  ProxyExchange::Client client;
+  client.fd = sockfd_;
+  client.ssl = ssl_;
+  client.splice_in = ssl_ == nullptr;
+  client.splice_out = ssl_ == nullptr || ktls_send_;
+  client.keep_alive = req.linger;
+  req.proxy = std::make_unique<ProxyExchange>(
+      upstreams, static_cast<size_t>(req.proxy_route), client,
+      proxy_request_head(req, peer_ip_, ssl_ != nullptr), body_start,
+      req.content_length, req.chunked, req.method == HEAD);
+  req.read_idx = req.checked_idx;
+  return true;
+}
+
+auto HttpConn::ProxyStep() -> IoStatus {
+  auto& req = *req_;
+  auto& proxy = *req.proxy;
+  using Status = ProxyExchange::Status;
+  using Wait = ProxyExchange::Wait;
+  Status status = proxy.Pump();
+  if (req.first_byte_ns == 0 && proxy.head_bytes() > 0) {
+    req.first_byte_ns = SteadyNowNs();
+    req.trace.Stamp(TracePoint::kFirstSend);
+  }
+  switch (status) {
+    case Status::kWait:
+      // The exchange armed its upstream connection itself
+      if (proxy.wait() == Wait::kClientRead) {
+        ModFd(sockfd_, NetEvent::READ_EVENT);
+        return IoStatus::kWantRead;
+      }
+      if (proxy.wait() == Wait::kClientWrite) {
+        ModFd(sockfd_, NetEvent::WRITE_EVENT);
+        return IoStatus::kWantWrite;
+      }
+      return proxy.wait() == Wait::kUpstreamRead ? IoStatus::kWantRead
+                                                 : IoStatus::kWantWrite;
+    case Status::kDone:
+      req.status = proxy.status();
+      req.write_buf_sent = static_cast<int>(proxy.head_bytes());
+      req.file_bytes_sent = static_cast<off_t>(proxy.body_bytes());
+      req.linger = req.linger && proxy.keep_alive() && KeepPipelined();
+      LOG_INFO_FMT("{}:{} {} -> {} via {}", ntohl(peer_ip_), ntohs(peer_port_),
+                   req.url, req.status, proxy.upstream());
+      return IoStatus::kDone;
+    case Status::kBadGateway:
+      req.linger = req.linger && proxy.keep_alive() && KeepPipelined();
+      req.proxy.reset();
+      return IoStatus::kDone;
+    case Status::kClosed:
+      break;
+  }
+  return IoStatus::kError;
+}
+
+auto HttpConn::KeepPipelined() -> bool {
+  auto& req = *req_;
+  auto pipelined = req.proxy->pipelined();
+  // The head before checked_idx still backs url and the headers
+  auto at = static_cast<size_t>(req.checked_idx);
+  if (pipelined.size() >= sizeof(req.read_buf) - at) {
+    LOG_WARN("Pipelined requests after a proxied one overflow the buffer.");
+    return false;
+  }
+  std::memcpy(req.read_buf + at, pipelined.data(), pipelined.size());
+  req.read_idx = static_cast<int>(at + pipelined.size());
+  req.read_buf[req.read_idx] = '\0';
+  return true;
+}
+
+auto HttpConn::IsProxying() const -> bool {
+  return req_ && req_->proxy;
+}
+
+auto HttpConn::ProxyWants(int fd) const -> bool {
+  return IsProxying() && req_->proxy->Wants(fd);
+}
+
+auto HttpConn::Proxy() -> bool {
+  IoStatus status = ProxyStep();
+  if (status == IoStatus::kWantRead || status == IoStatus::kWantWrite) {
+    return true;
+  }
+  if (status == IoStatus::kError) {
+    return false;
+  }
+  if (!req_->proxy) {
+    BuildResponse(BAD_GATEWAY);
+    return Write();
+  }
+  if (!FinishResponse()) {
+    return false;
+  }
+  NextRequest();
+  return true;
+}
+
+void HttpConn::AbortProxy() {
+  if (IsProxying()) {
+    req_->proxy.reset();
+  }
 }
 
 // Add response data to the write buffer
 auto HttpConn::AddResponse(std::string_view text) -> bool {
-  if (write_idx_ < 0) {
+  auto& req = *req_;
+  if (req.write_idx < 0) {
     return false;
   }
-  size_t remaining = sizeof(write_buf_) - static_cast<size_t>(write_idx_);
+  size_t remaining = sizeof(req.write_buf) - static_cast<size_t>(req.write_idx);
   if (text.size() > remaining) {
     return false;
   }
-  std::memcpy(write_buf_ + write_idx_, text.data(), text.size());
-  write_idx_ += static_cast<int>(text.size());
+  std::memcpy(req.write_buf + req.write_idx, text.data(), text.size());
+  req.write_idx += static_cast<int>(text.size());
   return true;
 }
 
@@ -598,9 +2032,11 @@ auto HttpConn::SetNonblocking(int interest_fd) -> int {
 void HttpConn::ModFd(int interest_fd, NetEvent ev) {
   int event_flags = -1;
   if (ev == NetEvent::READ_EVENT) {
-    event_flags = EPOLLREAD;
+    event_flags = EPOLLIN;
   } else if (ev == NetEvent::WRITE_EVENT) {
     event_flags = EPOLLOUT;
+  } else if (ev == NetEvent::READ_WRITE_EVENT) {
+    event_flags = EPOLLIN | EPOLLOUT;
   } else {
     return;
   }
@@ -616,7 +2052,11 @@ void HttpConn::ModFd(int interest_fd, NetEvent ev) {
   int16_t filter = -1;
   if (ev == NetEvent::READ_EVENT) {
     filter = EVFILT_READ;
-  } else if (ev == NetEvent::WRITE_EVENT) {
+  } else if (ev == NetEvent::WRITE_EVENT ||
+             ev == NetEvent::READ_WRITE_EVENT) {
+    // One-shot filters fire separately, so arming both could run Read()
+    // and Write() at once; an HTTP/2 connection with output pending waits
+    // for the socket to drain before reading again
     filter = EVFILT_WRITE;
   } else {
     return;
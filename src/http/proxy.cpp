@@ -0,0 +1,685 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements ProxyExchange: sending the request upstream,
+// rewriting the response head, and relaying both bodies.
+
+#include "http/proxy.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#include "logger/logger.hpp"
+#include "tls/tls_context.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+// Chunk size lines and trailers are short; anything longer is refused
+constexpr size_t kMaxFrameLine = 1024;
+constexpr uint64_t kMaxChunkSize = std::numeric_limits<uint64_t>::max();
+// Payload moved per splice() into the pipe
+constexpr size_t kSpliceSize = 256 * 1024;
+#if defined(MSG_MORE)
+constexpr int kMsgMore = MSG_MORE;
+#else
+constexpr int kMsgMore = 0;
+#endif
+
+auto iequals(std::string_view a, std::string_view b) -> bool {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+auto trim(std::string_view s) -> std::string_view {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() &&
+         (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// Whether the comma-separated list holds token, ignoring case
+auto has_token(std::string_view list, std::string_view token) -> bool {
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    if (iequals(trim(list.substr(0, comma)), token)) {
+      return true;
+    }
+    list = comma == std::string_view::npos ? std::string_view()
+                                           : list.substr(comma + 1);
+  }
+  return false;
+}
+
+auto hex_value(char c) -> int {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+}  // namespace
+
+void ProxyExchange::Framing::Reset(Kind kind, uint64_t length) {
+  kind_ = kind;
+  left_ = length;
+  size_ = 0;
+  line_ = 0;
+  digits_ = false;
+  ext_ = false;
+  switch (kind) {
+    case Kind::kNone:
+      state_ = State::kDone;
+      break;
+    case Kind::kLength:
+      state_ = length == 0 ? State::kDone : State::kData;
+      break;
+    case Kind::kChunked:
+      state_ = State::kSize;
+      break;
+    case Kind::kUntilClose:
+      left_ = std::numeric_limits<uint64_t>::max();
+      state_ = State::kData;
+      break;
+  }
+}
+
+auto ProxyExchange::Framing::blind() const -> uint64_t {
+  return state_ == State::kData ? left_ : 0;
+}
+
+void ProxyExchange::Framing::Skip(uint64_t n) {
+  if (kind_ == Kind::kUntilClose) {
+    return;
+  }
+  left_ -= n;
+  if (left_ == 0) {
+    state_ = kind_ == Kind::kLength ? State::kDone : State::kDataCr;
+  }
+}
+
+void ProxyExchange::Framing::Closed() {
+  if (kind_ == Kind::kUntilClose) {
+    state_ = State::kDone;
+  }
+}
+
+auto ProxyExchange::Framing::Scan(const char* data, size_t len) -> size_t {
+  size_t i = 0;
+  while (i < len && state_ != State::kDone && state_ != State::kBad) {
+    if (state_ == State::kData) {
+      auto take = static_cast<size_t>(std::min<uint64_t>(left_, len - i));
+      i += take;
+      Skip(take);
+      continue;
+    }
+    char c = data[i++];
+    switch (state_) {
+      case State::kSize: {
+        if (++line_ > kMaxFrameLine) {
+          state_ = State::kBad;
+        } else if (c == '\n') {
+          if (!digits_) {
+            state_ = State::kBad;
+          } else if (size_ == 0) {
+            state_ = State::kTrailer;
+            line_ = 0;
+          } else {
+            left_ = size_;
+            state_ = State::kData;
+          }
+          size_ = 0;
+          line_ = 0;
+          digits_ = false;
+          ext_ = false;
+        } else if (c == '\r' || ext_) {
+          // the line ends soon, extensions are passed on unread
+        } else if (c == ';' || c == ' ' || c == '\t') {
+          ext_ = true;
+        } else if (int v = hex_value(c);
+                   v >= 0 && size_ <= kMaxChunkSize / 16) {
+          size_ = size_ * 16 + static_cast<uint64_t>(v);
+          digits_ = true;
+        } else {
+          state_ = State::kBad;
+        }
+        break;
+      }
+      case State::kDataCr:
+        state_ = c == '\r' ? State::kDataLf
+                           : (c == '\n' ? State::kSize : State::kBad);
+        break;
+      case State::kDataLf:
+        state_ = c == '\n' ? State::kSize : State::kBad;
+        break;
+      case State::kTrailer:
+        if (c == '\n') {
+          if (line_ == 0) {
+            state_ = State::kDone;
+          }
+          line_ = 0;
+        } else if (c != '\r' && ++line_ > kMaxFrameLine) {
+          state_ = State::kBad;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return i;
+}
+
+ProxyExchange::ProxyExchange(UpstreamPool* pool, size_t route,
+                             const Client& client, std::string head,
+                             std::string_view body_start,
+                             int64_t content_length, bool chunked,
+                             bool head_only)
+    : pool_(pool),
+      route_(route),
+      client_(client),
+      request_(std::move(head)),
+      replayable_(false),
+      head_only_(head_only),
+      keep_alive_(client.keep_alive) {
+  if (chunked) {
+    req_body_.Reset(Framing::Kind::kChunked);
+  } else if (content_length > 0) {
+    req_body_.Reset(Framing::Kind::kLength,
+                    static_cast<uint64_t>(content_length));
+  }
+  size_t used = req_body_.Scan(body_start.data(), body_start.size());
+  request_.append(body_start.substr(0, used));
+  pipelined_.assign(body_start.substr(used));
+  replayable_ = req_body_.done();
+}
+
+ProxyExchange::~ProxyExchange() {
+  if (lease_.fd != -1) {
+    pool_->Release(&lease_, false);
+  }
+}
+
+auto ProxyExchange::Wants(int fd) const -> bool {
+  switch (wait_) {
+    case Wait::kClientRead:
+    case Wait::kClientWrite:
+      return fd == client_.fd;
+    case Wait::kUpstreamRead:
+    case Wait::kUpstreamWrite:
+      return fd == lease_.fd;
+    default:
+      return false;
+  }
+}
+
+auto ProxyExchange::upstream() const -> std::string_view {
+  return address_ != nullptr ? std::string_view(address_->text) : "-";
+}
+
+auto ProxyExchange::Pump() -> Status {
+  wait_ = Wait::kNone;
+  while (true) {
+    switch (stage_) {
+      case Stage::kConnect: {
+        if (req_body_.bad()) {
+          return Close();
+        }
+        if (attempts_ >= pool_->route_size(route_) ||
+            !pool_->Acquire(route_, client_.fd, &lease_)) {
+          LOG_WARN("No upstream could take the request.");
+          return BadGateway();
+        }
+        address_ = &pool_->upstream(lease_.upstream);
+        if (!lease_.reused) {
+          ++attempts_;
+        }
+        if (lease_.connecting) {
+          stage_ = Stage::kConnecting;
+          return WaitFor(Wait::kUpstreamWrite);
+        }
+        stage_ = Stage::kRequestHead;
+        break;
+      }
+
+      case Stage::kConnecting: {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(lease_.fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+          err = errno;
+        }
+        if (err != 0) {
+          LOG_WARN_FMT("Upstream {} connect error: {}", upstream(),
+                       std::strerror(err));
+          pool_->Fail(&lease_);
+          stage_ = Stage::kConnect;  // try the next upstream
+          break;
+        }
+        lease_.connecting = false;
+        stage_ = Stage::kRequestHead;
+        break;
+      }
+
+      case Stage::kRequestHead: {
+        bool broke = false;
+        while (request_sent_ < request_.size()) {
+          ssize_t n = Send(false, request_.data() + request_sent_,
+                           request_.size() - request_sent_, false);
+          if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return WaitFor(Wait::kUpstreamWrite);
+          }
+          if (n <= 0) {
+            broke = true;
+            break;
+          }
+          request_sent_ += static_cast<size_t>(n);
+        }
+        if (broke) {
+          if (!UpstreamBroke()) {
+            return BadGateway();
+          }
+          break;
+        }
+        stage_ = req_body_.done() ? Stage::kResponseHead : Stage::kRequestBody;
+        break;
+      }
+
+      case Stage::kRequestBody: {
+        switch (Relay(false, &req_body_)) {
+          case Flow::kDone:
+            stage_ = Stage::kResponseHead;
+            break;
+          case Flow::kWaitIn:
+            return WaitFor(Wait::kClientRead);
+          case Flow::kWaitOut:
+            return WaitFor(Wait::kUpstreamWrite);
+          case Flow::kInClosed:
+            return Close();  // the client left or broke the framing
+          case Flow::kOutError:
+            if (!UpstreamBroke()) {
+              return BadGateway();
+            }
+            break;
+        }
+        break;
+      }
+
+      case Stage::kResponseHead: {
+        std::string_view got(buf_, buf_end_);
+        auto end = got.find("\r\n\r\n");
+        if (end == std::string_view::npos) {
+          if (buf_end_ == sizeof(buf_)) {
+            LOG_WARN_FMT("Upstream {} sent an oversized response head",
+                         upstream());
+            return BadGateway();
+          }
+          ssize_t n = recv(lease_.fd, buf_ + buf_end_, sizeof(buf_) - buf_end_,
+                           0);
+          if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return WaitFor(Wait::kUpstreamRead);
+          }
+          if (n == -1 && errno == EINTR) {
+            break;
+          }
+          if (n <= 0) {
+            if (!UpstreamBroke()) {
+              return BadGateway();
+            }
+            break;
+          }
+          buf_end_ += static_cast<size_t>(n);
+          break;
+        }
+        size_t head_size = end + 4;
+        if (!ParseResponseHead(got.substr(0, head_size))) {
+          LOG_WARN_FMT("Upstream {} sent a malformed response head",
+                       upstream());
+          return BadGateway();
+        }
+        if (status_ < 200) {
+          // Interim responses are not passed on; the client's 100-continue
+          // was answered before the request went upstream
+          std::memmove(buf_, buf_ + head_size, buf_end_ - head_size);
+          buf_end_ -= head_size;
+          status_ = 0;
+          break;
+        }
+        buf_begin_ = head_size;
+        stage_ = Stage::kResponseHeadOut;
+        break;
+      }
+
+      case Stage::kResponseHeadOut: {
+        while (head_out_sent_ < head_out_.size()) {
+          ssize_t n = Send(true, head_out_.data() + head_out_sent_,
+                           head_out_.size() - head_out_sent_,
+                           buf_begin_ < buf_end_);
+          if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return WaitFor(Wait::kClientWrite);
+          }
+          if (n <= 0) {
+            return Close();
+          }
+          head_out_sent_ += static_cast<size_t>(n);
+          head_bytes_ += static_cast<uint64_t>(n);
+        }
+        // Body bytes that came with the head
+        size_t used = resp_body_.Scan(buf_ + buf_begin_, buf_end_ - buf_begin_);
+        if (resp_body_.bad()) {
+          return Close();
+        }
+        if (buf_begin_ + used < buf_end_) {
+          upstream_reusable_ = false;  // bytes past the response
+        }
+        buf_end_ = buf_begin_ + used;
+        stage_ = Stage::kResponseBody;
+        break;
+      }
+
+      case Stage::kResponseBody: {
+        switch (Relay(true, &resp_body_)) {
+          case Flow::kDone:
+            stage_ = Stage::kDone;
+            pool_->Release(&lease_, upstream_reusable_);
+            return Status::kDone;
+          case Flow::kWaitIn:
+            return WaitFor(Wait::kUpstreamRead);
+          case Flow::kWaitOut:
+            return WaitFor(Wait::kClientWrite);
+          case Flow::kInClosed:
+            LOG_WARN_FMT("Upstream {} cut the response short", upstream());
+            return Close();
+          case Flow::kOutError:
+            return Close();
+        }
+        break;
+      }
+
+      case Stage::kDone:
+        return Status::kDone;
+    }
+  }
+}
+
+auto ProxyExchange::Relay(bool to_client, Framing* framing) -> Flow {
+  while (true) {
+    while (buf_begin_ < buf_end_) {
+      ssize_t n =
+          Send(to_client, buf_ + buf_begin_, buf_end_ - buf_begin_, false);
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return Flow::kWaitOut;
+      }
+      if (n <= 0) {
+        return Flow::kOutError;
+      }
+      buf_begin_ += static_cast<size_t>(n);
+      body_bytes_ += to_client ? static_cast<uint64_t>(n) : 0;
+    }
+    buf_begin_ = buf_end_ = 0;
+#if defined(__linux__)
+    int in_fd = to_client ? lease_.fd : client_.fd;
+    int out_fd = to_client ? client_.fd : lease_.fd;
+    while (pipe_bytes_ > 0) {
+      ssize_t n = splice(lease_.pipe[0], nullptr, out_fd, nullptr, pipe_bytes_,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n == -1 && errno == EAGAIN) {
+        return Flow::kWaitOut;
+      }
+      if (n <= 0) {
+        return Flow::kOutError;
+      }
+      pipe_bytes_ -= static_cast<size_t>(n);
+      body_bytes_ += to_client ? static_cast<uint64_t>(n) : 0;
+    }
+#endif
+    if (framing->done()) {
+      return Flow::kDone;
+    }
+    uint64_t blind = framing->blind();
+#if defined(__linux__)
+    bool can_splice = to_client ? client_.splice_out : client_.splice_in;
+    if (blind > 0 && can_splice && pool_->EnsurePipe(&lease_)) {
+      auto want = static_cast<size_t>(std::min<uint64_t>(blind, kSpliceSize));
+      ssize_t n = splice(in_fd, nullptr, lease_.pipe[1], nullptr, want,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n == -1 && errno == EAGAIN) {
+        return Flow::kWaitIn;  // the pipe is empty here, so the socket is
+      }
+      if (n == 0 && framing->until_close()) {
+        framing->Closed();
+        continue;
+      }
+      if (n <= 0) {
+        return Flow::kInClosed;
+      }
+      framing->Skip(static_cast<uint64_t>(n));
+      pipe_bytes_ = static_cast<size_t>(n);
+      continue;
+    }
+#endif
+    size_t want = sizeof(buf_);
+    if (blind > 0) {
+      want = static_cast<size_t>(std::min<uint64_t>(want, blind));
+    }
+    ssize_t n = Recv(!to_client, buf_, want);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return Flow::kWaitIn;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == 0 && framing->until_close()) {
+      framing->Closed();
+      continue;
+    }
+    if (n <= 0) {
+      return Flow::kInClosed;
+    }
+    size_t used = framing->Scan(buf_, static_cast<size_t>(n));
+    if (framing->bad()) {
+      return Flow::kInClosed;
+    }
+    if (used < static_cast<size_t>(n)) {
+      // Bytes past the body: a pipelined request or a confused upstream
+      if (to_client) {
+        upstream_reusable_ = false;
+      } else {
+        pipelined_.append(buf_ + used, static_cast<size_t>(n) - used);
+      }
+    }
+    buf_end_ = used;
+  }
+}
+
+auto ProxyExchange::Recv(bool from_client, char* buf, size_t len)
+    -> ssize_t {
+  if (!from_client) {
+    return recv(lease_.fd, buf, len, 0);
+  }
+  if (client_.ssl != nullptr) {
+    return TlsRecv(client_.ssl, buf, len);
+  }
+  return recv(client_.fd, buf, len, 0);
+}
+
+auto ProxyExchange::Send(bool to_client, const char* buf, size_t len,
+                         bool more) -> ssize_t {
+  if (!to_client) {
+    return send(lease_.fd, buf, len, 0);
+  }
+  if (client_.ssl != nullptr) {
+    return TlsSend(client_.ssl, buf, len);
+  }
+  return send(client_.fd, buf, len, more ? kMsgMore : 0);
+}
+
+auto ProxyExchange::ParseResponseHead(std::string_view head) -> bool {
+  auto line_end = head.find('\n');
+  auto line = trim(head.substr(0, line_end));
+  head.remove_prefix(line_end + 1);
+  // "HTTP/1.x NNN reason"
+  if (line.size() < 12 || !line.starts_with("HTTP/1.") ||
+      (line[7] != '0' && line[7] != '1') || line[8] != ' ' ||
+      (line.size() > 12 && line[12] != ' ')) {
+    return false;
+  }
+  unsigned status = 0;
+  auto [end, ec] = std::from_chars(line.data() + 9, line.data() + 12, status);
+  if (ec != std::errc() || end != line.data() + 12 || status < 100 ||
+      status > 599 || status == 101) {
+    return false;  // no upgrades were asked for
+  }
+  status_ = static_cast<uint16_t>(status);
+  if (status_ < 200) {
+    return true;
+  }
+
+  bool close = line[7] == '0';  // HTTP/1.0 closes unless told otherwise
+  bool encoded = false;
+  bool chunked = false;
+  int64_t length = -1;
+  head_out_.assign(line).append("\r\n");
+  while (!head.empty()) {
+    line_end = head.find('\n');
+    auto header = trim(head.substr(0, line_end));
+    head.remove_prefix(line_end == std::string_view::npos ? head.size()
+                                                          : line_end + 1);
+    if (header.empty()) {
+      break;
+    }
+    auto colon = header.find(':');
+    if (colon == std::string_view::npos || colon == 0) {
+      return false;
+    }
+    auto name = header.substr(0, colon);
+    auto value = trim(header.substr(colon + 1));
+    if (iequals(name, "Connection")) {
+      if (has_token(value, "close")) {
+        close = true;
+      } else if (has_token(value, "keep-alive")) {
+        close = false;
+      }
+      continue;  // hop-by-hop, rewritten below
+    }
+    if (iequals(name, "Keep-Alive") || iequals(name, "Proxy-Connection")) {
+      continue;
+    }
+    if (iequals(name, "Transfer-Encoding")) {
+      encoded = true;
+      auto last = value.substr(value.rfind(',') + 1);
+      chunked = iequals(trim(last), "chunked");
+    } else if (iequals(name, "Content-Length")) {
+      int64_t n = -1;
+      auto [p, err] =
+          std::from_chars(value.data(), value.data() + value.size(), n);
+      if (err != std::errc() || p != value.data() + value.size() || n < 0 ||
+          (length != -1 && length != n)) {
+        return false;
+      }
+      length = n;
+    }
+    head_out_.append(header).append("\r\n");
+  }
+
+  if (head_only_ || status_ == 204 || status_ == 304) {
+    resp_body_.Reset(Framing::Kind::kNone);
+  } else if (encoded) {
+    // Transfer-Encoding wins over Content-Length; without a final chunked
+    // the body runs until the upstream closes
+    resp_body_.Reset(chunked ? Framing::Kind::kChunked
+                             : Framing::Kind::kUntilClose);
+  } else if (length >= 0) {
+    resp_body_.Reset(Framing::Kind::kLength, static_cast<uint64_t>(length));
+  } else {
+    resp_body_.Reset(Framing::Kind::kUntilClose);
+  }
+  upstream_reusable_ = !close && !resp_body_.until_close();
+  // The client sees the end of an until-close body the same way
+  keep_alive_ = keep_alive_ && !resp_body_.until_close();
+  head_out_.append(keep_alive_ ? "Connection: keep-alive\r\n\r\n"
+                               : "Connection: close\r\n\r\n");
+  return true;
+}
+
+auto ProxyExchange::WaitFor(Wait wait) -> Status {
+  wait_ = wait;
+  if (wait == Wait::kUpstreamRead || wait == Wait::kUpstreamWrite) {
+    pool_->Arm(lease_, wait == Wait::kUpstreamWrite);
+  }
+  return Status::kWait;
+}
+
+auto ProxyExchange::UpstreamBroke() -> bool {
+  // An idle connection the upstream gave up on before this request reached
+  // it; nothing was answered, so the request can go out again
+  bool retry = lease_.reused && replayable_ && buf_end_ == 0;
+  if (lease_.reused) {
+    pool_->Release(&lease_, false);
+  } else {
+    pool_->Fail(&lease_);
+  }
+  if (!retry) {
+    LOG_WARN_FMT("Upstream {} closed the connection before responding",
+                 upstream());
+    return false;
+  }
+  request_sent_ = 0;
+  stage_ = Stage::kConnect;
+  return true;
+}
+
+auto ProxyExchange::BadGateway() -> Status {
+  if (lease_.fd != -1) {
+    pool_->Release(&lease_, false);
+  }
+  // Unread body bytes would be taken for the next request
+  keep_alive_ = keep_alive_ && req_body_.done();
+  stage_ = Stage::kDone;
+  return Status::kBadGateway;
+}
+
+auto ProxyExchange::Close() -> Status {
+  if (lease_.fd != -1) {
+    pool_->Release(&lease_, false);
+  }
+  keep_alive_ = false;
+  stage_ = Stage::kDone;
+  return Status::kClosed;
+}
+
+}  // namespace my_web_server
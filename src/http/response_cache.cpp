@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements ResponseCache building and publication.
+
+#include "http/response_cache.hpp"
+
+#include <format>
+#include <fstream>
+#include <iterator>
+
+#include "config/global_config.hpp"
+#include "http/http_response_templates.hpp"
+#include "logger/logger.hpp"
+#include "utils/rcu_cell.hpp"
+#include "utils/resource_utils.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+RcuCell<ResponseCache> g_response_cache;
+
+auto ReadPage(const char* name) -> std::optional<std::string> {
+  auto path = resource_dir() / "html" / name;
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    LOG_WARN(std::format("Cannot read page \"{}\"", path.string()));
+    return std::nullopt;
+  }
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+auto ResponseCache::Build(const ServerConfig& cfg)
+    -> std::unique_ptr<ResponseCache> {
+  auto cache = std::make_unique<ResponseCache>();
+  cache->text = cfg.custom_response_text;
+  if (cfg.custom_response_text.has_value()) {
+    cache->pages[kOk] = std::format(
+        kHtmlWrapFmt, std::format("{}\n", cfg.custom_response_text.value()));
+  } else {
+    cache->pages[kOk] = ReadPage("200.html");
+  }
+  cache->pages[kBadRequest] = ReadPage("400.html");
+  cache->pages[kForbidden] = ReadPage("403.html");
+  cache->pages[kNotFound] = ReadPage("404.html");
+  cache->pages[kInternalError] = ReadPage("500.html");
+  return cache;
+}
+
+auto ResponseCache::Current() -> const ResponseCache* {
+  return g_response_cache.Load();
+}
+
+void ResponseCache::Rebuild() {
+  g_response_cache.Publish(Build(GlobalConfig::Instance().Get()));
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements Upload: chunked decoding, splice from the
+// socket through a pipe into a temporary file, and the final rename.
+
+#include "http/upload.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+
+namespace my_web_server {
+
+namespace {
+
+// Chunk size lines and trailers are short; anything longer is refused
+constexpr size_t kMaxFrameLine = 1024;
+// Payload moved per splice() pair; the pipe is grown to match if allowed
+constexpr size_t kPipeSize = 256 * 1024;
+// Bodies in progress are dot files next to their target
+constexpr std::string_view kTempPrefix = ".upload-";
+
+}  // namespace
+
+Upload::Upload(uint64_t length, bool chunked, uint64_t limit)
+    : chunked_(chunked),
+      discard_(!chunked && length > limit),
+      limit_(limit),
+      left_(chunked ? 0 : length),
+      stage_(chunked ? Stage::kSize
+                     : (length == 0 ? Stage::kDone : Stage::kData)) {}
+
+Upload::~Upload() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+  if (pipe_[0] != -1) {
+    close(pipe_[0]);
+    close(pipe_[1]);
+  }
+  if (!committed_ && !temp_path_.empty()) {
+    unlink(temp_path_.c_str());
+  }
+}
+
+auto Upload::Open(const std::filesystem::path& dir, std::string_view name)
+    -> bool {
+  std::string prefix = dir.native();
+  if (prefix.empty() || prefix.back() != '/') {
+    prefix += '/';
+  }
+  target_path_ = prefix;
+  target_path_ += name;
+  // In the target's directory, so the rename stays on one filesystem
+  temp_path_ = prefix;
+  temp_path_ += kTempPrefix;
+  temp_path_ += "XXXXXX";
+  fd_ = mkostemp(temp_path_.data(), O_CLOEXEC);
+  if (fd_ == -1) {
+    temp_path_.clear();
+    return false;
+  }
+  // mkostemp creates it 0600; served files are readable like any other
+  fchmod(fd_, 0644);
+  return true;
+}
+
+auto Upload::Consume(std::string_view data, size_t* used) -> Status {
+  size_t pos = 0;
+  Status status = Status::kMore;
+  while (status == Status::kMore) {
+    if (stage_ == Stage::kDone) {
+      status = Status::kDone;
+      break;
+    }
+    if (stage_ == Stage::kData) {
+      if (pos == data.size()) {
+        break;
+      }
+      size_t n = static_cast<size_t>(
+          std::min<uint64_t>(left_, data.size() - pos));
+      if (!discard_ && !Write(data.data() + pos, n)) {
+        status = Status::kIoError;
+        break;
+      }
+      pos += n;
+      Advance(n);
+      continue;
+    }
+    auto rest = data.substr(pos);
+    auto eol = rest.find("\r\n");
+    if (eol == std::string_view::npos) {
+      if (rest.size() > kMaxFrameLine) {
+        status = Status::kBadBody;
+      }
+      break;
+    }
+    pos += eol + 2;
+    status = Frame(rest.substr(0, eol));
+  }
+  *used = pos;
+  return status;
+}
+
+auto Upload::Frame(std::string_view line) -> Status {
+  switch (stage_) {
+    case Stage::kSize: {
+      // chunk-size [ chunk-ext ]; extensions are ignored
+      auto digits = line.substr(0, line.find_first_of("; \t"));
+      uint64_t size = 0;
+      auto [end, ec] = std::from_chars(
+          digits.data(), digits.data() + digits.size(), size, 16);
+      if (digits.empty() || ec != std::errc() ||
+          end != digits.data() + digits.size()) {
+        return Status::kBadBody;
+      }
+      if (size == 0) {
+        stage_ = Stage::kTrailer;
+        return Status::kMore;
+      }
+      if (size > limit_ - std::min(limit_, received_)) {
+        if (size > limit_ + kMaxDiscard - received_) {
+          return Status::kTooLarge;
+        }
+        discard_ = true;
+      }
+      left_ = size;
+      stage_ = Stage::kData;
+      return Status::kMore;
+    }
+    case Stage::kDataEnd:
+      if (!line.empty()) {
+        return Status::kBadBody;
+      }
+      stage_ = Stage::kSize;
+      return Status::kMore;
+    case Stage::kTrailer:
+      if (line.empty()) {
+        stage_ = Stage::kDone;
+      }
+      return Status::kMore;  // trailer fields are ignored
+    case Stage::kData:
+    case Stage::kDone:
+      break;
+  }
+  return Status::kBadBody;
+}
+
+void Upload::Advance(uint64_t n) {
+  left_ -= n;
+  received_ += n;
+  if (left_ == 0) {
+    stage_ = chunked_ ? Stage::kDataEnd : Stage::kDone;
+  }
+}
+
+auto Upload::Write(const char* data, size_t len) -> bool {
+  while (len > 0) {
+    ssize_t n = write(fd_, data, len);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+#if defined(__linux__)
+auto Upload::Splice(int sockfd) -> Status {
+  if (pipe_[0] == -1) {
+    if (pipe2(pipe_, O_CLOEXEC | O_NONBLOCK) == -1) {
+      pipe_[0] = pipe_[1] = -1;
+      return Status::kIoError;
+    }
+    fcntl(pipe_[1], F_SETPIPE_SZ, static_cast<int>(kPipeSize));  // best effort
+  }
+  while (stage_ == Stage::kData) {
+    size_t want = static_cast<size_t>(std::min<uint64_t>(left_, kPipeSize));
+    ssize_t n = splice(sockfd, nullptr, pipe_[1], nullptr, want,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n == 0) {
+      return Status::kClosed;
+    }
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN ? Status::kWantRead : Status::kClosed;
+    }
+    // Drain the pipe completely, so it is empty between calls
+    for (ssize_t moved = 0; moved < n;) {
+      ssize_t m = splice(pipe_[0], nullptr, fd_, nullptr,
+                         static_cast<size_t>(n - moved), SPLICE_F_MOVE);
+      if (m == -1 && errno == EINTR) {
+        continue;
+      }
+      if (m <= 0) {
+        return Status::kIoError;
+      }
+      moved += m;
+    }
+    Advance(static_cast<uint64_t>(n));
+  }
+  return stage_ == Stage::kDone ? Status::kDone : Status::kMore;
+}
+#endif
+
+auto Upload::Commit() -> bool {
+  struct stat target {};
+  created_ = lstat(target_path_.c_str(), &target) == -1 && errno == ENOENT;
+  if (close(fd_) == -1) {
+    fd_ = -1;
+    return false;  // e.g. delayed write errors on network filesystems
+  }
+  fd_ = -1;
+  if (rename(temp_path_.c_str(), target_path_.c_str()) == -1) {
+    return false;
+  }
+  committed_ = true;
+  return true;
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements proxy route parsing and matching, and
+// UpstreamPool's connection reuse and load balancing.
+
+#include "http/upstream_pool.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#endif
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+// An upstream that refused or broke a connection is left alone this long
+constexpr int64_t kRetryDelayNs = 2'000'000'000;
+// Room for a spliced body slice; grown to this if the system allows
+constexpr int kPipeSize = 256 * 1024;
+// Bounded so a route can be tracked in a 64-bit mask
+constexpr size_t kMaxUpstreamsPerRoute = 64;
+
+auto steady_now_ns() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+auto parse_address(std::string_view text, UpstreamAddress* out) -> bool {
+  auto colon = text.rfind(':');
+  if (colon == std::string_view::npos) {
+    return false;
+  }
+  std::string host(text.substr(0, colon));
+  if (host == "localhost") {
+    host = "127.0.0.1";
+  }
+  auto port_text = text.substr(colon + 1);
+  unsigned port = 0;
+  auto [end, ec] = std::from_chars(
+      port_text.data(), port_text.data() + port_text.size(), port);
+  in_addr addr{};
+  if (port_text.empty() || ec != std::errc() ||
+      end != port_text.data() + port_text.size() || port == 0 ||
+      port > 65535 || inet_pton(AF_INET, host.c_str(), &addr) != 1) {
+    return false;
+  }
+  out->text = std::string(text);
+  out->ip = addr.s_addr;
+  out->port = htons(static_cast<uint16_t>(port));
+  return true;
+}
+
+}  // namespace
+
+auto ParseProxyRoute(std::string_view spec, ProxyRoute* out) -> bool {
+  auto eq = spec.find('=');
+  if (eq == std::string_view::npos || eq == 0 || spec.front() != '/') {
+    return false;
+  }
+  ProxyRoute route;
+  route.prefix = std::string(spec.substr(0, eq));
+  auto list = spec.substr(eq + 1);
+  while (true) {
+    auto comma = list.find(',');
+    UpstreamAddress address;
+    if (!parse_address(list.substr(0, comma), &address)) {
+      return false;
+    }
+    route.upstreams.push_back(std::move(address));
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma + 1);
+  }
+  if (route.upstreams.size() > kMaxUpstreamsPerRoute) {
+    return false;
+  }
+  *out = std::move(route);
+  return true;
+}
+
+auto MatchProxyRoute(const ProxyOptions& options, std::string_view target)
+    -> int {
+  auto path = target.substr(0, target.find('?'));
+  int best = -1;
+  size_t best_size = 0;
+  for (size_t i = 0; i < options.routes.size(); ++i) {
+    std::string_view prefix = options.routes[i].prefix;
+    if (!path.starts_with(prefix) || prefix.size() < best_size) {
+      continue;
+    }
+    // Whole segments only, unless the prefix ends with its own slash
+    if (path.size() > prefix.size() && prefix.back() != '/' &&
+        path[prefix.size()] != '/') {
+      continue;
+    }
+    best = static_cast<int>(i);
+    best_size = prefix.size();
+  }
+  return best;
+}
+
+UpstreamPool::UpstreamPool(const ProxyOptions& options, int mux_fd)
+    : mux_fd_(mux_fd), keepalive_(options.keepalive) {
+  // Routes naming the same upstream share its connections
+  for (const auto& route : options.routes) {
+    auto& members = routes_.emplace_back();
+    for (const auto& address : route.upstreams) {
+      auto it = std::find_if(
+          backends_.begin(), backends_.end(),
+          [&address](const Backend& b) { return b.address == address; });
+      if (it == backends_.end()) {
+        backends_.push_back(Backend{.address = address});
+        it = backends_.end() - 1;
+      }
+      members.push_back(static_cast<uint32_t>(it - backends_.begin()));
+    }
+  }
+  cursors_.assign(routes_.size(), 0);
+}
+
+UpstreamPool::~UpstreamPool() {
+  for (auto& backend : backends_) {
+    for (const auto& conn : backend.idle) {
+      CloseConn(conn.fd, conn.pipe);
+    }
+  }
+}
+
+auto UpstreamPool::Acquire(size_t route, int owner_fd, UpstreamLease* lease)
+    -> bool {
+  Metrics::Instance().Add(Counter::kProxyRequests);
+  for (size_t attempt = 0; attempt < routes_[route].size(); ++attempt) {
+    uint32_t index = Pick(route);
+    auto& backend = backends_[index];
+    *lease = UpstreamLease{};
+    lease->upstream = index;
+    if (!backend.idle.empty()) {
+      auto conn = backend.idle.back();
+      backend.idle.pop_back();
+      lease->fd = conn.fd;
+      lease->pipe[0] = conn.pipe[0];
+      lease->pipe[1] = conn.pipe[1];
+      lease->reused = true;
+    } else if (!Connect(index, lease)) {
+      continue;  // refused at once; Connect() marked it
+    }
+    ++backend.active;
+    SetOwner(lease->fd, owner_fd);
+    return true;
+  }
+  *lease = UpstreamLease{};
+  return false;
+}
+
+auto UpstreamPool::Pick(size_t route) -> uint32_t {
+  const auto& members = routes_[route];
+  size_t start = cursors_[route]++ % members.size();
+  int64_t now = steady_now_ns();
+  uint32_t best = members[start];
+  bool best_up = false;
+  for (size_t k = 0; k < members.size(); ++k) {
+    uint32_t index = members[(start + k) % members.size()];
+    const auto& backend = backends_[index];
+    bool up = backend.retry_ns <= now;
+    if (up && (!best_up || backend.active < backends_[best].active)) {
+      best = index;
+      best_up = true;
+    } else if (!best_up && backend.retry_ns < backends_[best].retry_ns) {
+      best = index;  // all resting: the one that will be back first
+    }
+  }
+  return best;
+}
+
+auto UpstreamPool::Connect(uint32_t backend, UpstreamLease* lease) -> bool {
+  auto& target = backends_[backend];
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    LOG_ERROR_FMT("Upstream socket creation error: {}", std::strerror(errno));
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = target.address.ip;
+  addr.sin_port = target.address.port;
+  Metrics::Instance().Add(Counter::kUpstreamConnects);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 &&
+      errno != EINPROGRESS) {
+    LOG_WARN_FMT("Upstream {} connect error: {}", target.address.text,
+                 std::strerror(errno));
+    close(fd);
+    lease->fd = -1;
+    Fail(lease);
+    return false;
+  }
+  // Registered once; waits are armed one at a time with Arm()
+  lease->fd = fd;
+  lease->connecting = true;
+#if defined(__linux__)
+  epoll_event event{};
+  event.data.fd = fd;
+  event.events = EPOLLOUT | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(mux_fd_, EPOLL_CTL_ADD, fd, &event);
+#elif defined(__APPLE__)
+  Watch(fd, EVFILT_WRITE);
+#endif
+  return true;
+}
+
+void UpstreamPool::Release(UpstreamLease* lease, bool reusable) {
+  if (lease->fd == -1) {
+    return;
+  }
+  auto& backend = backends_[lease->upstream];
+  --backend.active;
+  if (reusable) {
+    backend.failures = 0;  // a whole exchange made it through
+    backend.retry_ns = 0;
+  }
+  if (reusable && backend.idle.size() < keepalive_) {
+    SetOwner(lease->fd, kIdle);
+    backend.idle.push_back({lease->fd, {lease->pipe[0], lease->pipe[1]}});
+    // Anything but EAGAIN while idle means the upstream closed it
+#if defined(__linux__)
+    Watch(lease->fd, EPOLLIN);
+#elif defined(__APPLE__)
+    Watch(lease->fd, EVFILT_READ);
+#endif
+  } else {
+    CloseConn(lease->fd, lease->pipe);
+  }
+  *lease = UpstreamLease{};
+}
+
+void UpstreamPool::Fail(UpstreamLease* lease) {
+  auto& backend = backends_[lease->upstream];
+  ++backend.failures;
+  backend.retry_ns = steady_now_ns() + kRetryDelayNs;
+  Metrics::Instance().Add(Counter::kUpstreamFailures);
+  if (backend.failures == 1) {
+    LOG_WARN_FMT("Upstream {} failed, skipping it for {} s",
+                 backend.address.text, kRetryDelayNs / 1'000'000'000);
+  }
+  if (lease->fd != -1) {
+    --backend.active;
+    CloseConn(lease->fd, lease->pipe);
+  }
+  *lease = UpstreamLease{};
+}
+
+void UpstreamPool::Arm(const UpstreamLease& lease, bool write) {
+#if defined(__linux__)
+  Watch(lease.fd, write ? EPOLLOUT : EPOLLIN);
+#elif defined(__APPLE__)
+  Watch(lease.fd, write ? EVFILT_WRITE : EVFILT_READ);
+#endif
+}
+
+auto UpstreamPool::EnsurePipe(UpstreamLease* lease) -> bool {
+  if (lease->pipe[0] != -1) {
+    return true;
+  }
+#if defined(__linux__)
+  if (pipe2(lease->pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+    lease->pipe[0] = lease->pipe[1] = -1;
+    return false;
+  }
+  fcntl(lease->pipe[1], F_SETPIPE_SZ, kPipeSize);  // best effort
+  return true;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+auto UpstreamPool::OnEvent(int fd) -> int {
+  int owner = owners_[static_cast<size_t>(fd)];
+  if (owner != kIdle) {
+    return owner;
+  }
+  char byte = 0;
+  ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+#if defined(__linux__)
+    Watch(fd, EPOLLIN);  // a stale wakeup
+#elif defined(__APPLE__)
+    Watch(fd, EVFILT_READ);
+#endif
+    return -1;
+  }
+  // Closed, reset, or bytes nobody asked for: drop it
+  for (auto& backend : backends_) {
+    auto it = std::find_if(
+        backend.idle.begin(), backend.idle.end(),
+        [fd](const IdleConn& conn) { return conn.fd == fd; });
+    if (it != backend.idle.end()) {
+      CloseConn(it->fd, it->pipe);
+      backend.idle.erase(it);
+      break;
+    }
+  }
+  return -1;
+}
+
+auto UpstreamPool::active() const -> size_t {
+  size_t total = 0;
+  for (const auto& backend : backends_) {
+    total += backend.active;
+  }
+  return total;
+}
+
+auto UpstreamPool::idle() const -> size_t {
+  size_t total = 0;
+  for (const auto& backend : backends_) {
+    total += backend.idle.size();
+  }
+  return total;
+}
+
+void UpstreamPool::SetOwner(int fd, int owner) {
+  auto index = static_cast<size_t>(fd);
+  if (index >= owners_.size()) {
+    owners_.resize(std::max(index + 1, owners_.size() * 2), kNotOurs);
+  }
+  owners_[index] = owner;
+}
+
+#if defined(__linux__)
+void UpstreamPool::Watch(int fd, uint32_t events) {
+  epoll_event event{};
+  event.data.fd = fd;
+  event.events = events | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(mux_fd_, EPOLL_CTL_MOD, fd, &event);
+}
+#elif defined(__APPLE__)
+void UpstreamPool::Watch(int fd, uint32_t events) {
+  struct kevent event;
+  EV_SET(&event, fd, static_cast<int16_t>(events),
+         EV_ADD | EV_ENABLE | EV_CLEAR | EV_ONESHOT, 0, 0,
+         (void*)(intptr_t)fd);
+  kevent(mux_fd_, &event, 1, nullptr, 0, nullptr);
+}
+#endif
+
+void UpstreamPool::CloseConn(int fd, const int* pipe) {
+  SetOwner(fd, kNotOurs);
+#if defined(__linux__)
+  epoll_ctl(mux_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+  close(fd);
+  if (pipe[0] != -1) {
+    close(pipe[0]);
+    close(pipe[1]);
+  }
+}
+
+}  // namespace my_web_server
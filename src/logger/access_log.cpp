@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements the access log: per-thread record rings, the
+// writer thread and Combined / JSON Lines rendering.
+
+#include "logger/access_log.hpp"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <format>
+#include <iterator>
+
+#include "logger/logger.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace my_web_server {
+
+// One ring per producing thread, shared with a thread_local holder so
+// records survive thread exit until the writer drains them.
+struct AccessLogBuffer {
+  explicit AccessLogBuffer(size_t capacity) : ring(capacity) {}
+
+  SpscRing<AccessRecord> ring;
+  uint32_t sample_counter{0};  // owner thread only
+  std::atomic<bool> retired{false};
+};
+
+namespace {
+
+// Indexed by HttpConn::METHOD
+constexpr std::array<std::string_view, 9> kMethodNames = {
+    "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT",
+    "PATCH"};
+
+struct AccessBufferHolder {
+  std::shared_ptr<AccessLogBuffer> buffer;
+  ~AccessBufferHolder() {
+    if (buffer) {
+      buffer->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local AccessBufferHolder t_access_buffer;
+
+auto MethodName(uint8_t method) -> std::string_view {
+  return method < kMethodNames.size() ? kMethodNames[method] : "-";
+}
+
+auto PeerAddress(uint32_t ip) -> std::string_view {
+  thread_local char text[INET_ADDRSTRLEN];
+  in_addr addr{};
+  addr.s_addr = ip;
+  if (inet_ntop(AF_INET, &addr, text, sizeof(text)) == nullptr) {
+    return "-";
+  }
+  return text;
+}
+
+auto BreakDownTime(int64_t timestamp_ns, long* millis) -> std::tm {
+  std::time_t seconds = static_cast<std::time_t>(timestamp_ns / 1000000000);
+  *millis = static_cast<long>(timestamp_ns / 1000000 % 1000);
+  std::tm tm{};
+  gmtime_r(&seconds, &tm);
+  return tm;
+}
+
+// Quote-safe text for the combined format, escaped the way nginx does
+void AppendEscaped(std::string* out, std::string_view text) {
+  for (char c : text) {
+    auto byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\' || byte < 0x20 || byte >= 0x7f) {
+      std::format_to(std::back_inserter(*out), "\\x{:02X}", byte);
+    } else {
+      out->push_back(c);
+    }
+  }
+}
+
+void AppendJsonString(std::string* out, std::string_view text) {
+  out->push_back('"');
+  for (char c : text) {
+    auto byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (byte < 0x20 || byte >= 0x7f) {
+      // Truncation may split UTF-8 sequences, so escape every non-ASCII byte
+      std::format_to(std::back_inserter(*out), "\\u{:04x}", byte);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+}  // namespace
+
+void AccessRecord::SetUrl(std::string_view value) {
+  url_len = static_cast<uint8_t>(std::min(value.size(), sizeof(url)));
+  std::copy_n(value.data(), url_len, url);
+}
+
+void AccessRecord::SetAgent(std::string_view value) {
+  agent_len = static_cast<uint8_t>(std::min(value.size(), sizeof(agent)));
+  std::copy_n(value.data(), agent_len, agent);
+}
+
+void AppendAccessRecord(std::string* out, const AccessRecord& record,
+                        AccessLogFormat format) {
+  long millis = 0;
+  std::tm tm = BreakDownTime(record.timestamp_ns, &millis);
+  std::string_view url(record.url, record.url_len);
+  std::string_view agent(record.agent, record.agent_len);
+  uint64_t bytes = record.header_bytes + record.body_bytes;
+  auto it = std::back_inserter(*out);
+
+  if (format == AccessLogFormat::kJsonLines) {
+    char when[32];
+    std::strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::format_to(it,
+                   "{{\"ts\":\"{}.{:03}Z\",\"ip\":\"{}\",\"port\":{},"
+                   "\"method\":\"{}\",\"url\":",
+                   when, millis, PeerAddress(record.peer_ip),
+                   ntohs(record.peer_port), MethodName(record.method));
+    AppendJsonString(out, url);
+    std::format_to(it,
+                   ",\"status\":{},\"bytes\":{},\"body_bytes\":{},"
+                   "\"ttfb_us\":{},\"duration_us\":{},\"tls\":{},\"ua\":",
+                   record.status, bytes, record.body_bytes, record.ttfb_us,
+                   record.duration_us, record.tls);
+    AppendJsonString(out, agent);
+    out->append("}\n");
+    return;
+  }
+
+  // 127.0.0.1 - - [19/Oct/2026:10:00:00 +0000] "GET / HTTP/1.1" 200 512
+  // "-" "curl/8.0" 41 97
+  char when[32];
+  std::strftime(when, sizeof(when), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+  std::format_to(it, "{} - - [{}] \"{} ", PeerAddress(record.peer_ip), when,
+                 MethodName(record.method));
+  if (url.empty()) {
+    out->push_back('-');
+  } else {
+    AppendEscaped(out, url);
+  }
+  std::format_to(it, " HTTP/1.1\" {} {} \"-\" \"", record.status, bytes);
+  if (agent.empty()) {
+    out->push_back('-');
+  } else {
+    AppendEscaped(out, agent);
+  }
+  std::format_to(it, "\" {} {}\n", record.ttfb_us, record.duration_us);
+}
+
+auto AccessLog::Instance() -> AccessLog& {
+  static AccessLog instance;
+  return instance;
+}
+
+AccessLog::~AccessLog() { Stop(); }
+
+void AccessLog::Start(const AccessLogOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (writer_.joinable() || options.file.path.empty()) {
+    return;
+  }
+  options_ = options;
+  options_.sample_every = std::max<uint32_t>(options_.sample_every, 1);
+  sample_every_.store(options_.sample_every, std::memory_order_relaxed);
+  if (options_.file.path != "-") {
+    sink_ = std::make_unique<LogFileSink>();
+    if (!sink_->Open(options_.file)) {
+      sink_.reset();
+      LOG_ERROR(std::format("Access log disabled, cannot open \"{}\"",
+                            options_.file.path));
+      return;
+    }
+  }
+  stop_ = false;
+  writer_ = std::thread([this]() { WriterLoop(); });
+  enabled_.store(true, std::memory_order_release);
+}
+
+void AccessLog::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!writer_.joinable()) {
+      return;
+    }
+    enabled_.store(false, std::memory_order_release);
+    stop_ = true;
+  }
+  cond_.notify_one();
+  writer_.join();
+  std::lock_guard<std::mutex> lock(mutex_);
+  sink_.reset();
+}
+
+void AccessLog::ReopenFiles() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sink_) {
+    sink_->RequestReopen();
+  }
+}
+
+auto AccessLog::LocalBuffer() -> AccessLogBuffer& {
+  if (!t_access_buffer.buffer) {
+    t_access_buffer.buffer =
+        std::make_shared<AccessLogBuffer>(options_.ring_capacity);
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.push_back(t_access_buffer.buffer);
+  }
+  return *t_access_buffer.buffer;
+}
+
+auto AccessLog::ShouldRecord(uint16_t status) -> bool {
+  if (!enabled()) {
+    return false;
+  }
+  uint32_t sample_every = sample_every_.load(std::memory_order_relaxed);
+  if (status >= 400 || sample_every == 1) {
+    return true;
+  }
+  auto& buffer = LocalBuffer();
+  return buffer.sample_counter++ % sample_every == 0;
+}
+
+void AccessLog::SetSampleEvery(uint32_t sample_every) {
+  sample_every_.store(std::max<uint32_t>(sample_every, 1),
+                      std::memory_order_relaxed);
+}
+
+void AccessLog::Record(const AccessRecord& record) {
+  if (!enabled()) {
+    return;
+  }
+  AccessRecord copy = record;
+  if (!LocalBuffer().ring.TryPush(std::move(copy))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void AccessLog::WriterLoop() {
+  std::string out;
+  std::vector<size_t> ends;
+  uint64_t dropped_reported = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    bool stopping = stop_;
+    lock.unlock();
+
+    DrainOnce(&out, &ends);
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported) {
+      LOG_WARN_FMT("Access log ring full, dropped {} records",
+                   dropped - dropped_reported);
+      dropped_reported = dropped;
+    }
+    if (!out.empty()) {
+      if (sink_) {
+        // One iovec per line so the sink only rotates between records
+        std::vector<iovec> records;
+        records.reserve(ends.size());
+        size_t begin = 0;
+        for (size_t end : ends) {
+          records.push_back({out.data() + begin, end - begin});
+          begin = end;
+        }
+        sink_->Write(records);
+      } else {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+      }
+      out.clear();
+      ends.clear();
+    }
+
+    lock.lock();
+    if (stopping) {
+      return;
+    }
+    if (!stop_) {
+      cond_.wait_for(lock, options_.drain_interval);
+    }
+  }
+}
+
+void AccessLog::DrainOnce(std::string* out, std::vector<size_t>* ends) {
+  std::vector<std::shared_ptr<AccessLogBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    std::erase_if(buffers_, [](const auto& buffer) {
+      return buffer->retired.load(std::memory_order_acquire) &&
+             buffer->ring.Empty();
+    });
+    buffers = buffers_;
+  }
+  AccessRecord record;
+  for (const auto& buffer : buffers) {
+    for (size_t i = 0; i < buffer->ring.Capacity(); ++i) {
+      if (!buffer->ring.TryPop(&record)) {
+        break;
+      }
+      AppendAccessRecord(out, record, options_.format);
+      ends->push_back(out->size());
+    }
+  }
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Encodes and decodes traffic capture events; shared by the
+// server and the capture_replay tool.
+
+#include "logger/capture_format.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+// Requests are bounded by the read buffer; anything larger is corruption
+constexpr uint64_t kMaxDataBytes = 1 << 20;
+
+void PutVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void PutFixed(std::string* out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+auto ZigZag(int64_t value) -> uint64_t {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+auto UnZigZag(uint64_t value) -> int64_t {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+auto ReadFixed(std::FILE* in, int bytes, uint64_t* value) -> bool {
+  unsigned char buf[8];
+  if (std::fread(buf, 1, static_cast<size_t>(bytes), in) !=
+      static_cast<size_t>(bytes)) {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    *value |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  }
+  return true;
+}
+
+}  // namespace
+
+void AppendCaptureHeader(std::string* out, int64_t start_wall_ns) {
+  out->append(kCaptureMagic);
+  PutFixed(out, static_cast<uint64_t>(start_wall_ns), 8);
+}
+
+void CaptureEncoder::Append(std::string* out, CaptureKind kind,
+                            uint32_t conn_id, int64_t time_ns,
+                            std::string_view payload) {
+  out->push_back(static_cast<char>(kind));
+  PutVarint(out, conn_id);
+  PutVarint(out, ZigZag(time_ns - last_ns_));
+  last_ns_ = time_ns;
+  if (kind == CaptureKind::kData) {
+    PutVarint(out, payload.size());
+    out->append(payload);
+  } else if (kind == CaptureKind::kOpen) {
+    out->append(payload);
+  }
+}
+
+void CaptureEncoder::AppendOpen(std::string* out, uint32_t conn_id,
+                                int64_t time_ns, uint32_t peer_ip,
+                                uint16_t peer_port, bool tls) {
+  std::string payload;
+  PutFixed(&payload, peer_ip, 4);
+  PutFixed(&payload, peer_port, 2);
+  payload.push_back(tls ? 1 : 0);
+  Append(out, CaptureKind::kOpen, conn_id, time_ns, payload);
+}
+
+auto CaptureDecoder::ReadHeader() -> bool {
+  char magic[kCaptureMagic.size()];
+  uint64_t start = 0;
+  if (std::fread(magic, 1, sizeof(magic), in_) != sizeof(magic) ||
+      std::string_view(magic, sizeof(magic)) != kCaptureMagic ||
+      !ReadFixed(in_, 8, &start)) {
+    error_ = true;
+    return false;
+  }
+  start_wall_ns_ = static_cast<int64_t>(start);
+  return true;
+}
+
+auto CaptureDecoder::ReadVarint(uint64_t* value) -> bool {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = std::fgetc(in_);
+    if (c == EOF) {
+      return false;
+    }
+    *value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto CaptureDecoder::Next(CaptureEvent* event) -> bool {
+  int kind = std::fgetc(in_);
+  if (kind == EOF) {
+    return false;  // clean end of file
+  }
+  uint64_t conn_id = 0;
+  uint64_t delta = 0;
+  if (kind < static_cast<int>(CaptureKind::kOpen) ||
+      kind > static_cast<int>(CaptureKind::kDropped) ||
+      !ReadVarint(&conn_id) || conn_id > UINT32_MAX || !ReadVarint(&delta)) {
+    error_ = true;
+    return false;
+  }
+  event->kind = static_cast<CaptureKind>(kind);
+  event->conn_id = static_cast<uint32_t>(conn_id);
+  last_ns_ += UnZigZag(delta);
+  event->time_ns = last_ns_;
+  event->data.clear();
+  if (event->kind == CaptureKind::kOpen) {
+    uint64_t ip = 0;
+    uint64_t port = 0;
+    int flags = 0;
+    if (!ReadFixed(in_, 4, &ip) || !ReadFixed(in_, 2, &port) ||
+        (flags = std::fgetc(in_)) == EOF) {
+      error_ = true;
+      return false;
+    }
+    event->peer_ip = static_cast<uint32_t>(ip);
+    event->peer_port = static_cast<uint16_t>(port);
+    event->tls = (flags & 1) != 0;
+  } else if (event->kind == CaptureKind::kData) {
+    uint64_t len = 0;
+    if (!ReadVarint(&len) || len > kMaxDataBytes) {
+      error_ = true;
+      return false;
+    }
+    event->data.resize(len);
+    if (std::fread(event->data.data(), 1, len, in_) != len) {
+      error_ = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements LogFileSink batched writes and rotation.
+
+#include "logger/log_file_sink.hpp"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <format>
+
+namespace my_web_server {
+
+namespace {
+
+#if defined(IOV_MAX)
+constexpr size_t kMaxIov = IOV_MAX;
+#else
+constexpr size_t kMaxIov = 1024;
+#endif
+
+constexpr std::chrono::seconds kMinRotateBackoff{1};
+constexpr std::chrono::seconds kMaxRotateBackoff{60};
+
+}  // namespace
+
+LogFileSink::~LogFileSink() {
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+auto LogFileSink::Open(const LogFileOptions& options) -> bool {
+  options_ = options;
+  return OpenFile();
+}
+
+auto LogFileSink::OpenFile() -> bool {
+  // O_APPEND keeps concurrent writers (and a reopened file) consistent
+  int fd = open(options_.path.c_str(),
+                O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    // Keep writing to the file already open, if any
+    std::fprintf(stderr, "Fail to open log file \"%s\": %s\n",
+                 options_.path.c_str(), std::strerror(errno));
+    return false;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+  fd_ = fd;
+  struct stat st{};
+  size_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+  opened_at_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+auto LogFileSink::Rotate() -> bool {
+  // path -> path.YYYYmmdd-HHMMSS[.N]; the live path is recreated empty
+  std::time_t now = std::time(nullptr);
+  std::tm tm{};
+  localtime_r(&now, &tm);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+  auto target = std::format("{}.{}", options_.path, stamp);
+  for (int n = 1; access(target.c_str(), F_OK) == 0; ++n) {
+    target = std::format("{}.{}.{}", options_.path, stamp, n);
+  }
+  // ENOENT: the file was moved away already (or an earlier reopen failed
+  // after the rename), so only the reopen is left to do
+  bool ok = rename(options_.path.c_str(), target.c_str()) == 0 ||
+            errno == ENOENT;
+  if (!ok) {
+    std::fprintf(stderr, "Fail to rotate log file \"%s\": %s\n",
+                 options_.path.c_str(), std::strerror(errno));
+  }
+  ok = ok && OpenFile();
+  auto steady_now = std::chrono::steady_clock::now();
+  if (ok) {
+    rotate_backoff_ = std::chrono::seconds(0);
+  } else {
+    // Keep appending to the current file and try again later, so a
+    // read-only directory costs one message per backoff, not a busy loop
+    rotate_backoff_ = std::clamp(rotate_backoff_ * 2, kMinRotateBackoff,
+                                 kMaxRotateBackoff);
+  }
+  rotate_retry_at_ = steady_now + rotate_backoff_;
+  return ok;
+}
+
+void LogFileSink::Write(const std::vector<iovec>& records) {
+  if (reopen_.exchange(false, std::memory_order_relaxed)) {
+    OpenFile();
+  }
+  if (fd_ == -1) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (options_.rotate_interval.count() > 0 && now >= rotate_retry_at_ &&
+      now - opened_at_ >= options_.rotate_interval) {
+    Rotate();
+  }
+
+  size_t begin = 0;
+  while (begin < records.size()) {
+    // While a failed rotation backs off, the size limit is ignored
+    bool limit = options_.rotate_bytes > 0 &&
+                 std::chrono::steady_clock::now() >= rotate_retry_at_;
+    if (limit && size_ > 0 &&
+        size_ + records[begin].iov_len > options_.rotate_bytes) {
+      limit = Rotate();
+    }
+    // Take as many records as fit before the size limit, and always at
+    // least one: a fresh file takes a record larger than the limit, and a
+    // failed rotation must not stop the batch
+    size_t end = begin + 1;
+    uint64_t bytes = records[begin].iov_len;
+    while (end < records.size() && end - begin < kMaxIov &&
+           !(limit &&
+             size_ + bytes + records[end].iov_len > options_.rotate_bytes)) {
+      bytes += records[end].iov_len;
+      ++end;
+    }
+    WriteAll(records.data() + begin, end - begin);
+    size_ += bytes;
+    begin = end;
+  }
+}
+
+void LogFileSink::WriteAll(const iovec* iov, size_t count) {
+  std::vector<iovec> pending(iov, iov + count);
+  size_t index = 0;
+  while (index < pending.size()) {
+    ssize_t n = writev(fd_, pending.data() + index,
+                       static_cast<int>(pending.size() - index));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;  // disk full or similar: drop rather than stall the backend
+    }
+    // Skip fully written iovecs and trim a partially written one
+    auto written = static_cast<size_t>(n);
+    while (index < pending.size() && written >= pending[index].iov_len) {
+      written -= pending[index].iov_len;
+      ++index;
+    }
+    if (index < pending.size()) {
+      pending[index].iov_base = static_cast<char*>(pending[index].iov_base) +
+                                written;
+      pending[index].iov_len -= written;
+    }
+  }
+}
+
+}  // namespace my_web_server
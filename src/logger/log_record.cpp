@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements binary log record decoding, runtime formatting
+// and the on-disk frame format.
+
+#include "logger/log_record.hpp"
+
+#include <format>
+
+namespace my_web_server {
+
+namespace {
+
+template <typename T>
+auto ReadScalar(const BinaryLogRecord& rec, size_t* pos, T* out) -> bool {
+  if (*pos + sizeof(T) > rec.payload_size) {
+    return false;
+  }
+  std::memcpy(out, rec.payload.data() + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return true;
+}
+
+// Format one argument with the spec found between "{:" and "}"
+auto FormatOne(std::string_view spec, const LogArg& arg) -> std::string {
+  std::string field = "{";
+  if (!spec.empty()) {
+    field += ':';
+    field += spec;
+  }
+  field += '}';
+  return std::visit(
+      [&field](auto value) -> std::string {
+        try {
+          return std::vformat(field, std::make_format_args(value));
+        } catch (const std::format_error&) {
+          return std::vformat("{}", std::make_format_args(value));
+        }
+      },
+      arg);
+}
+
+template <typename T>
+void Append(std::string* out, const T& value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+auto Read(std::FILE* in, T* value) -> bool {
+  return std::fread(value, sizeof(T), 1, in) == 1;
+}
+
+auto ReadString(std::FILE* in, std::string* out) -> bool {
+  uint16_t len = 0;
+  if (!Read(in, &len)) {
+    return false;
+  }
+  out->resize(len);
+  return len == 0 || std::fread(out->data(), 1, len, in) == len;
+}
+
+}  // namespace
+
+auto DecodeLogArgs(const BinaryLogRecord& rec) -> std::vector<LogArg> {
+  std::vector<LogArg> args;
+  size_t pos = 0;
+  while (pos < rec.payload_size) {
+    auto tag = static_cast<LogArgTag>(rec.payload[pos++]);
+    switch (tag) {
+      case LogArgTag::kI64: {
+        int64_t value = 0;
+        if (!ReadScalar(rec, &pos, &value)) {
+          return args;
+        }
+        args.emplace_back(value);
+        break;
+      }
+      case LogArgTag::kU64: {
+        uint64_t value = 0;
+        if (!ReadScalar(rec, &pos, &value)) {
+          return args;
+        }
+        args.emplace_back(value);
+        break;
+      }
+      case LogArgTag::kF64: {
+        double value = 0;
+        if (!ReadScalar(rec, &pos, &value)) {
+          return args;
+        }
+        args.emplace_back(value);
+        break;
+      }
+      case LogArgTag::kBool: {
+        bool value = false;
+        if (!ReadScalar(rec, &pos, &value)) {
+          return args;
+        }
+        args.emplace_back(value);
+        break;
+      }
+      case LogArgTag::kChar: {
+        char value = 0;
+        if (!ReadScalar(rec, &pos, &value)) {
+          return args;
+        }
+        args.emplace_back(value);
+        break;
+      }
+      case LogArgTag::kStr: {
+        uint16_t len = 0;
+        if (!ReadScalar(rec, &pos, &len) || pos + len > rec.payload_size) {
+          return args;
+        }
+        args.emplace_back(std::string_view(rec.payload.data() + pos, len));
+        pos += len;
+        break;
+      }
+      default:
+        return args;
+    }
+  }
+  return args;
+}
+
+auto FormatLogRecord(std::string_view fmt, const std::vector<LogArg>& args)
+    -> std::string {
+  std::string out;
+  out.reserve(fmt.size() + 16 * args.size());
+  size_t next_arg = 0;
+  for (size_t i = 0; i < fmt.size(); ++i) {
+    char ch = fmt[i];
+    if ((ch == '{' || ch == '}') && i + 1 < fmt.size() && fmt[i + 1] == ch) {
+      out += ch;  // escaped brace
+      ++i;
+      continue;
+    }
+    if (ch != '{') {
+      out += ch;
+      continue;
+    }
+    auto close = fmt.find('}', i);
+    if (close == std::string_view::npos) {
+      out.append(fmt.substr(i));
+      break;
+    }
+    auto field = fmt.substr(i + 1, close - i - 1);
+    auto colon = field.find(':');
+    auto spec = colon == std::string_view::npos ? std::string_view{}
+                                                : field.substr(colon + 1);
+    if (next_arg < args.size()) {
+      out += FormatOne(spec, args[next_arg++]);
+    } else {
+      out += "<?>";
+    }
+    i = close;
+  }
+  return out;
+}
+
+void WriteFormatFrame(std::string* out, uint32_t fmt_id,
+                      const LogFormat& format) {
+  out->push_back(static_cast<char>(LogFrameKind::kFormat));
+  Append(out, fmt_id);
+  Append(out, static_cast<uint8_t>(format.level));
+  Append(out, static_cast<uint32_t>(format.line));
+  std::string_view file = format.file;
+  Append(out, static_cast<uint16_t>(file.size()));
+  out->append(file);
+  Append(out, static_cast<uint16_t>(format.fmt.size()));
+  out->append(format.fmt);
+}
+
+void WriteRecordFrame(std::string* out, size_t thread_id,
+                      const BinaryLogRecord& rec) {
+  out->push_back(static_cast<char>(LogFrameKind::kRecord));
+  Append(out, static_cast<uint64_t>(thread_id));
+  Append(out, rec.timestamp_ns);
+  Append(out, rec.fmt_id);
+  Append(out, rec.truncated);
+  Append(out, rec.payload_size);
+  out->append(rec.payload.data(), rec.payload_size);
+}
+
+void WriteTextFrame(std::string* out, size_t thread_id, int64_t timestamp_ns,
+                    int level, std::string_view message) {
+  out->push_back(static_cast<char>(LogFrameKind::kText));
+  Append(out, static_cast<uint64_t>(thread_id));
+  Append(out, timestamp_ns);
+  Append(out, static_cast<uint8_t>(level));
+  Append(out, static_cast<uint32_t>(message.size()));
+  out->append(message);
+}
+
+auto ReadFrame(std::FILE* in, DecodedFrame* frame) -> bool {
+  uint8_t kind = 0;
+  if (!Read(in, &kind)) {
+    return false;
+  }
+  frame->kind = static_cast<LogFrameKind>(kind);
+  if (frame->kind == LogFrameKind::kFormat) {
+    uint8_t level = 0;
+    uint32_t line = 0;
+    if (!Read(in, &frame->fmt_id) || !Read(in, &level) || !Read(in, &line) ||
+        !ReadString(in, &frame->file) || !ReadString(in, &frame->fmt)) {
+      return false;
+    }
+    frame->level = level;
+    frame->line = static_cast<int>(line);
+    return true;
+  }
+  if (frame->kind == LogFrameKind::kRecord) {
+    uint64_t thread_id = 0;
+    auto& rec = frame->record;
+    if (!Read(in, &thread_id) || !Read(in, &rec.timestamp_ns) ||
+        !Read(in, &rec.fmt_id) || !Read(in, &rec.truncated) ||
+        !Read(in, &rec.payload_size) || rec.payload_size > kBinaryPayloadSize) {
+      return false;
+    }
+    frame->thread_id = static_cast<size_t>(thread_id);
+    return rec.payload_size == 0 ||
+           std::fread(rec.payload.data(), 1, rec.payload_size, in) ==
+               rec.payload_size;
+  }
+  if (frame->kind == LogFrameKind::kText) {
+    uint64_t thread_id = 0;
+    uint8_t level = 0;
+    uint32_t len = 0;
+    if (!Read(in, &thread_id) || !Read(in, &frame->record.timestamp_ns) ||
+        !Read(in, &level) || !Read(in, &len)) {
+      return false;
+    }
+    frame->thread_id = static_cast<size_t>(thread_id);
+    frame->level = level;
+    frame->text.resize(len);
+    return len == 0 || std::fread(frame->text.data(), 1, len, in) == len;
+  }
+  return false;
+}
+
+}  // namespace my_web_server
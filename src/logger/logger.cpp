@@ -15,17 +15,22 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// File overview: Implements thread-safe in-memory logger with terminal output.
+// File overview: Implements thread-safe in-memory logger with terminal output
+// and the asynchronous ring-buffer backend.
 
 #include "logger/logger.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <format>
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <thread>
 
+#include "utils/spsc_ring.hpp"
+
 namespace my_web_server {
 
 namespace {
@@ -47,6 +52,72 @@ auto FormatTimestamp(const std::chrono::system_clock::time_point& timestamp)
   return std::format("{:%F %T}", timestamp);
 }
 
+void AppendFormatted(std::string* out, const LogEntry& entry) {
+  std::format_to(std::back_inserter(*out), "[{}] [{}] [{}] {}\n",
+                 FormatTimestamp(entry.timestamp), LevelToString(entry.level),
+                 entry.thread_id, entry.message);
+}
+
+auto CurrentThreadId() -> size_t {
+  return std::hash<std::thread::id>{}(std::this_thread::get_id());
+}
+
+}  // namespace
+
+// One per producing thread. Owned jointly by the thread (through a
+// thread_local holder) and the logger, so records survive thread exit until
+// the backend drains them.
+struct ThreadLogBuffer {
+  ThreadLogBuffer(size_t capacity, size_t id)
+      : ring(capacity), binary_ring(capacity), thread_id(id) {}
+
+  SpscRing<LogEntry> ring;
+  SpscRing<BinaryLogRecord> binary_ring;  // deferred-formatting records
+  size_t thread_id;
+  std::atomic<bool> retired{false};  // owning thread has exited
+
+  auto Empty() const -> bool { return ring.Empty() && binary_ring.Empty(); }
+};
+
+namespace {
+
+struct LocalBufferHolder {
+  std::shared_ptr<ThreadLogBuffer> buffer;
+  ~LocalBufferHolder() {
+    if (buffer) {
+      buffer->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local LocalBufferHolder t_log_buffer;
+
+// Push under the configured overflow policy. Returns false when the caller
+// should fall back to the synchronous path (blocking and async stopped).
+template <typename T>
+auto PushWithPolicy(SpscRing<T>& ring, T&& value, LogOverflowPolicy policy,
+                    const std::atomic<bool>& async,
+                    std::condition_variable& backend_cond,
+                    std::atomic<uint64_t>& dropped) -> bool {
+  if (ring.TryPush(std::move(value))) {
+    return true;
+  }
+  if (policy == LogOverflowPolicy::kDrop) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  // kBlock: nudge the backend and wait for room. TryPush leaves value
+  // untouched on failure, so it can be retried or logged synchronously.
+  while (async.load(std::memory_order_acquire)) {
+    backend_cond.notify_one();
+    std::this_thread::yield();
+    if (ring.TryPush(std::move(value))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace
 
 auto Logger::Instance() -> Logger& {
@@ -54,9 +125,29 @@ auto Logger::Instance() -> Logger& {
   return instance;
 }
 
+Logger::~Logger() {
+  StopAsync();
+  std::lock_guard<std::mutex> lock(mutex_);
+  FlushLocked();
+}
+
 void Logger::Log(LogLevel level, const char* file, int line,
                  std::string message) {
-  auto thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+  if (async_.load(std::memory_order_acquire)) {
+    auto& buffer = LocalBuffer();
+    LogEntry entry{std::chrono::system_clock::now(), level, file, line,
+                   buffer.thread_id, std::move(message)};
+    if (PushWithPolicy(buffer.ring, std::move(entry), options_.overflow,
+                       async_, backend_cond_, dropped_)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(std::move(entry));
+    FlushLocked();
+    return;
+  }
+
+  auto thread_id = CurrentThreadId();
 
   std::lock_guard<std::mutex> lock(mutex_);
   entries_.push_back({std::chrono::system_clock::now(), level, file, line,
@@ -68,20 +159,315 @@ void Logger::Log(LogLevel level, const char* file, int line,
 }
 
 void Logger::Flush() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  FlushLocked();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FlushLocked();
+  }
+  if (!async_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(backend_mutex_);
+  uint64_t target = ++flush_requested_;
+  backend_cond_.notify_one();
+  flush_cond_.wait(lock, [this, target]() {
+    return flush_done_ >= target || !backend_running_;
+  });
 }
 
 void Logger::FlushLocked() {
+  if (entries_.empty()) {
+    return;
+  }
+  std::string out;
   for (const auto& entry : entries_) {
-    auto line =
-        std::format("[{}] [{}] [{}] {}\n", FormatTimestamp(entry.timestamp),
-                    LevelToString(entry.level), entry.thread_id, entry.message);
-    std::fputs(line.c_str(), stderr);
+    AppendFormatted(&out, entry);
   }
+  std::fputs(out.c_str(), stderr);
   entries_.clear();
 }
 
+void Logger::StartAsync(const AsyncLogOptions& options) {
+  std::lock_guard<std::mutex> lock(backend_mutex_);
+  if (backend_running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> sync_lock(mutex_);
+    FlushLocked();
+  }
+  options_ = options;
+  if (!options_.file.path.empty()) {
+    file_sink_ = std::make_unique<LogFileSink>();
+    if (!file_sink_->Open(options_.file)) {
+      file_sink_.reset();  // keep logging to stderr
+    }
+  }
+  stop_backend_ = false;
+  backend_running_ = true;
+  backend_ = std::thread([this]() { BackendLoop(); });
+  async_.store(true, std::memory_order_release);
+}
+
+void Logger::StopAsync() {
+  {
+    std::lock_guard<std::mutex> lock(backend_mutex_);
+    if (!backend_running_ || stop_backend_) {
+      return;  // not started, or another caller is stopping it
+    }
+    // Producers racing with this store may still land in a ring; the final
+    // drain below picks up everything pushed before the backend exits.
+    async_.store(false, std::memory_order_release);
+    stop_backend_ = true;
+  }
+  backend_cond_.notify_one();
+  // Only the caller that set stop_backend_ gets here, and StartAsync()
+  // leaves backend_ alone until backend_running_ is cleared
+  backend_.join();
+  {
+    std::lock_guard<std::mutex> lock(backend_mutex_);
+    backend_running_ = false;
+    file_sink_.reset();
+  }
+  flush_cond_.notify_all();
+}
+
+void Logger::ReopenFiles() {
+  std::lock_guard<std::mutex> lock(backend_mutex_);
+  if (file_sink_) {
+    file_sink_->RequestReopen();
+  }
+}
+
+auto Logger::LocalBuffer() -> ThreadLogBuffer& {
+  if (!t_log_buffer.buffer) {
+    t_log_buffer.buffer = std::make_shared<ThreadLogBuffer>(
+        options_.ring_capacity, CurrentThreadId());
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.push_back(t_log_buffer.buffer);
+  }
+  return *t_log_buffer.buffer;
+}
+
+auto Logger::RegisterFormat(LogLevel level, const char* file, int line,
+                            std::string_view fmt) -> uint32_t {
+  std::lock_guard<std::mutex> lock(formats_mutex_);
+  uint32_t count = format_count_.load(std::memory_order_relaxed);
+  if (count >= kMaxLogFormats) {
+    return 0;  // registry full; records with id 0 are logged verbatim
+  }
+  formats_[count] = {static_cast<int>(level), file, line, fmt};
+  format_count_.store(count + 1, std::memory_order_release);
+  return count + 1;
+}
+
+auto Logger::Format(uint32_t fmt_id) const -> const LogFormat* {
+  if (fmt_id == 0 || fmt_id > format_count_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &formats_[fmt_id - 1];
+}
+
+void Logger::PushBinary(BinaryLogRecord&& record) {
+  if (async_.load(std::memory_order_acquire)) {
+    auto& buffer = LocalBuffer();
+    if (PushWithPolicy(buffer.binary_ring, std::move(record),
+                       options_.overflow, async_, backend_cond_, dropped_)) {
+      return;
+    }
+  }
+  // Synchronous mode formats right away
+  auto entry = ToEntry(CurrentThreadId(), record);
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.push_back(std::move(entry));
+  if (entries_.size() >= kFlushThreshold) {
+    FlushLocked();
+  }
+}
+
+auto Logger::ToEntry(size_t thread_id, const BinaryLogRecord& record) const
+    -> LogEntry {
+  LogEntry entry{std::chrono::system_clock::time_point(
+                     std::chrono::duration_cast<
+                         std::chrono::system_clock::duration>(
+                         std::chrono::nanoseconds(record.timestamp_ns))),
+                 LogLevel::kInfo, "", 0, thread_id, {}};
+  const LogFormat* format = Format(record.fmt_id);
+  auto args = DecodeLogArgs(record);
+  if (format == nullptr) {
+    entry.message = FormatLogRecord("{}", args);
+  } else {
+    entry.level = static_cast<LogLevel>(format->level);
+    entry.file = format->file;
+    entry.line = format->line;
+    entry.message = FormatLogRecord(format->fmt, args);
+  }
+  if (record.truncated != 0) {
+    entry.message += " [truncated]";
+  }
+  return entry;
+}
+
+void Logger::BackendLoop() {
+  std::vector<LogEntry> batch;
+  std::vector<BinaryBatchEntry> binary_batch;
+  if (!options_.binary_path.empty()) {
+    binary_file_ = std::fopen(options_.binary_path.c_str(), "ab");
+    if (binary_file_ == nullptr) {
+      std::fprintf(stderr, "Fail to open binary log \"%s\", using stderr\n",
+                   options_.binary_path.c_str());
+    } else if (std::ftell(binary_file_) == 0) {
+      std::fwrite(kBinaryLogMagic.data(), 1, kBinaryLogMagic.size(),
+                  binary_file_);
+    }
+    formats_written_ = 0;
+  }
+  std::unique_lock<std::mutex> lock(backend_mutex_);
+  while (true) {
+    // Everything pushed before these snapshots is popped by the pass below.
+    uint64_t flush_target = flush_requested_;
+    bool stopping = stop_backend_;
+    lock.unlock();
+
+    if (DrainRings(&batch, &binary_batch)) {
+      if (binary_file_ != nullptr) {
+        WriteBinaryBatch(&batch, &binary_batch);
+      } else {
+        WriteBatch(&batch, &binary_batch);
+      }
+    }
+
+    lock.lock();
+    flush_done_ = flush_target;
+    flush_cond_.notify_all();
+    if (stopping) {
+      if (binary_file_ != nullptr) {
+        std::fclose(binary_file_);
+        binary_file_ = nullptr;
+      }
+      return;
+    }
+    if (flush_requested_ == flush_target && !stop_backend_) {
+      backend_cond_.wait_for(lock, options_.drain_interval);
+    }
+  }
+}
+
+auto Logger::DrainRings(std::vector<LogEntry>* batch,
+                        std::vector<BinaryBatchEntry>* binary_batch) -> bool {
+  std::vector<std::shared_ptr<ThreadLogBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    // Forget exited threads once their rings are empty
+    std::erase_if(buffers_, [](const auto& buffer) {
+      return buffer->retired.load(std::memory_order_acquire) &&
+             buffer->Empty();
+    });
+    buffers = buffers_;
+  }
+
+  LogEntry entry;
+  BinaryLogRecord record;
+  for (const auto& buffer : buffers) {
+    // Bounded by capacity so a busy producer cannot starve the others
+    for (size_t i = 0; i < buffer->ring.Capacity(); ++i) {
+      if (!buffer->ring.TryPop(&entry)) {
+        break;
+      }
+      batch->push_back(std::move(entry));
+    }
+    for (size_t i = 0; i < buffer->binary_ring.Capacity(); ++i) {
+      if (!buffer->binary_ring.TryPop(&record)) {
+        break;
+      }
+      binary_batch->push_back({buffer->thread_id, record});
+    }
+  }
+  return !batch->empty() || !binary_batch->empty() ||
+         dropped_.load(std::memory_order_relaxed) != dropped_reported_;
+}
+
+void Logger::WriteBatch(std::vector<LogEntry>* batch,
+                        std::vector<BinaryBatchEntry>* binary_batch) {
+  // Deferred records are formatted here, off the logging threads
+  for (const auto& item : *binary_batch) {
+    batch->push_back(ToEntry(item.thread_id, item.record));
+  }
+  binary_batch->clear();
+  // Rings are drained one after another; restore global time order
+  std::stable_sort(batch->begin(), batch->end(),
+                   [](const LogEntry& a, const LogEntry& b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != dropped_reported_) {
+    batch->push_back({std::chrono::system_clock::now(), LogLevel::kWarn,
+                      __FILE__, __LINE__, CurrentThreadId(),
+                      std::format("Log ring full, dropped {} records",
+                                  dropped - dropped_reported_)});
+    dropped_reported_ = dropped;
+  }
+
+  // Format the whole batch into one buffer, remembering record boundaries
+  std::string out;
+  std::vector<size_t> ends;
+  ends.reserve(batch->size());
+  for (const auto& entry : *batch) {
+    AppendFormatted(&out, entry);
+    ends.push_back(out.size());
+  }
+  batch->clear();
+
+  if (file_sink_) {
+    // One iovec per record lets the sink rotate between records while still
+    // writing the whole batch with a few writev calls
+    std::vector<iovec> records;
+    records.reserve(ends.size());
+    size_t begin = 0;
+    for (size_t end : ends) {
+      records.push_back({out.data() + begin, end - begin});
+      begin = end;
+    }
+    file_sink_->Write(records);
+    return;
+  }
+  // One write per batch instead of one per record
+  std::fwrite(out.data(), 1, out.size(), stderr);
+  std::fflush(stderr);
+}
+
+void Logger::WriteBinaryBatch(std::vector<LogEntry>* batch,
+                              std::vector<BinaryBatchEntry>* binary_batch) {
+  std::string out;
+  // Describe call sites registered since the last batch
+  uint32_t count = format_count_.load(std::memory_order_acquire);
+  for (; formats_written_ < count; ++formats_written_) {
+    WriteFormatFrame(&out, formats_written_ + 1, formats_[formats_written_]);
+  }
+  for (const auto& item : *binary_batch) {
+    WriteRecordFrame(&out, item.thread_id, item.record);
+  }
+  // Plain LOG_* entries are already formatted and go out as text frames
+  uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != dropped_reported_) {
+    batch->push_back({std::chrono::system_clock::now(), LogLevel::kWarn,
+                      __FILE__, __LINE__, CurrentThreadId(),
+                      std::format("Log ring full, dropped {} records",
+                                  dropped - dropped_reported_)});
+    dropped_reported_ = dropped;
+  }
+  for (const auto& entry : *batch) {
+    WriteTextFrame(&out, entry.thread_id,
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       entry.timestamp.time_since_epoch())
+                       .count(),
+                   static_cast<int>(entry.level), entry.message);
+  }
+  std::fwrite(out.data(), 1, out.size(), binary_file_);
+  std::fflush(binary_file_);
+  batch->clear();
+  binary_batch->clear();
+}
+
 auto Logger::entries() const -> const std::vector<LogEntry>& {
   return entries_;
 }
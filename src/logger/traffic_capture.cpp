@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements traffic capture: per-thread chunk rings, the
+// per-descriptor connection table and the writer thread.
+
+#include "logger/traffic_capture.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+#include "logger/logger.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace my_web_server {
+
+// One ring per producing thread, shared with a thread_local holder so
+// chunks survive thread exit until the writer drains them.
+struct CaptureBuffer {
+  explicit CaptureBuffer(size_t capacity) : ring(capacity) {}
+
+  SpscRing<CaptureChunk> ring;
+  std::atomic<bool> retired{false};
+};
+
+namespace {
+
+constexpr uint32_t kLostBit = 1U << 31;
+// The table is indexed by descriptor; descriptors above this are not
+// captured
+constexpr size_t kMaxTableSize = 1 << 20;
+
+struct CaptureBufferHolder {
+  std::shared_ptr<CaptureBuffer> buffer;
+  ~CaptureBufferHolder() {
+    if (buffer) {
+      buffer->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local CaptureBufferHolder t_capture_buffer;
+
+auto SteadyNowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+auto WriteAll(int fd, const std::string& data) -> bool {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(fd, data.data() + done, data.size() - done);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+}  // namespace
+
+auto TrafficCapture::Instance() -> TrafficCapture& {
+  static TrafficCapture instance;
+  return instance;
+}
+
+TrafficCapture::~TrafficCapture() { Stop(); }
+
+void TrafficCapture::Start(const TrafficCaptureOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (writer_.joinable() || options.path.empty()) {
+    return;
+  }
+  options_ = options;
+  SetSampleEvery(options_.sample_every);
+  fd_ = open(options_.path.c_str(),
+             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ == -1) {
+    LOG_ERROR(std::format("Traffic capture disabled, cannot open \"{}\": {}",
+                          options_.path, std::strerror(errno)));
+    return;
+  }
+  rlimit limit{};
+  conn_ids_size_ = kMaxTableSize;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < kMaxTableSize) {
+    conn_ids_size_ = limit.rlim_cur;
+  }
+  conn_ids_ = std::make_unique<std::atomic<uint32_t>[]>(conn_ids_size_);
+
+  std::string header;
+  AppendCaptureHeader(
+      &header, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count());
+  WriteAll(fd_, header);
+  start_ns_ = SteadyNowNs();
+  encoder_ = CaptureEncoder();
+  stop_ = false;
+  writer_ = std::thread([this]() { WriterLoop(); });
+  enabled_.store(true, std::memory_order_release);
+}
+
+void TrafficCapture::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!writer_.joinable()) {
+      return;
+    }
+    enabled_.store(false, std::memory_order_release);
+    stop_ = true;
+  }
+  cond_.notify_one();
+  writer_.join();
+  std::lock_guard<std::mutex> lock(mutex_);
+  close(fd_);
+  fd_ = -1;
+}
+
+void TrafficCapture::SetSampleEvery(uint32_t sample_every) {
+  sample_every_.store(std::max<uint32_t>(sample_every, 1),
+                      std::memory_order_relaxed);
+}
+
+auto TrafficCapture::LocalBuffer() -> CaptureBuffer& {
+  if (!t_capture_buffer.buffer) {
+    t_capture_buffer.buffer =
+        std::make_shared<CaptureBuffer>(options_.ring_capacity);
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.push_back(t_capture_buffer.buffer);
+  }
+  return *t_capture_buffer.buffer;
+}
+
+auto TrafficCapture::Push(CaptureChunk* chunk) -> bool {
+  if (LocalBuffer().ring.TryPush(std::move(*chunk))) {
+    return true;
+  }
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+auto TrafficCapture::ConnId(int fd) const -> uint32_t {
+  if (!enabled() || fd < 0 || static_cast<size_t>(fd) >= conn_ids_size_) {
+    return 0;
+  }
+  return conn_ids_[fd].load(std::memory_order_relaxed);
+}
+
+void TrafficCapture::OnOpen(int fd, uint32_t peer_ip, uint16_t peer_port,
+                            bool tls) {
+  if (!enabled() || fd < 0 || static_cast<size_t>(fd) >= conn_ids_size_) {
+    return;
+  }
+  // Whole connections are sampled so keep-alive sequences stay intact
+  uint32_t n = next_conn_.fetch_add(1, std::memory_order_relaxed);
+  uint32_t id = 0;
+  if (n % sample_every_.load(std::memory_order_relaxed) == 0) {
+    id = n % (kLostBit - 1) + 1;
+    CaptureChunk chunk;
+    chunk.time_ns = SteadyNowNs();
+    chunk.conn_id = id;
+    chunk.kind = CaptureKind::kOpen;
+    std::memcpy(chunk.data, &peer_ip, sizeof(peer_ip));
+    std::memcpy(chunk.data + sizeof(peer_ip), &peer_port, sizeof(peer_port));
+    chunk.data[sizeof(peer_ip) + sizeof(peer_port)] = tls ? 1 : 0;
+    if (!Push(&chunk)) {
+      id = 0;  // without its open event the connection is useless
+    }
+  }
+  conn_ids_[fd].store(id, std::memory_order_relaxed);
+}
+
+void TrafficCapture::OnData(int fd, const char* data, size_t len) {
+  uint32_t id = ConnId(fd);
+  if (id == 0 || (id & kLostBit) != 0) {
+    return;
+  }
+  int64_t now = SteadyNowNs();
+  while (len > 0) {
+    CaptureChunk chunk;
+    chunk.time_ns = now;
+    chunk.conn_id = id;
+    chunk.kind = CaptureKind::kData;
+    chunk.len = static_cast<uint16_t>(std::min(len, kCaptureChunkBytes));
+    std::memcpy(chunk.data, data, chunk.len);
+    data += chunk.len;
+    len -= chunk.len;
+    if (!Push(&chunk)) {
+      // A request with a hole would replay as garbage; drop the rest
+      conn_ids_[fd].store(id | kLostBit, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+void TrafficCapture::OnClose(int fd) {
+  uint32_t id = ConnId(fd);
+  if (id == 0) {
+    return;
+  }
+  conn_ids_[fd].store(0, std::memory_order_relaxed);
+  CaptureChunk chunk;
+  chunk.time_ns = SteadyNowNs();
+  chunk.conn_id = id & ~kLostBit;
+  chunk.kind = (id & kLostBit) != 0 ? CaptureKind::kDropped
+                                    : CaptureKind::kClose;
+  Push(&chunk);
+}
+
+void TrafficCapture::WriterLoop() {
+  std::vector<CaptureChunk> pending;
+  std::string out;
+  uint64_t dropped_reported = 0;
+  bool write_failed = false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    bool stopping = stop_;
+    lock.unlock();
+
+    DrainOnce(&pending);
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported) {
+      LOG_WARN_FMT("Traffic capture ring full, dropped {} chunks",
+                   dropped - dropped_reported);
+      dropped_reported = dropped;
+    }
+    if (!pending.empty()) {
+      // Rings are drained one after another; restore time order within
+      // the batch. Readers sort again for the rare event that missed it.
+      std::stable_sort(pending.begin(), pending.end(),
+                       [](const CaptureChunk& a, const CaptureChunk& b) {
+                         return a.time_ns < b.time_ns;
+                       });
+      for (const auto& chunk : pending) {
+        int64_t time_ns = chunk.time_ns - start_ns_;
+        if (chunk.kind == CaptureKind::kOpen) {
+          uint32_t ip = 0;
+          uint16_t port = 0;
+          std::memcpy(&ip, chunk.data, sizeof(ip));
+          std::memcpy(&port, chunk.data + sizeof(ip), sizeof(port));
+          encoder_.AppendOpen(&out, chunk.conn_id, time_ns, ip, port,
+                              chunk.data[sizeof(ip) + sizeof(port)] != 0);
+        } else {
+          encoder_.Append(&out, chunk.kind, chunk.conn_id, time_ns,
+                          std::string_view(chunk.data, chunk.len));
+        }
+      }
+      pending.clear();
+      if (!WriteAll(fd_, out) && !write_failed) {
+        LOG_ERROR(std::format("Traffic capture write to \"{}\" failed: {}",
+                              options_.path, std::strerror(errno)));
+        write_failed = true;
+      }
+      out.clear();
+    }
+
+    lock.lock();
+    if (stopping) {
+      return;
+    }
+    if (!stop_) {
+      cond_.wait_for(lock, options_.drain_interval);
+    }
+  }
+}
+
+void TrafficCapture::DrainOnce(std::vector<CaptureChunk>* pending) {
+  std::vector<std::shared_ptr<CaptureBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    std::erase_if(buffers_, [](const auto& buffer) {
+      return buffer->retired.load(std::memory_order_acquire) &&
+             buffer->ring.Empty();
+    });
+    buffers = buffers_;
+  }
+  CaptureChunk chunk;
+  for (const auto& buffer : buffers) {
+    for (size_t i = 0; i < buffer->ring.Capacity(); ++i) {
+      if (!buffer->ring.TryPop(&chunk)) {
+        break;
+      }
+      pending->push_back(chunk);
+    }
+  }
+}
+
+}  // namespace my_web_server
@@ -20,7 +20,12 @@
 #include <format>
 
 #include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+#include "logger/access_log.hpp"
 #include "logger/logger.hpp"
+#include "logger/traffic_capture.hpp"
+#include "metrics/flight_recorder.hpp"
+#include "metrics/trace_clock.hpp"
 #include "server/web_server.hpp"
 
 auto main(int argc, char* argv[]) -> int {
@@ -32,10 +37,28 @@ auto main(int argc, char* argv[]) -> int {
   const auto& cfg = config.Get();
   LOG_INFO(std::format("Initializing web server at ip {} port {} dir \"{}\".",
                        cfg.ip, cfg.port, cfg.server_working_dir.string()));
-  my_web_server::Logger::Instance().Flush();
+  LOG_INFO(my_web_server::HttpConn::MemoryReport(cfg.max_conn));
+  my_web_server::TraceClock::Calibrate();
+  LOG_INFO(std::format("Request trace clock: {}",
+                       my_web_server::TraceClock::Describe()));
+  my_web_server::FlightRecorder::Instance().SetCapacity(
+      cfg.flight_recorder_events);
+  auto& logger = my_web_server::Logger::Instance();
+  logger.Flush();
+  // Keep formatting and stderr writes off the reactor and worker threads
+  logger.StartAsync({.overflow = cfg.log_overflow,
+                     .binary_path = cfg.log_binary_path,
+                     .file = cfg.log_file});
+  auto& access_log = my_web_server::AccessLog::Instance();
+  access_log.Start(cfg.access_log);
+  auto& capture = my_web_server::TrafficCapture::Instance();
+  capture.Start(cfg.capture);
 
-  my_web_server::WebServer server(cfg.ip.c_str(), cfg.port);
+  my_web_server::WebServer server(cfg.ip.c_str(), cfg.port, cfg.max_conn);
   server.Run();
-  my_web_server::Logger::Instance().Flush();
+  capture.Stop();
+  access_log.Stop();
+  logger.Flush();
+  logger.StopAsync();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements the flight recorder rings and their text dump.
+
+#include "metrics/flight_recorder.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <format>
+#include <fstream>
+
+namespace my_web_server {
+
+namespace {
+
+auto CurrentTid() -> int {
+#if defined(__linux__)
+  return static_cast<int>(gettid());
+#else
+  return 0;
+#endif
+}
+
+}  // namespace
+
+auto FlightEventName(FlightEvent event) -> std::string_view {
+  switch (event) {
+    case FlightEvent::kAccept:
+      return "accept";
+    case FlightEvent::kClose:
+      return "close";
+    case FlightEvent::kEpollBatch:
+      return "epoll_batch";
+    case FlightEvent::kDispatch:
+      return "dispatch";
+    case FlightEvent::kTaskStart:
+      return "task_start";
+    case FlightEvent::kParsed:
+      return "parsed";
+    case FlightEvent::kResponse:
+      return "response";
+    case FlightEvent::kComplete:
+      return "complete";
+    case FlightEvent::kEagainRead:
+      return "eagain_read";
+    case FlightEvent::kEagainWrite:
+      return "eagain_write";
+    case FlightEvent::kSignal:
+      return "signal";
+    case FlightEvent::kCount:
+      break;
+  }
+  return "?";
+}
+
+FlightRecorder::Ring::Ring(size_t capacity, int tid)
+    : mask_(std::bit_ceil(capacity) - 1),
+      tid_(tid),
+      slots_(std::make_unique<Slot[]>(mask_ + 1)) {}
+
+void FlightRecorder::Ring::CopyTo(std::vector<FlightRecord>* out) const {
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t begin = head > mask_ + 1 ? head - (mask_ + 1) : 0;
+  for (uint64_t i = begin; i < head; ++i) {
+    const auto& slot = slots_[i & mask_];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != i + 1) {
+      continue;  // overwritten since head was read
+    }
+    uint64_t ticks = slot.ticks.load(std::memory_order_relaxed);
+    uint64_t packed = slot.packed.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) {
+      continue;  // overwritten during the copy
+    }
+    out->push_back({.ticks = ticks,
+                    .tid = tid_,
+                    .fd = static_cast<int32_t>(packed & 0xffffffff),
+                    .event = static_cast<FlightEvent>((packed >> 32) & 0xffff),
+                    .arg = static_cast<uint16_t>(packed >> 48)});
+  }
+}
+
+auto FlightRecorder::Instance() -> FlightRecorder& {
+  static FlightRecorder instance;
+  return instance;
+}
+
+auto FlightRecorder::Local() -> Ring& {
+  thread_local Ring* ring = nullptr;
+  if (ring == nullptr) {
+    auto owned = std::make_shared<Ring>(capacity_, CurrentTid());
+    ring = owned.get();
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.push_back(std::move(owned));
+  }
+  return *ring;
+}
+
+auto FlightRecorder::Snapshot() const -> std::vector<FlightRecord> {
+  std::vector<FlightRecord> records;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (const auto& ring : rings_) {
+      ring->CopyTo(&records);
+    }
+  }
+  std::stable_sort(records.begin(), records.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.ticks < b.ticks;
+                   });
+  return records;
+}
+
+auto FlightRecorder::Dump(const std::string& path) const -> int64_t {
+  // Pair the tick clock with the wall clock once; events are placed
+  // relative to this instant
+  uint64_t now_ticks = TraceClock::Now();
+  auto now_wall = std::chrono::system_clock::now();
+  auto records = Snapshot();
+
+  std::string out = std::format(
+      "# flight recorder dump pid={} at {:%FT%T}Z, {} events, clock {}\n"
+      "# time(UTC) tid event fd arg\n",
+      getpid(), std::chrono::floor<std::chrono::seconds>(now_wall),
+      records.size(), TraceClock::Describe());
+  auto it = std::back_inserter(out);
+  for (const auto& record : records) {
+    auto age = std::chrono::nanoseconds(
+        TraceClock::ToNs(now_ticks > record.ticks ? now_ticks - record.ticks
+                                                  : 0));
+    auto when = std::chrono::floor<std::chrono::microseconds>(
+        now_wall - std::chrono::duration_cast<
+                       std::chrono::system_clock::duration>(age));
+    auto seconds = std::chrono::floor<std::chrono::seconds>(when);
+    std::format_to(it, "{:%T}.{:06} {} {} {} {}\n", seconds,
+                   (when - seconds).count(), record.tid,
+                   FlightEventName(record.event), record.fd, record.arg);
+  }
+
+  std::ofstream file(path, std::ios::app);
+  if (!file) {
+    return -1;
+  }
+  file << out;
+  file.flush();
+  if (!file) {
+    return -1;
+  }
+  return static_cast<int64_t>(records.size());
+}
+
+}  // namespace my_web_server
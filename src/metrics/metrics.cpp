@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements Metrics shard registration, aggregation and
+// Prometheus text rendering.
+
+#include "metrics/metrics.hpp"
+
+#include <cmath>
+#include <format>
+#include <iterator>
+
+#include "metrics/request_trace.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+constexpr std::array<double, 16> kLatencyBounds = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05,   0.1,     0.25,   0.5,   1.0,    2.5,   5.0,  10.0};
+constexpr std::array<double, 12> kSizeBounds = {
+    256,     1024,     4096,      16384,     65536,     262144,
+    1048576, 4194304, 16777216, 67108864, 268435456, 1073741824};
+
+static_assert(static_cast<size_t>(Histogram::kCount) -
+                  static_cast<size_t>(Histogram::kPhaseAccept) ==
+              kTracePhaseCount);
+
+struct StatusSeries {
+  Counter counter;
+  std::string_view code;
+};
+constexpr std::array<StatusSeries, 6> kStatusSeries = {{
+    {Counter::kStatus200, "200"},
+    {Counter::kStatus400, "400"},
+    {Counter::kStatus403, "403"},
+    {Counter::kStatus404, "404"},
+    {Counter::kStatus500, "500"},
+    {Counter::kStatusOther, "other"},
+}};
+
+}  // namespace
+
+auto Metrics::Instance() -> Metrics& {
+  static Metrics instance;
+  return instance;
+}
+
+auto Metrics::Local() -> Shard& {
+  thread_local Shard* shard = nullptr;
+  if (shard == nullptr) {
+    auto owned = std::make_shared<Shard>();
+    shard = owned.get();
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    shards_.push_back(std::move(owned));
+  }
+  return *shard;
+}
+
+auto Metrics::StatusCounter(uint16_t status) -> Counter {
+  switch (status) {
+    case 200:
+      return Counter::kStatus200;
+    case 400:
+      return Counter::kStatus400;
+    case 403:
+      return Counter::kStatus403;
+    case 404:
+      return Counter::kStatus404;
+    case 500:
+      return Counter::kStatus500;
+    default:
+      return Counter::kStatusOther;
+  }
+}
+
+auto Metrics::Read(Counter counter) const -> uint64_t {
+  uint64_t total = 0;
+  std::lock_guard<std::mutex> lock(shards_mutex_);
+  for (const auto& shard : shards_) {
+    total += shard->counters[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+  return total;
+}
+
+auto Metrics::Read(Histogram histogram) const -> LogLinearHistogram::Snapshot {
+  LogLinearHistogram::Snapshot snapshot;
+  std::lock_guard<std::mutex> lock(shards_mutex_);
+  for (const auto& shard : shards_) {
+    shard->histograms[static_cast<size_t>(histogram)].AddTo(&snapshot);
+  }
+  return snapshot;
+}
+
+void Metrics::Render(std::string* out) const {
+  AppendMetricHeader(out, "connections_accepted_total", "counter",
+                     "Connections accepted");
+  AppendSample(out, "connections_accepted_total", "",
+               static_cast<double>(Read(Counter::kConnectionsAccepted)));
+  AppendMetricHeader(out, "connections_refused_total", "counter",
+                     "Connections closed at accept because of --max-conn");
+  AppendSample(out, "connections_refused_total", "",
+               static_cast<double>(Read(Counter::kConnectionsRefused)));
+
+  AppendMetricHeader(out, "tls_handshakes_total", "counter",
+                     "TLS handshakes by result");
+  AppendSample(out, "tls_handshakes_total", R"(result="ok")",
+               static_cast<double>(Read(Counter::kTlsHandshakes)));
+  AppendSample(out, "tls_handshakes_total", R"(result="failed")",
+               static_cast<double>(Read(Counter::kTlsHandshakeFailures)));
+
+  AppendMetricHeader(out, "http2_connections_total", "counter",
+                     "Connections switched to HTTP/2 (h2c)");
+  AppendSample(out, "http2_connections_total", "",
+               static_cast<double>(Read(Counter::kH2Connections)));
+  AppendMetricHeader(out, "http2_streams_total", "counter",
+                     "HTTP/2 streams answered");
+  AppendSample(out, "http2_streams_total", "",
+               static_cast<double>(Read(Counter::kH2Streams)));
+
+  AppendMetricHeader(out, "responses_total", "counter",
+                     "Responses completed by status code");
+  for (const auto& series : kStatusSeries) {
+    AppendSample(out, "responses_total",
+                 std::format(R"(code="{}")", series.code),
+                 static_cast<double>(Read(series.counter)));
+  }
+  AppendMetricHeader(out, "response_bytes_total", "counter",
+                     "Response bytes sent, headers included");
+  AppendSample(out, "response_bytes_total", "",
+               static_cast<double>(Read(Counter::kResponseBytes)));
+  AppendMetricHeader(out, "upload_bytes_total", "counter",
+                     "PUT/POST body bytes received");
+  AppendSample(out, "upload_bytes_total", "",
+               static_cast<double>(Read(Counter::kUploadBytes)));
+  AppendMetricHeader(out, "proxy_requests_total", "counter",
+                     "Requests relayed to an upstream");
+  AppendSample(out, "proxy_requests_total", "",
+               static_cast<double>(Read(Counter::kProxyRequests)));
+  AppendMetricHeader(out, "upstream_connects_total", "counter",
+                     "New upstream connections attempted");
+  AppendSample(out, "upstream_connects_total", "",
+               static_cast<double>(Read(Counter::kUpstreamConnects)));
+  AppendMetricHeader(out, "upstream_errors_total", "counter",
+                     "Upstream connections refused or broken");
+  AppendSample(out, "upstream_errors_total", "",
+               static_cast<double>(Read(Counter::kUpstreamFailures)));
+
+  auto duration = Read(Histogram::kRequestDuration);
+  AppendMetricHeader(out, "request_duration_seconds", "histogram",
+                     "First request byte to last response byte");
+  AppendHistogram(out, "request_duration_seconds", "", duration, 1e-9,
+                  LatencyBounds());
+  AppendMetricHeader(out, "request_duration_quantile_seconds", "gauge",
+                     "Request duration quantiles since start (+12.5% max)");
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    AppendSample(out, "request_duration_quantile_seconds",
+                 std::format(R"(quantile="{}")", q),
+                 static_cast<double>(duration.Quantile(q)) * 1e-9);
+  }
+
+  AppendMetricHeader(out, "response_size_bytes", "histogram",
+                     "Bytes per response, headers included");
+  AppendHistogram(out, "response_size_bytes", "",
+                  Read(Histogram::kResponseSize), 1.0, SizeBounds());
+
+  AppendMetricHeader(out, "request_phase_seconds", "histogram",
+                     "Time per request phase, from TSC trace stamps");
+  for (size_t i = 0; i < kTracePhaseCount; ++i) {
+    auto histogram = static_cast<Histogram>(
+        static_cast<size_t>(Histogram::kPhaseAccept) + i);
+    auto phase = TracePhaseName(static_cast<TracePhase>(i));
+    AppendHistogram(out, "request_phase_seconds",
+                    std::format(R"(phase="{}")", phase), Read(histogram),
+                    1e-9, LatencyBounds());
+  }
+}
+
+void AppendMetricHeader(std::string* out, std::string_view name,
+                        std::string_view type, std::string_view help) {
+  std::format_to(std::back_inserter(*out),
+                 "# HELP mws_{} {}\n# TYPE mws_{} {}\n", name, help, name,
+                 type);
+}
+
+void AppendSample(std::string* out, std::string_view name,
+                  std::string_view labels, double value) {
+  if (labels.empty()) {
+    std::format_to(std::back_inserter(*out), "mws_{} {}\n", name, value);
+  } else {
+    std::format_to(std::back_inserter(*out), "mws_{}{{{}}} {}\n", name,
+                   labels, value);
+  }
+}
+
+void AppendHistogram(std::string* out, std::string_view name,
+                     std::string_view labels,
+                     const LogLinearHistogram::Snapshot& snapshot,
+                     double scale, std::span<const double> bounds) {
+  std::string_view sep = labels.empty() ? "" : ",";
+  for (double bound : bounds) {
+    auto raw = static_cast<uint64_t>(std::llround(bound / scale));
+    std::format_to(std::back_inserter(*out),
+                   "mws_{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, sep,
+                   bound, snapshot.CountAtMost(raw));
+  }
+  std::format_to(std::back_inserter(*out),
+                 "mws_{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, sep,
+                 snapshot.count);
+  std::string_view open = labels.empty() ? "" : "{";
+  std::string_view close = labels.empty() ? "" : "}";
+  std::format_to(std::back_inserter(*out), "mws_{}_sum{}{}{} {}\n", name, open,
+                 labels, close, static_cast<double>(snapshot.sum) * scale);
+  std::format_to(std::back_inserter(*out), "mws_{}_count{}{}{} {}\n", name,
+                 open, labels, close, snapshot.count);
+}
+
+auto LatencyBounds() -> std::span<const double> { return kLatencyBounds; }
+
+auto SizeBounds() -> std::span<const double> { return kSizeBounds; }
+
+}  // namespace my_web_server
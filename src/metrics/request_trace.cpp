@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements phase accounting and the slow trace slots.
+
+#include "metrics/request_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iterator>
+
+#include "metrics/metrics.hpp"
+
+namespace my_web_server {
+
+auto TracePhaseName(TracePhase phase) -> std::string_view {
+  switch (phase) {
+    case TracePhase::kAccept:
+      return "accept";
+    case TracePhase::kRead:
+      return "read";
+    case TracePhase::kQueue:
+      return "queue";
+    case TracePhase::kParse:
+      return "parse";
+    case TracePhase::kRespond:
+      return "respond";
+    case TracePhase::kSendWait:
+      return "send_wait";
+    case TracePhase::kSend:
+      return "send";
+    case TracePhase::kCount:
+      break;
+  }
+  return "?";
+}
+
+auto SlowTraceLog::Instance() -> SlowTraceLog& {
+  static SlowTraceLog instance;
+  return instance;
+}
+
+void SlowTraceLog::Finish(const RequestTrace& trace, uint16_t status,
+                          std::string_view url) {
+  const auto& ticks = trace.ticks;
+  uint64_t complete = ticks[static_cast<size_t>(TracePoint::kComplete)];
+  if (complete == 0) {
+    return;
+  }
+  SlowTrace slow;
+  auto& metrics = Metrics::Instance();
+  uint64_t first = 0;
+  for (size_t i = 0; i < kTracePhaseCount; ++i) {
+    if (first == 0) {
+      first = ticks[i];
+    }
+    uint64_t from = ticks[i];
+    uint64_t to = ticks[i + 1];
+    if (from == 0 || to == 0 || to < from) {
+      continue;
+    }
+    slow.phase_ns[i] = TraceClock::ToNs(to - from);
+    metrics.Observe(static_cast<Histogram>(
+                        static_cast<size_t>(Histogram::kPhaseAccept) + i),
+                    slow.phase_ns[i]);
+  }
+  if (first == 0 || complete < first) {
+    return;
+  }
+  slow.total_ns = TraceClock::ToNs(complete - first);
+  if (slow.total_ns <= threshold_ns_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  slow.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+  slow.status = status;
+  slow.url_len =
+      static_cast<uint8_t>(std::min(url.size(), SlowTrace::kUrlSize));
+  std::copy_n(url.data(), slow.url_len, slow.url);
+  Offer(slow);
+}
+
+void SlowTraceLog::Offer(const SlowTrace& trace) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (used_ < kSlots) {
+    slots_[used_++] = trace;
+  } else {
+    auto fastest = std::min_element(
+        slots_.begin(), slots_.end(), [](const auto& a, const auto& b) {
+          return a.total_ns < b.total_ns;
+        });
+    if (trace.total_ns <= fastest->total_ns) {
+      return;  // lost a race with another slower trace
+    }
+    *fastest = trace;
+  }
+  if (used_ == kSlots) {
+    auto fastest = std::min_element(
+        slots_.begin(), slots_.end(), [](const auto& a, const auto& b) {
+          return a.total_ns < b.total_ns;
+        });
+    threshold_ns_.store(fastest->total_ns, std::memory_order_relaxed);
+  }
+}
+
+auto SlowTraceLog::Slowest() const -> std::vector<SlowTrace> {
+  std::vector<SlowTrace> traces;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    traces.assign(slots_.begin(), slots_.begin() + used_);
+  }
+  std::sort(traces.begin(), traces.end(), [](const auto& a, const auto& b) {
+    return a.total_ns > b.total_ns;
+  });
+  return traces;
+}
+
+void SlowTraceLog::Render(std::string* out) const {
+  auto it = std::back_inserter(*out);
+  std::format_to(it, "# clock: {}; phases in microseconds\n# total_us",
+                 TraceClock::Describe());
+  for (size_t i = 0; i < kTracePhaseCount; ++i) {
+    std::format_to(it, " {}", TracePhaseName(static_cast<TracePhase>(i)));
+  }
+  std::format_to(it, " status age_s url\n");
+  auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::system_clock::now().time_since_epoch())
+                 .count();
+  for (const auto& trace : Slowest()) {
+    std::format_to(it, "{:.1f}", static_cast<double>(trace.total_ns) / 1e3);
+    for (uint64_t ns : trace.phase_ns) {
+      std::format_to(it, " {:.1f}", static_cast<double>(ns) / 1e3);
+    }
+    std::format_to(it, " {} {:.0f} {}\n", trace.status,
+                   static_cast<double>(now - trace.wall_ns) / 1e9,
+                   std::string_view(trace.url, trace.url_len));
+  }
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements TraceClock calibration.
+
+#include "metrics/trace_clock.hpp"
+
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace my_web_server {
+
+namespace {
+
+// Only a TSC that ticks at a constant rate through frequency changes and
+// deep C-states can be converted with a single factor
+auto HasInvariantTsc() -> bool {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.starts_with("flags")) {
+      return line.find(" constant_tsc") != std::string::npos &&
+             line.find(" nonstop_tsc") != std::string::npos;
+    }
+  }
+#endif
+  return false;
+}
+
+}  // namespace
+
+void TraceClock::Calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+  if (use_tsc_ || !HasInvariantTsc()) {
+    return;
+  }
+  uint64_t ns_start = Now();
+  uint64_t tsc_start = __rdtsc();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  uint64_t ns_end = Now();
+  uint64_t tsc_end = __rdtsc();
+  if (tsc_end <= tsc_start || ns_end <= ns_start) {
+    return;
+  }
+  ns_per_tick_q32_ = static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(ns_end - ns_start) << 32) /
+      (tsc_end - tsc_start));
+  use_tsc_ = true;
+#endif
+}
+
+auto TraceClock::Describe() -> std::string {
+  if (!use_tsc_) {
+    return "CLOCK_MONOTONIC_RAW";
+  }
+  double mhz = 1e3 * static_cast<double>(1ULL << 32) /
+               static_cast<double>(ns_per_tick_q32_);
+  return std::format("tsc {:.1f} MHz", mhz);
+}
+
+}  // namespace my_web_server
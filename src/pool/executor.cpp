@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements Executor lane setup, batch posting and reports.
+
+#include "pool/executor.hpp"
+
+#include <format>
+
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+#include "utils/cpu_topology.hpp"
+
+namespace my_web_server {
+
+namespace {
+
+auto MakeLane(Lane lane, const LaneOptions& options)
+    -> std::unique_ptr<ThreadPool> {
+  ThreadPool::ThreadInit init;
+  if (!options.affinity.empty()) {
+    init = [lane, affinity = options.affinity](size_t index) {
+      const auto& cpus = affinity[index % affinity.size()];
+      if (!PinCurrentThread(cpus)) {
+        LOG_WARN_FMT("Cannot pin {} worker {} (first CPU {})",
+                     Executor::LaneName(lane), index, cpus.front());
+      }
+    };
+  }
+  return std::make_unique<ThreadPool>(options.threads, options.queue_limit,
+                                      std::move(init));
+}
+
+}  // namespace
+
+Executor::Executor(const ExecutorOptions& options) {
+  pools_[static_cast<size_t>(Lane::kCpu)] = MakeLane(Lane::kCpu, options.cpu);
+  pools_[static_cast<size_t>(Lane::kIo)] = MakeLane(Lane::kIo, options.io);
+}
+
+Executor::~Executor() {
+  pools_[static_cast<size_t>(Lane::kCpu)].reset();
+  pools_[static_cast<size_t>(Lane::kIo)].reset();
+}
+
+void Executor::PostBatch(Lane lane, std::span<Task> tasks) {
+  size_t accepted = pool(lane).TryAddTasks(tasks);
+  if (lane == Lane::kIo) {
+    pool(lane).AddTasks(tasks.subspan(accepted));
+    return;
+  }
+  for (auto& task : tasks.subspan(accepted)) {
+    task();
+  }
+}
+
+auto Executor::Report() const -> std::string {
+  std::string report;
+  for (size_t i = 0; i < pools_.size(); ++i) {
+    auto lane = static_cast<Lane>(i);
+    auto stats = pools_[i]->Stats();
+    double avg_wait_us =
+        stats.started == 0 ? 0.0
+                           : static_cast<double>(stats.wait_ns_total) /
+                                 static_cast<double>(stats.started) / 1000.0;
+    if (!report.empty()) {
+      report += "; ";
+    }
+    report += std::format(
+        "lane {}: threads={} limit={} tasks={} queued={} max_queued={} "
+        "avg_wait={:.1f}us max_wait={:.1f}us over_limit={}",
+        LaneName(lane), pools_[i]->thread_num(), pools_[i]->queue_limit(),
+        stats.started, stats.queued, stats.max_queued, avg_wait_us,
+        static_cast<double>(stats.max_wait_ns) / 1000.0, stats.rejected);
+  }
+  return report;
+}
+
+void Executor::AppendMetrics(std::string* out) const {
+  struct Family {
+    std::string_view name;
+    std::string_view type;
+    std::string_view help;
+    double (*value)(const ThreadPool&, const PoolStats&);
+  };
+  static constexpr Family kFamilies[] = {
+      {"lane_threads", "gauge", "Worker threads per lane",
+       [](const ThreadPool& pool, const PoolStats&) {
+         return static_cast<double>(pool.thread_num());
+       }},
+      {"lane_queue_depth", "gauge", "Tasks submitted but not started",
+       [](const ThreadPool&, const PoolStats& stats) {
+         return static_cast<double>(stats.queued);
+       }},
+      {"lane_queue_depth_max", "gauge", "Highest queue depth since start",
+       [](const ThreadPool&, const PoolStats& stats) {
+         return static_cast<double>(stats.max_queued);
+       }},
+      {"lane_tasks_started_total", "counter", "Tasks started per lane",
+       [](const ThreadPool&, const PoolStats& stats) {
+         return static_cast<double>(stats.started);
+       }},
+      {"lane_tasks_over_limit_total", "counter",
+       "Tasks submitted at the queue limit (run by the submitter on cpu, "
+       "queued anyway on io)",
+       [](const ThreadPool&, const PoolStats& stats) {
+         return static_cast<double>(stats.rejected);
+       }},
+  };
+  std::array<PoolStats, static_cast<size_t>(Lane::kCount)> stats;
+  for (size_t i = 0; i < pools_.size(); ++i) {
+    stats[i] = pools_[i]->Stats();
+  }
+  for (const auto& family : kFamilies) {
+    AppendMetricHeader(out, family.name, family.type, family.help);
+    for (size_t i = 0; i < pools_.size(); ++i) {
+      AppendSample(out, family.name,
+                   std::format(R"(lane="{}")", LaneName(static_cast<Lane>(i))),
+                   family.value(*pools_[i], stats[i]));
+    }
+  }
+  AppendMetricHeader(out, "lane_queue_wait_seconds", "histogram",
+                     "Time from submit to start per lane");
+  for (size_t i = 0; i < pools_.size(); ++i) {
+    AppendHistogram(out, "lane_queue_wait_seconds",
+                    std::format(R"(lane="{}")", LaneName(static_cast<Lane>(i))),
+                    pools_[i]->WaitHistogram(), 1e-9, LatencyBounds());
+  }
+}
+
+auto Executor::LaneName(Lane lane) -> std::string_view {
+  switch (lane) {
+    case Lane::kCpu:
+      return "cpu";
+    case Lane::kIo:
+      return "io";
+    case Lane::kCount:
+      break;
+  }
+  return "?";
+}
+
+}  // namespace my_web_server
@@ -15,47 +15,375 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-// File overview: Implements ThreadPool worker lifecycle and task queue.
+// File overview: Implements ThreadPool workers, submission and stealing.
 
 #include "pool/thread_pool.hpp"
 
+#include <algorithm>
+#include <chrono>
+
+#include "utils/usdt.hpp"
+
 namespace my_web_server {
 
-ThreadPool::ThreadPool(size_t thread_num) : pool_(std::make_shared<Pool>()) {
-  pool_->thread_num = thread_num;
-  // Creat worker threads
+struct ThreadPool::TaskNode {
+  Task task;
+  TaskNode* next{nullptr};  // inbox or free list link
+  int64_t enqueued_ns{0};   // steady clock, for wait-time stats
+};
+
+namespace {
+
+// Identifies the pool and worker the current thread belongs to, so tasks
+// that submit more work push to their own deque
+thread_local const void* t_pool = nullptr;
+thread_local size_t t_worker_index = 0;
+
+// Steal rounds over all victims before a worker parks
+constexpr int kStealRounds = 2;
+
+auto SteadyNowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Queue node recycling. Nodes are usually allocated by the reactor and freed
+// by workers, so each thread keeps a private free list and hands surplus
+// nodes to a process-wide stack in chains. The shared stack is only pushed
+// with CAS and emptied with one exchange, which keeps it ABA-free.
+template <typename Node>
+class NodeFreeList {
+ public:
+  static auto Alloc() -> Node* {
+    auto& local = t_local;
+    if (local.head == nullptr) {
+      local.head = shared_.exchange(nullptr, std::memory_order_acquire);
+      local.count = 0;
+      for (Node* node = local.head; node != nullptr; node = node->next) {
+        ++local.count;
+      }
+      if (local.head == nullptr) {
+        return new Node();
+      }
+    }
+    Node* node = local.head;
+    local.head = node->next;
+    --local.count;
+    node->next = nullptr;
+    return node;
+  }
+
+  // The node's task must already be reset
+  static void Free(Node* node) {
+    auto& local = t_local;
+    node->next = local.head;
+    local.head = node;
+    if (++local.count < kLocalMax) {
+      return;
+    }
+    // Give half of the list away as one chain
+    Node* first = local.head;
+    Node* last = first;
+    for (size_t i = 1; i < kLocalMax / 2; ++i) {
+      last = last->next;
+    }
+    local.head = last->next;
+    local.count -= kLocalMax / 2;
+    last->next = shared_.load(std::memory_order_relaxed);
+    while (!shared_.compare_exchange_weak(last->next, first,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  static constexpr size_t kLocalMax = 256;
+
+  struct Local {
+    Node* head{nullptr};
+    size_t count{0};
+    ~Local() {
+      while (head != nullptr) {
+        Node* next = head->next;
+        delete head;
+        head = next;
+      }
+    }
+  };
+
+  static inline std::atomic<Node*> shared_{nullptr};
+  static inline thread_local Local t_local;
+};
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_num, size_t queue_limit,
+                       ThreadInit thread_init)
+    : queue_limit_(queue_limit) {
+  if (thread_num == 0) {
+    thread_num = 1;
+  }
+  workers_.reserve(thread_num);
   for (size_t i = 0; i < thread_num; ++i) {
-    pool_->workers.emplace_back(std::thread([pool = pool_]() {
-      while (true) {
-        std::function<void()> task;
-        {
-          std::unique_lock<std::mutex> lock(pool->mtx);
-          // Wait until there is a task or the pool is closed
-          pool->cond.wait(lock, [pool]() {
-            return pool->is_closed || !pool->tasks.empty();
-          });
-
-          if (pool->is_closed && pool->tasks.empty()) {
-            return;
-          }
-
-          task = std::move(pool->tasks.front());
-          pool->tasks.pop();
-        }
-        task();
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // Start threads only once every worker exists; thieves scan all of them
+  for (size_t i = 0; i < thread_num; ++i) {
+    workers_[i]->thread = std::thread([this, i, thread_init]() {
+      if (thread_init) {
+        thread_init(i);
       }
-    }));
+      WorkerLoop(i);
+    });
   }
 }
 
 ThreadPool::~ThreadPool() {
-  pool_->is_closed = true;
-  pool_->cond.notify_all();
-  for (std::thread& worker : pool_->workers) {
-    if (worker.joinable()) {
-      worker.join();
+  closed_.store(true, std::memory_order_release);
+  idle_.NotifyAll();
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+  // A submit racing with close can land after its target exited. Run the
+  // leftovers here, acting as worker i so follow-up tasks stay local.
+  t_pool = this;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    t_worker_index = i;
+    while (TaskNode* node = TakeInbox(*workers_[i], i)) {
+      do {
+        RunNode(node, *workers_[i]);
+      } while (workers_[i]->deque.Pop(&node));
+    }
+  }
+  t_pool = nullptr;
+}
+
+void ThreadPool::CheckOpen() const {
+  if (t_pool != this && closed_.load(std::memory_order_acquire)) {
+    throw std::runtime_error("ThreadPool is closed. Cannot add new task.");
+  }
+}
+
+void ThreadPool::Submit(Task&& task) {
+  TaskNode* node = NodeFreeList<TaskNode>::Alloc();
+  node->task = std::move(task);
+  node->enqueued_ns = SteadyNowNs();
+  MWS_USDT2(task_enqueue, this, node);
+  if (t_pool == this) {
+    workers_[t_worker_index]->deque.Push(node);
+  } else {
+    PushInbox(node, node);
+  }
+  idle_.NotifyOne();
+}
+
+void ThreadPool::AddTasks(std::span<Task> tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  CheckOpen();
+  Admit(tasks.size(), false);
+  Enqueue(tasks);
+}
+
+auto ThreadPool::TryAddTasks(std::span<Task> tasks) -> size_t {
+  if (tasks.empty()) {
+    return 0;
+  }
+  CheckOpen();
+  size_t admitted = Admit(tasks.size(), true);
+  Enqueue(tasks.first(admitted));
+  return admitted;
+}
+
+void ThreadPool::Enqueue(std::span<Task> tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  int64_t now_ns = SteadyNowNs();
+  if (t_pool == this) {
+    for (auto& task : tasks) {
+      TaskNode* node = NodeFreeList<TaskNode>::Alloc();
+      node->task = std::move(task);
+      node->enqueued_ns = now_ns;
+      MWS_USDT2(task_enqueue, this, node);
+      workers_[t_worker_index]->deque.Push(node);
+    }
+    idle_.NotifyOne();
+    return;
+  }
+  // Inboxes are LIFO stacks reversed on take, so link newest-first here
+  TaskNode* first = nullptr;
+  TaskNode* last = nullptr;
+  for (auto& task : tasks) {
+    TaskNode* node = NodeFreeList<TaskNode>::Alloc();
+    node->task = std::move(task);
+    node->enqueued_ns = now_ns;
+    MWS_USDT2(task_enqueue, this, node);
+    node->next = first;
+    first = node;
+    if (last == nullptr) {
+      last = node;
+    }
+  }
+  PushInbox(first, last);
+  idle_.NotifyOne();
+}
+
+void ThreadPool::PushInbox(TaskNode* first, TaskNode* last) {
+  size_t target =
+      next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  auto& inbox = workers_[target]->inbox;
+  last->next = inbox.load(std::memory_order_relaxed);
+  while (!inbox.compare_exchange_weak(last->next, first,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+auto ThreadPool::TakeInbox(Worker& from, size_t index) -> TaskNode* {
+  if (from.inbox.load(std::memory_order_relaxed) == nullptr) {
+    return nullptr;
+  }
+  TaskNode* head = from.inbox.exchange(nullptr, std::memory_order_acquire);
+  if (head == nullptr) {
+    return nullptr;
+  }
+  // The stack is newest-first; reverse it so the oldest task runs first
+  TaskNode* reversed = nullptr;
+  while (head != nullptr) {
+    TaskNode* next = head->next;
+    head->next = reversed;
+    reversed = head;
+    head = next;
+  }
+  TaskNode* first = reversed;
+  // The rest goes to the back of our deque where other workers can steal it
+  for (TaskNode* node = first->next; node != nullptr;) {
+    TaskNode* next = node->next;
+    workers_[index]->deque.Push(node);
+    node = next;
+  }
+  if (first->next != nullptr) {
+    idle_.NotifyOne();
+  }
+  return first;
+}
+
+auto ThreadPool::FindTask(size_t index) -> TaskNode* {
+  auto& self = *workers_[index];
+  TaskNode* node = nullptr;
+  if (self.deque.Pop(&node)) {
+    return node;
+  }
+  if ((node = TakeInbox(self, index)) != nullptr) {
+    return node;
+  }
+  size_t count = workers_.size();
+  for (int round = 0; round < kStealRounds; ++round) {
+    // Start after ourselves so thieves spread over different victims
+    for (size_t i = 1; i < count; ++i) {
+      auto& victim = *workers_[(index + i) % count];
+      if (victim.deque.Steal(&node)) {
+        return node;
+      }
+      if ((node = TakeInbox(victim, index)) != nullptr) {
+        return node;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+  t_pool = this;
+  t_worker_index = index;
+  while (true) {
+    TaskNode* node = FindTask(index);
+    if (node == nullptr) {
+      auto key = idle_.PrepareWait();
+      node = FindTask(index);
+      if (node == nullptr) {
+        if (closed_.load(std::memory_order_acquire)) {
+          idle_.CancelWait();
+          return;
+        }
+        idle_.Wait(key);
+        continue;
+      }
+      idle_.CancelWait();
+    }
+    RunNode(node, *workers_[index]);
+  }
+}
+
+void ThreadPool::RunNode(TaskNode* node, Worker& worker) {
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  auto wait = static_cast<uint64_t>(
+      std::max<int64_t>(SteadyNowNs() - node->enqueued_ns, 0));
+  // Single writer per worker, so plain load + store is enough
+  worker.started.store(worker.started.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+  worker.wait_ns.store(worker.wait_ns.load(std::memory_order_relaxed) + wait,
+                       std::memory_order_relaxed);
+  if (wait > worker.max_wait_ns.load(std::memory_order_relaxed)) {
+    worker.max_wait_ns.store(wait, std::memory_order_relaxed);
+  }
+  worker.wait_histogram.Record(wait);
+  MWS_USDT3(task_dequeue, this, node, wait);
+  node->task();
+  node->task.Reset();  // drop captures before the node is reused
+  NodeFreeList<TaskNode>::Free(node);
+}
+
+auto ThreadPool::Admit(size_t count, bool bounded) -> size_t {
+  auto admitted = static_cast<int64_t>(count);
+  size_t queue_limit = queue_limit_.load(std::memory_order_relaxed);
+  if (bounded && queue_limit != 0) {
+    int64_t room = static_cast<int64_t>(queue_limit) -
+                   queued_.load(std::memory_order_relaxed);
+    admitted = std::clamp<int64_t>(room, 0, admitted);
+    if (admitted < static_cast<int64_t>(count)) {
+      rejected_.fetch_add(count - static_cast<size_t>(admitted),
+                          std::memory_order_relaxed);
     }
+    if (admitted == 0) {
+      return 0;
+    }
+  }
+  int64_t depth =
+      queued_.fetch_add(admitted, std::memory_order_relaxed) + admitted;
+  int64_t max = max_queued_.load(std::memory_order_relaxed);
+  while (depth > max && !max_queued_.compare_exchange_weak(
+                            max, depth, std::memory_order_relaxed)) {
+  }
+  return static_cast<size_t>(admitted);
+}
+
+auto ThreadPool::Stats() const -> PoolStats {
+  PoolStats stats;
+  for (const auto& worker : workers_) {
+    stats.started += worker->started.load(std::memory_order_relaxed);
+    stats.wait_ns_total += worker->wait_ns.load(std::memory_order_relaxed);
+    stats.max_wait_ns = std::max(
+        stats.max_wait_ns, worker->max_wait_ns.load(std::memory_order_relaxed));
+  }
+  stats.queued = std::max<int64_t>(queued_.load(std::memory_order_relaxed), 0);
+  stats.submitted = stats.started + static_cast<uint64_t>(stats.queued);
+  stats.max_queued = max_queued_.load(std::memory_order_relaxed);
+  stats.rejected = rejected_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+auto ThreadPool::WaitHistogram() const -> LogLinearHistogram::Snapshot {
+  LogLinearHistogram::Snapshot snapshot;
+  for (const auto& worker : workers_) {
+    worker->wait_histogram.AddTo(&snapshot);
   }
+  return snapshot;
 }
 
 }  // namespace my_web_server
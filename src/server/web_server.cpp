@@ -31,9 +31,21 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "config/global_config.hpp"
+#include "http/http_response_templates.hpp"
+#include "http/response_cache.hpp"
+#include "http/upstream_pool.hpp"
+#include "logger/access_log.hpp"
+#include "logger/traffic_capture.hpp"
 #include "logger/logger.hpp"
-#include "pool/thread_pool.hpp"
+#include "metrics/flight_recorder.hpp"
+#include "metrics/metrics.hpp"
+#include "metrics/request_trace.hpp"
+#include "pool/executor.hpp"
 #include "server/web_server.hpp"
+#include "tls/tls_context.hpp"
+#include "utils/cpu_topology.hpp"
+#include "utils/usdt.hpp"
 
 namespace my_web_server {
 
@@ -52,8 +64,7 @@ void HandleSignal(int sig) {
 
 }  // namespace
 
-WebServer::WebServer(const char* ip, int port, std::size_t max_conn,
-                     std::size_t thread_num)
+WebServer::WebServer(const char* ip, int port, std::size_t max_conn)
     : ip_(strdup(ip)), port_(port), max_conn_(max_conn) {
   listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
   if (listen_fd_ == -1) {
@@ -69,37 +80,143 @@ WebServer::WebServer(const char* ip, int port, std::size_t max_conn,
     LOG_ERROR("Multiplex creation error.");
     exit(EXIT_FAILURE);
   }
-  thread_pool_ = std::make_unique<ThreadPool>(thread_num);
+  const auto& cfg = GlobalConfig::Instance().Get();
+  if (cfg.tls_port.has_value()) {
+    tls_ctx_ = std::make_unique<TlsContext>();
+    if (!tls_ctx_->Init(cfg.tls_cert_file, cfg.tls_key_file)) {
+      exit(EXIT_FAILURE);
+    }
+    tls_listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (tls_listen_fd_ == -1) {
+      LOG_ERROR(std::format("TLS socket creation error: {}", strerror(errno)));
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (cfg.metrics_port.has_value()) {
+    metrics_listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (metrics_listen_fd_ == -1) {
+      LOG_ERROR(
+          std::format("Metrics socket creation error: {}", strerror(errno)));
+      exit(EXIT_FAILURE);
+    }
+  }
+  auto topology = CpuTopology::Detect();
+  auto placement = topology.Plan(cfg.pin_policy, cfg.executor.cpu.threads,
+                                 cfg.executor.io.threads);
+  ExecutorOptions lanes = cfg.executor;
+  lanes.cpu.threads = placement.cpu_threads;
+  lanes.cpu.affinity = placement.cpu_workers;
+  lanes.io.threads = placement.io_threads;
+  if (!placement.io_workers.empty()) {
+    lanes.io.affinity = {placement.io_workers};
+  }
+  reactor_cpus_ = placement.reactor;
+  LOG_INFO(std::format("{}; pin={} cpu_threads={} io_threads={} reactor_cpu={}",
+                       topology.Describe(), PinPolicyName(cfg.pin_policy),
+                       lanes.cpu.threads, lanes.io.threads,
+                       reactor_cpus_.empty()
+                           ? std::string("any")
+                           : std::to_string(reactor_cpus_.front())));
+  executor_ = std::make_unique<Executor>(lanes);
+  HttpConn::SetExecutor(executor_.get());
+  if (!cfg.proxy.routes.empty()) {
+    upstreams_ = std::make_unique<UpstreamPool>(cfg.proxy, mux_fd_);
+    HttpConn::SetUpstreams(upstreams_.get());
+  }
+  ResponseCache::Rebuild();
+  coroutines_ = cfg.coroutines;
 }
 
 WebServer::~WebServer() { CleanUp(); }
 
 void WebServer::StartListening() {
+  BindAndListen(listen_fd_, port_);
+  if (tls_listen_fd_ != -1) {
+    BindAndListen(tls_listen_fd_,
+                  GlobalConfig::Instance().Get().tls_port.value());
+  }
+  if (metrics_listen_fd_ != -1) {
+    BindAndListen(metrics_listen_fd_,
+                  GlobalConfig::Instance().Get().metrics_port.value());
+  }
+  LOG_INFO("Start listening successfully.");
+}
+
+void WebServer::BindAndListen(int interest_fd, int port) {
   // Enable address reuse to avoid "Address already in use" errors
   int opt = 1;
-  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  setsockopt(interest_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
   sockaddr_in address;
   address.sin_family = AF_INET;
   address.sin_addr.s_addr = inet_addr(ip_);
-  address.sin_port = htons(port_);
+  address.sin_port = htons(port);
 
   int ret = 0;
   ret =
-      bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+      bind(interest_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
   if (ret == -1) {
-    LOG_ERROR(std::format("Bind error: {}", strerror(errno)));
+    LOG_ERROR(std::format("Bind error on port {}: {}", port, strerror(errno)));
     exit(EXIT_FAILURE);
   }
 
-  ret = listen(listen_fd_, SOMAXCONN);
+  ret = listen(interest_fd, SOMAXCONN);
   if (ret == -1) {
     LOG_ERROR(std::format("Listen error: {}", strerror(errno)));
     exit(EXIT_FAILURE);
   }
 
-  AddFd(listen_fd_, false);
-  LOG_INFO("Start listening successfully.");
+  AddFd(interest_fd, false);
+}
+
+void WebServer::AcceptConnections(int interest_fd, const TlsContext* tls) {
+  // In ET mode, must accept ALL pending connections in a loop
+  while (true) {
+    sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    int conn_fd = accept(interest_fd, reinterpret_cast<sockaddr*>(&client_addr),
+                         &client_addr_len);
+    if (conn_fd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // No more pending connections
+        break;
+      }
+      LOG_ERROR(std::format("Accept error: {}", strerror(errno)));
+      break;
+    }
+    if (users_.size() >= max_conn_) {
+      LOG_WARN("Exceeds the maximum connections.");
+      Metrics::Instance().Add(Counter::kConnectionsRefused);
+      close(conn_fd);
+      continue;
+    }
+    SSL* ssl = nullptr;
+    if (tls != nullptr) {
+      ssl = tls->NewSession(conn_fd);
+      if (ssl == nullptr) {
+        LOG_ERROR(std::format("TLS session creation error: {}",
+                              TlsErrorString()));
+        close(conn_fd);
+        continue;
+      }
+    }
+    Metrics::Instance().Add(Counter::kConnectionsAccepted);
+    users_[conn_fd] = std::make_shared<HttpConn>();
+    users_[conn_fd]->Init(conn_fd, client_addr, mux_fd_, ssl);
+    TrafficCapture::Instance().OnOpen(conn_fd, client_addr.sin_addr.s_addr,
+                                      client_addr.sin_port, tls != nullptr);
+    if (coroutines_) {
+      users_[conn_fd]->StartCoroutine();
+    }
+    AddFd(conn_fd, true);
+    MWS_USDT3(conn_accept, conn_fd, ntohl(client_addr.sin_addr.s_addr),
+              tls != nullptr);
+    FlightRecorder::Instance().Record(FlightEvent::kAccept, conn_fd,
+                                      tls != nullptr);
+    LOG_INFO_FMT("New connection fd={} ip={} port={} tls={}", conn_fd,
+                 ntohl(client_addr.sin_addr.s_addr),
+                 ntohs(client_addr.sin_port), tls != nullptr);
+  }
 }
 
 void WebServer::SetupSignalHandling() {
@@ -121,7 +238,9 @@ void WebServer::SetupSignalHandling() {
   sa.sa_flags = 0;  // No SA_RESTART: blocking syscalls return EINTR too.
   sigaction(SIGINT, &sa, nullptr);
   sigaction(SIGTERM, &sa, nullptr);
-  sigaction(SIGHUP, &sa, nullptr);
+  sigaction(SIGHUP, &sa, nullptr);   // reload the config file
+  sigaction(SIGUSR1, &sa, nullptr);  // dump the flight recorder
+  sigaction(SIGUSR2, &sa, nullptr);  // reopen log files
 
   struct sigaction ignore{};
   ignore.sa_handler = SIG_IGN;
@@ -133,6 +252,7 @@ void WebServer::SetupSignalHandling() {
 #if defined(__linux__)
 void WebServer::Run() {
   epoll_event events[kMaxEvents];
+  PinReactor();
   StartListening();
   SetupSignalHandling();
   // Main event loop would go here
@@ -143,71 +263,81 @@ void WebServer::Run() {
       LOG_ERROR(std::format("Epoll wait error: {}", strerror(errno)));
       break;
     }
+    if (num_events > 0) {
+      FlightRecorder::Instance().Record(FlightEvent::kEpollBatch, -1,
+                                        num_events);
+    }
 
     for (int i = 0; i < num_events; ++i) {
       int sockfd = events[i].data.fd;
-      // Shutdown signal arrived via the self-pipe.
+      // Signals arrive via the self-pipe.
       if (sockfd == g_signal_pipe[0]) {
-        char buf[64];
-        while (read(g_signal_pipe[0], buf, sizeof(buf)) > 0) {
+        HandleSignals();
+        if (!running_) {
+          break;
         }
-        LOG_INFO("Received shutdown signal, starting graceful shutdown.");
-        running_ = false;
-        break;
+        continue;
       }
       // New connection
       if (sockfd == listen_fd_) {
-        // In ET mode, must accept ALL pending connections in a loop
-        while (true) {
-          sockaddr_in client_addr;
-          socklen_t client_addr_len = sizeof(client_addr);
-          int conn_fd =
-              accept(listen_fd_, reinterpret_cast<sockaddr*>(&client_addr),
-                     &client_addr_len);
-          if (conn_fd < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-              // No more pending connections
-              break;
-            }
-            LOG_ERROR(std::format("Accept error: {}", strerror(errno)));
-            break;
-          }
-          if (users_.size() >= max_conn_) {
-            LOG_WARN("Exceeds the maximum connections.");
-            close(conn_fd);
-            continue;
-          }
-          users_[conn_fd] = std::make_shared<HttpConn>();
-          users_[conn_fd]->Init(conn_fd, client_addr, mux_fd_);
-          AddFd(conn_fd, true);
-          LOG_INFO(std::format("New connection fd={} ip={} port={}", conn_fd,
-                               ntohl(client_addr.sin_addr.s_addr),
-                               ntohs(client_addr.sin_port)));
-        }  // end of accept loop
+        AcceptConnections(listen_fd_, nullptr);
+      } else if (sockfd == tls_listen_fd_) {
+        AcceptConnections(tls_listen_fd_, tls_ctx_.get());
+      } else if (sockfd == metrics_listen_fd_) {
+        AcceptAdmin();
+      } else if (admin_conns_.contains(sockfd)) {
+        HandleAdmin(sockfd,
+                    events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR));
+      } else if (upstreams_ != nullptr && upstreams_->Contains(sockfd)) {
+        HandleUpstream(sockfd);
+      } else if (auto conn = FindConn(sockfd); conn == nullptr) {
+        // Closed earlier in this batch, e.g. through its upstream
+        continue;
       } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
         // Connection closed or error
-        users_.erase(sockfd);
-        RemoveFd(sockfd);
+        CloseConn(sockfd);
+      } else if (coroutines_) {
+        // The handler runs inline up to its next await
+        if (conn->IsProxying() && !conn->ProxyWants(sockfd)) {
+          continue;  // the relay waits for its upstream
+        }
+        if (!conn->Resume()) {
+          CloseConn(sockfd);
+        }
+      } else if (conn->IsProxying()) {
+        // Relayed here on the reactor thread, see HandleUpstream()
+        if (conn->ProxyWants(sockfd) && !conn->Proxy()) {
+          CloseConn(sockfd);
+        }
       } else if (events[i].events & EPOLLIN) {
         // Read event: fill buffer, then dispatch to thread pool for parsing
-        auto conn = users_[sockfd];  // Copy shared_ptr, not reference!
+        if (conn->IsHandshaking()) {
+          // Handshake crypto is too heavy for the reactor thread
+          pending_tasks_.emplace_back([conn]() { conn->Handshake(); });
+          continue;
+        }
         if (!conn->Read()) {
           // Read error or connection closed by client
-          users_.erase(sockfd);
-          RemoveFd(sockfd);
+          CloseConn(sockfd);
           continue;
         }
-        thread_pool_->AddTask(
+        conn->Trace(TracePoint::kEnqueue);
+        FlightRecorder::Instance().Record(FlightEvent::kDispatch, sockfd);
+        pending_tasks_.emplace_back(
             [conn]() { conn->Process(); });  // Capture by value!
       } else if (events[i].events & EPOLLOUT) {
         // Write event: attempt to send pending data
-        if (!users_[sockfd]->Write()) {
+        if (conn->IsHandshaking()) {
+          pending_tasks_.emplace_back([conn]() { conn->Handshake(); });
+          continue;
+        }
+        if (!conn->Write()) {
           // write() closes the connection on failure
-          users_.erase(sockfd);
-          RemoveFd(sockfd);
+          CloseConn(sockfd);
         }
       }
     }
+    FlushTasks();
   }
   CleanUp();
 }
@@ -228,10 +358,18 @@ void WebServer::RemoveFd(int interest_fd) {
   close(interest_fd);
 }
 
+void WebServer::ArmWrite(int interest_fd) {
+  epoll_event event;
+  event.data.fd = interest_fd;
+  event.events = EPOLLOUT | EPOLLET | EPOLLRDHUP;
+  epoll_ctl(mux_fd_, EPOLL_CTL_MOD, interest_fd, &event);
+}
+
 #elif defined(__APPLE__)
 
 void WebServer::Run() {
   struct kevent events[kMaxEvents];
+  PinReactor();
   StartListening();
   SetupSignalHandling();
   while (running_) {
@@ -241,80 +379,97 @@ void WebServer::Run() {
       LOG_ERROR(std::format("Kqueue wait error: {}", strerror(errno)));
       break;
     }
+    if (num_events > 0) {
+      FlightRecorder::Instance().Record(FlightEvent::kEpollBatch, -1,
+                                        num_events);
+    }
 
     for (int i = 0; i < num_events; ++i) {
       int sockfd = static_cast<int>(events[i].ident);
       uint16_t flags = events[i].flags;
       int16_t filter = events[i].filter;
 
-      // Shutdown signal arrived via the self-pipe.
+      // Signals arrive via the self-pipe.
       if (sockfd == g_signal_pipe[0]) {
-        char buf[64];
-        while (read(g_signal_pipe[0], buf, sizeof(buf)) > 0) {
+        HandleSignals();
+        if (!running_) {
+          break;
         }
-        LOG_INFO("Received shutdown signal, starting graceful shutdown.");
-        running_ = false;
-        break;
+        continue;
       }
 
-      if (flags & (EV_ERROR | EV_EOF)) {
-        users_.erase(sockfd);
-        RemoveFd(sockfd);
+      if (sockfd == metrics_listen_fd_) {
+        AcceptAdmin();
+        continue;
+      }
+      if (admin_conns_.contains(sockfd)) {
+        HandleAdmin(sockfd, flags & (EV_ERROR | EV_EOF));
+        continue;
+      }
+      if (upstreams_ != nullptr && upstreams_->Contains(sockfd)) {
+        HandleUpstream(sockfd);
         continue;
       }
 
       if (sockfd == listen_fd_) {
-        // In ET mode, must handle all pending connections
-        while (true) {
-          sockaddr_in client_addr;
-          socklen_t client_addr_len = sizeof(client_addr);
-          int conn_fd =
-              accept(listen_fd_, reinterpret_cast<sockaddr*>(&client_addr),
-                     &client_addr_len);
-          if (conn_fd < 0) {
-            // No more
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-              break;
-            }
-            LOG_ERROR(
-                std::format("Accept connection error: {}", strerror(errno)));
-            break;
-          }
-
-          if (users_.size() >= max_conn_) {
-            LOG_WARN("Exceeds the maximum connections.");
-            close(conn_fd);
-            continue;
-          }
-
-          users_[conn_fd] = std::make_shared<HttpConn>();
-          users_[conn_fd]->Init(conn_fd, client_addr, mux_fd_);
-          AddFd(conn_fd, true);
-          LOG_INFO(std::format("New connection fd={} ip={} port={}", conn_fd,
-                               ntohl(client_addr.sin_addr.s_addr),
-                               ntohs(client_addr.sin_port)));
+        AcceptConnections(listen_fd_, nullptr);
+        continue;
+      }
+      if (sockfd == tls_listen_fd_) {
+        AcceptConnections(tls_listen_fd_, tls_ctx_.get());
+        continue;
+      }
+
+      auto conn = FindConn(sockfd);
+      if (conn == nullptr) {
+        continue;  // closed earlier in this batch, e.g. through its upstream
+      }
+      if (flags & (EV_ERROR | EV_EOF)) {
+        CloseConn(sockfd);
+        continue;
+      }
+
+      if (coroutines_) {
+        if (conn->IsProxying() && !conn->ProxyWants(sockfd)) {
+          continue;  // the relay waits for its upstream
+        }
+        if (!conn->Resume()) {
+          CloseConn(sockfd);
+        }
+        continue;
+      }
+      if (conn->IsProxying()) {
+        if (conn->ProxyWants(sockfd) && !conn->Proxy()) {
+          CloseConn(sockfd);
         }
         continue;
       }
 
       if (filter == EVFILT_READ) {
-        auto conn = users_[sockfd];
-        if (!conn || !conn->Read()) {
-          users_.erase(sockfd);
-          RemoveFd(sockfd);
+        if (conn->IsHandshaking()) {
+          pending_tasks_.emplace_back([conn]() { conn->Handshake(); });
+          continue;
+        }
+        if (!conn->Read()) {
+          CloseConn(sockfd);
           continue;
         }
-        thread_pool_->AddTask([conn]() { conn->Process(); });
+        conn->Trace(TracePoint::kEnqueue);
+        FlightRecorder::Instance().Record(FlightEvent::kDispatch, sockfd);
+        pending_tasks_.emplace_back([conn]() { conn->Process(); });
       }
 
       if (filter == EVFILT_WRITE) {
-        auto conn = users_[sockfd];
-        if (!conn || !conn->Write()) {
-          users_.erase(sockfd);
-          RemoveFd(sockfd);
+        if (conn->IsHandshaking()) {
+          pending_tasks_.emplace_back([conn]() { conn->Handshake(); });
+          continue;
+        }
+        if (!conn->Write()) {
+          CloseConn(sockfd);
         }
       }
     }
+    FlushTasks();
   }
   CleanUp();
 }
@@ -339,8 +494,42 @@ void WebServer::RemoveFd(int interest_fd) {
   kevent(mux_fd_, &event, 1, nullptr, 0, nullptr);
   close(interest_fd);
 }
+
+void WebServer::ArmWrite(int interest_fd) {
+  struct kevent event;
+  EV_SET(&event, interest_fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_CLEAR, 0,
+         0, (void*)(intptr_t)interest_fd);
+  if (kevent(mux_fd_, &event, 1, nullptr, 0, nullptr) == -1) {
+    LOG_WARN(std::format("Kqueue add failed: {}", strerror(errno)));
+  }
+}
 #endif
 
+void WebServer::HandleSignals() {
+  char buf[64];
+  ssize_t n = 0;
+  while ((n = read(g_signal_pipe[0], buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < n; ++i) {
+      FlightRecorder::Instance().Record(FlightEvent::kSignal, -1,
+                                        static_cast<uint8_t>(buf[i]));
+      if (buf[i] == SIGUSR1) {
+        LOG_INFO("Received SIGUSR1, dumping the flight recorder.");
+        DumpFlightRecorder();
+      } else if (buf[i] == SIGUSR2) {
+        LOG_INFO("Received SIGUSR2, reopening log files.");
+        Logger::Instance().ReopenFiles();
+        AccessLog::Instance().ReopenFiles();
+      } else if (buf[i] == SIGHUP) {
+        LOG_INFO("Received SIGHUP, reloading configuration.");
+        ReloadConfig();
+      } else if (running_) {
+        LOG_INFO("Received shutdown signal, starting graceful shutdown.");
+        running_ = false;
+      }
+    }
+  }
+}
+
 auto WebServer::SetNonblocking(int interest_fd) -> int {
   int old_option = fcntl(interest_fd, F_GETFL);
   int new_option = old_option | O_NONBLOCK;
@@ -348,24 +537,226 @@ auto WebServer::SetNonblocking(int interest_fd) -> int {
   return old_option;
 }
 
+void WebServer::DumpFlightRecorder() {
+  // Formatting and file I/O stay off the reactor thread
+  std::string path = GlobalConfig::Instance().Get().flight_recorder_file;
+  executor_->Post(Lane::kIo, [path = std::move(path)]() {
+    int64_t events = FlightRecorder::Instance().Dump(path);
+    if (events < 0) {
+      LOG_ERROR(std::format("Flight recorder dump to {} failed: {}", path,
+                            strerror(errno)));
+      return;
+    }
+    LOG_INFO(std::format("Flight recorder: {} events appended to {}", events,
+                         path));
+  });
+}
+
+void WebServer::ReloadConfig() {
+  if (!GlobalConfig::Instance().Reload()) {
+    return;
+  }
+  const auto& cfg = GlobalConfig::Instance().Get();
+  max_conn_ = cfg.max_conn;
+  executor_->pool(Lane::kCpu).SetQueueLimit(cfg.executor.cpu.queue_limit);
+  executor_->pool(Lane::kIo).SetQueueLimit(cfg.executor.io.queue_limit);
+  AccessLog::Instance().SetSampleEvery(cfg.access_log.sample_every);
+  TrafficCapture::Instance().SetSampleEvery(cfg.capture.sample_every);
+  // Pages are re-read from disk, so rebuild off the reactor thread
+  executor_->Post(Lane::kIo, []() { ResponseCache::Rebuild(); });
+}
+
+void WebServer::PinReactor() {
+  if (!PinCurrentThread(reactor_cpus_)) {
+    LOG_WARN(std::format("Cannot pin reactor to CPU {}: {}",
+                         reactor_cpus_.front(), strerror(errno)));
+  }
+}
+
+void WebServer::FlushTasks() {
+  if (pending_tasks_.empty()) {
+    return;
+  }
+  executor_->PostBatch(Lane::kCpu, pending_tasks_);
+  pending_tasks_.clear();
+}
+
+void WebServer::AcceptAdmin() {
+  while (true) {
+    int conn_fd = accept(metrics_listen_fd_, nullptr, nullptr);
+    if (conn_fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG_ERROR(std::format("Metrics accept error: {}", strerror(errno)));
+      }
+      break;
+    }
+    if (admin_conns_.size() >= kMaxAdminConns) {
+      close(conn_fd);
+      continue;
+    }
+    admin_conns_[conn_fd] = AdminConn{};
+    AddFd(conn_fd, false);
+  }
+}
+
+void WebServer::HandleAdmin(int interest_fd, bool hangup) {
+  auto& conn = admin_conns_[interest_fd];
+  if (conn.response.empty()) {
+    char buf[1024];
+    while (true) {
+      ssize_t n = recv(interest_fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        conn.request.append(buf, static_cast<size_t>(n));
+        if (conn.request.size() > kMaxAdminRequest) {
+          CloseAdmin(interest_fd);
+          return;
+        }
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        hangup = true;
+      }
+      break;
+    }
+    if (conn.request.find("\r\n\r\n") == std::string::npos) {
+      if (hangup) {
+        CloseAdmin(interest_fd);
+      }
+      return;
+    }
+    conn.response = BuildAdminResponse(conn.request);
+  }
+  while (conn.sent < conn.response.size()) {
+    ssize_t n = send(interest_fd, conn.response.data() + conn.sent,
+                     conn.response.size() - conn.sent, 0);
+    if (n > 0) {
+      conn.sent += static_cast<size_t>(n);
+      continue;
+    }
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      ArmWrite(interest_fd);
+      return;
+    }
+    break;
+  }
+  CloseAdmin(interest_fd);
+}
+
+void WebServer::CloseConn(int sockfd) {
+  MWS_USDT1(conn_close, sockfd);
+  FlightRecorder::Instance().Record(FlightEvent::kClose, sockfd);
+  TrafficCapture::Instance().OnClose(sockfd);
+  if (auto it = users_.find(sockfd); it != users_.end()) {
+    it->second->AbortProxy();  // here, while the pool is ours to touch
+  }
+  users_.erase(sockfd);
+  RemoveFd(sockfd);
+}
+
+auto WebServer::FindConn(int sockfd) const -> std::shared_ptr<HttpConn> {
+  auto it = users_.find(sockfd);
+  if (it == users_.end() || it->second == nullptr ||
+      it->second->GetFd() != sockfd) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+void WebServer::HandleUpstream(int upstream_fd) {
+  int owner = upstreams_->OnEvent(upstream_fd);
+  if (owner < 0) {
+    return;  // an idle connection, handled by the pool
+  }
+  auto conn = FindConn(owner);
+  if (conn == nullptr || !conn->ProxyWants(upstream_fd)) {
+    return;  // stale
+  }
+  bool alive = coroutines_ ? conn->Resume() : conn->Proxy();
+  if (!alive) {
+    CloseConn(owner);
+  }
+}
+
+void WebServer::CloseAdmin(int interest_fd) {
+  admin_conns_.erase(interest_fd);
+  RemoveFd(interest_fd);
+}
+
+auto WebServer::BuildAdminResponse(std::string_view request) const
+    -> std::string {
+  auto is_path = [request](std::string_view path) {
+    if (!request.starts_with("GET ") || !request.substr(4).starts_with(path)) {
+      return false;
+    }
+    auto rest = request.substr(4 + path.size());
+    return rest.starts_with(' ') || rest.starts_with('?');
+  };
+  std::string body;
+  if (is_path("/traces")) {
+    SlowTraceLog::Instance().Render(&body);
+    return std::format(kHeaderMetrics, body.size()) + body;
+  }
+  if (!is_path("/metrics")) {
+    return std::string(kHeader404Empty);
+  }
+  Metrics::Instance().Render(&body);
+  AppendMetricHeader(&body, "connections_active", "gauge",
+                     "Open client connections");
+  AppendSample(&body, "connections_active", "",
+               static_cast<double>(users_.size()));
+  if (upstreams_ != nullptr) {
+    AppendMetricHeader(&body, "upstream_connections", "gauge",
+                       "Upstream connections lent to requests or idle");
+    AppendSample(&body, "upstream_connections", R"(state="active")",
+                 static_cast<double>(upstreams_->active()));
+    AppendSample(&body, "upstream_connections", R"(state="idle")",
+                 static_cast<double>(upstreams_->idle()));
+  }
+  executor_->AppendMetrics(&body);
+  return std::format(kHeaderMetrics, body.size()) + body;
+}
+
 void WebServer::CleanUp() {
   if (mux_fd_ == -1) {
     return;  // Already cleaned up
   }
   // 1. Drain in-flight tasks first
-  thread_pool_.reset();
+  LOG_INFO(executor_->Report());
+  if (coroutines_) {
+    LOG_INFO_FMT("Coroutine frames that missed the arena: {}",
+                 CoroArena::HeapFallbacks());
+  }
+  // Tasks still draining load the pointer once per step. Those that saw it
+  // set still post into open lanes (cpu drains first and only cpu work moves
+  // on to io); the rest run inline.
+  HttpConn::SetExecutor(nullptr);
+  executor_.reset();
 
   // 2. Close active client connections
   for (const auto& entry : users_) {
     RemoveFd(entry.first);
   }
   users_.clear();
+  HttpConn::SetUpstreams(nullptr);
+  upstreams_.reset();  // after the exchanges that borrowed from it
+  for (const auto& entry : admin_conns_) {
+    RemoveFd(entry.first);
+  }
+  admin_conns_.clear();
 
   // 3. Tear down the multiplexer, listening socket and self-pipe.
   close(mux_fd_);
   mux_fd_ = -1;
   close(listen_fd_);
   listen_fd_ = -1;
+  if (tls_listen_fd_ != -1) {
+    close(tls_listen_fd_);
+    tls_listen_fd_ = -1;
+  }
+  if (metrics_listen_fd_ != -1) {
+    close(metrics_listen_fd_);
+    metrics_listen_fd_ = -1;
+  }
   for (int& fd : g_signal_pipe) {
     if (fd != -1) {
       close(fd);
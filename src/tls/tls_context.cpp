@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements TlsContext setup and session creation.
+
+#include "tls/tls_context.hpp"
+
+#include <openssl/err.h>
+
+#include <cerrno>
+#include <format>
+
+#include "logger/logger.hpp"
+
+namespace my_web_server {
+
+TlsContext::~TlsContext() {
+  if (ctx_ != nullptr) {
+    SSL_CTX_free(ctx_);
+    ctx_ = nullptr;
+  }
+}
+
+auto TlsContext::Init(const std::string& cert_file, const std::string& key_file)
+    -> bool {
+  ctx_ = SSL_CTX_new(TLS_server_method());
+  if (ctx_ == nullptr) {
+    LOG_ERROR(std::format("SSL_CTX_new failed: {}", TlsErrorString()));
+    return false;
+  }
+
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  // Ask OpenSSL to install the negotiated keys with setsockopt(SOL_TLS) once
+  // the handshake finishes. If the kernel lacks the tls ULP or the cipher is
+  // not offloadable, OpenSSL silently keeps the record layer in userspace.
+  SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+  // Non-blocking sockets: a retried SSL_write may pass a different buffer
+  // address (we re-read file chunks into a stack buffer), and partial writes
+  // are reported instead of buffered. Idle sessions drop their record
+  // buffers so keep-alive TLS connections stay small.
+  SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                             SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                             SSL_MODE_RELEASE_BUFFERS);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx_, cert_file.c_str()) != 1) {
+    LOG_ERROR(std::format("Fail to load TLS certificate \"{}\": {}", cert_file,
+                          TlsErrorString()));
+    return false;
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx_, key_file.c_str(), SSL_FILETYPE_PEM) !=
+      1) {
+    LOG_ERROR(std::format("Fail to load TLS private key \"{}\": {}", key_file,
+                          TlsErrorString()));
+    return false;
+  }
+  if (SSL_CTX_check_private_key(ctx_) != 1) {
+    LOG_ERROR("TLS private key does not match the certificate.");
+    return false;
+  }
+  return true;
+}
+
+auto TlsContext::NewSession(int sockfd) const -> SSL* {
+  SSL* ssl = SSL_new(ctx_);
+  if (ssl == nullptr) {
+    return nullptr;
+  }
+  if (SSL_set_fd(ssl, sockfd) != 1) {
+    SSL_free(ssl);
+    return nullptr;
+  }
+  SSL_set_accept_state(ssl);
+  return ssl;
+}
+
+auto TlsErrorString() -> std::string {
+  std::string out;
+  unsigned long err = 0;
+  while ((err = ERR_get_error()) != 0) {
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof(buf));
+    if (!out.empty()) {
+      out += "; ";
+    }
+    out += buf;
+  }
+  return out.empty() ? "unknown error" : out;
+}
+
+auto TlsRecv(SSL* ssl, char* buf, size_t len) -> ssize_t {
+  int ret = SSL_read(ssl, buf, static_cast<int>(len));
+  if (ret > 0) {
+    return ret;
+  }
+  switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      errno = EAGAIN;
+      return -1;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;
+    default:
+      ERR_clear_error();
+      errno = EIO;
+      return -1;
+  }
+}
+
+auto TlsSend(SSL* ssl, const char* buf, size_t len) -> ssize_t {
+  int ret = SSL_write(ssl, buf, static_cast<int>(len));
+  if (ret > 0) {
+    return ret;
+  }
+  switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      errno = EAGAIN;
+      return -1;
+    default:
+      ERR_clear_error();
+      errno = EIO;
+      return -1;
+  }
+}
+
+}  // namespace my_web_server
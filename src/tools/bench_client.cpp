@@ -0,0 +1,959 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: HTTP/1.1 load generator for this server. Epoll-based and
+// multi-threaded, with open-model (constant-rate) or closed-loop request
+// scheduling, keep-alive on or off, pipelining, and URL mixes read from a
+// file. Latency is measured from each request's intended send time, so a
+// stalled server is not hidden by coordinated omission. Extra idle
+// keep-alive connections can be held open alongside the traffic.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "metrics/histogram.hpp"
+
+namespace {
+
+using my_web_server::LogLinearHistogram;
+
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr int kMaxEvents = 256;
+constexpr int64_t kNsPerSec = 1000000000;
+constexpr auto kEpollOut = static_cast<uint32_t>(EPOLLOUT);
+// Marks idle connections in epoll_event::data
+constexpr uint64_t kIdleTag = uint64_t{1} << 63;
+
+struct Options {
+  std::string host{"127.0.0.1"};
+  int port{8001};
+  size_t connections{16};
+  size_t threads{1};
+  double rate{0};  // requests/s over all connections; 0 = closed loop
+  double duration_s{10};
+  double warmup_s{0};  // responses to requests due before this are ignored
+  bool keep_alive{true};
+  size_t pipeline{1};  // requests in flight per connection
+  size_t idle{0};      // extra connections that send one request, then wait
+  std::vector<std::string> urls{"/"};
+  std::string urls_file{};
+  bool json{false};
+};
+
+auto NowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Incremental HTTP/1.1 response parser. Bodies are counted, not stored, so
+// large downloads use no memory; Content-Length, chunked and
+// read-until-close bodies are supported.
+class ResponseParser {
+ public:
+  enum class Result : uint8_t { kNeedMore, kDone, kError };
+
+  // Consume bytes from data, stopping after one complete response. *used
+  // is the number of bytes that belonged to it.
+  auto Feed(const char* data, size_t len, size_t* used) -> Result {
+    size_t i = 0;
+    Result result = Result::kNeedMore;
+    while (i < len && result == Result::kNeedMore) {
+      switch (state_) {
+        case State::kHeaders:
+          result = FeedHeaders(data, len, &i);
+          break;
+        case State::kBody: {
+          auto n = std::min<uint64_t>(left_, len - i);
+          left_ -= n;
+          body_bytes_ += n;
+          i += n;
+          if (left_ == 0) {
+            result = Result::kDone;
+          }
+          break;
+        }
+        case State::kUntilClose:
+          body_bytes_ += len - i;
+          i = len;
+          break;
+        case State::kChunkSize:
+        case State::kTrailers:
+          result = FeedLine(data[i++]);
+          break;
+        case State::kChunkData: {
+          auto n = std::min<uint64_t>(left_, len - i);
+          left_ -= n;
+          body_bytes_ += n;
+          i += n;
+          if (left_ == 0) {
+            state_ = State::kChunkEnd;
+            left_ = 2;  // CRLF after the chunk
+          }
+          break;
+        }
+        case State::kChunkEnd:
+          ++i;
+          if (--left_ == 0) {
+            state_ = State::kChunkSize;
+          }
+          break;
+      }
+    }
+    *used = i;
+    return result;
+  }
+
+  // The peer closed the connection; completes a read-until-close body
+  auto FinishAtEof() const -> bool { return state_ == State::kUntilClose; }
+  // Whether any byte of the next response has been seen
+  auto Started() const -> bool {
+    return state_ != State::kHeaders || !line_.empty();
+  }
+
+  auto status() const -> int { return status_; }
+  auto close() const -> bool { return close_; }
+  auto body_bytes() const -> uint64_t { return body_bytes_; }
+
+  void Reset() {
+    state_ = State::kHeaders;
+    line_.clear();
+    left_ = 0;
+    status_ = 0;
+    close_ = false;
+    body_bytes_ = 0;
+  }
+
+ private:
+  enum class State : uint8_t {
+    kHeaders,
+    kBody,
+    kUntilClose,
+    kChunkSize,
+    kChunkData,
+    kChunkEnd,
+    kTrailers
+  };
+
+  auto FeedHeaders(const char* data, size_t len, size_t* i) -> Result {
+    size_t search_from = line_.size() >= 3 ? line_.size() - 3 : 0;
+    line_.append(data + *i, len - *i);
+    auto end = line_.find("\r\n\r\n", search_from);
+    if (end == std::string::npos) {
+      *i = len;
+      return line_.size() > kMaxHeaderBytes ? Result::kError
+                                            : Result::kNeedMore;
+    }
+    size_t header_len = end + 4;
+    *i = len - (line_.size() - header_len);
+    line_.resize(header_len);
+    return ParseHeaders();
+  }
+
+  auto ParseHeaders() -> Result {
+    std::string_view head = line_;
+    if (!head.starts_with("HTTP/1.") || head.size() < 12) {
+      return Result::kError;
+    }
+    auto [ptr, ec] =
+        std::from_chars(head.data() + 9, head.data() + 12, status_);
+    if (ec != std::errc() || ptr != head.data() + 12) {
+      return Result::kError;
+    }
+    std::string lower(head);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) {
+      return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    });
+    close_ = head.starts_with("HTTP/1.0") ||
+             lower.find("\r\nconnection: close") != std::string::npos;
+    auto te = lower.find("\r\ntransfer-encoding:");
+    auto cl = lower.find("\r\ncontent-length:");
+    line_.clear();
+    if (te != std::string::npos &&
+        lower.find("chunked", te) < lower.find("\r\n", te + 2)) {
+      state_ = State::kChunkSize;
+      return Result::kNeedMore;
+    }
+    if (cl != std::string::npos) {
+      const char* begin = lower.data() + cl + 17;
+      while (*begin == ' ') {
+        ++begin;
+      }
+      auto [end, cl_ec] =
+          std::from_chars(begin, lower.data() + lower.size(), left_);
+      if (cl_ec != std::errc()) {
+        return Result::kError;
+      }
+      state_ = State::kBody;
+      return left_ == 0 ? Result::kDone : Result::kNeedMore;
+    }
+    if (status_ == 204 || status_ == 304) {
+      return Result::kDone;
+    }
+    state_ = State::kUntilClose;
+    return Result::kNeedMore;
+  }
+
+  // One byte of a chunk-size or trailer line
+  auto FeedLine(char c) -> Result {
+    line_.push_back(c);
+    if (line_.size() > kMaxHeaderBytes) {
+      return Result::kError;
+    }
+    if (!line_.ends_with("\r\n")) {
+      return Result::kNeedMore;
+    }
+    if (state_ == State::kTrailers) {
+      bool last = line_ == "\r\n";
+      line_.clear();
+      return last ? Result::kDone : Result::kNeedMore;
+    }
+    uint64_t size = 0;
+    auto [ptr, ec] =
+        std::from_chars(line_.data(), line_.data() + line_.size(), size, 16);
+    line_.clear();
+    if (ec != std::errc()) {
+      return Result::kError;
+    }
+    if (size == 0) {
+      state_ = State::kTrailers;
+    } else {
+      state_ = State::kChunkData;
+      left_ = size;
+    }
+    return Result::kNeedMore;
+  }
+
+  State state_{State::kHeaders};
+  std::string line_{};  // headers, or the current chunk-size/trailer line
+  uint64_t left_{0};    // body or chunk bytes still expected
+  int status_{0};
+  bool close_{false};
+  uint64_t body_bytes_{0};
+};
+
+struct Stats {
+  LogLinearHistogram latency;  // ns from intended send to last byte
+  uint64_t min_ns{UINT64_MAX};
+  uint64_t max_ns{0};
+  uint64_t requests{0};
+  uint64_t bytes{0};
+  uint64_t non_2xx{0};
+  uint64_t connect_errors{0};
+  uint64_t io_errors{0};     // reset or closed with requests in flight
+  uint64_t parse_errors{0};
+  uint64_t unfinished{0};    // due but not answered when the run ended
+  uint64_t idle_closed{0};   // idle connections the server dropped
+};
+
+struct IdleConn {
+  int fd{-1};
+  bool sent{false};
+};
+
+struct Conn {
+  size_t index{0};  // across all threads, selects the URL sequence
+  int fd{-1};
+  bool connecting{false};
+  bool want_write{false};  // EPOLLOUT registered
+  std::string out{};
+  size_t out_sent{0};
+  std::deque<int64_t> in_flight{};  // intended send time per request
+  int64_t next_due{0};              // open model only
+  uint64_t sent{0};
+  ResponseParser parser{};
+};
+
+class Worker {
+ public:
+  Worker(const Options& opts, const sockaddr_in& addr, int64_t start_ns,
+         std::vector<size_t> conn_indexes, size_t idle)
+      : opts_(opts), addr_(addr), start_ns_(start_ns), idle_(idle) {
+    end_ns_ = start_ns + static_cast<int64_t>(opts.duration_s * kNsPerSec);
+    warmup_end_ns_ =
+        start_ns + static_cast<int64_t>(opts.warmup_s * kNsPerSec);
+    if (opts.rate > 0) {
+      interval_ns_ = static_cast<int64_t>(
+          static_cast<double>(opts.connections) * kNsPerSec / opts.rate);
+    }
+    depth_ = opts.keep_alive ? std::max<size_t>(opts.pipeline, 1) : 1;
+    conns_.resize(conn_indexes.size());
+    for (size_t i = 0; i < conns_.size(); ++i) {
+      auto& conn = conns_[i];
+      conn.index = conn_indexes[i];
+      // Spread the first requests over one interval
+      conn.next_due = start_ns + interval_ns_ *
+                                     static_cast<int64_t>(conn.index) /
+                                     static_cast<int64_t>(opts.connections);
+    }
+  }
+
+  void Run() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+      std::perror("epoll_create1");
+      return;
+    }
+    for (size_t i = 0; i < conns_.size(); ++i) {
+      Connect(i);
+    }
+    for (size_t i = 0; i < idle_.size(); ++i) {
+      ConnectIdle(i);
+    }
+    epoll_event events[kMaxEvents];
+    while (true) {
+      int64_t now = NowNs();
+      if (now >= end_ns_) {
+        break;
+      }
+      int64_t wake = end_ns_;
+      if (now >= start_ns_) {
+        for (size_t i = 0; i < conns_.size(); ++i) {
+          wake = std::min(wake, Pump(i, now));
+        }
+      } else {
+        wake = start_ns_;
+      }
+      int timeout_ms = static_cast<int>(
+          std::max<int64_t>(wake - NowNs(), 0) / 1000000);
+      int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+      for (int e = 0; e < n; ++e) {
+        if (events[e].data.u64 & kIdleTag) {
+          OnIdleEvent(static_cast<size_t>(events[e].data.u64 & ~kIdleTag));
+          continue;
+        }
+        auto i = static_cast<size_t>(events[e].data.u64);
+        if (events[e].events & (EPOLLOUT | EPOLLERR)) {
+          OnWritable(i);
+        }
+        if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          OnReadable(i, NowNs());
+        }
+      }
+    }
+    int64_t now = NowNs();
+    for (auto& conn : conns_) {
+      stats_.unfinished += conn.in_flight.size();
+      if (interval_ns_ > 0 && conn.next_due < now) {
+        stats_.unfinished +=
+            static_cast<uint64_t>((now - conn.next_due) / interval_ns_ + 1);
+      }
+      if (conn.fd != -1) {
+        close(conn.fd);
+      }
+    }
+    for (auto& idle : idle_) {
+      if (idle.fd != -1) {
+        close(idle.fd);
+      }
+    }
+    close(epoll_fd_);
+  }
+
+  auto stats() const -> const Stats& { return stats_; }
+
+ private:
+  // Queue every request that is due and fits in the pipeline; returns when
+  // this connection next needs attention
+  auto Pump(size_t i, int64_t now) -> int64_t {
+    auto& conn = conns_[i];
+    bool open_model = interval_ns_ > 0;
+    while (conn.in_flight.size() < depth_ &&
+           (!open_model || conn.next_due <= now)) {
+      if (conn.fd == -1 && !Connect(i)) {
+        break;
+      }
+      int64_t intended = open_model ? conn.next_due : now;
+      const auto& url =
+          opts_.urls[(conn.index + conn.sent * opts_.connections) %
+                     opts_.urls.size()];
+      conn.out += std::format(
+          "GET {} HTTP/1.1\r\nHost: {}\r\nConnection: {}\r\n\r\n", url,
+          opts_.host, opts_.keep_alive ? "keep-alive" : "close");
+      conn.in_flight.push_back(intended);
+      ++conn.sent;
+      if (open_model) {
+        conn.next_due += interval_ns_;
+      }
+    }
+    if (!conn.connecting && conn.fd != -1) {
+      Flush(i);
+    }
+    if (!open_model || conn.in_flight.size() >= depth_) {
+      return end_ns_;  // woken by the socket
+    }
+    return conn.next_due;
+  }
+
+  auto Connect(size_t i) -> bool {
+    auto& conn = conns_[i];
+    conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn.fd == -1) {
+      ++stats_.connect_errors;
+      return false;
+    }
+    int one = 1;
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret =
+        connect(conn.fd, reinterpret_cast<const sockaddr*>(&addr_),
+                sizeof(addr_));
+    if (ret == -1 && errno != EINPROGRESS) {
+      ++stats_.connect_errors;
+      close(conn.fd);
+      conn.fd = -1;
+      return false;
+    }
+    conn.connecting = ret == -1;
+    conn.want_write = conn.connecting;
+    conn.parser.Reset();
+    epoll_event event{};
+    event.events = EPOLLIN | (conn.want_write ? kEpollOut : 0);
+    event.data.u64 = i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn.fd, &event);
+    return true;
+  }
+
+  // Idle connections send one keep-alive request once connected, discard
+  // the response and then stay quiet until the run ends
+  void ConnectIdle(size_t i) {
+    auto& idle = idle_[i];
+    idle.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (idle.fd == -1) {
+      ++stats_.connect_errors;
+      return;
+    }
+    int ret = connect(idle.fd, reinterpret_cast<const sockaddr*>(&addr_),
+                      sizeof(addr_));
+    if (ret == -1 && errno != EINPROGRESS) {
+      ++stats_.connect_errors;
+      close(idle.fd);
+      idle.fd = -1;
+      return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | kEpollOut;
+    event.data.u64 = kIdleTag | i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, idle.fd, &event);
+  }
+
+  void OnIdleEvent(size_t i) {
+    auto& idle = idle_[i];
+    if (idle.fd == -1) {
+      return;
+    }
+    if (!idle.sent) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(idle.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        ++stats_.connect_errors;
+        CloseIdle(i);
+        return;
+      }
+      auto request = std::format(
+          "GET {} HTTP/1.1\r\nHost: {}\r\nConnection: keep-alive\r\n\r\n",
+          opts_.urls[i % opts_.urls.size()], opts_.host);
+      ssize_t n =
+          send(idle.fd, request.data(), request.size(), MSG_NOSIGNAL);
+      if (n == -1 && (errno == EAGAIN || errno == EINPROGRESS)) {
+        return;  // still connecting; EPOLLOUT fires again
+      }
+      if (n != static_cast<ssize_t>(request.size())) {
+        ++stats_.idle_closed;
+        CloseIdle(i);
+        return;
+      }
+      idle.sent = true;
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.u64 = kIdleTag | i;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, idle.fd, &event);
+    }
+    char buf[kReadChunk];
+    while (true) {
+      ssize_t n = recv(idle.fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        continue;
+      }
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+      }
+      ++stats_.idle_closed;
+      CloseIdle(i);
+      return;
+    }
+  }
+
+  void CloseIdle(size_t i) {
+    auto& idle = idle_[i];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, idle.fd, nullptr);
+    close(idle.fd);
+    idle.fd = -1;
+  }
+
+  void Disconnect(size_t i) {
+    auto& conn = conns_[i];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+    conn.fd = -1;
+    conn.connecting = false;
+    conn.want_write = false;
+    conn.out.clear();
+    conn.out_sent = 0;
+  }
+
+  // Drop a broken connection; its requests are lost and counted
+  void Fail(size_t i, uint64_t* counter) {
+    auto& conn = conns_[i];
+    *counter += 1;
+    conn.in_flight.clear();
+    Disconnect(i);
+  }
+
+  void SetWriteInterest(size_t i, bool want) {
+    auto& conn = conns_[i];
+    if (conn.want_write == want) {
+      return;
+    }
+    conn.want_write = want;
+    epoll_event event{};
+    event.events = EPOLLIN | (want ? kEpollOut : 0);
+    event.data.u64 = i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &event);
+  }
+
+  void OnWritable(size_t i) {
+    auto& conn = conns_[i];
+    if (conn.fd == -1) {
+      return;
+    }
+    if (conn.connecting) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        Fail(i, &stats_.connect_errors);
+        return;
+      }
+      conn.connecting = false;
+    }
+    Flush(i);
+  }
+
+  void Flush(size_t i) {
+    auto& conn = conns_[i];
+    while (conn.out_sent < conn.out.size()) {
+      ssize_t n = send(conn.fd, conn.out.data() + conn.out_sent,
+                       conn.out.size() - conn.out_sent, MSG_NOSIGNAL);
+      if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          SetWriteInterest(i, true);
+          return;
+        }
+        Fail(i, &stats_.io_errors);
+        return;
+      }
+      conn.out_sent += static_cast<size_t>(n);
+    }
+    conn.out.clear();
+    conn.out_sent = 0;
+    SetWriteInterest(i, false);
+  }
+
+  void OnReadable(size_t i, int64_t now) {
+    char buf[kReadChunk];
+    auto& conn = conns_[i];
+    while (conn.fd != -1) {
+      ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+      if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return;
+        }
+        Fail(i, &stats_.io_errors);
+        return;
+      }
+      if (n == 0) {
+        if (conn.parser.FinishAtEof()) {
+          Complete(i, now);
+        }
+        if (conn.fd == -1) {
+          return;
+        }
+        if (!conn.in_flight.empty() || conn.parser.Started()) {
+          Fail(i, &stats_.io_errors);
+        } else {
+          Disconnect(i);  // idle keep-alive connection closed by the server
+        }
+        return;
+      }
+      stats_.bytes += static_cast<uint64_t>(n);
+      size_t pos = 0;
+      while (pos < static_cast<size_t>(n) && conn.fd != -1) {
+        size_t used = 0;
+        auto result =
+            conn.parser.Feed(buf + pos, static_cast<size_t>(n) - pos, &used);
+        pos += used;
+        if (result == ResponseParser::Result::kError) {
+          Fail(i, &stats_.parse_errors);
+          return;
+        }
+        if (result == ResponseParser::Result::kDone) {
+          Complete(i, now);
+        }
+      }
+    }
+  }
+
+  void Complete(size_t i, int64_t now) {
+    auto& conn = conns_[i];
+    if (conn.in_flight.empty()) {
+      Fail(i, &stats_.parse_errors);  // response nobody asked for
+      return;
+    }
+    int64_t intended = conn.in_flight.front();
+    conn.in_flight.pop_front();
+    if (intended >= warmup_end_ns_) {
+      auto latency =
+          static_cast<uint64_t>(std::max<int64_t>(now - intended, 0));
+      stats_.latency.Record(latency);
+      stats_.min_ns = std::min(stats_.min_ns, latency);
+      stats_.max_ns = std::max(stats_.max_ns, latency);
+      ++stats_.requests;
+      if (conn.parser.status() < 200 || conn.parser.status() >= 300) {
+        ++stats_.non_2xx;
+      }
+    }
+    bool close_after = conn.parser.close() || !opts_.keep_alive;
+    conn.parser.Reset();
+    if (close_after) {
+      // Requests pipelined behind a closing response are lost
+      stats_.io_errors += conn.in_flight.size();
+      conn.in_flight.clear();
+      Disconnect(i);
+    }
+  }
+
+  const Options& opts_;
+  sockaddr_in addr_;
+  int64_t start_ns_;
+  int64_t end_ns_{0};
+  int64_t warmup_end_ns_{0};
+  int64_t interval_ns_{0};  // per connection, 0 = closed loop
+  size_t depth_{1};
+  int epoll_fd_{-1};
+  std::vector<Conn> conns_;
+  std::vector<IdleConn> idle_;
+  Stats stats_;
+};
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(
+      stderr,
+      "Usage: %s [options]\n"
+      "  --host HOST          server address (default 127.0.0.1)\n"
+      "  --port N             server port (default 8001)\n"
+      "  --connections N      open connections (default 16)\n"
+      "  --threads N          client threads (default 1)\n"
+      "  --rate R             requests/s over all connections; 0 sends as\n"
+      "                       fast as responses allow (default 0)\n"
+      "  --duration S         seconds to run (default 10)\n"
+      "  --warmup S           ignore requests due in the first S seconds\n"
+      "  --no-keep-alive      one request per connection\n"
+      "  --pipeline N         requests in flight per connection (default 1)\n"
+      "  --idle N             also hold N idle keep-alive connections\n"
+      "  --url PATH           request PATH (default /)\n"
+      "  --urls FILE          URL mix: one \"PATH [WEIGHT]\" per line\n"
+      "  --json               print one JSON object instead of text\n",
+      argv0);
+}
+
+auto ParseNumber(const char* text, double* out) -> bool {
+  std::string_view view(text);
+  auto [ptr, ec] =
+      std::from_chars(view.data(), view.data() + view.size(), *out);
+  return ec == std::errc() && ptr == view.data() + view.size() && *out >= 0;
+}
+
+auto ReadUrls(const std::string& path, std::vector<std::string>* urls)
+    -> bool {
+  std::ifstream file(path);
+  if (!file) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+    return false;
+  }
+  urls->clear();
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    auto space = line.find_first_of(" \t");
+    std::string url = line.substr(0, space);
+    double weight = 1;
+    if (space != std::string::npos) {
+      auto rest = line.find_first_not_of(" \t", space);
+      if (rest != std::string::npos &&
+          (!ParseNumber(line.c_str() + rest, &weight) || weight > 1000)) {
+        std::fprintf(stderr, "%s: bad weight in \"%s\"\n", path.c_str(),
+                     line.c_str());
+        return false;
+      }
+    }
+    if (url.empty() || url[0] != '/') {
+      std::fprintf(stderr, "%s: URL must start with /: \"%s\"\n",
+                   path.c_str(), line.c_str());
+      return false;
+    }
+    // Weights repeat the URL; the connections walk the list in turn
+    for (int w = 0; w < static_cast<int>(weight); ++w) {
+      urls->push_back(url);
+    }
+  }
+  if (urls->empty()) {
+    std::fprintf(stderr, "%s: no URLs\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+auto ParseArgs(int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool has_value = i + 1 < argc;
+    double number = 0;
+    if (arg == "--no-keep-alive") {
+      opts->keep_alive = false;
+    } else if (arg == "--json") {
+      opts->json = true;
+    } else if (arg == "--host" && has_value) {
+      opts->host = argv[++i];
+    } else if (arg == "--url" && has_value) {
+      opts->urls = {argv[++i]};
+    } else if (arg == "--urls" && has_value) {
+      opts->urls_file = argv[++i];
+    } else if (has_value && ParseNumber(argv[i + 1], &number)) {
+      ++i;
+      if (arg == "--port" && number >= 1 && number <= 65535) {
+        opts->port = static_cast<int>(number);
+      } else if (arg == "--connections" && number >= 1) {
+        opts->connections = static_cast<size_t>(number);
+      } else if (arg == "--threads" && number >= 1) {
+        opts->threads = static_cast<size_t>(number);
+      } else if (arg == "--rate") {
+        opts->rate = number;
+      } else if (arg == "--duration" && number > 0) {
+        opts->duration_s = number;
+      } else if (arg == "--warmup") {
+        opts->warmup_s = number;
+      } else if (arg == "--pipeline" && number >= 1) {
+        opts->pipeline = static_cast<size_t>(number);
+      } else if (arg == "--idle") {
+        opts->idle = static_cast<size_t>(number);
+      } else {
+        std::fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1],
+                     argv[i]);
+        return false;
+      }
+    } else {
+      std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      return false;
+    }
+  }
+  if (opts->warmup_s >= opts->duration_s) {
+    std::fprintf(stderr, "--warmup must be shorter than --duration\n");
+    return false;
+  }
+  opts->threads = std::min(opts->threads, opts->connections);
+  return opts->urls_file.empty() || ReadUrls(opts->urls_file, &opts->urls);
+}
+
+auto Resolve(const Options& opts, sockaddr_in* addr) -> bool {
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  int ret = getaddrinfo(opts.host.c_str(), nullptr, &hints, &result);
+  if (ret != 0) {
+    std::fprintf(stderr, "%s: %s\n", opts.host.c_str(), gai_strerror(ret));
+    return false;
+  }
+  *addr = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+  addr->sin_port = htons(static_cast<uint16_t>(opts.port));
+  freeaddrinfo(result);
+  return true;
+}
+
+auto FormatNs(uint64_t ns) -> std::string {
+  if (ns >= 1000000000) {
+    return std::format("{:.2f}s", static_cast<double>(ns) / 1e9);
+  }
+  if (ns >= 1000000) {
+    return std::format("{:.2f}ms", static_cast<double>(ns) / 1e6);
+  }
+  return std::format("{:.1f}us", static_cast<double>(ns) / 1e3);
+}
+
+constexpr double kQuantiles[] = {0.5, 0.75, 0.9, 0.99, 0.999, 0.9999};
+
+void Report(const Options& opts, const Stats& total,
+            const LogLinearHistogram::Snapshot& latency) {
+  double seconds = opts.duration_s - opts.warmup_s;
+  double rps = static_cast<double>(total.requests) / seconds;
+  double mean_ns = latency.count == 0 ? 0
+                                      : static_cast<double>(latency.sum) /
+                                            static_cast<double>(latency.count);
+  uint64_t min_ns = latency.count == 0 ? 0 : total.min_ns;
+  if (opts.json) {
+    std::string out = std::format(
+        R"({{"connections":{},"threads":{},"rate":{},"keep_alive":{},)"
+        R"("pipeline":{},"duration_s":{},"requests":{},"rps":{:.1f},)"
+        R"("bytes":{},"errors":{{"connect":{},"io":{},"parse":{},)"
+        R"("non_2xx":{},"unfinished":{}}},"idle":{},"idle_closed":{},)"
+        R"("latency_us":{{"min":{:.1f},"mean":{:.1f},"max":{:.1f})",
+        opts.connections, opts.threads, opts.rate, opts.keep_alive,
+        opts.pipeline, seconds, total.requests, rps, total.bytes,
+        total.connect_errors, total.io_errors, total.parse_errors,
+        total.non_2xx, total.unfinished, opts.idle, total.idle_closed,
+        static_cast<double>(min_ns) / 1e3,
+        mean_ns / 1e3, static_cast<double>(total.max_ns) / 1e3);
+    for (double q : kQuantiles) {
+      out += std::format(R"(,"p{}":{:.1f})", q * 100,
+                         static_cast<double>(latency.Quantile(q)) / 1e3);
+    }
+    out += "}}\n";
+    std::fputs(out.c_str(), stdout);
+    return;
+  }
+
+  std::string out = std::format(
+      "{:.1f}s @ {}:{}, {} threads, {} connections, {}, pipeline {}, {}\n"
+      "  requests  {} ({:.1f}/s), {:.2f} MiB read ({:.2f} MiB/s)\n"
+      "  errors    connect {}, io {}, parse {}, non-2xx {}, unfinished {}\n"
+      "  latency from intended send time (coordinated omission corrected)\n"
+      "    min {}  mean {}  max {}\n",
+      seconds, opts.host, opts.port, opts.threads, opts.connections,
+      opts.keep_alive ? "keep-alive" : "no keep-alive", opts.pipeline,
+      opts.rate > 0 ? std::format("{:.0f} req/s open model", opts.rate)
+                    : std::string("closed loop"),
+      total.requests, rps, static_cast<double>(total.bytes) / (1 << 20),
+      static_cast<double>(total.bytes) / (1 << 20) / opts.duration_s,
+      total.connect_errors, total.io_errors, total.parse_errors,
+      total.non_2xx, total.unfinished, FormatNs(min_ns),
+      FormatNs(static_cast<uint64_t>(mean_ns)), FormatNs(total.max_ns));
+  if (opts.idle > 0) {
+    out.insert(out.find("  latency"),
+               std::format("  idle      {} held, {} closed by the server\n",
+                           opts.idle, total.idle_closed));
+  }
+  for (double q : kQuantiles) {
+    out += std::format("    p{:<7} {}\n", q * 100,
+                       FormatNs(latency.Quantile(q)));
+  }
+  std::fputs(out.c_str(), stdout);
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  Options opts;
+  if (argc > 1 && (std::string_view(argv[1]) == "-h" ||
+                   std::string_view(argv[1]) == "--help")) {
+    PrintUsage(argv[0]);
+    return 0;
+  }
+  if (!ParseArgs(argc, argv, &opts)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  sockaddr_in addr{};
+  if (!Resolve(opts, &addr)) {
+    return 1;
+  }
+
+  // Every connection is a descriptor; raise the soft limit if needed
+  rlimit limit{};
+  rlim_t wanted = opts.connections + opts.idle + 64;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted) {
+    limit.rlim_cur = std::min(wanted, limit.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  // Connections are opened before the clock starts; idle connections get
+  // longer, since there may be thousands of them
+  int64_t start_ns =
+      NowNs() + 100000000 + static_cast<int64_t>(opts.idle) * 50000;
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (size_t t = 0; t < opts.threads; ++t) {
+    std::vector<size_t> indexes;
+    for (size_t c = t; c < opts.connections; c += opts.threads) {
+      indexes.push_back(c);
+    }
+    size_t idle = opts.idle / opts.threads + (t < opts.idle % opts.threads);
+    workers.push_back(std::make_unique<Worker>(opts, addr, start_ns,
+                                               std::move(indexes), idle));
+  }
+  std::vector<std::thread> threads;
+  for (auto& worker : workers) {
+    threads.emplace_back([&worker]() { worker->Run(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  Stats total;
+  LogLinearHistogram::Snapshot latency;
+  for (const auto& worker : workers) {
+    const auto& stats = worker->stats();
+    stats.latency.AddTo(&latency);
+    total.min_ns = std::min(total.min_ns, stats.min_ns);
+    total.max_ns = std::max(total.max_ns, stats.max_ns);
+    total.requests += stats.requests;
+    total.bytes += stats.bytes;
+    total.non_2xx += stats.non_2xx;
+    total.connect_errors += stats.connect_errors;
+    total.io_errors += stats.io_errors;
+    total.parse_errors += stats.parse_errors;
+    total.unfinished += stats.unfinished;
+    total.idle_closed += stats.idle_closed;
+  }
+  Report(opts, total, latency);
+  return total.requests == 0 ? 1 : 0;
+}
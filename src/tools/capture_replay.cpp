@@ -0,0 +1,653 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Replays a traffic capture written with --capture against a
+// server. Every recorded connection is opened, written and closed at its
+// recorded time (optionally sped up), with each recorded read sent as one
+// write, so keep-alive reuse and pipelined requests arrive in the same
+// shape. Replay is deterministic: the same capture always produces the same
+// byte streams in the same order.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "logger/capture_format.hpp"
+
+namespace {
+
+using my_web_server::CaptureDecoder;
+using my_web_server::CaptureEvent;
+using my_web_server::CaptureKind;
+
+constexpr int kMaxEvents = 256;
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr int64_t kNsPerSec = 1000000000;
+constexpr auto kEpollOut = static_cast<uint32_t>(EPOLLOUT);
+
+struct Options {
+  std::string host{"127.0.0.1"};
+  int port{8001};
+  std::string file{};
+  double speed{1};      // 2 replays the recorded timeline twice as fast
+  size_t copies{1};     // connections opened per recorded connection
+  double drain_s{5};    // wait for responses after a connection's close
+  bool dump{false};
+};
+
+// One recorded connection: its open event first, then data and close
+struct Recorded {
+  uint32_t id{0};
+  std::vector<CaptureEvent> events{};
+  bool dropped{false};
+};
+
+struct Replay {
+  const Recorded* recorded{nullptr};
+  size_t next{0};  // next event to act on
+  int fd{-1};
+  bool connecting{false};
+  bool want_write{false};
+  bool closing{false};      // past the recorded close
+  bool half_closed{false};  // write side shut down, draining responses
+  bool done{false};
+  std::string out{};
+  size_t out_sent{0};
+};
+
+struct Stats {
+  uint64_t connections{0};
+  uint64_t writes{0};
+  uint64_t bytes_sent{0};
+  uint64_t bytes_received{0};
+  uint64_t connect_errors{0};
+  uint64_t resets{0};
+  uint64_t unsent_bytes{0};   // data due after the connection was gone
+  uint64_t server_closed{0};  // closed by the server before our close
+  uint64_t skipped{0};        // recorded connections that lost bytes
+  int64_t lag_total_ns{0};    // actions run later than scheduled
+  int64_t lag_max_ns{0};
+  uint64_t actions{0};
+};
+
+auto NowNs() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(
+      stderr,
+      "Usage: %s [options] CAPTURE\n"
+      "  --host HOST    server address (default 127.0.0.1)\n"
+      "  --port N       server port (default 8001)\n"
+      "  --speed F      replay F times faster than recorded (default 1)\n"
+      "  --copies N     open each recorded connection N times (default 1)\n"
+      "  --drain S      seconds to wait for responses after a connection's\n"
+      "                 recorded close (default 5)\n"
+      "  --dump         print the capture instead of replaying it\n",
+      argv0);
+}
+
+auto ParseNumber(const char* text, double* out) -> bool {
+  std::string_view view(text);
+  auto [ptr, ec] =
+      std::from_chars(view.data(), view.data() + view.size(), *out);
+  return ec == std::errc() && ptr == view.data() + view.size() && *out >= 0;
+}
+
+auto ParseArgs(int argc, char* argv[], Options* opts) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool has_value = i + 1 < argc;
+    double number = 0;
+    if (arg == "--dump") {
+      opts->dump = true;
+    } else if (arg == "--host" && has_value) {
+      opts->host = argv[++i];
+    } else if ((arg == "--port" || arg == "--speed" || arg == "--copies" ||
+                arg == "--drain") &&
+               has_value) {
+      if (!ParseNumber(argv[++i], &number)) {
+        std::fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1],
+                     argv[i]);
+        return false;
+      }
+      if (arg == "--port" && number >= 1 && number <= 65535) {
+        opts->port = static_cast<int>(number);
+      } else if (arg == "--speed" && number > 0) {
+        opts->speed = number;
+      } else if (arg == "--copies" && number >= 1) {
+        opts->copies = static_cast<size_t>(number);
+      } else if (arg == "--drain") {
+        opts->drain_s = number;
+      } else {
+        std::fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1],
+                     argv[i]);
+        return false;
+      }
+    } else if (!arg.starts_with("--") && opts->file.empty()) {
+      opts->file = argv[i];
+    } else {
+      std::fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      return false;
+    }
+  }
+  if (opts->file.empty()) {
+    std::fprintf(stderr, "No capture file given\n");
+    return false;
+  }
+  return true;
+}
+
+// Read the whole capture; events come back sorted by time, ties in file
+// order, which is the order they were read on each connection
+auto LoadCapture(const std::string& path, int64_t* start_wall_ns,
+                 std::vector<CaptureEvent>* events) -> bool {
+  std::FILE* in = std::fopen(path.c_str(), "rb");
+  if (in == nullptr) {
+    std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+    return false;
+  }
+  CaptureDecoder decoder(in);
+  if (!decoder.ReadHeader()) {
+    std::fprintf(stderr, "%s: not a capture file\n", path.c_str());
+    std::fclose(in);
+    return false;
+  }
+  CaptureEvent event;
+  while (decoder.Next(&event)) {
+    events->push_back(std::move(event));
+  }
+  if (decoder.error()) {
+    // The server was probably killed mid-write; use what is complete
+    std::fprintf(stderr, "%s: truncated after %zu events\n", path.c_str(),
+                 events->size());
+  }
+  std::fclose(in);
+  *start_wall_ns = decoder.start_wall_ns();
+  std::stable_sort(events->begin(), events->end(),
+                   [](const CaptureEvent& a, const CaptureEvent& b) {
+                     return a.time_ns < b.time_ns;
+                   });
+  return true;
+}
+
+auto KindName(CaptureKind kind) -> std::string_view {
+  switch (kind) {
+    case CaptureKind::kOpen:
+      return "open";
+    case CaptureKind::kData:
+      return "data";
+    case CaptureKind::kClose:
+      return "close";
+    case CaptureKind::kDropped:
+      return "dropped";
+  }
+  return "?";
+}
+
+void Dump(int64_t start_wall_ns, const std::vector<CaptureEvent>& events) {
+  std::printf("# capture started at %lld ns since the epoch\n",
+              static_cast<long long>(start_wall_ns));
+  std::printf("# time_s conn event details\n");
+  for (const auto& event : events) {
+    std::string line =
+        std::format("{:.6f} {} {}", static_cast<double>(event.time_ns) / 1e9,
+                    event.conn_id, KindName(event.kind));
+    if (event.kind == CaptureKind::kOpen) {
+      char ip[INET_ADDRSTRLEN] = "-";
+      in_addr addr{};
+      addr.s_addr = event.peer_ip;
+      inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+      line += std::format(" {}:{}{}", ip, ntohs(event.peer_port),
+                          event.tls ? " tls" : "");
+    } else if (event.kind == CaptureKind::kData) {
+      line += std::format(" {} \"", event.data.size());
+      for (char c : event.data) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '\r') {
+          line += "\\r";
+        } else if (c == '\n') {
+          line += "\\n";
+        } else if (c == '"' || c == '\\') {
+          line += '\\';
+          line += c;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+          line += std::format("\\x{:02x}", byte);
+        } else {
+          line += c;
+        }
+      }
+      line += '"';
+    }
+    line += '\n';
+    std::fputs(line.c_str(), stdout);
+  }
+}
+
+// Group events by connection; connections that lost bytes in the server's
+// capture rings are left out, since they would replay as broken requests
+auto GroupConnections(std::vector<CaptureEvent>* events, Stats* stats)
+    -> std::vector<Recorded> {
+  std::map<uint32_t, Recorded> by_id;
+  for (auto& event : *events) {
+    auto& recorded = by_id[event.conn_id];
+    recorded.id = event.conn_id;
+    if (event.kind == CaptureKind::kDropped) {
+      recorded.dropped = true;
+    }
+    recorded.events.push_back(std::move(event));
+  }
+  std::vector<Recorded> connections;
+  for (auto& [id, recorded] : by_id) {
+    if (recorded.dropped || recorded.events.empty() ||
+        recorded.events.front().kind != CaptureKind::kOpen) {
+      ++stats->skipped;
+      continue;
+    }
+    connections.push_back(std::move(recorded));
+  }
+  return connections;
+}
+
+class Replayer {
+ public:
+  Replayer(const Options& opts, const sockaddr_in& addr,
+           const std::vector<Recorded>& connections)
+      : opts_(opts), addr_(addr) {
+    for (const auto& recorded : connections) {
+      for (size_t c = 0; c < opts.copies; ++c) {
+        replays_.push_back(Replay{.recorded = &recorded});
+      }
+    }
+  }
+
+  auto Run() -> bool {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+      std::perror("epoll_create1");
+      return false;
+    }
+    start_ns_ = NowNs() + 100000000;
+    for (size_t i = 0; i < replays_.size(); ++i) {
+      Schedule(i, Due(replays_[i].recorded->events.front().time_ns));
+    }
+    remaining_ = replays_.size();
+    epoll_event events[kMaxEvents];
+    while (remaining_ > 0) {
+      int64_t now = NowNs();
+      while (!timers_.empty() && timers_.top().first <= now) {
+        auto [due, i] = timers_.top();
+        timers_.pop();
+        OnTimer(i, due, now);
+      }
+      if (remaining_ == 0) {
+        break;
+      }
+      int timeout_ms = -1;
+      if (!timers_.empty()) {
+        // Round up so the loop does not spin until the timer is due
+        timeout_ms = static_cast<int>(
+            (std::max<int64_t>(timers_.top().first - NowNs(), 0) + 999999) /
+            1000000);
+      }
+      int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+      for (int e = 0; e < n; ++e) {
+        auto i = static_cast<size_t>(events[e].data.u64);
+        if (events[e].events & (EPOLLOUT | EPOLLERR)) {
+          OnWritable(i);
+        }
+        if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          OnReadable(i);
+        }
+      }
+    }
+    elapsed_ns_ = NowNs() - start_ns_;
+    close(epoll_fd_);
+    return true;
+  }
+
+  auto stats() const -> const Stats& { return stats_; }
+  auto elapsed_ns() const -> int64_t { return elapsed_ns_; }
+
+ private:
+  using Timer = std::pair<int64_t, size_t>;
+
+  auto Due(int64_t time_ns) const -> int64_t {
+    return start_ns_ +
+           static_cast<int64_t>(static_cast<double>(time_ns) / opts_.speed);
+  }
+
+  void Schedule(size_t i, int64_t due) { timers_.emplace(due, i); }
+
+  // Each replay has one timer at a time: its next recorded event, or the
+  // end of the drain once every event has been acted on
+  void OnTimer(size_t i, int64_t due, int64_t now) {
+    auto& r = replays_[i];
+    if (r.done) {
+      return;
+    }
+    const auto& events = r.recorded->events;
+    if (r.next >= events.size()) {
+      Finish(i);  // drain timed out
+      return;
+    }
+    stats_.lag_total_ns += now - due;
+    stats_.lag_max_ns = std::max(stats_.lag_max_ns, now - due);
+    ++stats_.actions;
+    const auto& event = events[r.next++];
+    switch (event.kind) {
+      case CaptureKind::kOpen:
+        Connect(i);
+        break;
+      case CaptureKind::kData:
+        if (r.fd == -1) {
+          stats_.unsent_bytes += event.data.size();
+        } else {
+          r.out += event.data;
+          ++stats_.writes;
+          if (!r.connecting) {
+            Flush(i);
+          }
+        }
+        break;
+      case CaptureKind::kClose:
+      case CaptureKind::kDropped:
+        r.next = events.size();
+        break;
+    }
+    if (r.done) {
+      return;
+    }
+    if (r.next < events.size()) {
+      Schedule(i, Due(events[r.next].time_ns));
+      return;
+    }
+    // Past the last event (or a recording that ended without a close)
+    r.closing = true;
+    if (r.fd == -1) {
+      Finish(i);
+    } else if (!r.connecting && r.out_sent == r.out.size()) {
+      HalfClose(i);
+    }
+  }
+
+  void Connect(size_t i) {
+    auto& r = replays_[i];
+    r.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (r.fd == -1) {
+      ++stats_.connect_errors;
+      return;
+    }
+    int one = 1;
+    setsockopt(r.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret = connect(r.fd, reinterpret_cast<const sockaddr*>(&addr_),
+                      sizeof(addr_));
+    if (ret == -1 && errno != EINPROGRESS) {
+      ++stats_.connect_errors;
+      close(r.fd);
+      r.fd = -1;
+      return;
+    }
+    ++stats_.connections;
+    r.connecting = ret == -1;
+    r.want_write = r.connecting;
+    epoll_event event{};
+    event.events = EPOLLIN | (r.want_write ? kEpollOut : 0);
+    event.data.u64 = i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, r.fd, &event);
+  }
+
+  void SetWriteInterest(size_t i, bool want) {
+    auto& r = replays_[i];
+    if (r.want_write == want) {
+      return;
+    }
+    r.want_write = want;
+    epoll_event event{};
+    event.events = EPOLLIN | (want ? kEpollOut : 0);
+    event.data.u64 = i;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, r.fd, &event);
+  }
+
+  void OnWritable(size_t i) {
+    auto& r = replays_[i];
+    if (r.fd == -1) {
+      return;
+    }
+    if (r.connecting) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(r.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        ++stats_.connect_errors;
+        Drop(i);
+        return;
+      }
+      r.connecting = false;
+    }
+    Flush(i);
+  }
+
+  void Flush(size_t i) {
+    auto& r = replays_[i];
+    while (r.out_sent < r.out.size()) {
+      ssize_t n = send(r.fd, r.out.data() + r.out_sent,
+                       r.out.size() - r.out_sent, MSG_NOSIGNAL);
+      if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          SetWriteInterest(i, true);
+          return;
+        }
+        ++stats_.resets;
+        Drop(i);
+        return;
+      }
+      r.out_sent += static_cast<size_t>(n);
+      stats_.bytes_sent += static_cast<uint64_t>(n);
+    }
+    r.out.clear();
+    r.out_sent = 0;
+    SetWriteInterest(i, false);
+    if (r.closing && !r.half_closed) {
+      HalfClose(i);
+    }
+  }
+
+  // Stop sending but keep reading, so responses to the last requests
+  // still arrive; the server closes once it sees the end of input
+  void HalfClose(size_t i) {
+    auto& r = replays_[i];
+    r.half_closed = true;
+    shutdown(r.fd, SHUT_WR);
+    Schedule(i, NowNs() + static_cast<int64_t>(opts_.drain_s * kNsPerSec));
+  }
+
+  void OnReadable(size_t i) {
+    char buf[kReadChunk];
+    auto& r = replays_[i];
+    while (r.fd != -1) {
+      ssize_t n = recv(r.fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        stats_.bytes_received += static_cast<uint64_t>(n);
+        continue;
+      }
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+      }
+      if (n == -1) {
+        ++stats_.resets;
+      } else if (!r.closing) {
+        ++stats_.server_closed;
+      }
+      if (r.closing) {
+        Finish(i);
+      } else {
+        Drop(i);
+      }
+      return;
+    }
+  }
+
+  // The connection is gone before its recording ended; later data is
+  // counted as unsent
+  void Drop(size_t i) {
+    auto& r = replays_[i];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, r.fd, nullptr);
+    close(r.fd);
+    r.fd = -1;
+    r.connecting = false;
+    r.out.clear();
+    r.out_sent = 0;
+    if (r.closing) {
+      Finish(i);
+    }
+  }
+
+  void Finish(size_t i) {
+    auto& r = replays_[i];
+    if (r.fd != -1) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, r.fd, nullptr);
+      close(r.fd);
+      r.fd = -1;
+    }
+    r.done = true;
+    --remaining_;
+  }
+
+  const Options& opts_;
+  sockaddr_in addr_;
+  int epoll_fd_{-1};
+  int64_t start_ns_{0};
+  int64_t elapsed_ns_{0};
+  size_t remaining_{0};  // replays not done yet
+  std::vector<Replay> replays_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+  Stats stats_;
+};
+
+auto Resolve(const Options& opts, sockaddr_in* addr) -> bool {
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  int ret = getaddrinfo(opts.host.c_str(), nullptr, &hints, &result);
+  if (ret != 0) {
+    std::fprintf(stderr, "%s: %s\n", opts.host.c_str(), gai_strerror(ret));
+    return false;
+  }
+  *addr = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+  addr->sin_port = htons(static_cast<uint16_t>(opts.port));
+  freeaddrinfo(result);
+  return true;
+}
+
+void Report(const Options& opts, size_t recorded, const Stats& stats,
+            int64_t elapsed_ns) {
+  double mean_lag_us =
+      stats.actions == 0 ? 0
+                         : static_cast<double>(stats.lag_total_ns) /
+                               static_cast<double>(stats.actions) / 1e3;
+  std::string out = std::format(
+      "replayed {} recorded connections x{} from {} in {:.2f}s at speed {}\n"
+      "  opened {} connections, {} writes, sent {:.2f} MiB, received "
+      "{:.2f} MiB\n"
+      "  errors    connect {}, reset {}, unsent {} bytes\n"
+      "  closed by the server first: {}\n"
+      "  skipped (bytes lost during capture): {}\n"
+      "  schedule lag: mean {:.1f}us, max {:.1f}us\n",
+      recorded, opts.copies, opts.file,
+      static_cast<double>(elapsed_ns) / 1e9, opts.speed, stats.connections,
+      stats.writes, static_cast<double>(stats.bytes_sent) / (1 << 20),
+      static_cast<double>(stats.bytes_received) / (1 << 20),
+      stats.connect_errors, stats.resets, stats.unsent_bytes,
+      stats.server_closed, stats.skipped, mean_lag_us,
+      static_cast<double>(stats.lag_max_ns) / 1e3);
+  std::fputs(out.c_str(), stdout);
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  Options opts;
+  if (argc > 1 && (std::string_view(argv[1]) == "-h" ||
+                   std::string_view(argv[1]) == "--help")) {
+    PrintUsage(argv[0]);
+    return 0;
+  }
+  if (!ParseArgs(argc, argv, &opts)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  int64_t start_wall_ns = 0;
+  std::vector<CaptureEvent> events;
+  if (!LoadCapture(opts.file, &start_wall_ns, &events)) {
+    return 1;
+  }
+  if (opts.dump) {
+    Dump(start_wall_ns, events);
+    return 0;
+  }
+
+  Stats skipped;
+  auto connections = GroupConnections(&events, &skipped);
+  if (connections.empty()) {
+    std::fprintf(stderr, "%s: no complete connections to replay\n",
+                 opts.file.c_str());
+    return 1;
+  }
+  sockaddr_in addr{};
+  if (!Resolve(opts, &addr)) {
+    return 1;
+  }
+  rlimit limit{};
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  Replayer replayer(opts, addr, connections);
+  if (!replayer.Run()) {
+    return 1;
+  }
+  Stats stats = replayer.stats();
+  stats.skipped = skipped.skipped;
+  Report(opts, connections.size(), stats, replayer.elapsed_ns());
+  return stats.connect_errors + stats.resets == 0 ? 0 : 1;
+}
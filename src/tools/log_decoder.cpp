@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Offline decoder that formats a binary log written with
+// AsyncLogOptions::binary_path (--log-binary) into text lines.
+
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "logger/log_record.hpp"
+
+namespace {
+
+constexpr auto LevelName(int level) -> std::string_view {
+  switch (level) {
+    case 0:
+      return "INFO";
+    case 1:
+      return "WARN";
+    case 2:
+      return "ERROR";
+    default:
+      return "???";
+  }
+}
+
+struct CallSite {
+  int level{0};
+  std::string file{};
+  int line{0};
+  std::string fmt{};
+};
+
+void PrintLine(int64_t timestamp_ns, int level, size_t thread_id,
+               std::string_view message) {
+  std::chrono::system_clock::time_point timestamp(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(timestamp_ns)));
+  auto line = std::format("[{:%F %T}] [{}] [{}] {}\n", timestamp,
+                          LevelName(level), thread_id, message);
+  std::fputs(line.c_str(), stdout);
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  if (argc != 2) {
+    std::fprintf(stderr, "Usage: %s BINARY_LOG\n", argv[0]);
+    return 1;
+  }
+  std::FILE* in = std::fopen(argv[1], "rb");
+  if (in == nullptr) {
+    std::perror(argv[1]);
+    return 1;
+  }
+
+  std::string magic(my_web_server::kBinaryLogMagic.size(), '\0');
+  if (std::fread(magic.data(), 1, magic.size(), in) != magic.size() ||
+      magic != my_web_server::kBinaryLogMagic) {
+    std::fprintf(stderr, "%s: not a binary log\n", argv[1]);
+    std::fclose(in);
+    return 1;
+  }
+
+  std::unordered_map<uint32_t, CallSite> sites;
+  my_web_server::DecodedFrame frame;
+  size_t records = 0;
+  while (my_web_server::ReadFrame(in, &frame)) {
+    switch (frame.kind) {
+      case my_web_server::LogFrameKind::kFormat:
+        sites[frame.fmt_id] = {frame.level, frame.file, frame.line, frame.fmt};
+        break;
+      case my_web_server::LogFrameKind::kRecord: {
+        auto args = my_web_server::DecodeLogArgs(frame.record);
+        auto it = sites.find(frame.record.fmt_id);
+        std::string message;
+        int level = 0;
+        if (it == sites.end()) {
+          message = std::format("<unknown format {}> ", frame.record.fmt_id) +
+                    my_web_server::FormatLogRecord("{} {} {} {}", args);
+        } else {
+          level = it->second.level;
+          message = my_web_server::FormatLogRecord(it->second.fmt, args);
+        }
+        if (frame.record.truncated != 0) {
+          message += " [truncated]";
+        }
+        PrintLine(frame.record.timestamp_ns, level, frame.thread_id, message);
+        break;
+      }
+      case my_web_server::LogFrameKind::kText:
+        PrintLine(frame.record.timestamp_ns, frame.level, frame.thread_id,
+                  frame.text);
+        break;
+    }
+    ++records;
+  }
+  bool clean_eof = std::feof(in) != 0;
+  std::fclose(in);
+  if (!clean_eof) {
+    std::fprintf(stderr, "%s: corrupt frame after %zu frames\n", argv[1],
+                 records);
+    return 1;
+  }
+  return 0;
+}
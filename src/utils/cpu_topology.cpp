@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Implements CPU topology detection from sysfs and
+// sched_getaffinity, and the thread placement policies.
+
+#include "utils/cpu_topology.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+#include <tuple>
+
+namespace my_web_server {
+
+namespace {
+
+constexpr std::string_view kSysCpuDir = "/sys/devices/system/cpu";
+constexpr std::string_view kSysNodeDir = "/sys/devices/system/node";
+
+auto ReadFirstLine(const std::filesystem::path& path, std::string* out)
+    -> bool {
+  std::ifstream file(path);
+  return static_cast<bool>(std::getline(file, *out));
+}
+
+auto ReadInt(const std::filesystem::path& path, int fallback) -> int {
+  std::string line;
+  int value = fallback;
+  if (ReadFirstLine(path, &line)) {
+    std::from_chars(line.data(), line.data() + line.size(), value);
+  }
+  return value;
+}
+
+// Compact "0-3,8" form of a sorted CPU list
+auto FormatCpuList(const std::vector<int>& cpus) -> std::string {
+  std::string out;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+      ++j;
+    }
+    if (!out.empty()) {
+      out += ',';
+    }
+    out += j == i ? std::format("{}", cpus[i])
+                  : std::format("{}-{}", cpus[i], cpus[j]);
+    i = j + 1;
+  }
+  return out;
+}
+
+}  // namespace
+
+auto ParsePinPolicy(std::string_view text, PinPolicy* out) -> bool {
+  if (text == "none") {
+    *out = PinPolicy::kNone;
+  } else if (text == "numa") {
+    *out = PinPolicy::kNuma;
+  } else if (text == "spread") {
+    *out = PinPolicy::kSpread;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+auto PinPolicyName(PinPolicy policy) -> std::string_view {
+  switch (policy) {
+    case PinPolicy::kNone:
+      return "none";
+    case PinPolicy::kNuma:
+      return "numa";
+    case PinPolicy::kSpread:
+      return "spread";
+  }
+  return "?";
+}
+
+auto ParseCpuList(std::string_view text) -> std::vector<int> {
+  std::vector<int> cpus;
+  while (!text.empty()) {
+    auto comma = text.find(',');
+    auto range = text.substr(0, comma);
+    text = comma == std::string_view::npos ? std::string_view{}
+                                           : text.substr(comma + 1);
+    while (!range.empty() && (range.back() == '\n' || range.back() == ' ')) {
+      range.remove_suffix(1);
+    }
+    if (range.empty()) {
+      continue;
+    }
+    int first = 0;
+    int last = 0;
+    auto dash = range.find('-');
+    if (std::from_chars(range.data(), range.data() + range.size(), first)
+            .ec != std::errc()) {
+      return {};
+    }
+    last = first;
+    if (dash != std::string_view::npos &&
+        std::from_chars(range.data() + dash + 1, range.data() + range.size(),
+                        last)
+                .ec != std::errc()) {
+      return {};
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+auto CpuTopology::Detect() -> CpuTopology {
+  CpuTopology topology;
+  std::vector<int> online;
+#if defined(__linux__)
+  std::string line;
+  if (ReadFirstLine(std::filesystem::path(kSysCpuDir) / "online", &line)) {
+    online = ParseCpuList(line);
+  }
+#endif
+  if (online.empty()) {
+    unsigned count = std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < count; ++cpu) {
+      online.push_back(static_cast<int>(cpu));
+    }
+  }
+
+#if defined(__linux__)
+  // taskset / cgroup cpusets narrow what we may use
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+  std::map<int, int> node_of;
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(kSysNodeDir, ec)) {
+    auto name = entry.path().filename().string();
+    int node = 0;
+    if (!name.starts_with("node") ||
+        std::from_chars(name.data() + 4, name.data() + name.size(), node).ec !=
+            std::errc()) {
+      continue;
+    }
+    if (ReadFirstLine(entry.path() / "cpulist", &line)) {
+      for (int cpu : ParseCpuList(line)) {
+        node_of[cpu] = node;
+      }
+    }
+  }
+
+  for (int cpu : online) {
+    if (have_mask && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))) {
+      continue;
+    }
+    auto dir = std::filesystem::path(kSysCpuDir) /
+               std::format("cpu{}", cpu) / "topology";
+    CpuInfo info;
+    info.cpu = cpu;
+    info.core_id = ReadInt(dir / "core_id", cpu);
+    info.package_id = std::max(ReadInt(dir / "physical_package_id", 0), 0);
+    auto node = node_of.find(cpu);
+    info.numa_node = node == node_of.end() ? 0 : node->second;
+    topology.cpus_.push_back(info);
+  }
+#else
+  for (int cpu : online) {
+    topology.cpus_.push_back({cpu, cpu, 0, 0});
+  }
+#endif
+  if (topology.cpus_.empty()) {
+    topology.cpus_.push_back({});
+  }
+  return topology;
+}
+
+auto CpuTopology::NumaNodeCount() const -> size_t {
+  std::set<int> nodes;
+  for (const auto& info : cpus_) {
+    nodes.insert(info.numa_node);
+  }
+  return nodes.size();
+}
+
+auto CpuTopology::Describe() const -> std::string {
+  std::set<std::pair<int, int>> cores;
+  std::set<int> packages;
+  std::vector<int> list;
+  for (const auto& info : cpus_) {
+    cores.insert({info.package_id, info.core_id});
+    packages.insert(info.package_id);
+    list.push_back(info.cpu);
+  }
+  return std::format("{} CPUs ({}) on {} cores, {} packages, {} NUMA nodes",
+                     cpus_.size(), FormatCpuList(list), cores.size(),
+                     packages.size(), NumaNodeCount());
+}
+
+auto CpuTopology::Plan(PinPolicy policy, size_t cpu_threads,
+                       size_t io_threads) const -> ThreadPlacement {
+  // Scope: the NUMA node with the most allowed CPUs, or everything
+  std::vector<CpuInfo> scope = cpus_;
+  if (policy == PinPolicy::kNuma) {
+    std::map<int, size_t> per_node;
+    for (const auto& info : cpus_) {
+      ++per_node[info.numa_node];
+    }
+    int node = std::max_element(per_node.begin(), per_node.end(),
+                                [](const auto& a, const auto& b) {
+                                  return a.second < b.second;
+                                })
+                   ->first;
+    std::erase_if(scope, [node](const CpuInfo& info) {
+      return info.numa_node != node;
+    });
+  }
+
+  // First hardware thread of every core, then the SMT siblings, so workers
+  // only share a core once every core has one
+  std::map<std::pair<int, int>, int> seen;
+  std::vector<std::tuple<int, int, int, int>> ranked;  // smt, pkg, core, cpu
+  for (const auto& info : scope) {
+    int smt = seen[{info.package_id, info.core_id}]++;
+    ranked.emplace_back(smt, info.package_id, info.core_id, info.cpu);
+  }
+  std::sort(ranked.begin(), ranked.end());
+  std::vector<int> ordered;
+  for (const auto& entry : ranked) {
+    ordered.push_back(std::get<3>(entry));
+  }
+
+  ThreadPlacement placement;
+  std::vector<int> workers(ordered.begin() + (ordered.size() > 1 ? 1 : 0),
+                           ordered.end());
+  placement.cpu_threads = cpu_threads != 0 ? cpu_threads : workers.size();
+  placement.io_threads = io_threads != 0
+                             ? io_threads
+                             : std::max<size_t>(2, placement.cpu_threads / 2);
+  if (policy == PinPolicy::kNone) {
+    return placement;
+  }
+  placement.reactor = {ordered.front()};
+  for (size_t i = 0; i < placement.cpu_threads; ++i) {
+    placement.cpu_workers.push_back({workers[i % workers.size()]});
+  }
+  placement.io_workers = workers;
+  std::sort(placement.io_workers.begin(), placement.io_workers.end());
+  return placement;
+}
+
+auto PinCurrentThread(const std::vector<int>& cpus) -> bool {
+  if (cpus.empty()) {
+    return true;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  // macOS only offers affinity hints (thread_policy_set), not pinning
+  return false;
+#endif
+}
+
+}  // namespace my_web_server
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks access log rendering in both output formats.
+
+#include "logger/access_log.hpp"
+
+#include <arpa/inet.h>
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+namespace {
+
+auto MakeRecord() -> my_web_server::AccessRecord {
+  my_web_server::AccessRecord record;
+  record.timestamp_ns = 1760000000123000000;  // 2025-10-09 08:53:20.123 UTC
+  record.peer_ip = htonl(0x7f000001);
+  record.peer_port = htons(5000);
+  record.status = 200;
+  record.header_bytes = 100;
+  record.body_bytes = 400;
+  record.ttfb_us = 12;
+  record.duration_us = 34;
+  record.SetUrl("/a \"b\".txt");
+  record.SetAgent("curl/8.0");
+  return record;
+}
+
+void TestCombined() {
+  std::string out;
+  my_web_server::AppendAccessRecord(&out, MakeRecord(),
+                                    my_web_server::AccessLogFormat::kCombined);
+  assert(out ==
+         "127.0.0.1 - - [09/Oct/2025:08:53:20 +0000] "
+         "\"GET /a \\x22b\\x22.txt HTTP/1.1\" 200 500 \"-\" \"curl/8.0\" "
+         "12 34\n");
+}
+
+void TestJsonLines() {
+  std::string out;
+  my_web_server::AppendAccessRecord(&out, MakeRecord(),
+                                    my_web_server::AccessLogFormat::kJsonLines);
+  assert(out ==
+         "{\"ts\":\"2025-10-09T08:53:20.123Z\",\"ip\":\"127.0.0.1\","
+         "\"port\":5000,\"method\":\"GET\",\"url\":\"/a \\\"b\\\".txt\","
+         "\"status\":200,\"bytes\":500,\"body_bytes\":400,\"ttfb_us\":12,"
+         "\"duration_us\":34,\"tls\":false,\"ua\":\"curl/8.0\"}\n");
+}
+
+// Long values are cut to the fixed record size instead of allocating
+void TestTruncation() {
+  my_web_server::AccessRecord record;
+  record.SetUrl(std::string(500, 'u'));
+  assert(record.url_len == my_web_server::kAccessUrlSize);
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestCombined();
+  TestJsonLines();
+  TestTruncation();
+  std::cout << "access_log_test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks config file parsing, command-line precedence and
+// snapshot publication on reload.
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "config/global_config.hpp"
+#include "http/response_cache.hpp"
+
+namespace {
+
+void WriteFile(const std::string& path, const std::string& text) {
+  std::ofstream(path, std::ios::trunc) << text;
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running config reload tests...\n";
+  const std::string path = "/tmp/config_reload_test.conf";
+  WriteFile(path,
+            "# comment\n"
+            "port = 9001\n"
+            "text = \"hello world\"\n"
+            "max-conn = 64\n"
+            "cpu-queue = 8\n"
+            "coroutines = true\n");
+
+  auto& config = my_web_server::GlobalConfig::Instance();
+  char arg0[] = "config_reload_test";
+  char arg1[] = "--config";
+  char* arg2 = const_cast<char*>(path.c_str());
+  char arg3[] = "--max-conn";
+  char arg4[] = "32";
+  char* argv[] = {arg0, arg1, arg2, arg3, arg4};
+  [[maybe_unused]] bool parsed = config.InitFromArgs(5, argv);
+  assert(parsed);
+
+  const auto& first = config.Get();
+  assert(first.port == 9001);
+  assert(first.custom_response_text == "hello world");
+  assert(first.max_conn == 32);  // the command line wins over the file
+  assert(first.executor.cpu.queue_limit == 8);
+  assert(first.coroutines);
+
+  auto cache = my_web_server::ResponseCache::Build(first);
+  assert(cache->text == first.custom_response_text);
+  assert(cache->pages[my_web_server::ResponseCache::kOk]->find(
+             "hello world") != std::string::npos);
+
+  // Live settings change, restart-only ones keep their running value
+  WriteFile(path,
+            "port = 9002\n"
+            "text = changed\n"
+            "cpu-queue = 16\n");
+  [[maybe_unused]] bool reloaded = config.Reload();
+  assert(reloaded);
+  [[maybe_unused]] const auto& second = config.Get();
+  assert(&second != &first);
+  assert(second.custom_response_text == "changed");
+  assert(second.executor.cpu.queue_limit == 16);
+  assert(second.max_conn == 32);
+  assert(second.port == 9001);
+  assert(second.coroutines);
+  // The old snapshot is retired, not freed
+  assert(first.custom_response_text == "hello world");
+
+  // A broken file leaves the running snapshot in place
+  WriteFile(path, "port 9003\n");
+  reloaded = config.Reload();
+  assert(!reloaded);
+  assert(&config.Get() == &second);
+  WriteFile(path, "no-such-flag = 1\n");
+  reloaded = config.Reload();
+  assert(!reloaded);
+  assert(&config.Get() == &second);
+  // A size that does not fit in 64 bits is refused, not wrapped
+  WriteFile(path, "max-upload = 99999999999G\n");
+  reloaded = config.Reload();
+  assert(!reloaded);
+  WriteFile(path, "max-upload = 16777215G\n");
+  reloaded = config.Reload();
+  assert(reloaded);
+  assert(config.Get().max_upload == 16777215ULL << 30);
+
+  std::remove(path.c_str());
+  std::cout << "All tests passed!\n";
+  return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Drives the coroutine connection handler over a socketpair
+// and checks that its frames come from the per-connection arena.
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+#include "config/global_config.hpp"
+#include "http/conn_coroutine.hpp"
+#include "http/http_conn.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+namespace {
+
+using my_web_server::CoroArena;
+using my_web_server::HttpConn;
+
+void TestArena() {
+  CoroArena* arena = CoroArena::Acquire();
+  uint64_t fallbacks = CoroArena::HeapFallbacks();
+  void* first = arena->AllocateFrame(256);
+  assert(first >= arena->storage &&
+         first < arena->storage + CoroArena::kFrameBytes);
+  // The arena holds one frame; a second one, or one too large, goes to the
+  // heap and is counted
+  void* second = arena->AllocateFrame(256);
+  void* large = CoroArena::Acquire()->AllocateFrame(CoroArena::kFrameBytes);
+  assert(CoroArena::HeapFallbacks() == fallbacks + 2);
+  CoroArena::DeallocateFrame(large);
+  CoroArena::DeallocateFrame(second);
+  CoroArena::DeallocateFrame(first);
+  void* again = arena->AllocateFrame(256);
+  assert(again == first);
+  CoroArena::DeallocateFrame(again);
+  CoroArena::Release(arena);
+}
+
+auto RecvAll(int fd, char* buf, size_t len) -> ssize_t {
+  ssize_t total = 0;
+  while (true) {
+    ssize_t r = recv(fd, buf + total, len - static_cast<size_t>(total) - 1,
+                     MSG_DONTWAIT);
+    if (r <= 0) {
+      break;
+    }
+    total += r;
+  }
+  buf[total] = '\0';
+  return total;
+}
+
+void TestHandler() {
+  int ep = epoll_create1(0);
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  epoll_event event{};
+  event.data.fd = sv[0];
+  event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sv[0], &event);
+
+  auto conn = std::make_shared<HttpConn>();
+  sockaddr_in dummy{};
+  conn->Init(sv[0], dummy, ep);
+  uint64_t fallbacks = CoroArena::HeapFallbacks();
+  conn->StartCoroutine();
+  assert(CoroArena::HeapFallbacks() == fallbacks);
+
+  // A request split across two reads parks the handler in between
+  const char* head = "GET / HTTP/1.1\r\nHost: localhost\r\n";
+  send(sv[1], head, strlen(head), 0);
+  bool running = conn->Resume();
+  assert(running);
+  char buf[8192];
+  ssize_t got = RecvAll(sv[1], buf, sizeof(buf));
+  assert(got == 0);
+
+  const char* rest = "Connection: keep-alive\r\n\r\n";
+  send(sv[1], rest, strlen(rest), 0);
+  running = conn->Resume();
+  assert(running);
+  got = RecvAll(sv[1], buf, sizeof(buf));
+  assert(got > 0);
+  assert(std::strncmp(buf, "HTTP/1.1 200 OK", 15) == 0);
+
+  // Pipelined requests read together are answered in order in one go
+  const char* pipelined =
+      "GET / HTTP/1.1\r\nConnection: keep-alive\r\n\r\n"
+      "GET /again HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+  send(sv[1], pipelined, strlen(pipelined), 0);
+  running = conn->Resume();
+  assert(running);
+  got = RecvAll(sv[1], buf, sizeof(buf));
+  assert(got > 0);
+  std::string_view both(buf);
+  assert(both.starts_with("HTTP/1.1 200 OK"));
+  assert(both.find("HTTP/1.1 200 OK", 15) != std::string_view::npos);
+
+  // The last request on the connection finishes the handler
+  const char* last =
+      "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  send(sv[1], last, strlen(last), 0);
+  running = conn->Resume();
+  assert(!running);
+  got = RecvAll(sv[1], buf, sizeof(buf));
+  assert(got > 0);
+  assert(std::strncmp(buf, "HTTP/1.1 200 OK", 15) == 0);
+
+  conn.reset();
+  close(sv[0]);
+  close(sv[1]);
+  close(ep);
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running coroutine connection tests...\n";
+  char arg0[] = "conn_coroutine_test";
+  char arg1[] = "--text";
+  char arg2[] = "coroutine";
+  char* argv[] = {arg0, arg1, arg2};
+  my_web_server::GlobalConfig::Instance().InitFromArgs(3, argv);
+
+  TestArena();
+  TestHandler();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#endif
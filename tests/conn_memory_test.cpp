@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Reports per-connection memory and checks that idle
+// keep-alive connections release their request buffers.
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+int main() {
+  std::cout << "Running connection memory tests...\n";
+  std::cout << my_web_server::HttpConn::MemoryReport(100000) << "\n";
+  assert(sizeof(my_web_server::HttpConn) <= 128);
+
+  char arg0[] = "conn_memory_test";
+  char* argv[] = {arg0};
+  my_web_server::GlobalConfig::Instance().InitFromArgs(1, argv);
+
+  // Serve keep-alive requests on many connections, then leave them idle
+  constexpr int kConns = 64;
+  int ep = epoll_create1(0);
+  std::vector<std::unique_ptr<my_web_server::HttpConn>> conns;
+  std::vector<int> clients;
+  for (int i = 0; i < kConns; ++i) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    epoll_event event{};
+    event.data.fd = sv[0];
+    event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sv[0], &event);
+
+    auto conn = std::make_unique<my_web_server::HttpConn>();
+    sockaddr_in dummy{};
+    conn->Init(sv[0], dummy, ep);
+
+    const char* req =
+        "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    send(sv[1], req, strlen(req), 0);
+    bool read_ok = conn->Read();
+    assert(read_ok);
+    conn->Process();
+    // Keep-alive: Write() finishes the response and keeps the socket open
+    bool keep = conn->Write();
+    assert(keep);
+
+    char buf[4096];
+    ssize_t r = recv(sv[1], buf, sizeof(buf), 0);
+    assert(r > 0);
+    conns.push_back(std::move(conn));
+    clients.push_back(sv[1]);
+  }
+
+  // A second request on an idle connection must still work after its
+  // buffers were returned to the free list.
+  const char* req =
+      "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  send(clients[0], req, strlen(req), 0);
+  bool read_ok = conns[0]->Read();
+  assert(read_ok);
+  conns[0]->Process();
+  bool keep = conns[0]->Write();
+  assert(!keep);
+  char buf[4096];
+  ssize_t r = recv(clients[0], buf, sizeof(buf), 0);
+  assert(r > 0);
+  assert(std::strncmp(buf, "HTTP/1.1 200 OK", 15) == 0);
+
+  for (int fd : clients) {
+    close(fd);
+  }
+  close(ep);
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#endif
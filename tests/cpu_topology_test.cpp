@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks CPU list parsing and thread placement policies on a
+// synthetic two-socket SMT machine, then prints the detected host topology.
+
+#include "utils/cpu_topology.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using my_web_server::CpuInfo;
+using my_web_server::CpuTopology;
+using my_web_server::PinPolicy;
+
+void TestParseCpuList() {
+  assert((my_web_server::ParseCpuList("0-3,8,10-11\n") ==
+          std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  assert(my_web_server::ParseCpuList("").empty());
+  assert(my_web_server::ParseCpuList("x").empty());
+}
+
+// 2 packages x 2 cores x 2 threads; cpu n+4 is the sibling of cpu n and
+// each package is its own NUMA node
+auto TwoSocketMachine() -> CpuTopology {
+  std::vector<CpuInfo> cpus;
+  for (int cpu = 0; cpu < 8; ++cpu) {
+    int package = (cpu % 4) / 2;
+    cpus.push_back({cpu, cpu % 2, package, package});
+  }
+  return CpuTopology(cpus);
+}
+
+void TestNumaPolicy() {
+  auto plan = TwoSocketMachine().Plan(PinPolicy::kNuma, 0, 0);
+  // Node 0 holds cpus 0,1 and their siblings 4,5; reactor takes cpu 0
+  assert(plan.reactor == std::vector<int>{0});
+  assert(plan.cpu_threads == 3);
+  assert(plan.cpu_workers[0] == std::vector<int>{1});  // other core first
+  assert(plan.cpu_workers[1] == std::vector<int>{4});  // then siblings
+  assert(plan.cpu_workers[2] == std::vector<int>{5});
+  assert((plan.io_workers == std::vector<int>{1, 4, 5}));
+  assert(plan.io_threads == 2);
+}
+
+void TestSpreadPolicy() {
+  auto plan = TwoSocketMachine().Plan(PinPolicy::kSpread, 3, 5);
+  // One worker per physical core before any SMT sibling is used
+  assert(plan.reactor == std::vector<int>{0});
+  assert(plan.cpu_workers[0] == std::vector<int>{1});
+  assert(plan.cpu_workers[1] == std::vector<int>{2});
+  assert(plan.cpu_workers[2] == std::vector<int>{3});
+  assert(plan.io_threads == 5);
+}
+
+void TestNoPinning() {
+  auto plan = TwoSocketMachine().Plan(PinPolicy::kNone, 0, 0);
+  assert(plan.reactor.empty() && plan.cpu_workers.empty());
+  assert(plan.cpu_threads == 7);
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestParseCpuList();
+  TestNumaPolicy();
+  TestSpreadPolicy();
+  TestNoPinning();
+  std::cout << CpuTopology::Detect().Describe() << "\n";
+  std::cout << "cpu_topology_test passed" << std::endl;
+  return 0;
+}
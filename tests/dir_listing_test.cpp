@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Directory listing query parsing, chunk framing, paging
+// and sorting over a directory of 10k files.
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "http/dir_listing.hpp"
+
+namespace {
+
+using my_web_server::DirListing;
+using my_web_server::ListingQuery;
+
+constexpr int kFiles = 10000;
+
+auto Query(std::string_view text) -> ListingQuery {
+  ListingQuery query;
+  bool parsed = ListingQuery::Parse(text, &query);
+  assert(parsed);
+  return query;
+}
+
+// The whole page through the chunked coding, checking its framing
+auto Chunked(DirListing* listing, size_t* chunks) -> std::string {
+  std::string wire;
+  *chunks = 0;
+  for (auto chunk = listing->Pending(); !chunk.empty();
+       chunk = listing->Pending()) {
+    assert(chunk.size() <= DirListing::kChunkSize);
+    // Sent in two parts, as a short write would
+    listing->Sent(chunk.size() / 2);
+    assert(listing->Pending() == chunk.substr(chunk.size() / 2));
+    listing->Sent(chunk.size() - chunk.size() / 2);
+    wire += chunk;
+    ++*chunks;
+  }
+  assert(!listing->More());
+
+  std::string body;
+  std::string_view rest = wire;
+  while (true) {
+    auto line_end = rest.find("\r\n");
+    assert(line_end != std::string_view::npos);
+    size_t size = std::stoul(std::string(rest.substr(0, line_end)), nullptr,
+                             16);
+    rest.remove_prefix(line_end + 2);
+    if (size == 0) {
+      assert(rest == "\r\n");
+      break;
+    }
+    body += rest.substr(0, size);
+    assert(rest.substr(size, 2) == "\r\n");
+    rest.remove_prefix(size + 2);
+  }
+  return body;
+}
+
+auto Page(const std::string& dir, std::string_view query) -> std::string {
+  DirListing listing;
+  listing.Open(dir, Query(query), "");
+  std::string body;
+  char buf[7];  // small reads go through the carry-over
+  while (size_t n = listing.Read(buf, sizeof(buf))) {
+    body.append(buf, n);
+  }
+  assert(listing.done());
+  return body;
+}
+
+auto Count(std::string_view body, std::string_view what) -> size_t {
+  size_t count = 0;
+  for (auto at = body.find(what); at != std::string_view::npos;
+       at = body.find(what, at + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void TestParse() {
+  ListingQuery query = Query("");
+  assert(query.sort == ListingQuery::Sort::kNone);
+  assert(query.limit == ListingQuery::kNoLimit);
+
+  query = Query("offset=10&limit=5&other=x&sort=mtime&order=desc");
+  assert(query.sort == ListingQuery::Sort::kMtime && query.descending);
+  assert(query.offset == 10 && query.limit == 5);
+
+  // A sorted page is bounded even without a limit
+  assert(Query("sort=name").limit == ListingQuery::kDefaultSortedLimit);
+  assert(Query("offset=200000").offset == 200000);
+
+  ListingQuery bad;
+  for (std::string_view text :
+       {"sort=date", "order=up", "offset=-1", "limit=", "limit=1x",
+        "sort=size&offset=100000&limit=1",
+        "sort=size&limit=100001"}) {
+    bool parsed = ListingQuery::Parse(text, &bad);
+    assert(!parsed);
+  }
+}
+
+void TestStreaming(const std::string& dir) {
+  auto listing = std::make_unique<DirListing>();
+  listing->Open(dir, ListingQuery{}, "custom text");
+  size_t chunks = 0;
+  std::string body = Chunked(listing.get(), &chunks);
+  assert(body.starts_with("<html><body>\ncustom text\n<pre>\n"));
+  assert(body.ends_with("</pre>\n</body></html>\n"));
+  assert(Count(body, "<a href=") == kFiles);  // not the subdirectory
+  assert(body.find("\"/sub\"") == std::string::npos);
+  assert(body.find("next page") == std::string::npos);
+  // Bounded chunks, so the memory used does not grow with the directory
+  assert(chunks > body.size() / DirListing::kChunkSize);
+  std::cout << "  " << kFiles << " files in " << chunks << " chunks\n";
+}
+
+void TestPaging(const std::string& dir) {
+  size_t listed = 0;
+  for (uint64_t offset = 0; offset < kFiles; offset += 3000) {
+    std::string body =
+        Page(dir, "limit=3000&offset=" + std::to_string(offset));
+    listed += Count(body, "<a href=\"/f");
+    bool last = offset + 3000 >= kFiles;
+    assert((body.find("next page") == std::string::npos) == last);
+    if (!last) {
+      assert(body.find("<a href=\"/?offset=" + std::to_string(offset + 3000) +
+                       "&amp;limit=3000\">") != std::string::npos);
+    }
+  }
+  assert(listed == kFiles);
+}
+
+void TestSorting(const std::string& dir) {
+  std::string body = Page(dir, "sort=name&offset=2&limit=3");
+  assert(body ==
+         "<html><body>\n<pre>\n"
+         "<a href=\"/f00002\">f00002</a>\n"
+         "<a href=\"/f00003\">f00003</a>\n"
+         "<a href=\"/f00004\">f00004</a>\n"
+         "<a href=\"/?offset=5&amp;limit=3&amp;sort=name&amp;order=asc\">"
+         "next page</a>\n"
+         "</pre>\n</body></html>\n");
+
+  body = Page(dir, "sort=name&order=desc&limit=1");
+  assert(body.find("\"/f09999\"") != std::string::npos);
+
+  // f00007 is the only file with content
+  body = Page(dir, "sort=size&order=desc&limit=2");
+  auto first = body.find("<a href=\"/f00007\">");
+  assert(first != std::string::npos && first < body.find("f00000"));
+  body = Page(dir, "sort=size&offset=9999&limit=10");
+  assert(Count(body, "<a href=\"/f") == 1);
+  assert(body.find("f00007") != std::string::npos);
+  assert(body.find("next page") == std::string::npos);
+}
+
+void TestMissingDirectory() {
+  std::string body = Page("/nonexistent/mws_dir", "");
+  assert(body.find("[Failed to read directory: ") != std::string::npos);
+  assert(body.ends_with("</pre>\n</body></html>\n"));
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running directory listing tests...\n";
+
+  char dir[] = "/tmp/mws_listing_XXXXXX";
+  char* made = mkdtemp(dir);
+  assert(made != nullptr);
+  for (int i = 0; i < kFiles; ++i) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "/f%05d", i);
+    std::ofstream file(std::string(dir) + name);
+    if (i == 7) {
+      file << "content";
+    }
+  }
+  std::string sub = std::string(dir) + "/sub";
+  int sub_ret = mkdir(sub.c_str(), 0700);
+  assert(sub_ret == 0);
+
+  TestParse();
+  TestStreaming(dir);
+  TestPaging(dir);
+  TestSorting(dir);
+  TestMissingDirectory();
+
+  for (int i = 0; i < kFiles; ++i) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "/f%05d", i);
+    unlink((std::string(dir) + name).c_str());
+  }
+  rmdir(sub.c_str());
+  rmdir(dir);
+  std::cout << "All tests passed!\n";
+  return 0;
+}
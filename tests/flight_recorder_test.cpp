@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks the flight recorder rings: per-thread recording,
+// overwrite of the oldest events, copies racing with writers, and the dump.
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics/flight_recorder.hpp"
+
+namespace {
+
+using my_web_server::FlightEvent;
+using my_web_server::FlightRecorder;
+
+constexpr size_t kCapacity = 64;
+
+void TestKeepsNewest() {
+  auto& recorder = FlightRecorder::Instance();
+  for (int i = 0; i < 1000; ++i) {
+    recorder.Record(FlightEvent::kAccept, i, 70000);
+  }
+  auto records = recorder.Snapshot();
+  assert(records.size() == kCapacity);
+  for (size_t i = 0; i < records.size(); ++i) {
+    assert(records[i].fd == static_cast<int>(1000 - kCapacity + i));
+    assert(records[i].event == FlightEvent::kAccept);
+    assert(records[i].arg == UINT16_MAX);  // clamped
+  }
+}
+
+void TestConcurrentWriters() {
+  auto& recorder = FlightRecorder::Instance();
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 3; ++t) {
+    writers.emplace_back([&recorder, &stop, t]() {
+      // Fill the ring at least once even if the thread starts late
+      for (uint32_t n = 0;
+           n < kCapacity || !stop.load(std::memory_order_relaxed); ++n) {
+        recorder.Record(FlightEvent::kParsed, t, n & 0xffff);
+      }
+    });
+  }
+  // Copies taken while the rings are overwritten contain only whole,
+  // ordered events from each writer
+  for (int round = 0; round < 200; ++round) {
+    auto records = recorder.Snapshot();
+    std::vector<int> last(3, -1);
+    for (const auto& record : records) {
+      if (record.event != FlightEvent::kParsed) {
+        continue;
+      }
+      assert(record.fd >= 0 && record.fd < 3);
+      // Increasing per writer, apart from the 16-bit wrap
+      assert(static_cast<int>(record.arg) > last[record.fd] ||
+             last[record.fd] > 0xffff - static_cast<int>(kCapacity));
+      last[record.fd] = record.arg;
+    }
+  }
+  stop = true;
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  // Rings of exited threads are kept
+  assert(recorder.Snapshot().size() == 4 * kCapacity);
+}
+
+void TestDump() {
+  std::string path = "/tmp/flight_recorder_test.txt";
+  std::remove(path.c_str());
+  auto& recorder = FlightRecorder::Instance();
+  recorder.Record(FlightEvent::kEagainWrite, 42);
+  int64_t events = recorder.Dump(path);
+  assert(events == static_cast<int64_t>(4 * kCapacity));
+  events = recorder.Dump(path);
+  assert(events == static_cast<int64_t>(4 * kCapacity));
+  std::ifstream file(path);
+  std::stringstream text;
+  text << file.rdbuf();
+  std::string dump = text.str();
+  assert(dump.starts_with("# flight recorder dump pid="));
+  assert(dump.find(" eagain_write 42 0\n") != std::string::npos);
+  // Dumps append
+  assert(dump.find("# flight recorder dump", 1) != std::string::npos);
+  std::remove(path.c_str());
+  events = recorder.Dump("/nonexistent/dir/flight.txt");
+  assert(events == -1);
+}
+
+}  // namespace
+
+auto main() -> int {
+  FlightRecorder::Instance().SetCapacity(kCapacity);
+  TestKeepsNewest();
+  TestConcurrentWriters();
+  TestDump();
+  std::cout << "flight recorder tests passed\n";
+  return 0;
+}
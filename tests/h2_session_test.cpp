@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: HPACK against the RFC 7541 examples, and the HTTP/2
+// session's framing, stream limits and flow control.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http/h2_session.hpp"
+#include "http/hpack.hpp"
+
+namespace {
+
+using my_web_server::H2Error;
+using my_web_server::H2Session;
+using my_web_server::HpackDecoder;
+using my_web_server::HpackHeader;
+
+auto FromHex(std::string_view hex) -> std::string {
+  std::string out;
+  int high = -1;
+  for (char c : hex) {
+    if (c == ' ') {
+      continue;
+    }
+    int v = c <= '9' ? c - '0' : c - 'a' + 10;
+    if (high < 0) {
+      high = v;
+    } else {
+      out.push_back(static_cast<char>(high << 4 | v));
+      high = -1;
+    }
+  }
+  return out;
+}
+
+auto Frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+           const std::string& payload) -> std::string {
+  std::string out;
+  out.push_back(static_cast<char>(payload.size() >> 16));
+  out.push_back(static_cast<char>(payload.size() >> 8));
+  out.push_back(static_cast<char>(payload.size()));
+  out.push_back(static_cast<char>(type));
+  out.push_back(static_cast<char>(flags));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(stream_id >> shift));
+  }
+  return out + payload;
+}
+
+auto U32(uint32_t value) -> std::string {
+  std::string out;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(value >> shift));
+  }
+  return out;
+}
+
+// GET path as literals without indexing
+auto RequestBlock(const std::string& path) -> std::string {
+  auto literal = [](const std::string& name, const std::string& value) {
+    return std::string(1, '\0') + static_cast<char>(name.size()) + name +
+           static_cast<char>(value.size()) + value;
+  };
+  return literal(":method", "GET") + literal(":scheme", "http") +
+         literal(":path", path) + literal(":authority", "test");
+}
+
+struct ParsedFrame {
+  uint8_t type;
+  uint8_t flags;
+  uint32_t stream_id;
+  std::string payload;
+};
+
+// Take everything the session has to send, DATA included
+auto Drain(H2Session* session) -> std::vector<ParsedFrame> {
+  std::string out;
+  while (true) {
+    auto pending = session->Pending();
+    if (pending.empty() && !session->Fill()) {
+      break;
+    }
+    pending = session->Pending();
+    out.append(pending);
+    session->Sent(pending.size());
+  }
+  std::vector<ParsedFrame> frames;
+  size_t pos = 0;
+  while (out.size() - pos >= 9) {
+    auto byte = [&](size_t i) { return static_cast<uint8_t>(out[pos + i]); };
+    size_t length = byte(0) << 16 | byte(1) << 8 | byte(2);
+    uint32_t id = static_cast<uint32_t>(byte(5) & 0x7f) << 24 |
+                  byte(6) << 16 | byte(7) << 8 | byte(8);
+    frames.push_back({byte(3), byte(4), id, out.substr(pos + 9, length)});
+    pos += 9 + length;
+  }
+  assert(pos == out.size());
+  return frames;
+}
+
+auto Connected() -> std::unique_ptr<H2Session> {
+  auto session = std::make_unique<H2Session>();
+  session->Start();
+  std::string in(my_web_server::kH2Preface);
+  in += Frame(0x4, 0, 0, "");
+  bool fed = session->Feed(in.data(), in.size());
+  assert(fed);
+  auto frames = Drain(session.get());
+  assert(frames.size() == 2);
+  assert(frames[0].type == 0x4 && frames[0].flags == 0);  // our SETTINGS
+  assert(frames[1].type == 0x4 && frames[1].flags == 0x1);  // ACK
+  return session;
+}
+
+auto Feed(H2Session* session, const std::string& bytes) -> bool {
+  return session->Feed(bytes.data(), bytes.size());
+}
+
+auto GoawayCode(const std::vector<ParsedFrame>& frames) -> uint32_t {
+  assert(!frames.empty() && frames.back().type == 0x7);
+  const auto& p = frames.back().payload;
+  return static_cast<uint32_t>(static_cast<uint8_t>(p[7]));
+}
+
+void TestHpack() {
+  // C.1: integers
+  std::string out;
+  my_web_server::HpackEncodeInteger(10, 5, 0, &out);
+  assert(out == FromHex("0a"));
+  out.clear();
+  my_web_server::HpackEncodeInteger(1337, 5, 0, &out);
+  assert(out == FromHex("1f9a0a"));
+
+  // C.4: three requests with Huffman coding, sharing the dynamic table
+  HpackDecoder decoder;
+  std::vector<HpackHeader> fields;
+  bool decoded_ok = decoder.Decode(
+      FromHex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"), &fields);
+  assert(decoded_ok);
+  assert(fields.size() == 4);
+  assert(fields[3].name == ":authority" &&
+         fields[3].value == "www.example.com");
+  assert(decoder.table_size() == 57);
+
+  fields.clear();
+  decoded_ok = decoder.Decode(FromHex("8286 84be 5886 a8eb 1064 9cbf"),
+                              &fields);
+  assert(decoded_ok);
+  assert(fields.size() == 5);
+  assert(fields[3].value == "www.example.com");
+  assert(fields[4].name == "cache-control" && fields[4].value == "no-cache");
+  assert(decoder.table_size() == 110);
+
+  fields.clear();
+  decoded_ok = decoder.Decode(FromHex("8287 85bf 4088 25a8 49e9 5ba9 7d7f "
+                                      "8925 a849 e95b b8e8 b4bf"),
+                              &fields);
+  assert(decoded_ok);
+  assert(fields.size() == 5);
+  assert(fields[1].value == "https" && fields[2].value == "/index.html");
+  assert(fields[4].name == "custom-key" && fields[4].value == "custom-value");
+  assert(decoder.table_size() == 164 && decoder.table_entries() == 3);
+
+  // Index past the table, and EOS inside a Huffman string
+  fields.clear();
+  decoded_ok = HpackDecoder().Decode(FromHex("c0"), &fields);
+  assert(!decoded_ok);
+  std::string decoded;
+  decoded_ok = my_web_server::HuffmanDecode(FromHex("ffff ffff"), &decoded);
+  assert(!decoded_ok);
+
+  // Encoder output decodes back, with static-table hits
+  std::string block;
+  my_web_server::HpackEncoder::EncodeStatus(200, &block);
+  my_web_server::HpackEncoder::EncodeStatus(302, &block);
+  my_web_server::HpackEncoder::Encode("content-length", "42", &block);
+  my_web_server::HpackEncoder::Encode("x-custom", "v", &block);
+  assert(static_cast<uint8_t>(block[0]) == 0x88);  // one byte for :status 200
+  fields.clear();
+  decoded_ok = HpackDecoder().Decode(block, &fields);
+  assert(decoded_ok);
+  assert(fields.size() == 4);
+  assert(fields[1].value == "302" && fields[2].value == "42");
+  assert(fields[3].name == "x-custom");
+  std::cout << "hpack ok\n";
+}
+
+void TestRequestResponse() {
+  auto session = Connected();
+  bool fed = Feed(session.get(), Frame(0x1, 0x5, 1, RequestBlock("/a")));
+  assert(fed);
+  assert(session->requests().size() == 1);
+  auto request = session->requests()[0];
+  session->requests().clear();
+  assert(request.stream_id == 1 && request.path == "/a" &&
+         request.authority == "test");
+
+  H2Session::Response response;
+  response.headers.emplace_back("content-type", "text/plain");
+  response.body = "hello";
+  session->Respond(1, std::move(response));
+  auto frames = Drain(session.get());
+  assert(frames.size() == 2);
+  assert(frames[0].type == 0x1 && frames[0].flags == 0x4);
+  assert(frames[1].type == 0x0 && frames[1].flags == 0x1);
+  assert(frames[1].payload == "hello");
+  assert(session->finished().size() == 1);
+  assert(session->finished()[0].status == 200);
+  assert(session->finished()[0].body_bytes == 5);
+
+  // PING is echoed; client GOAWAY lets the connection finish
+  fed = Feed(session.get(), Frame(0x6, 0, 0, "12345678"));
+  assert(fed);
+  frames = Drain(session.get());
+  assert(frames.size() == 1 && frames[0].flags == 0x1 &&
+         frames[0].payload == "12345678");
+  assert(!session->Done());
+  fed = Feed(session.get(), Frame(0x7, 0, 0, U32(1) + U32(0)));
+  assert(fed);
+  assert(session->Done());
+  std::cout << "request/response ok\n";
+}
+
+void TestFlowControlAndInterleaving() {
+  char path[] = "/tmp/mws_h2_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  std::string content(100000, 'x');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<char>('a' + i % 26);
+  }
+  ssize_t written = write(fd, content.data(), content.size());
+  assert(written == static_cast<ssize_t>(content.size()));
+
+  auto session = Connected();
+  std::string in = Frame(0x1, 0x5, 1, RequestBlock("/f")) +
+                   Frame(0x1, 0x5, 3, RequestBlock("/g"));
+  bool fed = Feed(session.get(), in);
+  assert(fed);
+  session->requests().clear();
+  for (uint32_t id : {1U, 3U}) {
+    H2Session::Response response;
+    response.file_fd = open(path, O_RDONLY);
+    response.file_size = static_cast<off_t>(content.size());
+    session->Respond(id, std::move(response));
+  }
+
+  // The connection window (65535) runs out with both streams interleaved
+  auto frames = Drain(session.get());
+  size_t sent = 0;
+  std::string body1;
+  std::vector<uint32_t> order;
+  for (const auto& frame : frames) {
+    if (frame.type == 0x0) {
+      sent += frame.payload.size();
+      order.push_back(frame.stream_id);
+      if (frame.stream_id == 1) {
+        body1 += frame.payload;
+      }
+    }
+  }
+  assert(sent == 65535);
+  assert(order.size() >= 2 && order[0] == 1 && order[1] == 3);
+  assert(!session->HasOutput());
+
+  // Opening the windows lets the rest through
+  in = Frame(0x8, 0, 0, U32(1 << 20)) + Frame(0x8, 0, 1, U32(1 << 20)) +
+       Frame(0x8, 0, 3, U32(1 << 20));
+  fed = Feed(session.get(), in);
+  assert(fed);
+  assert(session->HasOutput());
+  for (const auto& frame : Drain(session.get())) {
+    if (frame.type == 0x0 && frame.stream_id == 1) {
+      body1 += frame.payload;
+    }
+  }
+  assert(body1 == content);
+  assert(session->finished().size() == 2);
+
+  // Window overflow on the connection is fatal
+  fed = Feed(session.get(), Frame(0x8, 0, 0, U32(0x7fffffff)));
+  assert(!fed);
+  frames = Drain(session.get());
+  assert(GoawayCode(frames) == static_cast<uint32_t>(H2Error::kFlowControl));
+  unlink(path);
+  close(fd);
+  std::cout << "flow control ok\n";
+}
+
+void TestErrors() {
+  // Wrong preface
+  {
+    H2Session session;
+    session.Start();
+    std::string in = "GET / HTTP/1.1\r\n\r\n";
+    bool fed = session.Feed(in.data(), in.size());
+    assert(!fed);
+    auto frames = Drain(&session);
+    assert(GoawayCode(frames) == static_cast<uint32_t>(H2Error::kProtocol));
+    assert(session.Done());
+  }
+  // A frame other than CONTINUATION inside a header block
+  {
+    auto session = Connected();
+    std::string block = RequestBlock("/a");
+    std::string in = Frame(0x1, 0x1, 1, block.substr(0, 5)) +
+                     Frame(0x6, 0, 0, "12345678");
+    bool fed = Feed(session.get(), in);
+    assert(!fed);
+    auto frames = Drain(session.get());
+    assert(GoawayCode(frames) == static_cast<uint32_t>(H2Error::kProtocol));
+  }
+  // CONTINUATION completes the block
+  {
+    auto session = Connected();
+    std::string block = RequestBlock("/a");
+    std::string in = Frame(0x1, 0x1, 1, block.substr(0, 5)) +
+                     Frame(0x9, 0x4, 1, block.substr(5));
+    bool fed = Feed(session.get(), in);
+    assert(fed);
+    assert(session->requests().size() == 1);
+  }
+  // Malformed request and refused streams are reset, the connection stays
+  {
+    auto session = Connected();
+    std::string bad = RequestBlock("/a") + std::string(1, '\0') +
+                      static_cast<char>(10) + "connection" +
+                      static_cast<char>(5) + "close";
+    bool fed = Feed(session.get(), Frame(0x1, 0x5, 1, bad));
+    assert(fed);
+    assert(session->requests().empty());
+    auto frames = Drain(session.get());
+    assert(frames.size() == 1 && frames[0].type == 0x3);
+
+    std::string in;
+    for (uint32_t i = 0; i <= my_web_server::kH2MaxConcurrentStreams; ++i) {
+      in += Frame(0x1, 0x5, 3 + 2 * i, RequestBlock("/a"));
+    }
+    fed = Feed(session.get(), in);
+    assert(fed);
+    assert(session->requests().size() ==
+           my_web_server::kH2MaxConcurrentStreams);
+    frames = Drain(session.get());
+    assert(frames.size() == 1 && frames[0].type == 0x3);
+    assert(static_cast<uint8_t>(frames[0].payload[3]) ==
+           static_cast<uint8_t>(H2Error::kRefusedStream));
+
+    // A reset stream's request is withdrawn and its response dropped
+    fed = Feed(session.get(), Frame(0x3, 0, 3, U32(0x8)));
+    assert(fed);
+    assert(session->requests().size() ==
+           my_web_server::kH2MaxConcurrentStreams - 1);
+    session->Respond(3, H2Session::Response{});
+    frames = Drain(session.get());
+    assert(frames.empty());
+
+    // HEADERS on a closed stream is a connection error
+    fed = Feed(session.get(), Frame(0x1, 0x5, 1, RequestBlock("/a")));
+    assert(!fed);
+    frames = Drain(session.get());
+    assert(GoawayCode(frames) ==
+           static_cast<uint32_t>(H2Error::kStreamClosed));
+  }
+  // Oversized frame
+  {
+    auto session = Connected();
+    bool fed = Feed(session.get(), Frame(0x0, 0, 1, std::string(16385, 'x')));
+    assert(!fed);
+    auto frames = Drain(session.get());
+    assert(GoawayCode(frames) == static_cast<uint32_t>(H2Error::kFrameSize));
+  }
+  std::cout << "errors ok\n";
+}
+
+void TestUpgrade() {
+  H2Session session;
+  bool upgraded = session.Upgrade("*invalid*", {});
+  assert(!upgraded);
+  assert(session.Pending().empty());
+
+  // INITIAL_WINDOW_SIZE = 100 from HTTP2-Settings
+  H2Session::Request request;
+  request.method = "GET";
+  request.path = "/up";
+  upgraded = session.Upgrade("AAQAAABk", request);
+  assert(upgraded);
+  assert(session.Pending().starts_with("HTTP/1.1 101"));
+  std::string head(session.Pending().substr(
+      0, session.Pending().find("\r\n\r\n") + 4));
+  session.Sent(head.size());
+  assert(session.requests().size() == 1 &&
+         session.requests()[0].stream_id == 1);
+
+  H2Session::Response response;
+  response.body = std::string(300, 'b');
+  session.Respond(1, std::move(response));
+  // No DATA before the client's preface and SETTINGS
+  auto frames = Drain(&session);
+  assert(frames.size() == 2 && frames[1].type == 0x1);
+  std::string in(my_web_server::kH2Preface);
+  in += Frame(0x4, 0, 0, "");
+  bool fed = session.Feed(in.data(), in.size());
+  assert(fed);
+  frames = Drain(&session);
+  assert(frames.size() == 2 && frames[1].type == 0x0);
+  assert(frames[1].payload.size() == 100);  // the upgrade's window
+  std::cout << "upgrade ok\n";
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running HTTP/2 tests...\n";
+  TestHpack();
+  TestRequestResponse();
+  TestFlowControlAndInterleaving();
+  TestErrors();
+  TestUpgrade();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
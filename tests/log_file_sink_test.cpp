@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks LogFileSink size and interval rotation, failed
+// rotation, reopening after an external rename, and batches larger than
+// IOV_MAX.
+
+#include "logger/log_file_sink.hpp"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+using my_web_server::LogFileSink;
+
+auto ReadFile(const fs::path& path) -> std::string {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream out;
+  out << in.rdbuf();
+  return out.str();
+}
+
+auto ToIovecs(std::vector<std::string>& records) -> std::vector<iovec> {
+  std::vector<iovec> iov;
+  for (auto& record : records) {
+    iov.push_back({record.data(), record.size()});
+  }
+  return iov;
+}
+
+// Rotated copies of path in the order they were written: path.STAMP, then
+// path.STAMP.1, path.STAMP.2, ... for rotations within the same second
+auto RotatedFiles(const fs::path& path) -> std::vector<fs::path> {
+  std::vector<std::pair<std::pair<std::string, int>, fs::path>> found;
+  std::string prefix = path.filename().string() + ".";
+  for (const auto& entry : fs::directory_iterator(path.parent_path())) {
+    std::string name = entry.path().filename().string();
+    if (!name.starts_with(prefix)) {
+      continue;
+    }
+    std::string rest = name.substr(prefix.size());
+    auto dot = rest.find('.');
+    int n = dot == std::string::npos ? 0 : std::atoi(rest.c_str() + dot + 1);
+    found.push_back({{rest.substr(0, dot), n}, entry.path()});
+  }
+  std::sort(found.begin(), found.end());
+  std::vector<fs::path> files;
+  for (auto& [key, file] : found) {
+    files.push_back(file);
+  }
+  return files;
+}
+
+auto TempDir() -> fs::path {
+  char pattern[] = "/tmp/log_file_sink_testXXXXXX";
+  char* dir = mkdtemp(pattern);
+  assert(dir != nullptr);
+  return dir;
+}
+
+void TestSizeRotation() {
+  auto dir = TempDir();
+  auto path = dir / "app.log";
+  LogFileSink sink;
+  [[maybe_unused]] bool opened =
+      sink.Open({.path = path.string(), .rotate_bytes = 100});
+  assert(opened);
+
+  std::vector<std::string> records;
+  std::string expected;
+  for (int i = 0; i < 10; ++i) {
+    records.push_back(
+        std::format("record {:02} {}\n", i, std::string(19, 'x')));
+    expected += records.back();
+  }
+  assert(records[0].size() == 30);
+  sink.Write(ToIovecs(records));
+  // A record over the limit still goes out whole, in a file of its own
+  std::vector<std::string> big = {std::string(250, 'b') + "\n"};
+  sink.Write(ToIovecs(big));
+  expected += big[0];
+
+  auto rotated = RotatedFiles(path);
+  // 3 records fit per file: 4 files of records, then the big one
+  assert(rotated.size() == 4);
+  std::string joined;
+  for (size_t i = 0; i < rotated.size(); ++i) {
+    auto text = ReadFile(rotated[i]);
+    assert(text.size() <= 100);
+    assert(text.size() % 30 == 0);  // records are never split
+    joined += text;
+  }
+  assert(ReadFile(path) == big[0]);
+  joined += ReadFile(path);
+  assert(joined == expected);
+  fs::remove_all(dir);
+  std::cout << "PASS: size rotation\n";
+}
+
+void TestIntervalRotation() {
+  auto dir = TempDir();
+  auto path = dir / "app.log";
+  LogFileSink sink;
+  [[maybe_unused]] bool opened = sink.Open(
+      {.path = path.string(), .rotate_interval = std::chrono::seconds(1)});
+  assert(opened);
+  std::vector<std::string> first = {"before\n"};
+  sink.Write(ToIovecs(first));
+  sink.Write(ToIovecs(first));
+  assert(RotatedFiles(path).empty());
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  std::vector<std::string> second = {"after\n"};
+  sink.Write(ToIovecs(second));
+
+  auto rotated = RotatedFiles(path);
+  assert(rotated.size() == 1);
+  assert(ReadFile(rotated[0]) == "before\nbefore\n");
+  assert(ReadFile(path) == "after\n");
+  fs::remove_all(dir);
+  std::cout << "PASS: interval rotation\n";
+}
+
+void TestRotationFailure() {
+  auto dir = TempDir();
+  // A legal name that is too long to take the ".YYYYmmdd-HHMMSS" suffix, so
+  // every rename fails (even for root, unlike a read-only directory)
+  auto path = dir / (std::string(250, 'l') + ".log");
+  LogFileSink sink;
+  [[maybe_unused]] bool opened =
+      sink.Open({.path = path.string(), .rotate_bytes = 100});
+  assert(opened);
+
+  std::vector<std::string> records;
+  std::string expected;
+  for (int i = 0; i < 10; ++i) {
+    records.push_back(
+        std::format("record {:02} {}\n", i, std::string(19, 'x')));
+    expected += records.back();
+  }
+  // Must return, appending to the file it has, instead of retrying forever
+  sink.Write(ToIovecs(records));
+  sink.Write(ToIovecs(records));
+  expected += expected;
+  assert(RotatedFiles(path).empty());
+  assert(ReadFile(path) == expected);
+  fs::remove_all(dir);
+  std::cout << "PASS: rotation failure\n";
+}
+
+void TestReopen() {
+  auto dir = TempDir();
+  auto path = dir / "app.log";
+  auto moved = dir / "moved.log";
+  LogFileSink sink;
+  [[maybe_unused]] bool opened = sink.Open({.path = path.string()});
+  assert(opened);
+  std::vector<std::string> a = {"a\n"};
+  std::vector<std::string> b = {"b\n"};
+  std::vector<std::string> c = {"c\n"};
+  sink.Write(ToIovecs(a));
+  // An external logrotate moves the file; writes follow the open file until
+  // the sink is told to reopen the path
+  fs::rename(path, moved);
+  sink.Write(ToIovecs(b));
+  assert(!fs::exists(path));
+  sink.RequestReopen();
+  sink.Write(ToIovecs(c));
+  assert(ReadFile(moved) == "a\nb\n");
+  assert(ReadFile(path) == "c\n");
+  fs::remove_all(dir);
+  std::cout << "PASS: reopen after rename\n";
+}
+
+void TestLargeBatch() {
+  auto dir = TempDir();
+  auto path = dir / "app.log";
+  LogFileSink sink;
+  [[maybe_unused]] bool opened = sink.Open({.path = path.string()});
+  assert(opened);
+  // More records than one writev takes
+  std::vector<std::string> records;
+  std::string expected;
+  for (int i = 0; i < 5000; ++i) {
+    records.push_back(std::to_string(i) + "\n");
+    expected += records.back();
+  }
+  sink.Write(ToIovecs(records));
+  assert(ReadFile(path) == expected);
+  fs::remove_all(dir);
+  std::cout << "PASS: batch over IOV_MAX\n";
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestSizeRotation();
+  TestIntervalRotation();
+  TestRotationFailure();
+  TestReopen();
+  TestLargeBatch();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
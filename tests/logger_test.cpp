@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Stress test for the asynchronous Logger backend and checks
+// for deferred-formatting records.
+
+#include "logger/logger.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Deferred records must format exactly like std::format would
+void TestDeferredFormatting() {
+  my_web_server::BinaryLogRecord rec;
+  std::string url = "/index.html";
+  my_web_server::EncodeLogArgs(&rec, 42, 7U, url, 1.5, true, 'x');
+  auto args = my_web_server::DecodeLogArgs(rec);
+  assert(args.size() == 6);
+  auto text = my_web_server::FormatLogRecord(
+      "{} {:>4} {} {:.2f} {} {} {{}}", args);
+  auto expected =
+      std::format("{} {:>4} {} {:.2f} {} {} {{}}", 42, 7U, url, 1.5, true, 'x');
+  assert(text == expected);
+
+  // Oversized strings are cut to fit the fixed-size record
+  std::string big(500, 'a');
+  my_web_server::EncodeLogArgs(&rec, big);
+  assert(rec.truncated != 0);
+  assert(rec.payload_size <= my_web_server::kBinaryPayloadSize);
+  std::cout << "PASS: deferred formatting\n";
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestDeferredFormatting();
+
+  constexpr int kThreads = 8;
+  constexpr int kRecordsPerThread = 10000;
+  auto& logger = my_web_server::Logger::Instance();
+
+  // Tiny rings with the drop policy: producers must never stall, and every
+  // record is either written or counted as dropped.
+  logger.StartAsync({.overflow = my_web_server::LogOverflowPolicy::kDrop,
+                     .ring_capacity = 64});
+  {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([t]() {
+        for (int i = 0; i < kRecordsPerThread; ++i) {
+          LOG_INFO(std::format("thread {} record {}", t, i));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  logger.Flush();
+  std::cout << "Dropped with kDrop: " << logger.dropped() << "\n";
+  logger.StopAsync();
+
+  // Blocking policy: nothing may be dropped.
+  uint64_t dropped_before = logger.dropped();
+  logger.StartAsync({.overflow = my_web_server::LogOverflowPolicy::kBlock,
+                     .ring_capacity = 64});
+  {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([t]() {
+        for (int i = 0; i < kRecordsPerThread; ++i) {
+          LOG_WARN_FMT("blocking thread {} record {}", t, i);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  logger.Flush();
+  logger.StopAsync();
+
+  if (logger.dropped() != dropped_before) {
+    std::cerr << "FAIL: kBlock dropped "
+              << logger.dropped() - dropped_before << " records\n";
+    return 1;
+  }
+  std::cout << "PASS: async logger\n";
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks histogram bucketing and quantiles, per-thread
+// counter aggregation and the Prometheus rendering.
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics/histogram.hpp"
+#include "metrics/metrics.hpp"
+
+namespace {
+
+using my_web_server::Counter;
+using my_web_server::Histogram;
+using my_web_server::LogLinearHistogram;
+using my_web_server::Metrics;
+
+void TestBuckets() {
+  // Every value lands in a bucket whose upper edge is within 12.5% of it
+  for (uint64_t v = 0; v < (1ULL << 20); v = v * 9 / 8 + 1) {
+    size_t index = LogLinearHistogram::BucketIndex(v);
+    uint64_t upper = LogLinearHistogram::BucketUpper(index);
+    assert(upper >= v);
+    assert(upper - v <= v / 8);
+    if (index > 0) {
+      assert(LogLinearHistogram::BucketUpper(index - 1) < v);
+    }
+  }
+  assert(LogLinearHistogram::BucketIndex(15) == 15);
+  assert(LogLinearHistogram::BucketIndex(16) == 16);
+  assert(LogLinearHistogram::BucketUpper(16) == 17);
+}
+
+void TestQuantiles() {
+  LogLinearHistogram histogram;
+  for (uint64_t v = 1; v <= 1000; ++v) {
+    histogram.Record(v);
+  }
+  LogLinearHistogram::Snapshot snapshot;
+  histogram.AddTo(&snapshot);
+  assert(snapshot.count == 1000);
+  assert(snapshot.sum == 500500);
+  uint64_t p50 = snapshot.Quantile(0.5);
+  assert(p50 >= 500 && p50 <= 500 + 500 / 8);
+  uint64_t p99 = snapshot.Quantile(0.99);
+  assert(p99 >= 990 && p99 <= 990 + 990 / 8);
+  assert(snapshot.CountAtMost(15) == 15);
+}
+
+void TestShards() {
+  auto& metrics = Metrics::Instance();
+  uint64_t before = metrics.Read(Counter::kStatus404);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&metrics]() {
+      for (int i = 0; i < 10000; ++i) {
+        metrics.Add(Metrics::StatusCounter(404));
+        metrics.Observe(Histogram::kResponseSize, 100);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // Shards of exited threads still count
+  assert(metrics.Read(Counter::kStatus404) == before + 40000);
+  assert(metrics.Read(Histogram::kResponseSize).count >= 40000);
+
+  std::string text;
+  metrics.Render(&text);
+  assert(text.find("# TYPE mws_responses_total counter") != std::string::npos);
+  assert(text.find("mws_responses_total{code=\"404\"} 40000") !=
+         std::string::npos);
+  assert(text.find("mws_response_size_bytes_bucket{le=\"256\"} 40000") !=
+         std::string::npos);
+  assert(text.find("mws_response_size_bytes_bucket{le=\"+Inf\"} 40000") !=
+         std::string::npos);
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running metrics tests...\n";
+  TestBuckets();
+  TestQuantiles();
+  TestShards();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
@@ -0,0 +1,608 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Proxy routes, and requests relayed through HttpConn and
+// UpstreamPool to stand-in backends on loopback, in callback and coroutine
+// mode (Linux only).
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+#include "http/upstream_pool.hpp"
+#include "logger/logger.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+namespace {
+
+using my_web_server::HttpConn;
+using my_web_server::ProxyOptions;
+using my_web_server::ProxyRoute;
+using my_web_server::UpstreamPool;
+
+auto Lower(std::string_view s) -> std::string {
+  std::string out(s);
+  for (auto& c : out) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return out;
+}
+
+// Value of a header in a head, "" when absent
+auto HeaderValue(std::string_view head, std::string_view name)
+    -> std::string {
+  auto lower = Lower(head);
+  auto at = lower.find("\r\n" + Lower(name) + ":");
+  if (at == std::string::npos) {
+    return "";
+  }
+  at += name.size() + 3;
+  auto end = head.find("\r\n", at);
+  auto value = head.substr(at, end - at);
+  while (!value.empty() && value.front() == ' ') {
+    value.remove_prefix(1);
+  }
+  return std::string(value);
+}
+
+auto Chunked(std::string_view body, size_t chunk) -> std::string {
+  std::ostringstream out;
+  for (size_t at = 0; at < body.size(); at += chunk) {
+    auto part = body.substr(at, chunk);
+    out << std::hex << part.size() << "\r\n" << part << "\r\n";
+  }
+  out << "0\r\n\r\n";
+  return out.str();
+}
+
+auto Dechunk(std::string_view wire) -> std::string {
+  std::string body;
+  while (true) {
+    auto line_end = wire.find("\r\n");
+    size_t size = std::stoul(std::string(wire.substr(0, line_end)), nullptr,
+                             16);
+    if (size == 0) {
+      return body;
+    }
+    body += wire.substr(line_end + 2, size);
+    wire.remove_prefix(line_end + 2 + size + 2);
+  }
+}
+
+auto Pattern(size_t n) -> std::string {
+  std::string out(n, '\0');
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = static_cast<char>('a' + (i * 7) % 26);
+  }
+  return out;
+}
+
+// A keep-alive HTTP/1.1 server on a loopback port, one thread per
+// connection. Paths pick the response: /chunked, /close (until close),
+// /big (1 MiB), /drop (no response), anything else an echo line.
+class Backend {
+ public:
+  explicit Backend(std::string name) : name_(std::move(name)) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int ret = bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+                   sizeof(addr));
+    assert(ret == 0);
+    ret = listen(listen_fd_, 64);
+    assert(ret == 0);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+    std::thread([this]() { AcceptLoop(); }).detach();
+  }
+
+  auto address() const -> std::string {
+    return "127.0.0.1:" + std::to_string(port_);
+  }
+  auto connections() const -> int { return connections_.load(); }
+
+ private:
+  void AcceptLoop() {
+    while (true) {
+      int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd == -1) {
+        continue;
+      }
+      ++connections_;
+      std::thread([this, fd]() { Serve(fd); }).detach();
+    }
+  }
+
+  // Read until buf holds until, false on EOF
+  static auto ReadUntil(int fd, std::string* buf, std::string_view until)
+      -> bool {
+    char chunk[65536];
+    while (buf->find(until) == std::string::npos) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return false;
+      }
+      buf->append(chunk, static_cast<size_t>(n));
+    }
+    return true;
+  }
+
+  static void SendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+      ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (n <= 0) {
+        return;
+      }
+      data.remove_prefix(static_cast<size_t>(n));
+    }
+  }
+
+  void Serve(int fd) {
+    std::string buf;
+    while (ReadUntil(fd, &buf, "\r\n\r\n")) {
+      auto head_end = buf.find("\r\n\r\n") + 4;
+      std::string head = buf.substr(0, head_end);
+      buf.erase(0, head_end);
+      std::string body;
+      if (HeaderValue(head, "Transfer-Encoding") == "chunked") {
+        if (!ReadUntil(fd, &buf, "0\r\n\r\n")) {
+          break;
+        }
+        auto end = buf.find("0\r\n\r\n") + 5;
+        body = Dechunk(buf.substr(0, end));
+        buf.erase(0, end);
+      } else if (auto length = HeaderValue(head, "Content-Length");
+                 !length.empty()) {
+        size_t n = std::stoul(length);
+        char chunk[65536];
+        while (buf.size() < n) {
+          ssize_t r = recv(fd, chunk, sizeof(chunk), 0);
+          if (r <= 0) {
+            break;
+          }
+          buf.append(chunk, static_cast<size_t>(r));
+        }
+        body = buf.substr(0, n);
+        buf.erase(0, n);
+      }
+      std::string method = head.substr(0, head.find(' '));
+      std::string path = head.substr(method.size() + 1);
+      path = path.substr(0, path.find(' '));
+
+      if (path.ends_with("/drop")) {
+        break;
+      }
+      if (path.ends_with("/chunked")) {
+        SendAll(fd, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n" +
+                        Chunked("hello chunked world", 6));
+        continue;
+      }
+      if (path.ends_with("/close")) {
+        SendAll(fd, "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nuntil close");
+        break;
+      }
+      std::string out = path.ends_with("/big") ? Pattern(1 << 20) : "";
+      if (out.empty()) {
+        std::ostringstream echo;
+        echo << name_ << ' ' << method << ' ' << path << ' ' << body.size()
+             << ' ' << (body == Pattern(body.size()) ? "intact" : "mangled")
+             << " xff=" << HeaderValue(head, "X-Forwarded-For")
+             << " conn=" << HeaderValue(head, "Connection")
+             << " expect=" << HeaderValue(head, "Expect");
+        out = echo.str();
+      }
+      std::string response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                             std::to_string(out.size()) + "\r\n\r\n";
+      if (path.ends_with("/interim")) {
+        response = "HTTP/1.1 100 Continue\r\n\r\n" + response;
+      }
+      SendAll(fd, method == "HEAD" ? response : response + out);
+    }
+    close(fd);
+  }
+
+  std::string name_;
+  int listen_fd_{-1};
+  uint16_t port_{0};
+  std::atomic<int> connections_{0};
+};
+
+// Length of the whole response at the front of response (Content-Length
+// or chunked), 0 while it is incomplete
+auto ResponseSize(const std::string& response, bool head_only) -> size_t {
+  auto head_end = response.find("\r\n\r\n");
+  if (head_end == std::string::npos) {
+    return 0;
+  }
+  auto head = response.substr(0, head_end + 2);
+  if (head_only) {
+    return head_end + 4;
+  }
+  if (HeaderValue(head, "Transfer-Encoding") == "chunked") {
+    auto end = response.find("\r\n0\r\n\r\n", head_end);
+    return end == std::string::npos ? 0 : end + 7;
+  }
+  auto length = HeaderValue(head, "Content-Length");
+  if (length.empty() ||
+      response.size() - head_end - 4 < std::stoul(length)) {
+    return 0;
+  }
+  return head_end + 4 + std::stoul(length);
+}
+
+// Whether response holds count whole responses
+auto Complete(const std::string& response, bool head_only, int count = 1)
+    -> bool {
+  size_t at = 0;
+  for (int i = 0; i < count; ++i) {
+    size_t size = ResponseSize(response.substr(at), head_only);
+    if (size == 0) {
+      return false;
+    }
+    at += size;
+  }
+  return true;
+}
+
+// One client connection as the reactor sees it: HttpConn on a socket pair
+// and the pool's upstream connections, registered with one epoll instance
+// and dispatched the way WebServer::Run() does, without an executor.
+class Client {
+ public:
+  Client(int ep, UpstreamPool* pool, bool coroutine)
+      : ep_(ep), pool_(pool), coroutine_(coroutine) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv_);
+    fcntl(sv_[0], F_SETFL, fcntl(sv_[0], F_GETFL) | O_NONBLOCK);
+    epoll_event event{};
+    event.data.fd = sv_[0];
+    event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+    epoll_ctl(ep_, EPOLL_CTL_ADD, sv_[0], &event);
+    conn_ = std::make_shared<HttpConn>();
+    sockaddr_in peer{};
+    peer.sin_addr.s_addr = htonl(0x7f000002);  // 127.0.0.2
+    conn_->Init(sv_[0], peer, ep_);
+    if (coroutine_) {
+      conn_->StartCoroutine();
+    }
+  }
+  ~Client() {
+    Close();
+    close(sv_[1]);
+  }
+  Client(const Client&) = delete;
+  auto operator=(const Client&) -> Client& = delete;
+
+  // Send wire and return what came back once that many responses are
+  // complete or the connection closed
+  auto Roundtrip(std::string_view wire, size_t piece, bool head_only = false,
+                 int responses = 1) -> std::string {
+    std::string response;
+    for (int round = 0; round < 100000; ++round) {
+      if (!wire.empty()) {
+        ssize_t n = send(sv_[1], wire.data(), std::min(piece, wire.size()),
+                         MSG_DONTWAIT);
+        if (n > 0) {
+          wire.remove_prefix(static_cast<size_t>(n));
+        }
+      }
+      epoll_event ready[16];
+      int count = epoll_wait(ep_, ready, 16, 10);
+      for (int i = 0; i < count && open_; ++i) {
+        if (!Dispatch(ready[i].data.fd, ready[i].events)) {
+          Close();
+        }
+      }
+      char buf[65536];
+      ssize_t r = 0;
+      while ((r = recv(sv_[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        response.append(buf, static_cast<size_t>(r));
+      }
+      if (r == 0 ||
+          (wire.empty() && Complete(response, head_only, responses))) {
+        break;
+      }
+    }
+    return response;
+  }
+  auto open() const -> bool { return open_; }
+
+ private:
+  auto Dispatch(int fd, uint32_t events) -> bool {
+    if (pool_->Contains(fd)) {
+      int owner = pool_->OnEvent(fd);
+      if (owner != sv_[0] || !conn_->ProxyWants(fd)) {
+        return true;  // idle or stale
+      }
+      return coroutine_ ? conn_->Resume() : conn_->Proxy();
+    }
+    if (fd != sv_[0]) {
+      return true;  // a connection already closed
+    }
+    if ((events & (EPOLLHUP | EPOLLERR)) != 0) {
+      return false;
+    }
+    if (conn_->IsProxying() && !conn_->ProxyWants(fd)) {
+      return true;
+    }
+    if (coroutine_) {
+      return conn_->Resume();
+    }
+    if (conn_->IsProxying()) {
+      return conn_->Proxy();
+    }
+    if ((events & EPOLLIN) != 0) {
+      if (!conn_->Read()) {
+        return false;
+      }
+      conn_->Process();
+      return true;
+    }
+    return conn_->Write();
+  }
+
+  void Close() {
+    if (!open_) {
+      return;
+    }
+    open_ = false;
+    conn_->AbortProxy();
+    conn_.reset();
+    epoll_ctl(ep_, EPOLL_CTL_DEL, sv_[0], nullptr);
+    close(sv_[0]);
+  }
+
+  int ep_;
+  UpstreamPool* pool_;
+  bool coroutine_;
+  int sv_[2]{-1, -1};
+  std::shared_ptr<HttpConn> conn_;
+  bool open_{true};
+};
+
+auto Body(const std::string& response) -> std::string {
+  auto at = response.find("\r\n\r\n");
+  return at == std::string::npos ? "" : response.substr(at + 4);
+}
+
+auto StatusLine(const std::string& response) -> std::string {
+  return response.substr(0, response.find("\r\n"));
+}
+
+void TestRoutes() {
+  ProxyRoute route;
+  bool parsed = my_web_server::ParseProxyRoute(
+      "/api=127.0.0.1:80,localhost:8080", &route);
+  assert(parsed);
+  assert(route.prefix == "/api" && route.upstreams.size() == 2);
+  assert(route.upstreams[1].port == htons(8080));
+  for (const char* bad : {"api=127.0.0.1:80", "/api", "/api=", "/a=host:80",
+                          "/a=127.0.0.1", "/a=127.0.0.1:0",
+                          "/a=127.0.0.1:70000", "/a=127.0.0.1:80,"}) {
+    parsed = my_web_server::ParseProxyRoute(bad, &route);
+    assert(!parsed);
+  }
+
+  ProxyOptions options;
+  for (const char* spec : {"/api=127.0.0.1:1", "/api/v2=127.0.0.1:2",
+                           "/files/=127.0.0.1:3"}) {
+    parsed = my_web_server::ParseProxyRoute(spec, &route);
+    assert(parsed);
+    options.routes.push_back(route);
+  }
+  assert(my_web_server::MatchProxyRoute(options, "/api") == 0);
+  assert(my_web_server::MatchProxyRoute(options, "/api/x?y=1") == 0);
+  assert(my_web_server::MatchProxyRoute(options, "/api/v2/x") == 1);
+  assert(my_web_server::MatchProxyRoute(options, "/api/v2x") == 0);
+  assert(my_web_server::MatchProxyRoute(options, "/apix") == -1);
+  assert(my_web_server::MatchProxyRoute(options, "/files/a") == 2);
+  assert(my_web_server::MatchProxyRoute(options, "/files") == -1);
+  assert(my_web_server::MatchProxyRoute(options, "/x?/api") == -1);
+}
+
+auto Get(std::string_view path, std::string_view extra = "") -> std::string {
+  return "GET " + std::string(path) +
+         " HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n" +
+         std::string(extra) + "\r\n";
+}
+
+void TestRelay(int ep, UpstreamPool* pool, Backend* a, Backend* b,
+               bool coroutine) {
+  int connections = a->connections() + b->connections();
+  // Balanced over both upstreams, on reused connections
+  {
+    Client client(ep, pool, coroutine);
+    int seen_a = 0;
+    int seen_b = 0;
+    for (int i = 0; i < 20; ++i) {
+      auto response = client.Roundtrip(Get("/api/echo"), 1 << 16);
+      assert(StatusLine(response) == "HTTP/1.1 200 OK");
+      assert(HeaderValue(response, "Connection") == "keep-alive");
+      auto body = Body(response);
+      // Hop-by-hop headers rewritten, the client address passed on
+      assert(body.ends_with(" GET /api/echo 0 intact xff=127.0.0.2 "
+                            "conn=keep-alive expect="));
+      seen_a += body.starts_with("A ") ? 1 : 0;
+      seen_b += body.starts_with("B ") ? 1 : 0;
+    }
+    assert(seen_a == 10 && seen_b == 10);
+    assert(client.open());
+  }
+  assert(a->connections() + b->connections() - connections <= 2);
+  assert(pool->active() == 0 && pool->idle() >= 1);
+
+  Client client(ep, pool, coroutine);
+  // Request bodies, whole or trickled in so most of it is spliced
+  std::string upload = Pattern(300000);
+  for (size_t piece : {size_t{1} << 20, size_t{7000}}) {
+    auto wire = "POST /api/up HTTP/1.1\r\nConnection: keep-alive\r\n"
+                "Content-Length: 300000\r\nX-Forwarded-For: 10.0.0.1\r\n\r\n" +
+                upload;
+    auto body = Body(client.Roundtrip(wire, piece));
+    assert(body.ends_with(" POST /api/up 300000 intact xff=10.0.0.1, "
+                          "127.0.0.2 conn=keep-alive expect="));
+  }
+  auto chunked = "PUT /api/up HTTP/1.1\r\nConnection: keep-alive\r\n"
+                 "Transfer-Encoding: chunked\r\n"
+                 "Expect: 100-continue\r\n\r\n" +
+                 Chunked(upload, 10000);
+  // Expect is answered here, when at all, and not passed on
+  auto response = client.Roundtrip(chunked, 4096);
+  if (response.starts_with("HTTP/1.1 100 Continue\r\n\r\n")) {
+    response.erase(0, 25);
+  }
+  assert(Body(response).ends_with(" PUT /api/up 300000 intact "
+                                  "xff=127.0.0.2 conn=keep-alive expect="));
+
+  // Response bodies: spliced, chunked as sent, interim responses dropped
+  response = client.Roundtrip(Get("/api/big"), 1 << 16);
+  assert(Body(response) == Pattern(1 << 20));
+  response = client.Roundtrip(Get("/api/chunked"), 1 << 16);
+  assert(HeaderValue(response, "Transfer-Encoding") == "chunked");
+  assert(Dechunk(Body(response)) == "hello chunked world");
+  response = client.Roundtrip(Get("/api/interim"), 1 << 16);
+  assert(StatusLine(response) == "HTTP/1.1 200 OK");
+  response = client.Roundtrip(
+      "HEAD /api/echo HTTP/1.1\r\nConnection: keep-alive\r\n\r\n", 1 << 16,
+      true);
+  assert(StatusLine(response) == "HTTP/1.1 200 OK" && Body(response).empty());
+  assert(client.open());
+
+  // Methods served only on proxy routes
+  response = client.Roundtrip(
+      "DELETE /api/x HTTP/1.1\r\nConnection: keep-alive\r\n\r\n", 1 << 16);
+  assert(Body(response).find(" DELETE /api/x 0 ") != std::string::npos);
+  {
+    Client other(ep, pool, coroutine);
+    response = other.Roundtrip("DELETE /x HTTP/1.1\r\n\r\n", 1 << 16);
+    assert(StatusLine(response) == "HTTP/1.1 400 Bad Request");
+  }
+
+  // Requests pipelined behind a proxied one are answered after it, whether
+  // they came with its head or were read along with the end of its body
+  std::string small = Pattern(1000);
+  response = client.Roundtrip(
+      "POST /api/up HTTP/1.1\r\nConnection: keep-alive\r\n"
+      "Content-Length: 1000\r\n\r\n" +
+          small + Get("/api/chunked") + Get("/api/echo"),
+      1 << 20, false, 3);
+  auto first = response.find(" POST /api/up 1000 intact ");
+  auto second = response.find("hello ");
+  auto third = response.find(" GET /api/echo 0 intact ");
+  assert(first != std::string::npos && third != std::string::npos &&
+         first < second && second < third);
+  assert(client.open());
+  response = client.Roundtrip(
+      "PUT /api/up HTTP/1.1\r\nConnection: keep-alive\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n" +
+          Chunked(upload, 10000) + Get("/api/echo"),
+      4096, false, 2);
+  first = response.find(" PUT /api/up 300000 intact ");
+  second = response.find(" GET /api/echo 0 intact ");
+  assert(first != std::string::npos && second != std::string::npos &&
+         first < second);
+  assert(client.open());
+
+  // A body that runs until the upstream closes ends the client connection
+  // the same way
+  response = client.Roundtrip(Get("/api/close"), 1 << 16);
+  assert(HeaderValue(response, "Connection") == "close");
+  assert(Body(response) == "until close");
+  assert(!client.open());
+}
+
+void TestFailures(int ep, UpstreamPool* pool, bool coroutine) {
+  // Nothing listening: 502, and the client connection stays usable
+  Client client(ep, pool, coroutine);
+  auto response = client.Roundtrip(Get("/dead/x"), 1 << 16);
+  assert(StatusLine(response) == "HTTP/1.1 502 Bad Gateway");
+  assert(HeaderValue(response, "Connection") == "keep-alive");
+  assert(client.open());
+  // The upstream hangs up without answering
+  response = client.Roundtrip(Get("/api/drop"), 1 << 16);
+  assert(StatusLine(response) == "HTTP/1.1 502 Bad Gateway");
+  response = client.Roundtrip(Get("/api/echo"), 1 << 16);
+  assert(StatusLine(response) == "HTTP/1.1 200 OK");
+  assert(pool->active() == 0);
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running proxy tests...\n";
+  signal(SIGPIPE, SIG_IGN);
+  Backend a("A");
+  Backend b("B");
+  // A port with nothing behind it
+  int probe = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(probe, reinterpret_cast<sockaddr*>(&addr), &len);
+  std::string dead = "/dead=127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+  close(probe);
+
+  my_web_server::Logger::Instance().StartAsync();
+  std::string api = "/api=" + a.address() + "," + b.address();
+  char arg0[] = "proxy_test";
+  char arg1[] = "--proxy";
+  char arg3[] = "--proxy";
+  char* argv[] = {arg0, arg1, api.data(), arg3, dead.data()};
+  bool parsed = my_web_server::GlobalConfig::Instance().InitFromArgs(5, argv);
+  assert(parsed);
+
+  TestRoutes();
+  for (bool coroutine : {false, true}) {
+    int ep = epoll_create1(0);
+    {
+      UpstreamPool pool(my_web_server::GlobalConfig::Instance().Get().proxy,
+                        ep);
+      HttpConn::SetUpstreams(&pool);
+      TestRelay(ep, &pool, &a, &b, coroutine);
+      TestFailures(ep, &pool, coroutine);
+      HttpConn::SetUpstreams(nullptr);
+    }
+    close(ep);
+  }
+
+  my_web_server::Logger::Instance().StopAsync();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#else
+int main() { return 0; }
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Counts global allocations while serving keep-alive
+// requests, which must all come from the per-request arena (Linux only).
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+#include "http/response_cache.hpp"
+#include "logger/logger.hpp"
+
+// Allocation-counting hook: every global operator new made by the test
+// thread while counting is on is tallied. Other threads (the log backend)
+// are not counted.
+namespace {
+thread_local bool g_counting = false;
+thread_local size_t g_allocations = 0;
+}  // namespace
+
+auto operator new(size_t size) -> void* {
+  if (g_counting) {
+    ++g_allocations;
+  }
+  if (void* ptr = std::malloc(size == 0 ? 1 : size); ptr != nullptr) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new[](size_t size) -> void* { return operator new(size); }
+
+auto operator new(size_t size, std::align_val_t align) -> void* {
+  if (g_counting) {
+    ++g_allocations;
+  }
+  auto alignment = static_cast<size_t>(align);
+  size = (size + alignment - 1) / alignment * alignment;
+  if (void* ptr = std::aligned_alloc(alignment, size); ptr != nullptr) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t /*size*/) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t /*align*/) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t /*size*/,
+                     std::align_val_t /*align*/) noexcept {
+  std::free(ptr);
+}
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+namespace {
+
+using my_web_server::HttpConn;
+
+// One keep-alive request on conn; returns the status line and headers
+auto Serve(HttpConn* conn, int client, const std::string& url) -> std::string {
+  bool counting = g_counting;
+  g_counting = false;  // the client side is not under test
+  std::string req = "GET " + url +
+                    " HTTP/1.1\r\nHost: a-host-name-longer-than-sso.test\r\n"
+                    "Connection: keep-alive\r\n\r\n";
+  send(client, req.data(), req.size(), 0);
+  g_counting = counting;
+  [[maybe_unused]] bool read_ok = conn->Read();
+  assert(read_ok);
+  conn->Process();
+  [[maybe_unused]] bool write_ok = conn->Write();
+  assert(write_ok);
+  g_counting = false;
+  std::string response;
+  char buf[4096];
+  ssize_t r = 0;
+  while ((r = recv(client, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    response.append(buf, static_cast<size_t>(r));
+  }
+  response.resize(response.find("\r\n"));
+  g_counting = counting;
+  return response;
+}
+
+// Warm up, then serve the same request again with counting on
+auto AllocationsFor(HttpConn* conn, int client, const std::string& url,
+                    [[maybe_unused]] const char* status) -> size_t {
+  for (int i = 0; i < 3; ++i) {
+    std::string response = Serve(conn, client, url);
+    assert(response == status);
+  }
+  g_allocations = 0;
+  g_counting = true;
+  for (int i = 0; i < 16; ++i) {
+    Serve(conn, client, url);
+  }
+  g_counting = false;
+  return g_allocations;
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running request arena tests...\n";
+
+  char dir[] = "/tmp/mws_arena_XXXXXX";
+  [[maybe_unused]] char* made = mkdtemp(dir);
+  assert(made != nullptr);
+  std::string long_name = std::string(dir) + "/" + std::string(40, 'f');
+  std::ofstream(std::string(dir) + "/small.txt") << "hello\n";
+  std::ofstream(long_name) << "a file whose name does not fit in SSO\n";
+  // --dir is switched on by a reload, as the config is only parsed once
+  std::string config = std::string(dir) + ".conf";
+  std::ofstream(config) << "# no --dir yet\n";
+
+  my_web_server::Logger::Instance().StartAsync();
+
+  int ep = epoll_create1(0);
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  epoll_event event{};
+  event.data.fd = sv[0];
+  event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sv[0], &event);
+  HttpConn conn;
+  sockaddr_in dummy{};
+  conn.Init(sv[0], dummy, ep);
+
+  // Cached default page
+  {
+    char arg0[] = "request_arena_test";
+    char arg1[] = "--config";
+    char* argv[] = {arg0, arg1, config.data()};
+    [[maybe_unused]] bool parsed =
+        my_web_server::GlobalConfig::Instance().InitFromArgs(3, argv);
+    assert(parsed);
+    my_web_server::ResponseCache::Rebuild();
+    size_t n = AllocationsFor(&conn, sv[1], "/", "HTTP/1.1 200 OK");
+    std::cout << "default page: " << n << " allocations\n";
+    assert(n == 0);
+  }
+
+  // Files, error pages and an escape attempt under --dir
+  {
+    std::ofstream(config) << "dir = " << dir << "\n";
+    [[maybe_unused]] bool reloaded =
+        my_web_server::GlobalConfig::Instance().Reload();
+    assert(reloaded);
+    const std::pair<std::string, const char*> cases[] = {
+        {"/small.txt", "HTTP/1.1 200 OK"},
+        {"/" + std::string(40, 'f'), "HTTP/1.1 200 OK"},
+        {"/x/../small.txt", "HTTP/1.1 200 OK"},
+        {"/" + std::string(200, 'm'), "HTTP/1.1 404 Not Found"},
+        {"/../etc/passwd", "HTTP/1.1 403 Forbidden"},
+        {"/small.txt/", "HTTP/1.1 404 Not Found"},
+        {"/.", "HTTP/1.1 403 Forbidden"},
+    };
+    for (const auto& [url, status] : cases) {
+      size_t n = AllocationsFor(&conn, sv[1], url, status);
+      std::cout << url.substr(0, 20) << ": " << n << " allocations\n";
+      assert(n == 0);
+    }
+
+    // Longer than the inline arena: spills to the heap, which the hook
+    // must see, and is still answered
+    std::string huge = "/" + std::string(1800, 'h');
+    g_allocations = 0;
+    g_counting = true;
+    std::string response = Serve(&conn, sv[1], huge);
+    g_counting = false;
+    assert(response == "HTTP/1.1 404 Not Found");
+    assert(g_allocations > 0);
+  }
+
+  close(sv[1]);
+  close(ep);
+  unlink((std::string(dir) + "/small.txt").c_str());
+  unlink(long_name.c_str());
+  rmdir(dir);
+  unlink(config.c_str());
+  my_web_server::Logger::Instance().StopAsync();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks request trace phase accounting, which traces the
+// slow trace log keeps, and TraceClock conversion.
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "metrics/metrics.hpp"
+#include "metrics/request_trace.hpp"
+#include "metrics/trace_clock.hpp"
+
+namespace {
+
+using my_web_server::Histogram;
+using my_web_server::Metrics;
+using my_web_server::RequestTrace;
+using my_web_server::SlowTraceLog;
+using my_web_server::TraceClock;
+using my_web_server::TracePhase;
+using my_web_server::TracePoint;
+
+constexpr uint64_t kUs = 1000;
+
+// Before calibration ticks are nanoseconds, so traces can be built by hand
+auto MakeTrace(uint64_t total_ns, bool keep_alive) -> RequestTrace {
+  RequestTrace trace;
+  uint64_t t = 1000000;
+  for (size_t i = 0; i < trace.ticks.size(); ++i) {
+    trace.ticks[i] = t;
+    t += total_ns / (trace.ticks.size() - 1);
+  }
+  if (keep_alive) {
+    trace.ticks[static_cast<size_t>(TracePoint::kAccept)] = 0;
+  }
+  return trace;
+}
+
+void TestPhases() {
+  RequestTrace trace;
+  trace.ticks = {100, 200, 250, 1250, 1300, 1500, 2500, 2600};
+  SlowTraceLog::Instance().Finish(trace, 200, "/phases");
+  auto slowest = SlowTraceLog::Instance().Slowest();
+  assert(slowest.size() == 1);
+  const auto& slow = slowest[0];
+  assert(slow.total_ns == 2500);
+  assert(slow.status == 200);
+  assert(std::string(slow.url, slow.url_len) == "/phases");
+  assert(slow.phase_ns[static_cast<size_t>(TracePhase::kAccept)] == 100);
+  assert(slow.phase_ns[static_cast<size_t>(TracePhase::kQueue)] == 1000);
+  assert(slow.phase_ns[static_cast<size_t>(TracePhase::kSendWait)] == 1000);
+  assert(slow.phase_ns[static_cast<size_t>(TracePhase::kSend)] == 100);
+  assert(Metrics::Instance().Read(Histogram::kPhaseQueue).count == 1);
+
+  // A keep-alive request has no accept phase and starts at its first read
+  trace.ticks[static_cast<size_t>(TracePoint::kAccept)] = 0;
+  SlowTraceLog::Instance().Finish(trace, 404, "/keep-alive");
+  slowest = SlowTraceLog::Instance().Slowest();
+  assert(slowest.size() == 2);
+  assert(slowest[1].total_ns == 2400);
+  assert(slowest[1].phase_ns[static_cast<size_t>(TracePhase::kAccept)] == 0);
+  assert(Metrics::Instance().Read(Histogram::kPhaseAccept).count == 1);
+
+  // Requests that never completed are ignored
+  trace.ticks[static_cast<size_t>(TracePoint::kComplete)] = 0;
+  SlowTraceLog::Instance().Finish(trace, 200, "/unfinished");
+  assert(SlowTraceLog::Instance().Slowest().size() == 2);
+}
+
+void TestKeepsSlowest() {
+  auto& log = SlowTraceLog::Instance();
+  for (uint64_t i = 1; i <= SlowTraceLog::kSlots; ++i) {
+    log.Finish(MakeTrace(i * 100 * kUs, i % 2 == 0), 200, "/fill");
+  }
+  auto slowest = log.Slowest();
+  assert(slowest.size() == SlowTraceLog::kSlots);
+  // The two traces from TestPhases were pushed out
+  for (const auto& trace : slowest) {
+    assert(trace.total_ns >= 80 * kUs);
+  }
+
+  // Faster than every kept trace: dropped
+  log.Finish(MakeTrace(50 * kUs, false), 200, "/fast");
+  // Slowest so far: replaces the fastest kept trace
+  std::string long_url(200, 'x');
+  log.Finish(MakeTrace(10000 * kUs, false), 500, "/" + long_url);
+  slowest = log.Slowest();
+  assert(slowest.size() == SlowTraceLog::kSlots);
+  assert(slowest.front().status == 500);
+  assert(slowest.front().url_len == sizeof(slowest.front().url));
+  for (const auto& trace : slowest) {
+    assert(std::string(trace.url, trace.url_len) != "/fast");
+  }
+
+  std::string out;
+  log.Render(&out);
+  assert(out.find("# clock: ") == 0);
+  assert(out.find(" send_wait send status") != std::string::npos);
+}
+
+void TestClock() {
+  TraceClock::Calibrate();
+  std::cout << "trace clock: " << TraceClock::Describe() << '\n';
+  uint64_t start = TraceClock::Now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t ns = TraceClock::ToNs(TraceClock::Now() - start);
+  assert(ns >= 19000000);
+  assert(ns < 200000000);
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestPhases();
+  TestKeepsSlowest();
+  TestClock();
+  std::cout << "request trace tests passed\n";
+  return 0;
+}
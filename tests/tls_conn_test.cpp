@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: End-to-end HttpConn test over TLS with a self-signed
+// certificate and a local OpenSSL client (Linux only).
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+#include "tls/tls_context.hpp"
+
+#if defined(__linux__)
+namespace {
+
+// Write a throwaway self-signed certificate and key for CN=localhost.
+auto WriteSelfSignedCert(const char* cert_path, const char* key_path) -> bool {
+  EVP_PKEY* pkey = EVP_RSA_gen(2048);
+  X509* x509 = X509_new();
+  if (pkey == nullptr || x509 == nullptr) {
+    return false;
+  }
+  ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+  X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+  X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+  X509_set_pubkey(x509, pkey);
+  X509_NAME* name = X509_get_subject_name(x509);
+  const auto* cn = reinterpret_cast<const unsigned char*>("localhost");
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, cn, -1, -1, 0);
+  X509_set_issuer_name(x509, name);
+  X509_sign(x509, pkey, EVP_sha256());
+
+  FILE* cert = fopen(cert_path, "w");
+  FILE* key = fopen(key_path, "w");
+  bool ok = cert != nullptr && key != nullptr &&
+            PEM_write_X509(cert, x509) == 1 &&
+            PEM_write_PrivateKey(key, pkey, nullptr, nullptr, 0, nullptr,
+                                 nullptr) == 1;
+  if (cert != nullptr) fclose(cert);
+  if (key != nullptr) fclose(key);
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+  return ok;
+}
+
+void WaitReadable(int fd) {
+  pollfd pfd{fd, POLLIN | POLLOUT, 0};
+  poll(&pfd, 1, 1000);
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running TLS HttpConn Tests...\n";
+
+  const char* cert_path = "/tmp/my_web_server_tls_test_cert.pem";
+  const char* key_path = "/tmp/my_web_server_tls_test_key.pem";
+  bool cert_ok = WriteSelfSignedCert(cert_path, key_path);
+  assert(cert_ok);
+
+  char arg0[] = "tls_conn_test";
+  char* argv[] = {arg0};
+  my_web_server::GlobalConfig::Instance().InitFromArgs(1, argv);
+
+  my_web_server::TlsContext tls;
+  bool tls_ok = tls.Init(cert_path, key_path);
+  assert(tls_ok);
+
+  // kTLS needs a real TCP socket, so use loopback instead of socketpair
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  listen(listen_fd, 1);
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+
+  std::string response;
+  std::thread client([addr, &response]() {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    SSL* ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_connect(ssl) != 1) {
+      std::cerr << "client handshake failed\n";
+    } else {
+      const char* req =
+          "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+      SSL_write(ssl, req, static_cast<int>(strlen(req)));
+      char buf[4096];
+      int n = 0;
+      while ((n = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+        response.append(buf, static_cast<size_t>(n));
+      }
+    }
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    close(fd);
+  });
+
+  int conn_fd = accept(listen_fd, nullptr, nullptr);
+  fcntl(conn_fd, F_SETFL, fcntl(conn_fd, F_GETFL) | O_NONBLOCK);
+  int ep = epoll_create1(0);
+  epoll_event event{};
+  event.data.fd = conn_fd;
+  event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(ep, EPOLL_CTL_ADD, conn_fd, &event);
+
+  my_web_server::HttpConn conn;
+  sockaddr_in dummy{};
+  conn.Init(conn_fd, dummy, ep, tls.NewSession(conn_fd));
+
+  // Drive the non-blocking handshake as the thread pool would
+  while (conn.IsHandshaking()) {
+    WaitReadable(conn_fd);
+    conn.Handshake();
+  }
+  std::cout << "TLS handshake finished\n";
+
+  bool read_ok = false;
+  for (int i = 0; i < 100 && !read_ok; ++i) {
+    WaitReadable(conn_fd);
+    read_ok = conn.Read();
+  }
+  assert(read_ok);
+  conn.Process();
+  bool keep = conn.Write();
+  std::cout << "conn.Write() -> " << keep << "\n";
+
+  close(conn_fd);
+  client.join();
+  std::cout << "Response received:\n" << response << "\n";
+  assert(response.rfind("HTTP/1.1 200 OK", 0) == 0);
+
+  close(listen_fd);
+  close(ep);
+  unlink(cert_path);
+  unlink(key_path);
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#endif
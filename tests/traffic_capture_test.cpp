@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks the capture file encoding and that TrafficCapture
+// records sampled connections whole, with reads split across chunks
+// reassembled in order, and that a capture of pipelined requests replays
+// against HttpConn with every request answered.
+
+#include "logger/traffic_capture.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+namespace {
+
+using my_web_server::CaptureDecoder;
+using my_web_server::CaptureEncoder;
+using my_web_server::CaptureEvent;
+using my_web_server::CaptureKind;
+
+auto ReadAll(std::FILE* in, int64_t* start_wall_ns)
+    -> std::vector<CaptureEvent> {
+  CaptureDecoder decoder(in);
+  bool header_ok = decoder.ReadHeader();
+  assert(header_ok);
+  *start_wall_ns = decoder.start_wall_ns();
+  std::vector<CaptureEvent> events;
+  CaptureEvent event;
+  while (decoder.Next(&event)) {
+    events.push_back(event);
+  }
+  assert(!decoder.error());
+  return events;
+}
+
+void TestRoundTrip() {
+  std::string out;
+  my_web_server::AppendCaptureHeader(&out, 1760000000123456789);
+  CaptureEncoder encoder;
+  encoder.AppendOpen(&out, 7, 1000, htonl(0x7f000001), htons(5000), true);
+  encoder.Append(&out, CaptureKind::kData, 7, 250000, "GET / HTTP/1.1\r\n");
+  // Events from different threads may be written slightly out of order
+  encoder.Append(&out, CaptureKind::kData, 300, 249000, std::string(200, 'x'));
+  encoder.Append(&out, CaptureKind::kClose, 7, 1LL << 40, "");
+  encoder.Append(&out, CaptureKind::kDropped, 300, 1LL << 40, "");
+
+  std::FILE* in = fmemopen(out.data(), out.size(), "rb");
+  int64_t start = 0;
+  auto events = ReadAll(in, &start);
+  std::fclose(in);
+  assert(start == 1760000000123456789);
+  assert(events.size() == 5);
+  assert(events[0].kind == CaptureKind::kOpen && events[0].conn_id == 7);
+  assert(events[0].time_ns == 1000 && events[0].tls);
+  assert(events[0].peer_ip == htonl(0x7f000001));
+  assert(events[0].peer_port == htons(5000));
+  assert(events[1].data == "GET / HTTP/1.1\r\n");
+  assert(events[2].conn_id == 300 && events[2].time_ns == 249000);
+  assert(events[2].data == std::string(200, 'x'));
+  assert(events[3].kind == CaptureKind::kClose);
+  assert(events[3].time_ns == 1LL << 40);
+  assert(events[4].kind == CaptureKind::kDropped);
+
+  // A truncated file reports an error instead of a short event
+  std::string cut = out.substr(0, out.size() - 120);
+  in = fmemopen(cut.data(), cut.size(), "rb");
+  CaptureDecoder decoder(in);
+  bool header_ok = decoder.ReadHeader();
+  assert(header_ok);
+  CaptureEvent event;
+  while (decoder.Next(&event)) {
+  }
+  assert(decoder.error());
+  std::fclose(in);
+}
+
+void TestCapture() {
+  char path[] = "/tmp/traffic_capture_testXXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  close(fd);
+
+  auto& capture = my_web_server::TrafficCapture::Instance();
+  capture.Start({.path = path, .sample_every = 2});
+  assert(capture.enabled());
+  std::string big(3000, '\0');
+  for (size_t i = 0; i < big.size(); ++i) {
+    big[i] = static_cast<char>('a' + i % 26);
+  }
+  // Connections 1 and 3 are sampled, 2 is not
+  capture.OnOpen(5, htonl(0x0a000001), htons(1111), false);
+  capture.OnOpen(6, htonl(0x0a000002), htons(2222), false);
+  capture.OnOpen(7, htonl(0x0a000003), htons(3333), true);
+  capture.OnData(5, "GET /a HTTP/1.1\r\n\r\n", 19);
+  capture.OnData(6, "GET /b HTTP/1.1\r\n\r\n", 19);
+  capture.OnData(7, big.data(), big.size());
+  capture.OnData(5, "GET /c HTTP/1.1\r\n\r\n", 19);
+  capture.OnClose(5);
+  capture.OnClose(6);
+  capture.OnClose(7);
+  capture.Stop();
+  assert(capture.dropped() == 0);
+
+  std::FILE* in = std::fopen(path, "rb");
+  int64_t start = 0;
+  auto events = ReadAll(in, &start);
+  std::fclose(in);
+  std::remove(path);
+  assert(start > 0);
+
+  std::map<uint32_t, std::vector<CaptureEvent>> by_conn;
+  for (const auto& event : events) {
+    by_conn[event.conn_id].push_back(event);
+  }
+  assert(by_conn.size() == 2);
+  const auto& first = by_conn.at(1);
+  assert(first.size() == 4);
+  assert(first[0].kind == CaptureKind::kOpen);
+  assert(first[0].peer_port == htons(1111));
+  assert(first[1].data == "GET /a HTTP/1.1\r\n\r\n");
+  assert(first[2].data == "GET /c HTTP/1.1\r\n\r\n");
+  assert(first[3].kind == CaptureKind::kClose);
+
+  const auto& third = by_conn.at(3);
+  assert(third.front().kind == CaptureKind::kOpen && third.front().tls);
+  assert(third.back().kind == CaptureKind::kClose);
+  std::string joined;
+  int64_t last_ns = -1;
+  for (size_t i = 1; i + 1 < third.size(); ++i) {
+    assert(third[i].kind == CaptureKind::kData);
+    assert(third[i].time_ns >= last_ns);
+    last_ns = third[i].time_ns;
+    joined += third[i].data;
+  }
+  assert(third.size() > 3);  // the read was split into several chunks
+  assert(joined == big);
+}
+
+#if defined(__linux__)
+// Counts "HTTP/1.1 " status lines in what came back
+auto CountResponses(std::string_view wire) -> size_t {
+  size_t count = 0;
+  for (size_t at = wire.find("HTTP/1.1 "); at != std::string_view::npos;
+       at = wire.find("HTTP/1.1 ", at + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+// Replays a capture the way capture_replay does, each recorded read as one
+// write, into an HttpConn driven by a local epoll loop. Several requests in
+// one read must all be answered, in order, on the same connection.
+void TestPipelinedReplay() {
+  std::string request_a =
+      "GET /a HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+  std::string request_b =
+      "GET /b HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n";
+  std::string last = "GET /c HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+  std::string out;
+  my_web_server::AppendCaptureHeader(&out, 1760000000000000000);
+  CaptureEncoder encoder;
+  encoder.AppendOpen(&out, 1, 0, htonl(0x7f000001), htons(5000), false);
+  encoder.Append(&out, CaptureKind::kData, 1, 1000,
+                 request_a + request_b + request_a);
+  encoder.Append(&out, CaptureKind::kData, 1, 2000, request_b + last);
+  encoder.Append(&out, CaptureKind::kClose, 1, 3000, "");
+  std::FILE* in = fmemopen(out.data(), out.size(), "rb");
+  int64_t start = 0;
+  auto events = ReadAll(in, &start);
+  std::fclose(in);
+
+  int ep = epoll_create1(0);
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  epoll_event event{};
+  event.data.fd = sv[0];
+  event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sv[0], &event);
+  auto conn = std::make_shared<my_web_server::HttpConn>();
+  sockaddr_in dummy{};
+  conn->Init(sv[0], dummy, ep);
+
+  std::string responses;
+  bool open = true;
+  for (const auto& recorded : events) {
+    if (recorded.kind != CaptureKind::kData) {
+      continue;
+    }
+    send(sv[1], recorded.data.data(), recorded.data.size(), 0);
+    epoll_event ready{};
+    while (open && epoll_wait(ep, &ready, 1, 100) == 1) {
+      bool alive = true;
+      if ((ready.events & EPOLLIN) != 0) {
+        alive = conn->Read();
+        if (alive) {
+          conn->Process();
+        }
+      } else {
+        alive = conn->Write();
+      }
+      if (!alive) {
+        open = false;
+        epoll_ctl(ep, EPOLL_CTL_DEL, sv[0], nullptr);
+        close(sv[0]);
+      }
+    }
+    char buf[65536];
+    ssize_t n = 0;
+    while ((n = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+      responses.append(buf, static_cast<size_t>(n));
+    }
+  }
+  assert(CountResponses(responses) == 5);
+  assert(!open);  // the last request asked to close
+  conn.reset();
+  close(sv[1]);
+  close(ep);
+}
+#endif
+
+}  // namespace
+
+auto main() -> int {
+  char arg0[] = "traffic_capture_test";
+  char* argv[] = {arg0};
+  my_web_server::GlobalConfig::Instance().InitFromArgs(1, argv);
+  TestRoundTrip();
+  TestCapture();
+#if defined(__linux__)
+  TestPipelinedReplay();
+#endif
+  std::cout << "traffic_capture_test passed\n";
+  return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Upload's chunked decoding, size limit and splice path,
+// and PUT/POST requests through HttpConn over a socket pair (Linux only).
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "config/global_config.hpp"
+#include "http/http_conn.hpp"
+#include "http/upload.hpp"
+#include "logger/logger.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+namespace {
+
+using my_web_server::HttpConn;
+using my_web_server::Upload;
+using Status = Upload::Status;
+
+auto Slurp(const std::string& path) -> std::string {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+auto Exists(const std::string& path) -> bool {
+  struct stat st {};
+  return lstat(path.c_str(), &st) == 0;
+}
+
+auto Chunked(std::string_view body, size_t chunk) -> std::string {
+  std::ostringstream out;
+  for (size_t at = 0; at < body.size(); at += chunk) {
+    auto part = body.substr(at, chunk);
+    out << std::hex << part.size() << ";ext=1\r\n" << part << "\r\n";
+  }
+  out << "0\r\nTrailer: x\r\n\r\n";
+  return out.str();
+}
+
+// Feed wire to an upload n bytes at a time, keeping what it leaves unused
+auto FeedInPieces(Upload* upload, std::string_view wire, size_t n)
+    -> Status {
+  std::string pending;
+  Status status = Status::kMore;
+  for (size_t at = 0; at < wire.size() && status == Status::kMore; at += n) {
+    pending += wire.substr(at, n);
+    size_t used = 0;
+    status = upload->Consume(pending, &used);
+    pending.erase(0, used);
+  }
+  return status;
+}
+
+void TestDecoding(const std::string& dir) {
+  std::string body;
+  for (int i = 0; i < 5000; ++i) {
+    body += static_cast<char>('a' + i % 26);
+  }
+  // Every split of the framing across reads
+  for (size_t piece : {1, 2, 3, 7, 64, 100000}) {
+    Upload upload(0, true, 1 << 20);
+    bool opened = upload.Open(dir, "chunked.txt");
+    assert(opened);
+    Status status = FeedInPieces(&upload, Chunked(body, 777), piece);
+    assert(status == Status::kDone);
+    assert(upload.received() == body.size() && !upload.too_large());
+    bool committed = upload.Commit();
+    assert(committed);
+    assert(Slurp(dir + "/chunked.txt") == body);
+  }
+
+  // Content-Length, replacing the file
+  {
+    Upload upload(body.size(), false, 1 << 20);
+    bool opened = upload.Open(dir, "chunked.txt");
+    assert(opened);
+    Status status = FeedInPieces(&upload, body, 999);
+    assert(status == Status::kDone);
+    bool committed = upload.Commit();
+    assert(committed && !upload.created());
+  }
+
+  // Bad framing
+  for (const char* wire : {"zz\r\n", "5\r\nhello!!", "1\r\nab"}) {
+    Upload upload(0, true, 1 << 20);
+    bool opened = upload.Open(dir, "bad.txt");
+    assert(opened);
+    Status status = FeedInPieces(&upload, wire, 64);
+    assert(status == Status::kBadBody || status == Status::kMore);
+  }
+  {
+    Upload upload(0, true, 1 << 20);
+    bool opened = upload.Open(dir, "bad.txt");
+    assert(opened);
+    std::string long_line(2000, '1');
+    Status status = FeedInPieces(&upload, long_line, 64);
+    assert(status == Status::kBadBody);
+  }
+
+  // Over the limit: read to the end and thrown away, unless far over
+  {
+    Upload upload(0, true, 1000);
+    bool opened = upload.Open(dir, "big.txt");
+    assert(opened);
+    Status status = FeedInPieces(&upload, Chunked(body, 600), 500);
+    assert(status == Status::kDone);
+    assert(upload.too_large());
+  }
+  {
+    Upload upload(0, true, 1000);
+    bool opened = upload.Open(dir, "big.txt");
+    assert(opened);
+    std::string wire = "ffffffffff\r\n";
+    Status status = FeedInPieces(&upload, wire, 64);
+    assert(status == Status::kTooLarge);
+  }
+  // Unfinished uploads leave no file behind
+  assert(!Exists(dir + "/bad.txt") && !Exists(dir + "/big.txt"));
+}
+
+void TestSplice(const std::string& dir) {
+  int sv[2];
+  int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  assert(paired == 0);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  std::string body(300000, 'x');
+  for (size_t i = 0; i < body.size(); i += 4096) {
+    body[i] = static_cast<char>('0' + i % 10);
+  }
+  Upload upload(body.size(), false, 1 << 20);
+  bool opened = upload.Open(dir, "spliced.bin");
+  assert(opened);
+  size_t sent = 0;
+  Status status = Status::kMore;
+  while (status != Status::kDone) {
+    if (sent < body.size()) {
+      auto n = send(sv[1], body.data() + sent,
+                    std::min<size_t>(50000, body.size() - sent), 0);
+      assert(n > 0);
+      sent += static_cast<size_t>(n);
+    }
+    status = upload.Splice(sv[0]);
+    assert(status == Status::kWantRead || status == Status::kDone);
+  }
+  bool committed = upload.Commit();
+  assert(committed && upload.created());
+  assert(Slurp(dir + "/spliced.bin") == body);
+
+  // The peer going away mid-body
+  Upload cut(10, false, 1 << 20);
+  opened = cut.Open(dir, "cut.bin");
+  assert(opened);
+  send(sv[1], "abc", 3, 0);
+  close(sv[1]);
+  status = cut.Splice(sv[0]);
+  assert(status == Status::kClosed);
+  close(sv[0]);
+}
+
+// One request through HttpConn, sent in pieces of at most piece bytes,
+// then half-closed if hang_up. Returns the status line of the response.
+auto Request(const std::string& wire, size_t piece, bool hang_up = false)
+    -> std::string {
+  int ep = epoll_create1(0);
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  epoll_event event{};
+  event.data.fd = sv[0];
+  event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLONESHOT;
+  epoll_ctl(ep, EPOLL_CTL_ADD, sv[0], &event);
+  auto conn = std::make_shared<HttpConn>();
+  sockaddr_in dummy{};
+  conn->Init(sv[0], dummy, ep);
+
+  std::string response;
+  size_t sent = 0;
+  for (int round = 0; round < 100000; ++round) {
+    if (sent < wire.size()) {
+      size_t n = std::min(piece, wire.size() - sent);
+      ssize_t written = send(sv[1], wire.data() + sent, n, 0);
+      assert(written == static_cast<ssize_t>(n));
+      sent += n;
+      if (sent == wire.size() && hang_up) {
+        shutdown(sv[1], SHUT_WR);
+      }
+    }
+    epoll_event ready{};
+    if (epoll_wait(ep, &ready, 1, sent < wire.size() ? 0 : 1000) == 1 &&
+        (ready.events & EPOLLOUT) != 0) {
+      break;
+    }
+    if (!conn->Read()) {
+      break;
+    }
+    conn->Process();  // runs the upload inline, no executor
+  }
+  conn->Write();
+  char buf[4096];
+  ssize_t r = 0;
+  while ((r = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    response.append(buf, static_cast<size_t>(r));
+  }
+  close(sv[1]);
+  close(sv[0]);
+  close(ep);
+  // A 100 Continue comes first when asked for
+  if (response.starts_with("HTTP/1.1 100 Continue\r\n\r\n")) {
+    response.erase(0, 25);
+  }
+  return response.substr(0, response.find("\r\n"));
+}
+
+auto Put(std::string_view target, std::string_view headers,
+         std::string_view body) -> std::string {
+  return "PUT " + std::string(target) + " HTTP/1.1\r\nHost: test\r\n" +
+         std::string(headers) + "\r\n" + std::string(body);
+}
+
+void TestRequests(const std::string& dir) {
+  std::string body(200000, 'b');
+  body[0] = 'B';
+  std::string length = "Content-Length: " + std::to_string(body.size()) +
+                       "\r\n";
+  // Whole request at once (the body overflows read_buf), and trickled in
+  // so the payload is spliced
+  std::string status;
+  for (size_t piece : {size_t{1} << 20, size_t{3000}, size_t{100}}) {
+    unlink((dir + "/put.bin").c_str());
+    status = Request(Put("/put.bin", length, body), piece);
+    assert(status == "HTTP/1.1 201 Created");
+    assert(Slurp(dir + "/put.bin") == body);
+  }
+  status = Request(Put("/put.bin?x=1", length, body), 4096);
+  assert(status == "HTTP/1.1 204 No Content");
+  status = Request(Put("/put.bin", length + "Expect: 100-continue\r\n", body),
+                   65536);
+  assert(status == "HTTP/1.1 204 No Content");
+  status = Request(Put("/chunked.bin", "Transfer-Encoding: chunked\r\n",
+                       Chunked(body, 10000)),
+                   5000);
+  assert(status == "HTTP/1.1 201 Created");
+  assert(Slurp(dir + "/chunked.bin") == body);
+  std::string post = Put("/post.txt", "Content-Length: 5\r\n", "hello");
+  post.replace(0, 3, "POST");
+  status = Request(post, 1000);
+  assert(status == "HTTP/1.1 201 Created");
+  assert(Slurp(dir + "/post.txt") == "hello");
+
+  // Refused
+  status = Request(Put("/x", "", ""), 1000);
+  assert(status == "HTTP/1.1 411 Length Required");
+  status = Request(Put("/x", "Content-Length: 1x\r\n", "a"), 1000);
+  assert(status == "HTTP/1.1 400 Bad Request");
+  status = Request(
+      Put("/x", "Content-Length: 1\r\nTransfer-Encoding: chunked\r\n", "a"),
+      1000);
+  assert(status == "HTTP/1.1 400 Bad Request");
+  status = Request(Put("/x", "Transfer-Encoding: gzip\r\n", ""), 1000);
+  assert(status == "HTTP/1.1 400 Bad Request");
+  status = Request(Put("/", "Content-Length: 1\r\n", "a"), 1000);
+  assert(status == "HTTP/1.1 403 Forbidden");
+  status = Request(Put("/a/b", "Content-Length: 1\r\n", "a"), 1000);
+  assert(status == "HTTP/1.1 403 Forbidden");
+  status = Request(Put("/../x", "Content-Length: 1\r\n", "a"), 1000);
+  assert(status == "HTTP/1.1 403 Forbidden");
+  std::string over(1100000, 'o');
+  status = Request(
+      Put("/over.bin", "Content-Length: 1100000\r\nExpect: 100-continue\r\n",
+          ""),
+      1000);
+  assert(status == "HTTP/1.1 413 Content Too Large");
+  status = Request(Put("/over.bin", "Content-Length: 1100000\r\n", over),
+                   65536);
+  assert(status == "HTTP/1.1 413 Content Too Large");
+  status = Request(Put("/over.bin", "Transfer-Encoding: chunked\r\n",
+                       Chunked(over, 65536)),
+                   65536);
+  assert(status == "HTTP/1.1 413 Content Too Large");
+  status = Request(Put("/cut.bin", length, body.substr(0, 1000)), 1000, true);
+  assert(status.empty());  // closed before the end: no response
+  assert(!Exists(dir + "/over.bin") && !Exists(dir + "/cut.bin"));
+
+  // Headers that do not fit read_buf
+  status = Request(
+      Put("/x", "X-Long: " + std::string(3000, 'l') + "\r\n", ""), 1000);
+  assert(status == "HTTP/1.1 400 Bad Request");
+}
+
+}  // namespace
+
+int main() {
+  std::cout << "Running upload tests...\n";
+  char dir[] = "/tmp/mws_upload_XXXXXX";
+  char* made = mkdtemp(dir);
+  assert(made != nullptr);
+
+  my_web_server::Logger::Instance().StartAsync();
+  char arg0[] = "upload_test";
+  char arg1[] = "--dir";
+  char arg3[] = "--max-upload";
+  char arg4[] = "1M";
+  char* argv[] = {arg0, arg1, dir, arg3, arg4};
+  bool parsed = my_web_server::GlobalConfig::Instance().InitFromArgs(5, argv);
+  assert(parsed);
+
+  TestDecoding(dir);
+  TestSplice(dir);
+  TestRequests(dir);
+
+  for (const char* name : {"chunked.txt", "spliced.bin", "put.bin",
+                           "chunked.bin", "post.txt"}) {
+    unlink((std::string(dir) + "/" + name).c_str());
+  }
+  int removed = rmdir(dir);
+  assert(removed == 0);  // no temporary files left either
+  my_web_server::Logger::Instance().StopAsync();
+  std::cout << "All tests passed!\n";
+  return 0;
+}
+#else
+int main() { return 0; }
+#endif
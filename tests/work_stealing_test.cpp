@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2026 nate <176468367+zhuluoo@users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// File overview: Checks the work-stealing ThreadPool, its Chase-Lev deque
+// and Task under external, nested, batched and concurrent submission.
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "pool/executor.hpp"
+#include "pool/task.hpp"
+#include "pool/thread_pool.hpp"
+#include "utils/chase_lev_deque.hpp"
+
+namespace {
+
+// Every pushed item is taken exactly once by the owner or one of the thieves
+void TestDequeStealing() {
+  constexpr int kItems = 200000;
+  my_web_server::ChaseLevDeque<int*> deque(4);  // forces growth
+  std::vector<int> slots(kItems, 0);
+  std::atomic<int> taken{0};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < 3; ++t) {
+    thieves.emplace_back([&]() {
+      int* item = nullptr;
+      while (!done.load(std::memory_order_acquire)) {
+        if (deque.Steal(&item)) {
+          ++*item;
+          taken.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+  int* item = nullptr;
+  for (int i = 0; i < kItems; ++i) {
+    deque.Push(&slots[i]);
+    if (i % 3 == 0 && deque.Pop(&item)) {
+      ++*item;
+      taken.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  while (deque.Pop(&item)) {
+    ++*item;
+    taken.fetch_add(1, std::memory_order_relaxed);
+  }
+  while (taken.load() < kItems) {
+    std::this_thread::yield();
+  }
+  done.store(true, std::memory_order_release);
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+  for (int value : slots) {
+    assert(value == 1);
+  }
+}
+
+// Tasks from several external producers plus tasks spawned by tasks all run
+// before the destructor returns
+void TestPoolRunsEverything() {
+  constexpr int kProducers = 4;
+  constexpr int kTasksPerProducer = 20000;
+  std::atomic<int> counter{0};
+  {
+    my_web_server::ThreadPool pool(4);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+      producers.emplace_back([&]() {
+        for (int i = 0; i < kTasksPerProducer; ++i) {
+          pool.AddTask([&pool, &counter]() {
+            counter.fetch_add(1, std::memory_order_relaxed);
+            pool.AddTask([&counter]() {
+              counter.fetch_add(1, std::memory_order_relaxed);
+            });
+          });
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+  }
+  assert(counter.load() == 2 * kProducers * kTasksPerProducer);
+}
+
+// One long task must not hold up work queued behind it on the same worker
+void TestIdleWorkerSteals() {
+  my_web_server::ThreadPool pool(2);
+  std::atomic<bool> release{false};
+  std::atomic<int> quick{0};
+  pool.AddTask([&release]() {
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    pool.AddTask([&quick]() { quick.fetch_add(1); });
+  }
+  while (quick.load() < 100) {
+    std::this_thread::yield();
+  }
+  release.store(true);
+}
+
+// Move-only captures work; small and large captures both run and destroy
+void TestTaskStorage() {
+  auto owned = std::make_unique<int>(7);
+  int seen = 0;
+  my_web_server::Task small([&seen, owned = std::move(owned)]() {
+    seen += *owned;
+  });
+  my_web_server::Task moved(std::move(small));
+  assert(!small);
+  moved();
+  assert(seen == 7);
+
+  auto counted = std::make_shared<int>(0);
+  std::array<char, 256> big{};
+  {
+    my_web_server::Task large([counted, big]() { *counted += big[0] + 1; });
+    assert(counted.use_count() == 2);
+    my_web_server::Task other = std::move(large);
+    other();
+  }
+  assert(*counted == 1);
+  assert(counted.use_count() == 1);
+}
+
+// A batch from the reactor is run completely, spread over the workers
+void TestBatchSubmit() {
+  constexpr int kBatches = 2000;
+  constexpr int kBatchSize = 64;
+  std::atomic<int> counter{0};
+  {
+    my_web_server::ThreadPool pool(4);
+    std::vector<my_web_server::Task> batch;
+    for (int b = 0; b < kBatches; ++b) {
+      for (int i = 0; i < kBatchSize; ++i) {
+        batch.emplace_back(
+            [&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+      }
+      pool.AddTasks(batch);
+      batch.clear();
+    }
+  }
+  assert(counter.load() == kBatches * kBatchSize);
+}
+
+// A full lane refuses work; Executor then runs it on the caller
+void TestQueueLimitAndStats() {
+  std::atomic<bool> release{false};
+  std::atomic<int> ran{0};
+  my_web_server::Executor executor(
+      {.cpu = {.threads = 1, .queue_limit = 2}, .io = {.threads = 1}});
+  auto& cpu = executor.pool(my_web_server::Lane::kCpu);
+  cpu.AddTask([&release]() {
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  });
+  // Wait until the blocker runs so only the tasks below are queued
+  while (cpu.Stats().started == 0) {
+    std::this_thread::yield();
+  }
+  std::vector<my_web_server::Task> batch;
+  for (int i = 0; i < 4; ++i) {
+    batch.emplace_back([&ran]() { ran.fetch_add(1); });
+  }
+  size_t accepted = cpu.TryAddTasks(batch);
+  assert(accepted == 2);
+  auto caller = std::this_thread::get_id();
+  std::thread::id ran_on;
+  executor.Post(my_web_server::Lane::kCpu,
+                [&ran_on]() { ran_on = std::this_thread::get_id(); });
+  assert(ran_on == caller);
+
+  auto stats = cpu.Stats();
+  assert(stats.queued == 2);
+  assert(stats.max_queued >= 2);
+  assert(stats.rejected == 3);
+  release.store(true);
+  while (ran.load() < 2) {
+    std::this_thread::yield();
+  }
+  assert(cpu.Stats().started == 3);
+}
+
+// io work may block on the disk, so a full io lane queues past its limit
+// instead of running the task on the caller
+void TestIoLaneNeverInline() {
+  std::atomic<bool> release{false};
+  std::atomic<int> ran{0};
+  my_web_server::Executor executor(
+      {.cpu = {.threads = 1}, .io = {.threads = 1, .queue_limit = 1}});
+  auto& io = executor.pool(my_web_server::Lane::kIo);
+  io.AddTask([&release]() {
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (io.Stats().started == 0) {
+    std::this_thread::yield();
+  }
+  auto caller = std::this_thread::get_id();
+  std::atomic<int> on_caller{0};
+  auto task = [&ran, &on_caller, caller]() {
+    if (std::this_thread::get_id() == caller) {
+      on_caller.fetch_add(1);
+    }
+    ran.fetch_add(1);
+  };
+  for (int i = 0; i < 3; ++i) {
+    executor.Post(my_web_server::Lane::kIo, task);
+  }
+  std::vector<my_web_server::Task> batch;
+  for (int i = 0; i < 3; ++i) {
+    batch.emplace_back(task);
+  }
+  executor.PostBatch(my_web_server::Lane::kIo, batch);
+  assert(ran.load() == 0);
+  auto stats = io.Stats();
+  assert(stats.queued == 6);
+  assert(stats.rejected == 5);  // over the limit, but queued
+  release.store(true);
+  while (ran.load() < 6) {
+    std::this_thread::yield();
+  }
+  assert(on_caller.load() == 0);
+}
+
+}  // namespace
+
+auto main() -> int {
+  TestQueueLimitAndStats();
+  TestIoLaneNeverInline();
+  TestTaskStorage();
+  TestBatchSubmit();
+  TestDequeStealing();
+  TestPoolRunsEverything();
+  TestIdleWorkerSteals();
+  std::cout << "work_stealing_test passed" << std::endl;
+  return 0;
+}